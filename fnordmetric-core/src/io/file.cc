@@ -116,6 +116,27 @@ size_t File::read(util::Buffer* buf) {
   return read(buf->data(), buf->size());
 }
 
+void File::write(void const* buf, size_t buf_len) {
+  auto data = static_cast<char const*>(buf);
+
+  while (buf_len > 0) {
+    auto res = ::write(fd_, data, buf_len);
+
+    if (res < 0) {
+      RAISE_ERRNO(kIOError, "write(%i) failed", fd_);
+    }
+
+    data += res;
+    buf_len -= res;
+  }
+}
+
+void File::sync() {
+  if (fdatasync(fd_) < 0) {
+    RAISE_ERRNO(kIOError, "fdatasync(%i) failed", fd_);
+  }
+}
+
 File File::clone() const {
   int new_fd = dup(fd_);
 
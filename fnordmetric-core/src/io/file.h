@@ -83,6 +83,16 @@ public:
   size_t read(void* buf, size_t buf_len);
   size_t read(util::Buffer* buf);
 
+  /**
+   * Write all buf_len bytes at the current position
+   */
+  void write(void const* buf, size_t buf_len);
+
+  /**
+   * Flush the written data of the file to disk (fdatasync)
+   */
+  void sync();
+
   int fd() const;
   size_t size() const;
 
@@ -11,6 +11,7 @@
 #include <fnordmetric/io/fileutil.h>
 #include <fnordmetric/util/runtimeexception.h>
 #include <fnordmetric/util/stringutil.h>
+#include <stdio.h>
 #include <string.h>
 #include <sys/fcntl.h>
 #include <sys/stat.h>
@@ -143,6 +144,11 @@ void FileUtil::rm(const std::string& filename) {
   unlink(filename.c_str());
 }
 
+void FileUtil::mv(const std::string& src, const std::string& dst) {
+  if (::rename(src.c_str(), dst.c_str()) < 0) {
+    RAISE_ERRNO(kIOError, "rename(%s, %s) failed", src.c_str(), dst.c_str());
+  }
+}
 
 void FileUtil::truncate(const std::string& filename, size_t new_size) {
   if (::truncate(filename.c_str(), new_size) < 0) {
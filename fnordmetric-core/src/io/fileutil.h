@@ -57,6 +57,11 @@ public:
    */
   static void rm(const std::string& filename);
 
+  /**
+   * Atomically rename a file, replacing the destination if it exists
+   */
+  static void mv(const std::string& src, const std::string& dst);
+
   /**
    * Truncate a file
    */
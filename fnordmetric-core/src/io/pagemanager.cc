@@ -258,7 +258,7 @@ void MmapPageManager::MmappedPageRef::sync(bool async /* = false */) const {
   uintptr_t ptr = (uintptr_t) ((char *) getPtr()) + page_.offset;
   auto sptr = (ptr / (sys_page_size_)) * sys_page_size_;
   auto ssize = page_.size + (ptr - sptr);
-  msync((void *) sptr, ssize, async ? MS_SYNC : MS_ASYNC);
+  msync((void *) sptr, ssize, async ? MS_ASYNC : MS_SYNC);
 }
 
 MmapPageManager::MmappedPageRef::~MmappedPageRef() {
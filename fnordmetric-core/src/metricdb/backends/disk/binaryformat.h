@@ -25,11 +25,37 @@ namespace metricdb {
  *       <uint64_t>          // generation
  *       <uint32_t>          // number of parent generations
  *       *<uint64_t>         // parent generations
+ *       [<uint64_t>]        // rollup resolution (0 or missing for raw tables)
+ *       [<uint32_t>]        // row format (0 or missing for one <sample> or
+ *                           // <rollup_sample> row per sample, 1 for one
+ *                           // <compressed_block> row per block of samples,
+ *                           // 2 for <compressed_block> rows grouped by
+ *                           // series, see <series_index>)
+ *       [<uint32_t>]        // compaction output (1 for tables written by a
+ *                           // compaction, 0 or missing otherwise)
  *
  *   <sample> :=
  *        <uint64_t>      // sample value
  *        *<label>        // sample labels
  *
+ *   <rollup_sample> :=   // the samples of tables with a rollup resolution
+ *        <uint64_t>      // number of samples
+ *        <uint64_t>      // sum of the sample values
+ *        <uint64_t>      // min sample value
+ *        <uint64_t>      // max sample value
+ *        *<label>        // sample labels
+ *
+ *   <compressed_block> := // the row key is the time of the first sample
+ *        <uint32_t>      // number of samples
+ *        <uint32_t>      // number of 64 bit words in each sample value
+ *        <uint32_t>      // number of label sets
+ *        *<label_set>
+ *        <bytes>         // bit stream, see CompressedBlockWriter
+ *
+ *   <label_set> :=
+ *        <uint32_t>      // size
+ *        *<label>
+ *
  *   <label> :=
  *        <token>         // label key
  *        <token>         // label value
@@ -50,6 +76,46 @@ namespace metricdb {
  *   <token_reference> :=
  *        <uint32_t>      // token id (must be 0xf0000000 < id < 0xffffffff)
  *
+ *   <time_index> :=
+ *        <uint64_t>      // min sample time
+ *        <uint64_t>      // max sample time
+ *        *<seek_point>
+ *
+ *   <seek_point> :=
+ *        <uint64_t>      // sample time
+ *        <uint64_t>      // sstable body offset of the sample row
+ *
+ *   <series_index> :=    // sorted by series id
+ *        *<series_entry>
+ *
+ *   <series_entry> :=
+ *        <uint64_t>      // series id (FNV-1a of the sorted label set)
+ *        <uint64_t>      // min sample time
+ *        <uint64_t>      // max sample time
+ *        <uint64_t>      // sstable body offset of the series' first block
+ *        <uint64_t>      // sstable body offset after the series' last block
+ *        <uint32_t>      // number of labels
+ *        *<series_label> // sorted by key
+ *
+ *   <series_label> :=
+ *        <uint32_t>      // label key size
+ *        <bytes>         // label key
+ *        <uint32_t>      // label value size
+ *        <bytes>         // label value
+ *
+ *   <postings_index> :=
+ *        <uint32_t>      // number of postings lists
+ *        *<postings_list>
+ *
+ *   <postings_list> :=   // sorted by label key and value
+ *        <uint32_t>      // label key size
+ *        <bytes>         // label key
+ *        <uint32_t>      // label value size
+ *        <bytes>         // label value
+ *        <uint32_t>      // number of postings
+ *        *<uint64_t>     // sorted sstable body offsets of the rows (or
+ *                        // <compressed_block> rows) with the label
+ *
  */
 class BinaryFormat {
 public:
@@ -0,0 +1,93 @@
+/**
+ * This file is part of the "FnordMetric" project
+ *   Copyright (c) 2014 Paul Asmuth, Google Inc.
+ *
+ * FnordMetric is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License v3.0. You should have received a
+ * copy of the GNU General Public License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#include <fnordmetric/metricdb/backends/disk/bitstream.h>
+#include <fnordmetric/util/runtimeexception.h>
+
+namespace fnordmetric {
+namespace metricdb {
+namespace disk_backend {
+
+BitStreamWriter::BitStreamWriter() : bits_(0), num_bits_(0) {}
+
+void BitStreamWriter::writeBit(bool bit) {
+  bits_ = (bits_ << 1) | (bit ? 1 : 0);
+
+  if (++num_bits_ == 8) {
+    buffer_.push_back(static_cast<char>(bits_));
+    bits_ = 0;
+    num_bits_ = 0;
+  }
+}
+
+void BitStreamWriter::writeBits(uint64_t value, int num_bits) {
+  while (num_bits > 0) {
+    int n = 8 - num_bits_;
+    if (num_bits < n) {
+      n = num_bits;
+    }
+
+    num_bits -= n;
+    bits_ = (bits_ << n) | ((value >> num_bits) & ((1u << n) - 1));
+    num_bits_ += n;
+
+    if (num_bits_ == 8) {
+      buffer_.push_back(static_cast<char>(bits_));
+      bits_ = 0;
+      num_bits_ = 0;
+    }
+  }
+}
+
+const std::string& BitStreamWriter::data() {
+  while (num_bits_ != 0) {
+    writeBit(false);
+  }
+
+  return buffer_;
+}
+
+BitStreamReader::BitStreamReader(
+    void const* data,
+    size_t size) :
+    data_(static_cast<unsigned char const*>(data)),
+    size_(size),
+    pos_(0) {}
+
+bool BitStreamReader::readBit() {
+  if (pos_ >= size_ * 8) {
+    RAISE(kBufferOverflowError, "read beyond end of bit stream");
+  }
+
+  auto bit = (data_[pos_ / 8] >> (7 - pos_ % 8)) & 1;
+  ++pos_;
+  return bit;
+}
+
+uint64_t BitStreamReader::readBits(int num_bits) {
+  if (pos_ + num_bits > size_ * 8) {
+    RAISE(kBufferOverflowError, "read beyond end of bit stream");
+  }
+
+  uint64_t value = 0;
+  while (num_bits > 0) {
+    int avail = 8 - pos_ % 8;
+    int n = num_bits < avail ? num_bits : avail;
+
+    value = (value << n) | ((data_[pos_ / 8] >> (avail - n)) & ((1u << n) - 1));
+    pos_ += n;
+    num_bits -= n;
+  }
+
+  return value;
+}
+
+}
+}
+}
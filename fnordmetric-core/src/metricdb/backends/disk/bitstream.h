@@ -0,0 +1,61 @@
+/**
+ * This file is part of the "FnordMetric" project
+ *   Copyright (c) 2014 Paul Asmuth, Google Inc.
+ *
+ * FnordMetric is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License v3.0. You should have received a
+ * copy of the GNU General Public License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#ifndef _FNORDMETRIC_METRICDB_BITSTREAM_H
+#define _FNORDMETRIC_METRICDB_BITSTREAM_H
+#include <stdlib.h>
+#include <stdint.h>
+#include <string>
+
+namespace fnordmetric {
+namespace metricdb {
+namespace disk_backend {
+
+/**
+ * Appends values of 1 to 64 bits to a byte buffer, most significant bit first
+ */
+class BitStreamWriter {
+public:
+  BitStreamWriter();
+
+  void writeBit(bool bit);
+  void writeBits(uint64_t value, int num_bits);
+
+  /**
+   * Returns the written bits. The last byte is padded with zero bits
+   */
+  const std::string& data();
+
+protected:
+  std::string buffer_;
+  uint64_t bits_;
+  int num_bits_;
+};
+
+/**
+ * Reads values written by a BitStreamWriter
+ */
+class BitStreamReader {
+public:
+  BitStreamReader(void const* data, size_t size);
+
+  bool readBit();
+  uint64_t readBits(int num_bits);
+
+protected:
+  unsigned char const* data_;
+  size_t size_;
+  size_t pos_; /* in bits */
+};
+
+}
+}
+}
+
+#endif
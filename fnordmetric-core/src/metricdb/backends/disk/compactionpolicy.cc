@@ -0,0 +1,31 @@
+/**
+ * This file is part of the "FnordMetric" project
+ *   Copyright (c) 2014 Paul Asmuth, Google Inc.
+ *
+ * FnordMetric is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License v3.0. You should have received a
+ * copy of the GNU General Public License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#include <fnordmetric/metricdb/backends/disk/compactionpolicy.h>
+
+namespace fnordmetric {
+namespace metricdb {
+namespace disk_backend {
+
+CompactionPolicyChain::CompactionPolicyChain(
+    const std::vector<std::shared_ptr<CompactionPolicy>>& policies) :
+    policies_(policies) {}
+
+void CompactionPolicyChain::compact(
+    Metric* metric,
+    std::vector<std::shared_ptr<TableRef>>* tables) {
+  for (const auto& policy : policies_) {
+    policy->compact(metric, tables);
+  }
+}
+
+}
+}
+}
+
@@ -10,18 +10,47 @@
 #ifndef _FNORDMETRIC_METRICDB_COMPACTIONPOLICY_H_
 #define _FNORDMETRIC_METRICDB_COMPACTIONPOLICY_H_
 #include <fnordmetric/metricdb/backends/disk/tableref.h>
+#include <memory>
+#include <vector>
 
 namespace fnordmetric {
 namespace metricdb {
 namespace disk_backend {
+class Metric;
 
+/**
+ * A compaction policy rewrites the list of finalized (read only) tables of a
+ * metric, e.g. by merging them. The modified list is committed atomically as
+ * the new snapshot of the metric and tables that were removed from the list
+ * are deleted once they are no longer referenced.
+ *
+ * IMPLEMENTATIONS MUST BE THREADSAFE
+ */
 class CompactionPolicy {
 public:
   CompactionPolicy() {}
   virtual ~CompactionPolicy() {}
 
-  virtual void compact(std::vector<std::shared_ptr<TableRef>>* tables) = 0;
+  virtual void compact(
+      Metric* metric,
+      std::vector<std::shared_ptr<TableRef>>* tables) = 0;
+
+};
+
+/**
+ * Applies a list of compaction policies one after another
+ */
+class CompactionPolicyChain : public CompactionPolicy {
+public:
+  CompactionPolicyChain(
+      const std::vector<std::shared_ptr<CompactionPolicy>>& policies);
+
+  void compact(
+      Metric* metric,
+      std::vector<std::shared_ptr<TableRef>>* tables) override;
 
+protected:
+  std::vector<std::shared_ptr<CompactionPolicy>> policies_;
 };
 
 }
@@ -40,12 +40,16 @@ void CompactionTask::run() const {
       usleep(next_run - now);
     }
 
+    auto policy = metric_repo_->compactionPolicy();
+
     for (const auto& metric : metric_repo_->listMetrics()) {
       try {
         auto disk_metric = dynamic_cast<Metric*>(metric);
 
         if (disk_metric != nullptr) {
-          disk_metric->compact();
+          disk_metric->compact(
+              policy.get(),
+              metric_repo_->retention(disk_metric->key()));
         }
       } catch (util::RuntimeException e) {
         env()->logger()->printf(
@@ -55,6 +59,16 @@ void CompactionTask::run() const {
         e.debugPrint();
       }
     }
+
+    try {
+      metric_repo_->releaseWriteAheadLogSegments();
+    } catch (util::RuntimeException e) {
+      env()->logger()->printf(
+          "ERROR",
+          "uncaught exception while releasing write ahead log segments");
+
+      e.debugPrint();
+    }
   }
 }
 
@@ -0,0 +1,103 @@
+/**
+ * This file is part of the "FnordMetric" project
+ *   Copyright (c) 2014 Paul Asmuth, Google Inc.
+ *
+ * FnordMetric is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License v3.0. You should have received a
+ * copy of the GNU General Public License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#include <fnordmetric/metricdb/backends/disk/compressedblockcursor.h>
+#include <fnordmetric/util/runtimeexception.h>
+
+namespace fnordmetric {
+namespace metricdb {
+namespace disk_backend {
+
+CompressedBlockCursor::CompressedBlockCursor(
+    std::unique_ptr<sstable::Cursor> block_cursor,
+    size_t body_end /* = std::numeric_limits<size_t>::max() */) :
+    block_cursor_(std::move(block_cursor)),
+    body_end_(body_end),
+    initialized_(false),
+    valid_(false),
+    time_(0) {}
+
+void CompressedBlockCursor::seekTo(size_t body_offset) {
+  block_cursor_->seekTo(body_offset);
+  initialized_ = true;
+  valid_ = readBlock();
+}
+
+bool CompressedBlockCursor::next() {
+  if (!valid()) {
+    return false;
+  }
+
+  if (block_->readRow(&time_, &sample_)) {
+    return true;
+  }
+
+  if (!block_cursor_->next()) {
+    valid_ = false;
+    return false;
+  }
+
+  valid_ = readBlock();
+  return valid_;
+}
+
+bool CompressedBlockCursor::valid() {
+  if (!initialized_) {
+    initialized_ = true;
+    valid_ = readBlock();
+  }
+
+  return valid_;
+}
+
+void CompressedBlockCursor::getKey(void** data, size_t* size) {
+  if (!valid()) {
+    RAISE(kIllegalStateError, "invalid cursor");
+  }
+
+  *data = &time_;
+  *size = sizeof(time_);
+}
+
+void CompressedBlockCursor::getData(void** data, size_t* size) {
+  if (!valid()) {
+    RAISE(kIllegalStateError, "invalid cursor");
+  }
+
+  *data = &sample_[0];
+  *size = sample_.size();
+}
+
+size_t CompressedBlockCursor::position() const {
+  return block_cursor_->position();
+}
+
+bool CompressedBlockCursor::readBlock() {
+  while (block_cursor_->valid() && block_cursor_->position() < body_end_) {
+    void* data;
+    size_t size;
+    block_cursor_->getData(&data, &size);
+
+    block_.reset(new CompressedBlockReader(data, size));
+    if (block_->readRow(&time_, &sample_)) {
+      return true;
+    }
+
+    if (!block_cursor_->next()) {
+      break;
+    }
+  }
+
+  block_.reset();
+  return false;
+}
+
+}
+}
+}
@@ -0,0 +1,67 @@
+/**
+ * This file is part of the "FnordMetric" project
+ *   Copyright (c) 2014 Paul Asmuth, Google Inc.
+ *
+ * FnordMetric is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License v3.0. You should have received a
+ * copy of the GNU General Public License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#ifndef _FNORDMETRIC_METRICDB_COMPRESSEDBLOCKCURSOR_H
+#define _FNORDMETRIC_METRICDB_COMPRESSEDBLOCKCURSOR_H
+#include <fnordmetric/metricdb/backends/disk/compressedblockreader.h>
+#include <fnordmetric/sstable/cursor.h>
+#include <limits>
+#include <memory>
+#include <string>
+
+using namespace fnord;
+namespace fnordmetric {
+namespace metricdb {
+namespace disk_backend {
+
+/**
+ * Iterates over the samples of a table with one <compressed_block> per sstable
+ * row. The key of each row is the sample time and the data is the serialized
+ * sample, i.e. the rows are the same as the rows of an uncompressed table.
+ *
+ * position() returns the body offset of the current block and seekTo() must
+ * be called with the body offset of a block. If body_end is set, the cursor
+ * stops at the first block at or after body_end
+ */
+class CompressedBlockCursor : public sstable::Cursor {
+public:
+  CompressedBlockCursor(
+      std::unique_ptr<sstable::Cursor> block_cursor,
+      size_t body_end = std::numeric_limits<size_t>::max());
+
+  void seekTo(size_t body_offset) override;
+  bool next() override;
+  bool valid() override;
+
+  void getKey(void** data, size_t* size) override;
+  void getData(void** data, size_t* size) override;
+
+  size_t position() const override;
+
+protected:
+  /**
+   * Decode the first sample of the current block or of the next non-empty
+   * block
+   */
+  bool readBlock();
+
+  std::unique_ptr<sstable::Cursor> block_cursor_;
+  std::unique_ptr<CompressedBlockReader> block_;
+  size_t body_end_;
+  bool initialized_;
+  bool valid_;
+  uint64_t time_;
+  std::string sample_;
+};
+
+}
+}
+}
+
+#endif
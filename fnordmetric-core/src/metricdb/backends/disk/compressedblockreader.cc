@@ -0,0 +1,178 @@
+/**
+ * This file is part of the "FnordMetric" project
+ *   Copyright (c) 2014 Paul Asmuth, Google Inc.
+ *
+ * FnordMetric is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License v3.0. You should have received a
+ * copy of the GNU General Public License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#include <fnordmetric/metricdb/backends/disk/compressedblockreader.h>
+#include <fnordmetric/metricdb/backends/disk/compressedblockwriter.h>
+#include <fnordmetric/util/binarymessagereader.h>
+#include <fnordmetric/util/runtimeexception.h>
+#include <string.h>
+
+namespace fnordmetric {
+namespace metricdb {
+namespace disk_backend {
+
+CompressedBlockReader::CompressedBlockReader(
+    void const* data,
+    size_t size) :
+    row_(0),
+    last_time_(0),
+    last_label_set_id_(0) {
+  fnord::util::BinaryMessageReader reader(data, size);
+  num_rows_ = *reader.readUInt32();
+  value_words_ = *reader.readUInt32();
+
+  auto num_label_sets = *reader.readUInt32();
+  for (uint32_t i = 0; i < num_label_sets; ++i) {
+    auto label_set_size = *reader.readUInt32();
+    label_sets_.emplace_back(
+        reader.readString(label_set_size),
+        label_set_size);
+  }
+
+  for (uint32_t i = 0; i < num_label_sets; ++i) {
+    next_label_set_ids_.emplace_back(i);
+  }
+
+  series_.resize(num_label_sets);
+  series_initialized_.resize(num_label_sets, false);
+
+  size_t header_size = 0;
+  for (const auto& label_set : label_sets_) {
+    header_size += sizeof(uint32_t) + label_set.second;
+  }
+
+  header_size += sizeof(uint32_t) * 3;
+  if (header_size > size) {
+    RAISE(kBufferOverflowError, "corrupt compressed block");
+  }
+
+  bits_.reset(new BitStreamReader(
+      static_cast<char const*>(data) + header_size,
+      size - header_size));
+}
+
+size_t CompressedBlockReader::numRows() const {
+  return num_rows_;
+}
+
+bool CompressedBlockReader::readRow(uint64_t* time, std::string* sample) {
+  if (row_ >= num_rows_) {
+    return false;
+  }
+
+  auto label_set_id = readLabelSet();
+  auto& series = series_[label_set_id];
+
+  /* see CompressedBlockWriter::writeLabelSet */
+  if (!series_initialized_[label_set_id]) {
+    series.last_time = last_time_;
+    series.last_delta = 0;
+    series.values.resize(value_words_);
+    for (auto& value : series.values) {
+      value.value = 0;
+      value.leading_zeros = -1;
+      value.trailing_zeros = 0;
+    }
+
+    series_initialized_[label_set_id] = true;
+  }
+
+  readTime(&series, time);
+  last_time_ = *time;
+
+  auto value_size = value_words_ * sizeof(uint64_t);
+  sample->resize(value_size);
+
+  for (size_t i = 0; i < value_words_; ++i) {
+    auto word = readValueWord(&series.values[i]);
+    memcpy(&(*sample)[i * sizeof(word)], &word, sizeof(word));
+  }
+
+  const auto& label_set = label_sets_[label_set_id];
+  sample->append(label_set.first, label_set.second);
+
+  ++row_;
+  return true;
+}
+
+uint32_t CompressedBlockReader::readLabelSet() {
+  uint32_t label_set_id;
+
+  if (bits_->readBit()) {
+    label_set_id = bits_->readBits(CompressedBlockWriter::kLabelSetIDBits);
+  } else if (row_ > 0) {
+    label_set_id = next_label_set_ids_[last_label_set_id_];
+  } else {
+    RAISE(kIllegalStateError, "corrupt compressed block");
+  }
+
+  if (label_set_id >= label_sets_.size()) {
+    RAISE(kIndexError, "invalid label set id in compressed block");
+  }
+
+  if (row_ > 0) {
+    next_label_set_ids_[last_label_set_id_] = label_set_id;
+  }
+
+  last_label_set_id_ = label_set_id;
+  return label_set_id;
+}
+
+void CompressedBlockReader::readTime(SeriesState* series, uint64_t* time) {
+  if (row_ == 0) {
+    series->last_time = bits_->readBits(64);
+    series->last_delta = 0;
+    *time = series->last_time;
+    return;
+  }
+
+  uint64_t zigzag = 0;
+  if (!bits_->readBit()) {
+    zigzag = 0;
+  } else if (!bits_->readBit()) {
+    zigzag = bits_->readBits(14);
+  } else if (!bits_->readBit()) {
+    zigzag = bits_->readBits(20);
+  } else if (!bits_->readBit()) {
+    zigzag = bits_->readBits(32);
+  } else {
+    zigzag = bits_->readBits(64);
+  }
+
+  uint64_t dod = (zigzag >> 1) ^ (0 - (zigzag & 1));
+  series->last_delta += dod;
+  series->last_time += series->last_delta;
+  *time = series->last_time;
+}
+
+uint64_t CompressedBlockReader::readValueWord(ValueWordState* state) {
+  if (!bits_->readBit()) {
+    return state->value;
+  }
+
+  if (bits_->readBit()) {
+    state->leading_zeros = bits_->readBits(5);
+    int meaningful_bits = bits_->readBits(6) + 1;
+    if (state->leading_zeros + meaningful_bits > 64) {
+      RAISE(kIllegalStateError, "corrupt compressed block");
+    }
+
+    state->trailing_zeros = 64 - state->leading_zeros - meaningful_bits;
+  } else if (state->leading_zeros < 0) {
+    RAISE(kIllegalStateError, "corrupt compressed block");
+  }
+
+  auto meaningful_bits = 64 - state->leading_zeros - state->trailing_zeros;
+  state->value ^= bits_->readBits(meaningful_bits) << state->trailing_zeros;
+  return state->value;
+}
+
+}
+}
+}
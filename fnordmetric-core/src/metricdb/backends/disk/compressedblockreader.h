@@ -0,0 +1,64 @@
+/**
+ * This file is part of the "FnordMetric" project
+ *   Copyright (c) 2014 Paul Asmuth, Google Inc.
+ *
+ * FnordMetric is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License v3.0. You should have received a
+ * copy of the GNU General Public License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#ifndef _FNORDMETRIC_METRICDB_COMPRESSEDBLOCKREADER_H
+#define _FNORDMETRIC_METRICDB_COMPRESSEDBLOCKREADER_H
+#include <fnordmetric/metricdb/backends/disk/bitstream.h>
+#include <fnordmetric/metricdb/backends/disk/compressedblockwriter.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace fnordmetric {
+namespace metricdb {
+namespace disk_backend {
+
+/**
+ * Decodes a <compressed_block> written by a CompressedBlockWriter. The block
+ * data must stay valid while the reader is used
+ */
+class CompressedBlockReader {
+public:
+  CompressedBlockReader(void const* data, size_t size);
+
+  size_t numRows() const;
+
+  /**
+   * Decode the next sample of the block into time and sample. Returns false if
+   * all samples were read
+   */
+  bool readRow(uint64_t* time, std::string* sample);
+
+protected:
+  typedef CompressedBlockWriter::SeriesState SeriesState;
+  typedef CompressedBlockWriter::ValueWordState ValueWordState;
+
+  uint32_t readLabelSet();
+  void readTime(SeriesState* series, uint64_t* time);
+  uint64_t readValueWord(ValueWordState* state);
+
+  size_t num_rows_;
+  size_t value_words_;
+  std::vector<std::pair<char const*, size_t>> label_sets_;
+  std::unique_ptr<BitStreamReader> bits_;
+  size_t row_;
+  uint64_t last_time_;
+  std::vector<uint32_t> next_label_set_ids_;
+  uint32_t last_label_set_id_;
+  std::vector<SeriesState> series_;
+  std::vector<bool> series_initialized_;
+};
+
+}
+}
+}
+
+#endif
@@ -0,0 +1,252 @@
+/**
+ * This file is part of the "FnordMetric" project
+ *   Copyright (c) 2014 Paul Asmuth, Google Inc.
+ *
+ * FnordMetric is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License v3.0. You should have received a
+ * copy of the GNU General Public License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#include <fnordmetric/metricdb/backends/disk/compressedblockwriter.h>
+#include <fnordmetric/util/runtimeexception.h>
+#include <string.h>
+
+namespace fnordmetric {
+namespace metricdb {
+namespace disk_backend {
+
+static_assert(
+    CompressedBlockWriter::kMaxRowsPerBlock <=
+        (1 << CompressedBlockWriter::kLabelSetIDBits),
+    "label set ids must fit into kLabelSetIDBits");
+
+CompressedBlockWriter::CompressedBlockWriter(
+    size_t value_words) :
+    value_words_(value_words) {
+  reset();
+}
+
+void CompressedBlockWriter::addRow(
+    uint64_t time,
+    void const* data,
+    size_t size) {
+  if (num_rows_ >= kMaxRowsPerBlock) {
+    RAISE(kBufferOverflowError, "compressed block is full");
+  }
+
+  auto value_size = value_words_ * sizeof(uint64_t);
+  if (size < value_size) {
+    RAISE(kIllegalArgumentError, "sample is too small");
+  }
+
+  if (num_rows_ > 0 && time < last_time_) {
+    RAISE(kIllegalArgumentError, "samples must be sorted by time");
+  }
+
+  auto label_set_id = writeLabelSet(
+      std::string(
+          static_cast<char const*>(data) + value_size,
+          size - value_size));
+
+  auto& series = series_[label_set_id];
+  writeTime(&series, time);
+
+  for (size_t i = 0; i < value_words_; ++i) {
+    uint64_t word;
+    memcpy(
+        &word,
+        static_cast<char const*>(data) + i * sizeof(word),
+        sizeof(word));
+
+    writeValueWord(&series.values[i], word);
+  }
+
+  if (num_rows_ == 0) {
+    min_time_ = time;
+  }
+
+  last_time_ = time;
+  ++num_rows_;
+}
+
+/**
+ * '0' if the label set is the predicted label set, i.e. the label set that
+ * followed the previous sample's label set the last time (or the previous
+ * sample's label set if it wasn't followed by another one yet), '1' + the
+ * label set id otherwise
+ */
+uint32_t CompressedBlockWriter::writeLabelSet(const std::string& label_set) {
+  uint32_t label_set_id;
+
+  auto iter = label_set_ids_.find(label_set);
+  if (iter == label_set_ids_.end()) {
+    label_set_id = label_sets_.size();
+    label_set_ids_.emplace(label_set, label_set_id);
+    label_sets_.emplace_back(label_set);
+    next_label_set_ids_.emplace_back(label_set_id);
+
+    /* a new series starts at the time of the previous sample */
+    SeriesState series;
+    series.last_time = last_time_;
+    series.last_delta = 0;
+    series.values.resize(value_words_);
+    for (auto& value : series.values) {
+      value.value = 0;
+      value.leading_zeros = -1;
+      value.trailing_zeros = 0;
+    }
+
+    series_.emplace_back(series);
+  } else {
+    label_set_id = iter->second;
+  }
+
+  if (num_rows_ > 0 &&
+      label_set_id == next_label_set_ids_[last_label_set_id_]) {
+    bits_.writeBit(false);
+  } else {
+    bits_.writeBit(true);
+    bits_.writeBits(label_set_id, kLabelSetIDBits);
+  }
+
+  if (num_rows_ > 0) {
+    next_label_set_ids_[last_label_set_id_] = label_set_id;
+  }
+
+  last_label_set_id_ = label_set_id;
+  return label_set_id;
+}
+
+/**
+ * The time of the first sample of the block is stored verbatim. All following
+ * times are stored as the zigzag encoded difference between the delta to the
+ * previous time of the series and the previous delta of the series:
+ *
+ *   '0'                   delta of delta is zero
+ *   '10'   + 14 bits      delta of delta < 2^14
+ *   '110'  + 20 bits      delta of delta < 2^20
+ *   '1110' + 32 bits      delta of delta < 2^32
+ *   '1111' + 64 bits      any other delta of delta
+ */
+void CompressedBlockWriter::writeTime(SeriesState* series, uint64_t time) {
+  if (num_rows_ == 0) {
+    bits_.writeBits(time, 64);
+    series->last_time = time;
+    series->last_delta = 0;
+    return;
+  }
+
+  uint64_t delta = time - series->last_time;
+  int64_t dod = static_cast<int64_t>(delta - series->last_delta);
+  uint64_t zigzag = (static_cast<uint64_t>(dod) << 1) ^
+      static_cast<uint64_t>(dod >> 63);
+
+  if (zigzag == 0) {
+    bits_.writeBit(false);
+  } else if (zigzag < (1llu << 14)) {
+    bits_.writeBits(0b10, 2);
+    bits_.writeBits(zigzag, 14);
+  } else if (zigzag < (1llu << 20)) {
+    bits_.writeBits(0b110, 3);
+    bits_.writeBits(zigzag, 20);
+  } else if (zigzag < (1llu << 32)) {
+    bits_.writeBits(0b1110, 4);
+    bits_.writeBits(zigzag, 32);
+  } else {
+    bits_.writeBits(0b1111, 4);
+    bits_.writeBits(zigzag, 64);
+  }
+
+  series->last_time = time;
+  series->last_delta = delta;
+}
+
+/**
+ * Each value word is XORed with the previous value word of the series (zero
+ * for the first value) and stored as:
+ *
+ *   '0'                           the value is unchanged
+ *   '10' + meaningful bits        the meaningful bits of the XOR fit into the
+ *                                 window of the previous '11' value
+ *   '11' + 5 bits leading zeros + 6 bits (number of meaningful bits - 1) +
+ *          meaningful bits
+ */
+void CompressedBlockWriter::writeValueWord(
+    ValueWordState* state,
+    uint64_t value) {
+  uint64_t xored = value ^ state->value;
+  state->value = value;
+
+  if (xored == 0) {
+    bits_.writeBit(false);
+    return;
+  }
+
+  int leading_zeros = __builtin_clzll(xored);
+  int trailing_zeros = __builtin_ctzll(xored);
+  if (leading_zeros > 31) {
+    leading_zeros = 31;
+  }
+
+  if (state->leading_zeros >= 0 &&
+      leading_zeros >= state->leading_zeros &&
+      trailing_zeros >= state->trailing_zeros) {
+    bits_.writeBits(0b10, 2);
+    bits_.writeBits(
+        xored >> state->trailing_zeros,
+        64 - state->leading_zeros - state->trailing_zeros);
+  } else {
+    int meaningful_bits = 64 - leading_zeros - trailing_zeros;
+    bits_.writeBits(0b11, 2);
+    bits_.writeBits(leading_zeros, 5);
+    bits_.writeBits(meaningful_bits - 1, 6);
+    bits_.writeBits(xored >> trailing_zeros, meaningful_bits);
+    state->leading_zeros = leading_zeros;
+    state->trailing_zeros = trailing_zeros;
+  }
+}
+
+size_t CompressedBlockWriter::numRows() const {
+  return num_rows_;
+}
+
+uint64_t CompressedBlockWriter::minTime() const {
+  return min_time_;
+}
+
+uint64_t CompressedBlockWriter::maxTime() const {
+  return last_time_;
+}
+
+void CompressedBlockWriter::writeBlock(
+    fnord::util::BinaryMessageWriter* writer) {
+  writer->appendUInt32(num_rows_);
+  writer->appendUInt32(value_words_);
+  writer->appendUInt32(label_sets_.size());
+
+  for (const auto& label_set : label_sets_) {
+    writer->appendUInt32(label_set.size());
+    writer->append(label_set.data(), label_set.size());
+  }
+
+  const auto& bits = bits_.data();
+  writer->append(bits.data(), bits.size());
+
+  reset();
+}
+
+void CompressedBlockWriter::reset() {
+  num_rows_ = 0;
+  min_time_ = 0;
+  last_time_ = 0;
+  last_label_set_id_ = 0;
+  label_sets_.clear();
+  label_set_ids_.clear();
+  next_label_set_ids_.clear();
+  series_.clear();
+  bits_ = BitStreamWriter();
+}
+
+}
+}
+}
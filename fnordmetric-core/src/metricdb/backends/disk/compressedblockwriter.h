@@ -0,0 +1,97 @@
+/**
+ * This file is part of the "FnordMetric" project
+ *   Copyright (c) 2014 Paul Asmuth, Google Inc.
+ *
+ * FnordMetric is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License v3.0. You should have received a
+ * copy of the GNU General Public License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#ifndef _FNORDMETRIC_METRICDB_COMPRESSEDBLOCKWRITER_H
+#define _FNORDMETRIC_METRICDB_COMPRESSEDBLOCKWRITER_H
+#include <fnordmetric/metricdb/backends/disk/bitstream.h>
+#include <fnordmetric/util/binarymessagewriter.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace fnordmetric {
+namespace metricdb {
+namespace disk_backend {
+
+/**
+ * Encodes a block of serialized samples (see binaryformat.h) that are sorted
+ * by time into a <compressed_block>.
+ *
+ * The label sets are stored once per block. Each sample references its label
+ * set by id, or with a single bit if it has the label set that followed the
+ * previous sample's label set the last time, so runs and round robin
+ * sequences of label sets cost one bit per sample.
+ *
+ * The times and values are encoded per label set (i.e. per series): the times
+ * are delta-of-delta encoded and each 64 bit word of the values is XOR encoded
+ * against the same word of the previous value of the series
+ */
+class CompressedBlockWriter {
+public:
+  static const size_t kMaxRowsPerBlock = 4096;
+  static const int kLabelSetIDBits = 12;
+
+  /**
+   * @param value_words the number of 64 bit words that make up the value of
+   *                    each sample
+   */
+  CompressedBlockWriter(size_t value_words);
+
+  /**
+   * Add a sample to the block. Samples must be added in time order and at
+   * most kMaxRowsPerBlock samples may be added
+   */
+  void addRow(uint64_t time, void const* data, size_t size);
+
+  size_t numRows() const;
+  uint64_t minTime() const;
+  uint64_t maxTime() const;
+
+  /**
+   * Write the block and reset the writer
+   */
+  void writeBlock(fnord::util::BinaryMessageWriter* writer);
+
+  struct ValueWordState {
+    uint64_t value;
+    int leading_zeros; /* -1 if there is no previous window */
+    int trailing_zeros;
+  };
+
+  struct SeriesState {
+    uint64_t last_time;
+    uint64_t last_delta;
+    std::vector<ValueWordState> values;
+  };
+
+protected:
+  void reset();
+  uint32_t writeLabelSet(const std::string& label_set);
+  void writeTime(SeriesState* series, uint64_t time);
+  void writeValueWord(ValueWordState* state, uint64_t value);
+
+  size_t value_words_;
+  size_t num_rows_;
+  uint64_t min_time_;
+  uint64_t last_time_;
+  std::vector<std::string> label_sets_;
+  std::unordered_map<std::string, uint32_t> label_set_ids_;
+  std::vector<uint32_t> next_label_set_ids_;
+  uint32_t last_label_set_id_;
+  std::vector<SeriesState> series_;
+  BitStreamWriter bits_;
+};
+
+}
+}
+}
+
+#endif
@@ -9,13 +9,35 @@
  */
 #include <fnordmetric/environment.h>
 #include <fnordmetric/io/fileutil.h>
+#include <fnordmetric/metricdb/backends/disk/compressedblockreader.h>
+#include <fnordmetric/metricdb/backends/disk/compressedblockwriter.h>
+#include <fnordmetric/metricdb/backends/disk/livetablebudget.h>
+#include <fnordmetric/metricdb/backends/disk/manifest.h>
+#include <fnordmetric/metricdb/backends/disk/memtable.h>
 #include <fnordmetric/metricdb/backends/disk/metric.h>
+#include <fnordmetric/metricdb/backends/disk/postingsindex.h>
+#include <fnordmetric/metricdb/backends/disk/rollupcompactionpolicy.h>
+#include <fnordmetric/metricdb/backends/disk/sizetieredcompactionpolicy.h>
+#include <fnordmetric/metricdb/backends/disk/tableheaderwriter.h>
+#include <fnordmetric/metricdb/backends/disk/tablereadercache.h>
+#include <fnordmetric/metricdb/backends/disk/writeaheadlog.h>
+#include <fnordmetric/metricdb/backends/inmemory/metricrepository.h>
+#include <fnordmetric/metricdb/metrictableref.h>
+#include <fnordmetric/sql/runtime/defaultruntime.h>
+#include <fnordmetric/sql/runtime/queryplan.h>
+#include <fnordmetric/sql/runtime/queryplannode.h>
+#include <fnordmetric/sql/runtime/resultlist.h>
+#include <fnordmetric/sql/runtime/tablerepository.h>
+#include <fnordmetric/sstable/sstablerepair.h>
+#include <fnordmetric/thread/threadpool.h>
 #include <fnordmetric/util/unittest.h>
 #include <fnordmetric/util/wallclock.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <math.h>
+#include <atomic>
+#include <thread>
 
 using namespace fnordmetric::metricdb::disk_backend;
 using namespace fnordmetric::metricdb;
@@ -82,3 +104,2784 @@ TEST_CASE(DiskBackendTest, TestCreateNewMetric, [] () {
 
 
 
+
+TEST_CASE(DiskBackendTest, TestTimeRangeScan, [] () {
+  io::FileUtil::mkdir_p(kTestRepoPath);
+  FileRepository file_repo(kTestRepoPath);
+  file_repo.deleteAllFiles();
+
+  Metric metric("mysecondmetric", &file_repo);
+  metric.setLiveTableMaxSize(2 << 14); /* 32KB */
+  metric.setLiveTableIdleTimeMicros(0);
+
+  LabelListType smpl_labels;
+  smpl_labels.emplace_back("host", "myhost");
+
+  for (int i = 0; i < 10000; ++i) {
+    metric.insertSample(i, smpl_labels);
+  }
+
+  metric.compact();
+  auto time_middle = fnord::util::WallClock::unixMicros();
+
+  for (int i = 10000; i < 15000; ++i) {
+    metric.insertSample(i, smpl_labels);
+  }
+
+  EXPECT(metric.numTables() > 2);
+
+  int n = 0;
+  metric.scanSamples(
+      util::DateTime(time_middle),
+      util::DateTime::now(),
+      [&n] (Sample* sample) -> bool {
+        EXPECT_EQ(sample->value(), 10000 + n);
+        n++;
+        return true;
+      });
+
+  EXPECT_EQ(n, 5000);
+
+  metric.compact();
+
+  n = 0;
+  metric.scanSamples(
+      util::DateTime(time_middle),
+      util::DateTime::now(),
+      [&n] (Sample* sample) -> bool {
+        EXPECT_EQ(sample->value(), 10000 + n);
+        n++;
+        return true;
+      });
+
+  EXPECT_EQ(n, 5000);
+
+  n = 0;
+  metric.scanSamples(
+      util::DateTime::epoch(),
+      util::DateTime(time_middle),
+      [&n] (Sample* sample) -> bool {
+        EXPECT_EQ(sample->value(), n);
+        n++;
+        return true;
+      });
+
+  EXPECT_EQ(n, 10000);
+});
+
+TEST_CASE(DiskBackendTest, TestInsertSamplesBatch, [] () {
+  io::FileUtil::mkdir_p(kTestRepoPath);
+  FileRepository file_repo(kTestRepoPath);
+  file_repo.deleteAllFiles();
+
+  Metric metric("mythirdmetric", &file_repo);
+  metric.setLiveTableMaxSize(2 << 14); /* 32KB */
+
+  for (int j = 0; j < 10; ++j) {
+    std::vector<NewSample> batch;
+
+    for (int i = 0; i < 1000; ++i) {
+      NewSample sample;
+      sample.time = 0;
+      sample.value = j * 1000 + i;
+      sample.labels.emplace_back("host", i % 2 ? "odd" : "even");
+      batch.emplace_back(sample);
+    }
+
+    metric.insertSamples(batch);
+  }
+
+  EXPECT(metric.numTables() > 1);
+  EXPECT(metric.hasLabel("host"));
+
+  int n = 0;
+  metric.scanSamples(
+      util::DateTime::epoch(),
+      util::DateTime::now(),
+      [&n] (Sample* sample) -> bool {
+        EXPECT_EQ(sample->value(), n);
+        EXPECT_EQ(sample->labels().size(), 1);
+        EXPECT_EQ(sample->labels()[0].second, n % 2 ? "odd" : "even");
+        n++;
+        return true;
+      });
+
+  EXPECT_EQ(n, 10000);
+
+  std::vector<NewSample> invalid_batch;
+  NewSample invalid_sample;
+  invalid_sample.time = 0;
+  invalid_sample.value = 23;
+  invalid_sample.labels.emplace_back("host", "a");
+  invalid_sample.labels.emplace_back("host", "b");
+  invalid_batch.emplace_back(invalid_sample);
+
+  bool raised = false;
+  try {
+    metric.insertSamples(invalid_batch);
+  } catch (const fnordmetric::util::RuntimeException& e) {
+    raised = true;
+  }
+
+  EXPECT(raised);
+});
+
+TEST_CASE(DiskBackendTest, TestInsertInvalidBatch, [] () {
+  inmemory_backend::MetricRepository metric_repo;
+
+  NewSample valid_sample;
+  valid_sample.time = 0;
+  valid_sample.value = 23;
+  valid_sample.labels.emplace_back("host", "a");
+
+  NewSample invalid_sample;
+  invalid_sample.time = 0;
+  invalid_sample.value = 42;
+  invalid_sample.labels.emplace_back("host", "a");
+  invalid_sample.labels.emplace_back("host", "b");
+
+  IMetricRepository::SampleBatch batch;
+  batch["myvalidmetric"].emplace_back(valid_sample);
+  batch["myinvalidmetric"].emplace_back(valid_sample);
+  batch["myinvalidmetric"].emplace_back(invalid_sample);
+
+  bool raised = false;
+  try {
+    metric_repo.insertBatch(batch);
+  } catch (const fnordmetric::util::RuntimeException& e) {
+    raised = true;
+  }
+
+  /* none of the metrics of the batch are written */
+  EXPECT(raised);
+  EXPECT(metric_repo.findMetric("myvalidmetric") == nullptr);
+  EXPECT(metric_repo.findMetric("myinvalidmetric") == nullptr);
+
+  batch.erase("myinvalidmetric");
+  metric_repo.insertBatch(batch);
+
+  int n = 0;
+  metric_repo.findMetric("myvalidmetric")->scanSamples(
+      util::DateTime::epoch(),
+      util::DateTime::now(),
+      [&n] (Sample* sample) -> bool {
+        EXPECT_EQ(sample->value(), 23);
+        n++;
+        return true;
+      });
+
+  EXPECT_EQ(n, 1);
+});
+
+TEST_CASE(DiskBackendTest, TestInsertOutOfOrderSamples, [] () {
+  io::FileUtil::mkdir_p(kTestRepoPath);
+  FileRepository file_repo(kTestRepoPath);
+  file_repo.deleteAllFiles();
+
+  Metric metric("myfourthmetric", &file_repo);
+  metric.setLiveTableMaxSize(2 << 12); /* 8KB */
+  metric.setLiveTableIdleTimeMicros(0);
+
+  /* insert samples 0..9999 with times 1000000 + i in shuffled batches */
+  std::vector<NewSample> samples;
+  for (int i = 0; i < 10000; ++i) {
+    NewSample sample;
+    sample.time = 1000000 + i;
+    sample.value = i;
+    samples.emplace_back(sample);
+  }
+
+  srand(42);
+  for (int i = samples.size() - 1; i > 0; --i) {
+    std::swap(samples[i], samples[rand() % (i + 1)]);
+  }
+
+  auto check_scan = [&metric] (uint64_t begin, uint64_t end) {
+    uint64_t n = begin;
+    metric.scanSamples(
+        util::DateTime(1000000 + begin),
+        util::DateTime(1000000 + end),
+        [&n] (Sample* sample) -> bool {
+          EXPECT_EQ(static_cast<uint64_t>(sample->time()), 1000000 + n);
+          EXPECT_EQ(sample->value(), n);
+          n++;
+          return true;
+        });
+
+    EXPECT_EQ(n, end);
+  };
+
+  for (int i = 0; i < samples.size(); i += 500) {
+    metric.insertSamples(&samples[i], 500);
+
+    if (i == 5000) {
+      metric.compact();
+    }
+  }
+
+  check_scan(0, 10000);
+  check_scan(2345, 6789);
+
+  metric.compact();
+  check_scan(0, 10000);
+  check_scan(2345, 6789);
+});
+
+TEST_CASE(DiskBackendTest, TestLateTableFlush, [] () {
+  io::FileUtil::mkdir_p(kTestRepoPath);
+  FileRepository file_repo(kTestRepoPath);
+  file_repo.deleteAllFiles();
+
+  auto count_files = [&file_repo] () -> int {
+    int num_files = 0;
+    file_repo.listFiles([&num_files] (const std::string& filename) -> bool {
+      ++num_files;
+      return true;
+    });
+
+    return num_files;
+  };
+
+  Metric metric("mylatemetric", &file_repo);
+  metric.setSyncPolicy(
+      sstable::SSTableWriter::SyncPolicy::groupCommit(
+          2 << 20, /* 2MB */
+          100000 /* 100ms */));
+
+  /* samples from the future are rejected */
+  NewSample future_sample;
+  future_sample.time = fnord::util::WallClock::unixMicros() + 3600 * 1000000llu;
+  future_sample.value = 23;
+
+  bool raised = false;
+  try {
+    metric.insertSamples(&future_sample, 1);
+  } catch (const fnordmetric::util::RuntimeException& e) {
+    raised = true;
+  }
+
+  EXPECT(raised);
+  EXPECT_EQ(metric.numTables(), 0);
+
+  /* without a write ahead log, late samples are written to disk once the sync
+     delay has passed */
+  NewSample sample;
+  sample.time = 3000000;
+  sample.value = 1000;
+  metric.insertSamples(&sample, 1);
+
+  sample.time = 1000000;
+  sample.value = 0;
+  metric.insertSamples(&sample, 1);
+  EXPECT_EQ(metric.numTables(), 2);
+  EXPECT_EQ(count_files(), 1);
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(150));
+  metric.syncTables();
+  EXPECT_EQ(metric.numTables(), 2);
+  EXPECT_EQ(count_files(), 2);
+
+  /* late tables are also written to disk once they are full */
+  metric.setSyncPolicy(sstable::SSTableWriter::SyncPolicy::none());
+  metric.setLiveTableMaxSize(2 << 9); /* 1KB */
+  for (int i = 1; i < 1000; ++i) {
+    sample.time = 1000000 + i;
+    sample.value = i;
+    metric.insertSamples(&sample, 1);
+  }
+
+  EXPECT(metric.numTables() > 4);
+  EXPECT(count_files() >= metric.numTables() - 1);
+
+  int n = 0;
+  metric.scanSamples(
+      util::DateTime::epoch(),
+      std::numeric_limits<util::DateTime>::max(),
+      [&n] (Sample* sample) -> bool {
+        EXPECT_EQ(sample->value(), n);
+        ++n;
+        return true;
+      });
+
+  EXPECT_EQ(n, 1001);
+});
+
+TEST_CASE(DiskBackendTest, TestLateTableSnapshot, [] () {
+  TokenIndex token_index;
+  LateTableRef table("latetable", "mylatemetric", 1, {});
+
+  auto add_rows = [&] (std::vector<uint64_t> times) {
+    SampleWriter writer(&token_index);
+    std::vector<TableRef::SampleRef> refs;
+    for (const auto time : times) {
+      TableRef::SampleRef ref;
+      ref.time = time;
+      ref.offset = writer.size();
+      writer.writeValue<double>(time);
+      ref.size = writer.size() - ref.offset;
+      refs.emplace_back(ref);
+    }
+
+    table.addSamples(&writer, refs);
+  };
+
+  auto scan = [] (sstable::Cursor* cursor) -> std::vector<uint64_t> {
+    std::vector<uint64_t> times;
+    while (cursor->valid()) {
+      void* data;
+      size_t size;
+      cursor->getKey(&data, &size);
+      times.emplace_back(*static_cast<uint64_t*>(data));
+      EXPECT_EQ(cursor->position(), times.size() - 1);
+
+      if (!cursor->next()) {
+        break;
+      }
+    }
+
+    return times;
+  };
+
+  /* the rows are sorted by time and a cursor doesn't see rows that are added
+     after it was created */
+  add_rows({ 5000, 1000, 3000 });
+  auto cursor = table.cursorFrom(2000);
+  add_rows({ 4000, 2000 });
+
+  EXPECT(scan(cursor.get()) == std::vector<uint64_t>({ 3000, 5000 }));
+  EXPECT(
+      scan(table.cursorFrom(2000).get()) ==
+      std::vector<uint64_t>({ 2000, 3000, 4000, 5000 }));
+  EXPECT(!table.cursorFrom(5001)->valid());
+});
+
+TEST_CASE(DiskBackendTest, TestSizeTieredCompaction, [] () {
+  io::FileUtil::mkdir_p(kTestRepoPath);
+  FileRepository file_repo(kTestRepoPath);
+  file_repo.deleteAllFiles();
+
+  auto num_files = [&file_repo] () -> int {
+    int n = 0;
+    file_repo.listFiles([&n] (const std::string& filename) -> bool {
+      n++;
+      return true;
+    });
+    return n;
+  };
+
+  Metric metric("myfifthmetric", &file_repo);
+  metric.setLiveTableMaxSize(2 << 11); /* 4KB */
+  metric.setLiveTableIdleTimeMicros(0);
+
+  LabelListType smpl_labels;
+  smpl_labels.emplace_back("host", "myhost");
+
+  for (int i = 0; i < 20000; ++i) {
+    metric.insertSample(i, smpl_labels);
+  }
+
+  metric.compact();
+  auto num_tables = metric.numTables();
+  EXPECT(num_tables > 16);
+
+  SizeTieredCompactionPolicy policy;
+  metric.compact(&policy);
+  EXPECT(metric.numTables() < num_tables / 2);
+  EXPECT(num_files() < num_tables / 2);
+
+  int n = 0;
+  metric.scanSamples(
+      util::DateTime::epoch(),
+      util::DateTime::now(),
+      [&n] (Sample* sample) -> bool {
+        EXPECT_EQ(sample->value(), n);
+        EXPECT_EQ(sample->labels().size(), 1);
+        EXPECT_EQ(sample->labels()[0].second, "myhost");
+        n++;
+        return true;
+      });
+
+  EXPECT_EQ(n, 20000);
+});
+
+class InterruptedCompactionMetric : public Metric {
+public:
+  InterruptedCompactionMetric(
+      const std::string& key,
+      io::FileRepository* file_repo) :
+      Metric(key, file_repo) {}
+
+  /**
+   * Start merging all tables and write some of the merged samples, but never
+   * finalize the merged table, as if the process died during the merge
+   */
+  void startMerge(int num_samples) {
+    auto table = createCompactionTable(getSnapshot()->tables());
+
+    SampleWriter writer(&token_index_);
+    std::vector<TableRef::SampleRef> refs;
+    for (int i = 0; i < num_samples; ++i) {
+      TableRef::SampleRef ref;
+      ref.time = i + 1;
+      ref.offset = writer.size();
+      writer.writeValue<double>(i);
+      writer.writeLabel("host", "myhost");
+      ref.size = writer.size() - ref.offset;
+      refs.emplace_back(ref);
+    }
+
+    table->addSamples(&writer, refs);
+  }
+};
+
+TEST_CASE(DiskBackendTest, TestInterruptedCompaction, [] () {
+  io::FileUtil::mkdir_p(kTestRepoPath);
+  FileRepository file_repo(kTestRepoPath);
+  file_repo.deleteAllFiles();
+
+  auto list_files = [&file_repo] () -> std::set<std::string> {
+    std::set<std::string> files;
+    file_repo.listFiles([&files] (const std::string& filename) -> bool {
+      files.insert(filename);
+      return true;
+    });
+    return files;
+  };
+
+  std::set<std::string> files;
+  {
+    InterruptedCompactionMetric metric("myinterruptedmetric", &file_repo);
+    metric.setLiveTableMaxSize(2 << 11); /* 4KB */
+    metric.setLiveTableIdleTimeMicros(0);
+
+    LabelListType smpl_labels;
+    smpl_labels.emplace_back("host", "myhost");
+
+    for (int i = 0; i < 4000; ++i) {
+      metric.insertSample(i, smpl_labels);
+    }
+
+    metric.compact();
+    EXPECT(metric.numTables() > 16);
+
+    files = list_files();
+    metric.startMerge(2 * CompressedBlockWriter::kMaxRowsPerBlock);
+    EXPECT_EQ(list_files().size(), files.size() + 1);
+  }
+
+  std::vector<std::unique_ptr<TableRef>> tables;
+  file_repo.listFiles([&tables] (const std::string& filename) -> bool {
+    fnord::sstable::SSTableRepair repair(filename);
+    EXPECT(repair.checkAndRepair(true));
+    tables.emplace_back(TableRef::openTable(filename));
+    return true;
+  });
+
+  /* the incomplete merged table is deleted and the merged tables are kept */
+  Metric metric("myinterruptedmetric", &file_repo, std::move(tables));
+  EXPECT(list_files() == files);
+  EXPECT_EQ(metric.numTables(), files.size());
+
+  int n = 0;
+  metric.scanSamples(
+      util::DateTime::epoch(),
+      util::DateTime::now(),
+      [&n] (Sample* sample) -> bool {
+        EXPECT_EQ(sample->value(), n);
+        EXPECT_EQ(sample->labels()[0].second, "myhost");
+        n++;
+        return true;
+      });
+
+  EXPECT_EQ(n, 4000);
+
+  /* the next compaction merges the tables again */
+  SizeTieredCompactionPolicy policy;
+  metric.compact(&policy);
+  EXPECT(metric.numTables() < files.size() / 2);
+
+  n = 0;
+  metric.scanSamples(
+      util::DateTime::epoch(),
+      util::DateTime::now(),
+      [&n] (Sample* sample) -> bool {
+        EXPECT_EQ(sample->value(), n);
+        n++;
+        return true;
+      });
+
+  EXPECT_EQ(n, 4000);
+});
+
+TEST_CASE(DiskBackendTest, TestRollupCompaction, [] () {
+  io::FileUtil::mkdir_p(kTestRepoPath);
+  FileRepository file_repo(kTestRepoPath);
+  file_repo.deleteAllFiles();
+
+  Metric metric("mysixthmetric", &file_repo);
+  metric.setLiveTableMaxSize(2 << 11); /* 4KB */
+  metric.setLiveTableIdleTimeMicros(0);
+
+  /* two hours of samples from 30 days ago, one sample per host every 30s */
+  uint64_t hour = 3600 * 1000000llu;
+  uint64_t base = fnord::util::WallClock::unixMicros() - 30 * 24 * hour;
+  base -= base % hour;
+
+  std::vector<NewSample> samples;
+  for (int i = 0; i < 240; ++i) {
+    for (int host = 0; host < 2; ++host) {
+      NewSample sample;
+      sample.time = base + i * 30 * 1000000llu;
+      sample.value = i;
+      sample.labels.emplace_back("host", host == 0 ? "host1" : "host2");
+      samples.emplace_back(sample);
+    }
+  }
+
+  metric.insertSamples(samples);
+  metric.compact();
+  EXPECT_EQ(metric.rollupResolutions().size(), 0);
+
+  RollupCompactionPolicy policy(RollupCompactionPolicy::parseTiers("7d:1m"));
+  metric.compact(&policy);
+
+  auto resolutions = metric.rollupResolutions();
+  EXPECT_EQ(resolutions.size(), 1);
+  EXPECT_EQ(resolutions[0], 60 * 1000000llu);
+
+  /* one minute windows */
+  int n = 0;
+  metric.scanRollups(
+      util::DateTime::epoch(),
+      util::DateTime::now(),
+      60 * 1000000llu,
+      [&n, base] (RollupSample* sample) -> bool {
+        auto i = (n / 2) * 2;
+        EXPECT_EQ(sample->time, base + (n / 2) * 60 * 1000000llu);
+        EXPECT_EQ(sample->value.count, 2);
+        EXPECT_EQ(sample->value.sum, i + i + 1);
+        EXPECT_EQ(sample->value.min, i);
+        EXPECT_EQ(sample->value.max, i + 1);
+        EXPECT_EQ(sample->labels.size(), 1);
+        n++;
+        return true;
+      });
+
+  EXPECT_EQ(n, 240);
+
+  /* one hour windows are aggregated from the one minute rollups */
+  n = 0;
+  metric.scanRollups(
+      util::DateTime::epoch(),
+      util::DateTime::now(),
+      hour,
+      [&n, base, hour] (RollupSample* sample) -> bool {
+        EXPECT_EQ(sample->time, base + (n / 2) * hour);
+        EXPECT_EQ(sample->value.count, 120);
+        EXPECT_EQ(sample->value.min, (n / 2) * 120);
+        EXPECT_EQ(sample->value.max, (n / 2) * 120 + 119);
+        n++;
+        return true;
+      });
+
+  EXPECT_EQ(n, 4);
+
+  /* raw scans return the mean of each window */
+  n = 0;
+  metric.scanSamples(
+      util::DateTime::epoch(),
+      util::DateTime::now(),
+      [&n] (Sample* sample) -> bool {
+        EXPECT_EQ(sample->value(), (n / 2) * 2 + 0.5);
+        n++;
+        return true;
+      });
+
+  EXPECT_EQ(n, 240);
+
+  /* the rollup resolution is stored in the table header */
+  std::vector<std::unique_ptr<TableRef>> tables;
+  file_repo.listFiles([&tables] (const std::string& filename) -> bool {
+    fnord::sstable::SSTableRepair repair(filename);
+    EXPECT(repair.checkAndRepair(true));
+    tables.emplace_back(TableRef::openTable(filename));
+    return true;
+  });
+
+  Metric reopened_metric("mysixthmetric", &file_repo, std::move(tables));
+  resolutions = reopened_metric.rollupResolutions();
+  EXPECT_EQ(resolutions.size(), 1);
+  EXPECT_EQ(resolutions[0], 60 * 1000000llu);
+
+  n = 0;
+  reopened_metric.scanRollups(
+      util::DateTime::epoch(),
+      util::DateTime::now(),
+      hour,
+      [&n] (RollupSample* sample) -> bool {
+        EXPECT_EQ(sample->value.count, 120);
+        n++;
+        return true;
+      });
+
+  EXPECT_EQ(n, 4);
+});
+
+TEST_CASE(DiskBackendTest, TestRollupCompactionWithoutTimeIndex, [] () {
+  io::FileUtil::mkdir_p(kTestRepoPath);
+  FileRepository file_repo(kTestRepoPath);
+  file_repo.deleteAllFiles();
+
+  uint64_t hour = 3600 * 1000000llu;
+  uint64_t base = fnord::util::WallClock::unixMicros() - 30 * 24 * hour;
+
+  /* a table written before the time index was introduced */
+  {
+    TableHeaderWriter header("mylegacymetric", 1, std::vector<uint64_t>());
+    auto fileref = file_repo.createFile();
+    io::File::openFile(
+        fileref.absolute_path,
+        io::File::O_READ | io::File::O_WRITE | io::File::O_CREATE);
+
+    auto table = fnord::sstable::SSTableWriter::create(
+        fileref.absolute_path,
+        fnord::sstable::IndexProvider(),
+        header.data(),
+        header.size());
+
+    TokenIndex token_index;
+    for (int i = 0; i < 100; ++i) {
+      uint64_t time = base + i * 1000000llu;
+      SampleWriter sample(&token_index);
+      sample.writeValue<double>(i);
+      table->appendRow(&time, sizeof(time), sample.data(), sample.size());
+    }
+
+    table->finalize();
+  }
+
+  std::vector<std::unique_ptr<TableRef>> tables;
+  file_repo.listFiles([&tables] (const std::string& filename) -> bool {
+    tables.emplace_back(TableRef::openTable(filename));
+    return true;
+  });
+
+  Metric metric("mylegacymetric", &file_repo, std::move(tables));
+  metric.setLiveTableIdleTimeMicros(0);
+  EXPECT_EQ(metric.numTables(), 1);
+
+  /* the table might contain samples of any age, so it is never rolled up */
+  RollupCompactionPolicy policy(RollupCompactionPolicy::parseTiers("7d:1m"));
+  metric.compact(&policy);
+  EXPECT_EQ(metric.rollupResolutions().size(), 0);
+
+  int n = 0;
+  metric.scanSamples(
+      util::DateTime::epoch(),
+      util::DateTime::now(),
+      [&n] (Sample* sample) -> bool {
+        EXPECT_EQ(sample->value(), n);
+        n++;
+        return true;
+      });
+
+  EXPECT_EQ(n, 100);
+});
+
+TEST_CASE(DiskBackendTest, TestRetention, [] () {
+  io::FileUtil::mkdir_p(kTestRepoPath);
+  FileRepository file_repo(kTestRepoPath);
+  file_repo.deleteAllFiles();
+
+  auto list_files = [&file_repo] () -> std::set<std::string> {
+    std::set<std::string> files;
+    file_repo.listFiles([&files] (const std::string& filename) -> bool {
+      files.insert(filename);
+      return true;
+    });
+    return files;
+  };
+
+  Metric metric("myseventhmetric", &file_repo);
+  metric.setLiveTableIdleTimeMicros(0);
+
+  uint64_t day = 86400 * 1000000llu;
+  auto now = fnord::util::WallClock::unixMicros();
+
+  /* one table with samples from 40 days ago, one with samples from now */
+  std::vector<NewSample> samples;
+  for (int i = 0; i < 200; ++i) {
+    NewSample sample;
+    sample.time = i < 100 ? now - 40 * day + i : 0;
+    sample.value = i;
+    sample.labels.emplace_back("host", "myhost");
+    samples.emplace_back(sample);
+
+    if (i == 99 || i == 199) {
+      metric.insertSamples(samples);
+      metric.compact();
+      samples.clear();
+    }
+  }
+
+  auto files = list_files();
+  EXPECT_EQ(metric.numTables(), 2);
+  EXPECT_EQ(files.size(), 2);
+
+  /* tables that are younger than the retention are kept */
+  metric.compact(nullptr, 60 * day);
+  EXPECT_EQ(metric.numTables(), 2);
+  EXPECT(list_files() == files);
+
+  /* the expired table is dropped and its file is deleted */
+  metric.compact(nullptr, 30 * day);
+
+  int num_kept = 0;
+  for (const auto& filename : list_files()) {
+    num_kept += files.count(filename);
+  }
+
+  EXPECT_EQ(num_kept, 1);
+
+  int n = 0;
+  metric.scanSamples(
+      util::DateTime::epoch(),
+      util::DateTime::now(),
+      [&n] (Sample* sample) -> bool {
+        EXPECT_EQ(sample->value(), n + 100);
+        n++;
+        return true;
+      });
+
+  EXPECT_EQ(n, 100);
+});
+
+TEST_CASE(DiskBackendTest, TestTableReaderCache, [] () {
+  io::FileUtil::mkdir_p(kTestRepoPath);
+  FileRepository file_repo(kTestRepoPath);
+  file_repo.deleteAllFiles();
+
+  Metric metric("myeighthmetric", &file_repo);
+  metric.setLiveTableMaxSize(2 << 11); /* 4KB */
+  metric.setLiveTableIdleTimeMicros(0);
+
+  LabelListType smpl_labels;
+  smpl_labels.emplace_back("host", "myhost");
+
+  for (int i = 0; i < 2000; ++i) {
+    metric.insertSample(i, smpl_labels);
+  }
+
+  metric.compact();
+
+  std::vector<std::string> files;
+  file_repo.listFiles([&files] (const std::string& filename) -> bool {
+    files.emplace_back(filename);
+    return true;
+  });
+
+  EXPECT(files.size() > 2);
+
+  /* readers are shared until they are evicted */
+  TableReaderCache cache(2);
+  auto reader = cache.getReader(files[0]);
+  EXPECT(cache.getReader(files[0]).get() == reader.get());
+  EXPECT_EQ(cache.size(), 1);
+
+  cache.getReader(files[1]);
+  cache.getReader(files[2]);
+  EXPECT_EQ(cache.size(), 2);
+  EXPECT(cache.getReader(files[0]).get() != reader.get());
+
+  /* evicted readers stay valid while they are referenced */
+  auto cursor = reader->getCursor();
+  EXPECT(cursor->valid());
+
+  cache.evict(files[0]);
+  EXPECT_EQ(cache.size(), 1);
+
+  cache.setMaxSize(0);
+  EXPECT_EQ(cache.size(), 0);
+  EXPECT(cache.getReader(files[1]).get() != cache.getReader(files[1]).get());
+
+  /* repeated scans reuse the mapped tables */
+  for (int j = 0; j < 2; ++j) {
+    int n = 0;
+    metric.scanSamples(
+        util::DateTime::epoch(),
+        util::DateTime::now(),
+        [&n] (Sample* sample) -> bool {
+          EXPECT_EQ(sample->value(), n);
+          n++;
+          return true;
+        });
+
+    EXPECT_EQ(n, 2000);
+    EXPECT(TableReaderCache::get()->size() >= metric.numTables() - 1);
+  }
+});
+
+TEST_CASE(DiskBackendTest, TestParallelScan, [] () {
+  io::FileUtil::mkdir_p(kTestRepoPath);
+  FileRepository file_repo(kTestRepoPath);
+  file_repo.deleteAllFiles();
+
+  /* the pool's threads outlive the test, so the pool is never freed */
+  auto thread_pool = new fnord::thread::ThreadPool(
+      std::unique_ptr<fnord::util::ExceptionHandler>(
+          new fnord::util::CatchAndAbortExceptionHandler("crashed")));
+
+  Metric metric("myninthmetric", &file_repo);
+  metric.setLiveTableMaxSize(2 << 11); /* 4KB */
+  metric.setLiveTableIdleTimeMicros(0);
+  metric.setParallelScan(thread_pool, 3);
+
+  LabelListType smpl_labels;
+  smpl_labels.emplace_back("host", "myhost");
+
+  /* distinct timestamps, so that every 1us rollup holds a single sample */
+  for (int i = 0; i < 20000; ++i) {
+    NewSample sample;
+    sample.time = 1000000 + i;
+    sample.value = i;
+    sample.labels = smpl_labels;
+    metric.insertSamples(&sample, 1);
+  }
+
+  metric.compact();
+  EXPECT(metric.numTables() > 16);
+
+  int n = 0;
+  metric.scanSamples(
+      util::DateTime::epoch(),
+      util::DateTime::now(),
+      [&n] (Sample* sample) -> bool {
+        EXPECT_EQ(sample->value(), n);
+        EXPECT_EQ(sample->labels().size(), 1);
+        EXPECT_EQ(sample->labels()[0].second, "myhost");
+        n++;
+        return true;
+      });
+
+  EXPECT_EQ(n, 20000);
+
+  /* stopping the scan early cancels the prefetching */
+  n = 0;
+  metric.scanRollups(
+      util::DateTime::epoch(),
+      util::DateTime::now(),
+      1,
+      [&n] (RollupSample* sample) -> bool {
+        EXPECT_EQ(sample->value.sum, n);
+        return ++n < 100;
+      });
+
+  EXPECT_EQ(n, 100);
+});
+
+TEST_CASE(DiskBackendTest, TestCompressedBlocks, [] () {
+  TokenIndex token_index;
+  std::vector<uint64_t> times;
+  std::vector<std::string> samples;
+
+  uint64_t time = 1414000000000000llu;
+  for (int i = 0; i < 1000; ++i) {
+    /* regular intervals with jitter, duplicates and large gaps */
+    if (i % 100 == 99) {
+      time += 1llu << 40;
+    } else if (i % 7 != 0) {
+      time += 10000000 + (i * 7919) % 2000;
+    }
+
+    SampleWriter writer(&token_index);
+    if (i % 3 == 0) {
+      writer.writeValue<double>(42.0);
+    } else {
+      writer.writeValue<double>(i * 0.1 - 17);
+    }
+
+    writer.writeLabel("host", i % 2 == 0 ? "host1" : "host2");
+    if (i % 5 == 0) {
+      writer.writeLabel("dc", "dc1");
+    }
+
+    times.emplace_back(time);
+    samples.emplace_back(static_cast<char*>(writer.data()), writer.size());
+  }
+
+  CompressedBlockWriter block_writer(1);
+  for (int i = 0; i < times.size(); ++i) {
+    block_writer.addRow(times[i], samples[i].data(), samples[i].size());
+  }
+
+  EXPECT_EQ(block_writer.numRows(), 1000);
+  EXPECT_EQ(block_writer.minTime(), times.front());
+  EXPECT_EQ(block_writer.maxTime(), times.back());
+
+  fnord::util::BinaryMessageWriter block;
+  block_writer.writeBlock(&block);
+  EXPECT_EQ(block_writer.numRows(), 0);
+
+  size_t raw_size = 0;
+  for (const auto& sample : samples) {
+    raw_size += sample.size() + sizeof(uint64_t);
+  }
+
+  EXPECT(block.size() < raw_size / 2);
+
+  CompressedBlockReader block_reader(block.data(), block.size());
+  EXPECT_EQ(block_reader.numRows(), 1000);
+
+  uint64_t read_time;
+  std::string read_sample;
+  for (int i = 0; i < times.size(); ++i) {
+    EXPECT(block_reader.readRow(&read_time, &read_sample));
+    EXPECT_EQ(read_time, times[i]);
+    EXPECT(read_sample == samples[i]);
+  }
+
+  EXPECT(!block_reader.readRow(&read_time, &read_sample));
+});
+
+TEST_CASE(DiskBackendTest, TestCompressedCompaction, [] () {
+  io::FileUtil::mkdir_p(kTestRepoPath);
+  FileRepository file_repo(kTestRepoPath);
+  file_repo.deleteAllFiles();
+
+  Metric metric("mytenthmetric", &file_repo);
+  metric.setLiveTableMaxSize(2 << 11); /* 4KB */
+  metric.setLiveTableIdleTimeMicros(0);
+
+  /* a gauge with one sample per host every 10s */
+  uint64_t base = fnord::util::WallClock::unixMicros() - 86400 * 1000000llu;
+  std::vector<NewSample> samples;
+  for (int i = 0; i < 5000; ++i) {
+    for (int host = 0; host < 2; ++host) {
+      NewSample sample;
+      sample.time = base + i * 10 * 1000000llu;
+      sample.value = host == 0 ? 1.5 : i % 10;
+      sample.labels.emplace_back("host", host == 0 ? "host1" : "host2");
+      samples.emplace_back(sample);
+    }
+
+    if (samples.size() == 100) {
+      metric.insertSamples(samples);
+      samples.clear();
+    }
+  }
+
+  metric.compact();
+
+  auto raw_bytes = metric.totalBytes();
+  SizeTieredCompactionPolicy policy;
+  for (int i = 0; i < 5; ++i) {
+    metric.compact(&policy);
+  }
+
+  EXPECT(metric.totalBytes() < raw_bytes / 8);
+
+  auto check_samples = [base] (Metric* metric) {
+    int n = 0;
+    metric->scanSamples(
+        util::DateTime(base + 100 * 10 * 1000000llu),
+        util::DateTime::now(),
+        [&n, base] (Sample* sample) -> bool {
+          auto i = 100 + n / 2;
+          EXPECT_EQ(
+              static_cast<uint64_t>(sample->time()),
+              base + i * 10 * 1000000llu);
+          EXPECT_EQ(sample->labels().size(), 1);
+          if (sample->labels()[0].second == "host1") {
+            EXPECT_EQ(sample->value(), 1.5);
+          } else {
+            EXPECT_EQ(sample->value(), i % 10);
+          }
+          n++;
+          return true;
+        });
+
+    EXPECT_EQ(n, 9800);
+  };
+
+  check_samples(&metric);
+
+  /* the row format is stored in the table header */
+  std::vector<std::unique_ptr<TableRef>> tables;
+  file_repo.listFiles([&tables] (const std::string& filename) -> bool {
+    fnord::sstable::SSTableRepair repair(filename);
+    EXPECT(repair.checkAndRepair(true));
+    tables.emplace_back(TableRef::openTable(filename));
+    return true;
+  });
+
+  int num_compressed = 0;
+  for (const auto& table : tables) {
+    if (table->rowFormat() == TableRef::kCompressedBlocks) {
+      num_compressed++;
+    }
+  }
+
+  EXPECT(num_compressed > 0);
+
+  Metric reopened_metric("mytenthmetric", &file_repo, std::move(tables));
+  check_samples(&reopened_metric);
+});
+
+TEST_CASE(DiskBackendTest, TestSeriesPartitioning, [] () {
+  io::FileUtil::mkdir_p(kTestRepoPath);
+  FileRepository file_repo(kTestRepoPath);
+  file_repo.deleteAllFiles();
+
+  Metric metric("myeleventhmetric", &file_repo);
+  metric.setLiveTableMaxSize(2 << 11); /* 4KB */
+  metric.setLiveTableIdleTimeMicros(0);
+  metric.setSeriesPartitioning(true);
+
+  uint64_t base = fnord::util::WallClock::unixMicros() - 86400 * 1000000llu;
+  std::vector<NewSample> samples;
+  for (int i = 0; i < 2000; ++i) {
+    for (int host = 0; host < 3; ++host) {
+      NewSample sample;
+      sample.time = base + i * 1000000llu;
+      sample.value = host * 10000 + i;
+      /* the order of the labels must not matter */
+      if (i % 2 == 0) {
+        sample.labels.emplace_back("host", "host" + std::to_string(host));
+        sample.labels.emplace_back("dc", "dc1");
+      } else {
+        sample.labels.emplace_back("dc", "dc1");
+        sample.labels.emplace_back("host", "host" + std::to_string(host));
+      }
+      samples.emplace_back(sample);
+    }
+
+    if (samples.size() == 150) {
+      metric.insertSamples(samples);
+      samples.clear();
+    }
+  }
+
+  metric.compact();
+
+  SizeTieredCompactionPolicy policy;
+  for (int i = 0; i < 5; ++i) {
+    metric.compact(&policy);
+  }
+
+  auto check_samples = [base] (Metric* metric) {
+    int n = 0;
+    uint64_t last_time = 0;
+    metric->scanSamples(
+        util::DateTime(base),
+        util::DateTime::now(),
+        [&n, &last_time] (Sample* sample) -> bool {
+          auto time = static_cast<uint64_t>(sample->time());
+          EXPECT(time >= last_time);
+          EXPECT_EQ(sample->labels().size(), 2);
+          last_time = time;
+          n++;
+          return true;
+        });
+
+    EXPECT_EQ(n, 6000);
+
+    LabelFilter filter;
+    std::set<std::string> hosts;
+    hosts.insert("host2");
+    filter.addCondition("host", hosts);
+
+    int i = 0;
+    metric->scanSamples(
+        util::DateTime(base),
+        util::DateTime::now(),
+        filter,
+        [&i, base] (Sample* sample) -> bool {
+          EXPECT_EQ(
+              static_cast<uint64_t>(sample->time()),
+              base + i * 1000000llu);
+          EXPECT_EQ(sample->value(), 20000 + i);
+          i++;
+          return true;
+        });
+
+    EXPECT_EQ(i, 2000);
+
+    LabelFilter in_filter;
+    std::set<std::string> in_hosts;
+    in_hosts.insert("host0");
+    in_hosts.insert("host1");
+    in_hosts.insert("host7");
+    in_filter.addCondition("host", in_hosts);
+
+    int m = 0;
+    metric->scanSamples(
+        util::DateTime(base),
+        util::DateTime::now(),
+        in_filter,
+        [&m] (Sample* sample) -> bool {
+          EXPECT(sample->value() < 20000);
+          m++;
+          return true;
+        });
+
+    EXPECT_EQ(m, 4000);
+  };
+
+  check_samples(&metric);
+
+  std::vector<std::unique_ptr<TableRef>> tables;
+  file_repo.listFiles([&tables] (const std::string& filename) -> bool {
+    fnord::sstable::SSTableRepair repair(filename);
+    EXPECT(repair.checkAndRepair(true));
+    tables.emplace_back(TableRef::openTable(filename));
+    return true;
+  });
+
+  TokenIndex token_index;
+  LabelIndex label_index;
+  LabelFilter filter;
+  std::set<std::string> hosts;
+  hosts.insert("host1");
+  filter.addCondition("host", hosts);
+
+  int num_partitioned = 0;
+  for (const auto& reopened_table : tables) {
+    if (reopened_table->rowFormat() != TableRef::kSeriesBlocks) {
+      continue;
+    }
+
+    num_partitioned++;
+    auto table = TableRef::openTable(reopened_table->filename());
+    table->import(&token_index, &label_index);
+
+    const auto& series = table->seriesIndex().series();
+    EXPECT_EQ(series.size(), 3);
+    for (size_t i = 1; i < series.size(); ++i) {
+      EXPECT(series[i - 1].series_id < series[i].series_id);
+      EXPECT(series[i - 1].body_end <= series[i].body_begin);
+    }
+
+    /* a filtered cursor only returns the samples of the matching series */
+    auto cursor = table->cursorFrom(0, &filter);
+    while (cursor->valid()) {
+      void* data;
+      size_t size;
+      cursor->getData(&data, &size);
+
+      SampleReader<double> sample(data, size, &token_index);
+      EXPECT_EQ(sample.labels().size(), 2);
+      EXPECT_EQ(sample.labels()[0].second, "dc1");
+      EXPECT_EQ(sample.labels()[1].second, "host1");
+
+      if (!cursor->next()) {
+        break;
+      }
+    }
+  }
+
+  EXPECT(num_partitioned > 0);
+
+  Metric reopened_metric("myeleventhmetric", &file_repo, std::move(tables));
+  check_samples(&reopened_metric);
+});
+
+TEST_CASE(DiskBackendTest, TestPostingsIndex, [] () {
+  PostingsIndex index;
+  index.addPosting("host", "web1", 10);
+  index.addPosting("host", "web1", 30);
+  index.addPosting("host", "web2", 20);
+  index.addPosting("host", "web2", 30);
+  index.addPosting("dc", "dc1", 20);
+  index.addPosting("dc", "dc1", 30);
+  index.addPosting("dc", "dc1", 30);
+
+  EXPECT(index.postings("host", "web3") == nullptr);
+  EXPECT_EQ(index.postings("dc", "dc1")->size(), 2);
+
+  LabelFilter filter;
+  std::set<std::string> hosts;
+  hosts.insert("web1");
+  hosts.insert("web2");
+  filter.addCondition("host", hosts);
+
+  auto rows = index.findRows(filter);
+  EXPECT_EQ(rows.size(), 3);
+  EXPECT_EQ(rows[0], 10);
+  EXPECT_EQ(rows[1], 20);
+  EXPECT_EQ(rows[2], 30);
+
+  std::set<std::string> dcs;
+  dcs.insert("dc1");
+  filter.addCondition("dc", dcs);
+
+  rows = index.findRows(filter);
+  EXPECT_EQ(rows.size(), 2);
+  EXPECT_EQ(rows[0], 20);
+  EXPECT_EQ(rows[1], 30);
+
+  io::FileUtil::mkdir_p(kTestRepoPath);
+  FileRepository file_repo(kTestRepoPath);
+  file_repo.deleteAllFiles();
+
+  Metric metric("mytwelfthmetric", &file_repo);
+  metric.setLiveTableMaxSize(2 << 13); /* 16KB */
+  metric.setLiveTableIdleTimeMicros(0);
+
+  /* each host reports in bursts of 5000 samples */
+  uint64_t base = fnord::util::WallClock::unixMicros() - 86400 * 1000000llu;
+  for (int burst = 0; burst < 8; ++burst) {
+    std::vector<NewSample> samples;
+    for (int i = 0; i < 5000; ++i) {
+      NewSample sample;
+      sample.time = base + (burst * 5000 + i) * 1000000llu;
+      sample.value = burst;
+      sample.labels.emplace_back("host", "host" + std::to_string(burst % 4));
+      samples.emplace_back(sample);
+    }
+
+    metric.insertSamples(samples);
+  }
+
+  auto check_samples = [base] (Metric* metric) {
+    LabelFilter filter;
+    std::set<std::string> hosts;
+    hosts.insert("host1");
+    filter.addCondition("host", hosts);
+
+    int n = 0;
+    metric->scanSamples(
+        util::DateTime(base),
+        util::DateTime::now(),
+        filter,
+        [&n] (Sample* sample) -> bool {
+          EXPECT_EQ(sample->labels()[0].second, "host1");
+          EXPECT(sample->value() == 1 || sample->value() == 5);
+          n++;
+          return true;
+        });
+
+    EXPECT_EQ(n, 10000);
+  };
+
+  check_samples(&metric);
+
+  SizeTieredCompactionPolicy policy;
+  metric.compact(&policy);
+  check_samples(&metric);
+
+  std::vector<std::unique_ptr<TableRef>> tables;
+  file_repo.listFiles([&tables] (const std::string& filename) -> bool {
+    fnord::sstable::SSTableRepair repair(filename);
+    EXPECT(repair.checkAndRepair(true));
+    tables.emplace_back(TableRef::openTable(filename));
+    return true;
+  });
+
+  Metric reopened_metric("mytwelfthmetric", &file_repo, std::move(tables));
+  check_samples(&reopened_metric);
+
+  /* filtered table cursors skip the rows (or blocks) without host2 samples */
+  LabelFilter host_filter;
+  std::set<std::string> host2;
+  host2.insert("host2");
+  host_filter.addCondition("host", host2);
+
+  int num_rows = 0;
+  int num_filtered_rows = 0;
+  int num_host2_rows = 0;
+  file_repo.listFiles([&] (const std::string& filename) -> bool {
+    auto table = TableRef::openTable(filename);
+    TokenIndex token_index;
+    LabelIndex label_index;
+    table->import(&token_index, &label_index);
+
+    if (table->postingsIndex() == nullptr) {
+      return true;
+    }
+
+    auto count_rows = [&token_index] (
+        sstable::Cursor* cursor,
+        int* host2_rows) -> int {
+      int n = 0;
+      while (cursor->valid()) {
+        void* data;
+        size_t size;
+        cursor->getData(&data, &size);
+
+        SampleReader<double> sample(data, size, &token_index);
+        if (sample.labels()[0].second == "host2") {
+          (*host2_rows)++;
+        }
+
+        n++;
+        if (!cursor->next()) {
+          break;
+        }
+      }
+
+      return n;
+    };
+
+    int host2_rows = 0;
+    num_rows += count_rows(table->cursor().get(), &host2_rows);
+    num_filtered_rows += count_rows(
+        table->cursorFrom(0, &host_filter).get(),
+        &num_host2_rows);
+
+    EXPECT_EQ(num_host2_rows, host2_rows);
+    return true;
+  });
+
+  EXPECT_EQ(num_host2_rows, 10000);
+  EXPECT(num_filtered_rows < num_rows);
+});
+
+TEST_CASE(DiskBackendTest, TestConcurrentTokenIndex, [] () {
+  TokenIndex token_index;
+  EXPECT_EQ(token_index.findToken("token-0"), 0);
+
+  /* all threads add the same tokens in different orders and resolve them */
+  std::vector<std::thread> threads;
+  std::vector<std::vector<uint32_t>> ids(4);
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&token_index, &ids, t] () {
+      ids[t].resize(10000);
+
+      for (int i = 0; i < 10000; ++i) {
+        auto n = (i * 7 + t * 2500) % 10000;
+        auto token = "token-" + std::to_string(n);
+        auto id = token_index.findOrAddToken(token);
+        ids[t][n] = id;
+
+        if (token_index.resolveToken(id) != token) {
+          RAISE(kRuntimeError, "token resolved to the wrong string");
+        }
+      }
+    });
+  }
+
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  std::set<uint32_t> distinct_ids;
+  for (int i = 0; i < 10000; ++i) {
+    auto token = "token-" + std::to_string(i);
+    EXPECT_EQ(token_index.findToken(token), ids[0][i]);
+    EXPECT_EQ(token_index.resolveToken(ids[0][i]), token);
+
+    for (int t = 1; t < 4; ++t) {
+      EXPECT_EQ(ids[t][i], ids[0][i]);
+    }
+
+    distinct_ids.insert(ids[0][i]);
+  }
+
+  EXPECT_EQ(distinct_ids.size(), 10000);
+  EXPECT_EQ(token_index.tokenIDs().size(), 10000);
+
+  /* ids read from a token index footer may be sparse */
+  TokenIndex loaded_index;
+  uint32_t loaded_id = TokenIndex::kMinTokenID + 1000000;
+  loaded_index.addToken("foo", loaded_id);
+  loaded_index.addToken("foo", loaded_id);
+  EXPECT_EQ(loaded_index.resolveToken(loaded_id), "foo");
+  EXPECT_EQ(loaded_index.addToken("bar"), loaded_id + 1);
+
+  bool raised = false;
+  try {
+    loaded_index.addToken("baz", loaded_id);
+  } catch (const fnordmetric::util::RuntimeException& e) {
+    raised = true;
+  }
+
+  EXPECT(raised);
+});
+
+class CountingLabelSource : public SampleLabelSource {
+public:
+  CountingLabelSource() : num_decodes(0) {
+    labels_.emplace_back("host", "myhost");
+    label_refs_.emplace_back(
+        LabelRef(labels_[0].first),
+        LabelRef(labels_[0].second));
+  }
+
+  const LabelRefList& labelRefs() override {
+    ++num_decodes;
+    return label_refs_;
+  }
+
+  const std::vector<std::pair<std::string, std::string>>& labels() override {
+    ++num_decodes;
+    return labels_;
+  }
+
+  int num_decodes;
+
+protected:
+  LabelListType labels_;
+  LabelRefList label_refs_;
+};
+
+TEST_CASE(DiskBackendTest, TestLabelRefs, [] () {
+  io::FileUtil::mkdir_p(kTestRepoPath);
+  FileRepository file_repo(kTestRepoPath);
+  file_repo.deleteAllFiles();
+
+  /* labels are only decoded when they are accessed */
+  CountingLabelSource label_source;
+  Sample lazy_sample(util::DateTime::epoch(), 23, &label_source);
+  EXPECT_EQ(lazy_sample.value(), 23);
+  EXPECT_EQ(label_source.num_decodes, 0);
+
+  LabelRef host;
+  EXPECT(lazy_sample.findLabel("host", &host));
+  EXPECT_EQ(host.toString(), "myhost");
+  EXPECT(!lazy_sample.findLabel("dc", &host));
+  EXPECT(label_source.num_decodes > 0);
+
+  Metric metric("mylabelrefmetric", &file_repo);
+  metric.setLiveTableMaxSize(2 << 11); /* 4KB */
+  metric.setLiveTableIdleTimeMicros(0);
+
+  for (int i = 0; i < 5000; ++i) {
+    LabelListType smpl_labels;
+    smpl_labels.emplace_back("host", "host" + std::to_string(i % 3));
+    metric.insertSample(i, smpl_labels);
+
+    if (i == 2500) {
+      metric.compact();
+    }
+  }
+
+  int n = 0;
+  metric.scanSamples(
+      util::DateTime::epoch(),
+      std::numeric_limits<util::DateTime>::max(),
+      [&n] (Sample* sample) -> bool {
+        const auto& refs = sample->labelRefs();
+        EXPECT_EQ(refs.size(), 1);
+        EXPECT(refs[0].first == std::string("host"));
+        EXPECT_EQ(refs[0].second.toString(), "host" + std::to_string(n % 3));
+        EXPECT_EQ(sample->labels()[0].second, refs[0].second.toString());
+
+        LabelRef value;
+        EXPECT(sample->findLabel("host", &value));
+        EXPECT(value == refs[0].second);
+        n++;
+        return true;
+      });
+
+  EXPECT_EQ(n, 5000);
+});
+
+TEST_CASE(DiskBackendTest, TestProjectedScan, [] () {
+  io::FileUtil::mkdir_p(kTestRepoPath);
+  FileRepository file_repo(kTestRepoPath);
+  file_repo.deleteAllFiles();
+
+  Metric metric("myprojectedmetric", &file_repo);
+  metric.setLiveTableMaxSize(2 << 11); /* 4KB */
+  metric.setLiveTableIdleTimeMicros(0);
+
+  for (int i = 0; i < 3000; ++i) {
+    LabelListType smpl_labels;
+    smpl_labels.emplace_back("host", "host" + std::to_string(i % 2));
+    smpl_labels.emplace_back("dc", "dc1");
+    metric.insertSample(i, smpl_labels);
+  }
+
+  metric.compact();
+
+  /* only the values */
+  SampleProjection value_projection;
+  value_projection.setLabels(std::set<std::string>());
+  EXPECT(!value_projection.hasLabels());
+
+  int n = 0;
+  metric.scanSamples(
+      util::DateTime::epoch(),
+      util::DateTime::now(),
+      LabelFilter(),
+      value_projection,
+      [&n] (Sample* sample) -> bool {
+        EXPECT_EQ(sample->value(), n);
+        EXPECT_EQ(sample->labels().size(), 0);
+        EXPECT_EQ(sample->labelRefs().size(), 0);
+        n++;
+        return true;
+      });
+
+  EXPECT_EQ(n, 3000);
+
+  /* only the times of the samples that match a filter */
+  SampleProjection time_projection;
+  time_projection.setValue(false);
+  time_projection.setLabels(std::set<std::string>());
+
+  LabelFilter filter;
+  std::set<std::string> host1;
+  host1.insert("host1");
+  filter.addCondition("host", host1);
+
+  n = 0;
+  metric.scanSamples(
+      util::DateTime::epoch(),
+      util::DateTime::now(),
+      filter,
+      time_projection,
+      [&n] (Sample* sample) -> bool {
+        EXPECT_EQ(sample->labels().size(), 0);
+        n++;
+        return true;
+      });
+
+  EXPECT_EQ(n, 1500);
+
+  /* a single label */
+  SampleProjection label_projection;
+  std::set<std::string> host_label;
+  host_label.insert("host");
+  label_projection.setLabels(host_label);
+  EXPECT(label_projection.hasLabel("host"));
+  EXPECT(!label_projection.hasLabel("dc"));
+
+  n = 0;
+  metric.scanSamples(
+      util::DateTime::epoch(),
+      util::DateTime::now(),
+      LabelFilter(),
+      label_projection,
+      [&n] (Sample* sample) -> bool {
+        LabelRef value;
+        EXPECT(sample->findLabel("host", &value));
+        EXPECT_EQ(value.toString(), "host" + std::to_string(n % 2));
+        n++;
+        return true;
+      });
+
+  EXPECT_EQ(n, 3000);
+});
+
+class TimeRangeRecordingMetric : public Metric {
+public:
+  TimeRangeRecordingMetric(
+      const std::string& key,
+      io::FileRepository* file_repo) :
+      Metric(key, file_repo),
+      scanned_begin(0),
+      scanned_end(0) {}
+
+  using Metric::scanSamples;
+
+  void scanSamples(
+      const fnord::util::DateTime& time_begin,
+      const fnord::util::DateTime& time_end,
+      const LabelFilter& filter,
+      const SampleProjection& projection,
+      std::function<bool (Sample* sample)> callback) override {
+    scanned_begin = static_cast<uint64_t>(time_begin);
+    scanned_end = static_cast<uint64_t>(time_end);
+    Metric::scanSamples(time_begin, time_end, filter, projection, callback);
+  }
+
+  uint64_t scanned_begin;
+  uint64_t scanned_end;
+};
+
+TEST_CASE(DiskBackendTest, TestTimeRangePushdown, [] () {
+  io::FileUtil::mkdir_p(kTestRepoPath);
+  FileRepository file_repo(kTestRepoPath);
+  file_repo.deleteAllFiles();
+
+  TimeRangeRecordingMetric metric("mytimerangemetric", &file_repo);
+
+  uint64_t start_time = 1414000000000000llu;
+  std::vector<NewSample> samples(1000);
+  for (int i = 0; i < 1000; ++i) {
+    samples[i].time = start_time + i * 1000000llu;
+    samples[i].value = i;
+    samples[i].labels.emplace_back("host", "myhost");
+  }
+
+  metric.insertSamples(samples);
+
+  auto run_query = [&metric] (const char* query_str) -> int {
+    fnordmetric::query::DefaultRuntime runtime;
+    fnordmetric::query::TableRepository table_repo;
+    fnordmetric::query::QueryPlan query_plan(&table_repo);
+    query_plan.tableRepository()->addTableRef(
+        "mytimerangemetric",
+        std::unique_ptr<fnordmetric::query::TableRef>(
+            new MetricTableRef(&metric)));
+
+    auto ast = runtime.parser()->parseQuery(query_str);
+    runtime.queryPlanBuilder()->buildQueryPlan(ast, &query_plan);
+
+    fnordmetric::query::ResultList result;
+    auto query_plan_node = query_plan.queries()[0].get();
+    query_plan_node->setTarget(&result);
+    query_plan_node->execute();
+    return result.getNumRows();
+  };
+
+  /* "the last 100 seconds" */
+  auto num_rows = run_query(
+      "SELECT value FROM mytimerangemetric"
+      "    WHERE time >= FROM_TIMESTAMP(1414000900) AND host = 'myhost';");
+
+  EXPECT_EQ(num_rows, 100);
+  EXPECT_EQ(metric.scanned_begin, 1414000900000000llu);
+
+  /* bounds on both sides, in both operand orders */
+  num_rows = run_query(
+      "SELECT value FROM mytimerangemetric"
+      "    WHERE FROM_TIMESTAMP(1414000150) > time"
+      "    AND time > 1414000100000000"
+      "    AND time <= FROM_TIMESTAMP(1414000160);");
+
+  EXPECT_EQ(num_rows, 49);
+  EXPECT_EQ(metric.scanned_begin, 1414000100000001llu);
+  EXPECT_EQ(metric.scanned_end, 1414000150000000llu);
+
+  /* bounds inside of a disjunction are not pushed down */
+  num_rows = run_query(
+      "SELECT value FROM mytimerangemetric"
+      "    WHERE time < FROM_TIMESTAMP(1414000010)"
+      "    OR time >= FROM_TIMESTAMP(1414000990);");
+
+  EXPECT_EQ(num_rows, 20);
+  EXPECT_EQ(metric.scanned_begin, 0);
+});
+
+class RollupRangeRecordingMetric : public Metric {
+public:
+  RollupRangeRecordingMetric(
+      const std::string& key,
+      io::FileRepository* file_repo) :
+      Metric(key, file_repo),
+      scanned_begin(0),
+      scanned_end(0),
+      scanned_filter(false) {}
+
+  using Metric::scanRollups;
+
+  void scanRollups(
+      const fnord::util::DateTime& time_begin,
+      const fnord::util::DateTime& time_end,
+      const LabelFilter& filter,
+      uint64_t resolution,
+      std::function<bool (RollupSample* sample)> callback) override {
+    scanned_begin = static_cast<uint64_t>(time_begin);
+    scanned_end = static_cast<uint64_t>(time_end);
+    scanned_filter = !filter.empty();
+    Metric::scanRollups(time_begin, time_end, filter, resolution, callback);
+  }
+
+  uint64_t scanned_begin;
+  uint64_t scanned_end;
+  bool scanned_filter;
+};
+
+TEST_CASE(DiskBackendTest, TestRollupRangePushdown, [] () {
+  io::FileUtil::mkdir_p(kTestRepoPath);
+  FileRepository file_repo(kTestRepoPath);
+  file_repo.deleteAllFiles();
+
+  RollupRangeRecordingMetric metric("myrolluprangemetric", &file_repo);
+
+  /* the start time is a multiple of the resolution */
+  uint64_t start_time = 1413999960000000llu;
+  std::vector<NewSample> samples(1000);
+  for (int i = 0; i < 1000; ++i) {
+    samples[i].time = start_time + i * 1000000llu;
+    samples[i].value = i;
+    samples[i].labels.emplace_back("host", i % 2 ? "b" : "a");
+  }
+
+  metric.insertSamples(samples);
+
+  auto run_query = [&metric] (
+      const char* query_str,
+      fnordmetric::query::ResultList* result) {
+    fnordmetric::query::DefaultRuntime runtime;
+    fnordmetric::query::TableRepository table_repo;
+    fnordmetric::query::QueryPlan query_plan(&table_repo);
+    query_plan.tableRepository()->addTableRef(
+        "myrolluprangemetric",
+        std::unique_ptr<fnordmetric::query::TableRef>(
+            new MetricRollupTableRef(&metric, 60 * 1000000llu)));
+
+    auto ast = runtime.parser()->parseQuery(query_str);
+    runtime.queryPlanBuilder()->buildQueryPlan(ast, &query_plan);
+
+    auto query_plan_node = query_plan.queries()[0].get();
+    query_plan_node->setTarget(result);
+    query_plan_node->execute();
+  };
+
+  /* the range is widened to whole windows */
+  fnordmetric::query::ResultList result;
+  run_query(
+      "SELECT value_count, host FROM myrolluprangemetric"
+      "    WHERE time >= FROM_TIMESTAMP(1414000560)"
+      "    AND time < FROM_TIMESTAMP(1414000590)"
+      "    AND host = 'a';",
+      &result);
+
+  EXPECT_EQ(result.getNumRows(), 1);
+  EXPECT_EQ(result.getRow(0)[0], "30");
+  EXPECT_EQ(result.getRow(0)[1], "a");
+  EXPECT_EQ(metric.scanned_begin, 1414000560000000llu);
+  EXPECT_EQ(metric.scanned_end, 1414000620000000llu);
+  EXPECT(metric.scanned_filter);
+});
+
+TEST_CASE(DiskBackendTest, TestRollupTableColumns, [] () {
+  io::FileUtil::mkdir_p(kTestRepoPath);
+  FileRepository file_repo(kTestRepoPath);
+  file_repo.deleteAllFiles();
+
+  Metric metric("myrollupcolumnsmetric", &file_repo);
+  LabelListType smpl_labels;
+  smpl_labels.emplace_back("host", "myhost");
+  metric.insertSample(23, smpl_labels);
+
+  /* a label that is referenced twice is a single column */
+  MetricRollupTableRef table_ref(&metric, 60 * 1000000llu);
+  auto index = table_ref.getColumnIndex("host");
+  EXPECT_EQ(index, 5);
+  EXPECT_EQ(table_ref.getColumnIndex("host"), index);
+  EXPECT_EQ(table_ref.getColumnName(index), "host");
+  EXPECT_EQ(table_ref.columns().size(), 6);
+  EXPECT_EQ(table_ref.getColumnIndex("dc"), -1);
+});
+
+TEST_CASE(DiskBackendTest, TestStopAndReverseScan, [] () {
+  io::FileUtil::mkdir_p(kTestRepoPath);
+  FileRepository file_repo(kTestRepoPath);
+  file_repo.deleteAllFiles();
+
+  Metric metric("myreversemetric", &file_repo);
+  metric.setLiveTableMaxSize(2 << 11); /* 4KB */
+  metric.setLiveTableIdleTimeMicros(0);
+
+  /* one sample per second, spread over several tables */
+  uint64_t start_time = 1414000000000000llu;
+  for (int i = 0; i < 10000; ++i) {
+    NewSample sample;
+    sample.time = start_time + i * 1000000llu;
+    sample.value = i;
+    sample.labels.emplace_back("host", "myhost");
+    metric.insertSamples(&sample, 1);
+
+    if (i % 2500 == 0) {
+      metric.compact();
+    }
+  }
+
+  /* the scan stops when the callback returns false */
+  int n = 0;
+  metric.scanSamples(
+      util::DateTime::epoch(),
+      util::DateTime::now(),
+      [&n] (Sample* sample) -> bool {
+        EXPECT_EQ(sample->value(), n);
+        return ++n < 10;
+      });
+
+  EXPECT_EQ(n, 10);
+
+  /* the last 25 samples, newest first */
+  n = 0;
+  metric.scanSamplesReverse(
+      util::DateTime::epoch(),
+      util::DateTime::now(),
+      [&n] (Sample* sample) -> bool {
+        EXPECT_EQ(sample->value(), 9999 - n);
+        EXPECT_EQ(sample->labels()[0].second, "myhost");
+        return ++n < 25;
+      });
+
+  EXPECT_EQ(n, 25);
+
+  /* all samples in a time range, newest first */
+  n = 0;
+  metric.scanSamplesReverse(
+      start_time + 1000 * 1000000llu,
+      start_time + 9000 * 1000000llu,
+      [&n, start_time] (Sample* sample) -> bool {
+        EXPECT_EQ(sample->value(), 8999 - n);
+        EXPECT_EQ(
+            static_cast<uint64_t>(sample->time()),
+            start_time + (8999 - n) * 1000000llu);
+        ++n;
+        return true;
+      });
+
+  EXPECT_EQ(n, 8000);
+});
+
+TEST_CASE(DiskBackendTest, TestConcurrentSnapshotAccess, [] () {
+  io::FileUtil::mkdir_p(kTestRepoPath);
+  FileRepository file_repo(kTestRepoPath);
+  file_repo.deleteAllFiles();
+
+  Metric metric("mysnapshotmetric", &file_repo);
+  metric.setLiveTableMaxSize(2 << 11); /* 4KB */
+  metric.setLiveTableIdleTimeMicros(0);
+
+  /* the head snapshot is created by the first insert */
+  LabelListType first_labels;
+  first_labels.emplace_back("host", "myhost");
+  metric.insertSample(0, first_labels);
+
+  /* writers rotate the live table while readers scan the head snapshot */
+  std::atomic<int> writers_running(2);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 2; ++t) {
+    threads.emplace_back([&metric, &writers_running] () {
+      LabelListType smpl_labels;
+      smpl_labels.emplace_back("host", "myhost");
+
+      for (int i = 0; i < 5000; ++i) {
+        metric.insertSample(i, smpl_labels);
+      }
+
+      --writers_running;
+    });
+  }
+
+  int num_scans = 0;
+  int last_count = 0;
+  while (writers_running > 0) {
+    int count = 0;
+    metric.scanSamples(
+        util::DateTime::epoch(),
+        util::DateTime::now(),
+        [&count] (Sample* sample) -> bool {
+          ++count;
+          return true;
+        });
+
+    /* samples are never lost between snapshots */
+    EXPECT(count >= last_count);
+    EXPECT(metric.numTables() > 0);
+    last_count = count;
+    ++num_scans;
+  }
+
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  metric.compact();
+
+  int n = 0;
+  metric.scanSamples(
+      util::DateTime::epoch(),
+      std::numeric_limits<util::DateTime>::max(),
+      [&n] (Sample* sample) -> bool {
+        ++n;
+        return true;
+      });
+
+  EXPECT_EQ(n, 10001);
+  EXPECT(num_scans > 0);
+});
+
+TEST_CASE(DiskBackendTest, TestConcurrentMetricRepository, [] () {
+  inmemory_backend::MetricRepository metric_repo;
+  EXPECT(metric_repo.findMetric("metric-0") == nullptr);
+
+  /* enough metrics to grow the hash table a few times while it is read */
+  const int kNumMetrics = 5000;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&metric_repo, kNumMetrics] () {
+      for (int i = 0; i < kNumMetrics; ++i) {
+        auto key = "metric-" + std::to_string(i);
+        auto metric = metric_repo.findOrCreateMetric(key);
+        EXPECT(metric != nullptr);
+        EXPECT_EQ(metric->key(), key);
+        EXPECT(metric_repo.findMetric(key) == metric);
+        EXPECT(metric_repo.listMetrics().size() > 0);
+      }
+    });
+  }
+
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  EXPECT_EQ(metric_repo.listMetrics().size(), kNumMetrics);
+  for (int i = 0; i < kNumMetrics; ++i) {
+    auto key = "metric-" + std::to_string(i);
+    auto metric = metric_repo.findMetric(key);
+    EXPECT(metric != nullptr);
+    EXPECT_EQ(metric->key(), key);
+    EXPECT(metric_repo.findOrCreateMetric(key) == metric);
+  }
+});
+
+TEST_CASE(DiskBackendTest, TestLazyReopen, [] () {
+  io::FileUtil::mkdir_p(kTestRepoPath);
+  FileRepository file_repo(kTestRepoPath);
+  file_repo.deleteAllFiles();
+
+  {
+    Metric metric("mylazymetric", &file_repo);
+    metric.setLiveTableMaxSize(2 << 11); /* 4KB */
+
+    LabelListType smpl_labels;
+    smpl_labels.emplace_back("host", "myhost");
+
+    for (int i = 0; i < 2000; ++i) {
+      metric.insertSample(i, smpl_labels);
+    }
+
+    metric.compact();
+  }
+
+  std::vector<std::unique_ptr<TableRef>> tables;
+  file_repo.listFiles([&tables] (const std::string& filename) -> bool {
+    fnord::sstable::SSTableRepair repair(filename);
+    EXPECT(repair.checkAndRepair(true));
+    tables.emplace_back(TableRef::openTable(filename));
+    return true;
+  });
+
+  Metric metric("mylazymetric", &file_repo, std::move(tables));
+  EXPECT(metric.numTables() > 1);
+
+  /* the first accesses race to import the tables */
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&metric] () {
+      int n = 0;
+      metric.scanSamples(
+          util::DateTime::epoch(),
+          util::DateTime::now(),
+          [&n] (Sample* sample) -> bool {
+            EXPECT_EQ(sample->value(), n);
+            EXPECT_EQ(sample->labels().size(), 1);
+            EXPECT_EQ(sample->labels()[0].second, "myhost");
+            n++;
+            return true;
+          });
+
+      EXPECT_EQ(n, 2000);
+      EXPECT(metric.hasLabel("host"));
+    });
+  }
+
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  LabelListType smpl_labels;
+  smpl_labels.emplace_back("host", "myhost");
+  metric.insertSample(2000, smpl_labels);
+
+  int n = 0;
+  metric.scanSamples(
+      util::DateTime::epoch(),
+      util::DateTime::now(),
+      [&n] (Sample* sample) -> bool {
+        EXPECT_EQ(sample->labels()[0].second, "myhost");
+        n++;
+        return true;
+      });
+
+  EXPECT_EQ(n, 2001);
+  EXPECT_EQ(metric.labels().size(), 1);
+});
+
+TEST_CASE(DiskBackendTest, TestManifest, [] () {
+  io::FileUtil::mkdir_p(kTestRepoPath);
+  FileRepository file_repo(kTestRepoPath);
+  file_repo.deleteAllFiles();
+
+  LabelListType smpl_labels;
+  smpl_labels.emplace_back("host", "myhost");
+
+  {
+    Manifest manifest(kTestRepoPath);
+    Metric metric("mymanifestmetric", &file_repo, &manifest);
+    metric.setLiveTableMaxSize(2 << 11); /* 4KB */
+    metric.setLiveTableIdleTimeMicros(0);
+
+    for (int i = 0; i < 20000; ++i) {
+      metric.insertSample(i, smpl_labels);
+    }
+
+    metric.compact();
+    SizeTieredCompactionPolicy policy;
+    metric.compact(&policy);
+
+    /* leave an unfinished live table */
+    for (int i = 20000; i < 20010; ++i) {
+      metric.insertSample(i, smpl_labels);
+    }
+  }
+
+  /* the manifest lists exactly the tables on disk */
+  std::set<std::string> files;
+  file_repo.listFiles([&files] (const std::string& filename) -> bool {
+    if (filename.substr(filename.rfind('/') + 1) != Manifest::kFilename) {
+      files.insert(filename);
+    }
+
+    return true;
+  });
+
+  auto num_records = 0;
+  std::vector<std::unique_ptr<TableRef>> tables;
+  {
+    Manifest manifest(kTestRepoPath);
+    num_records = manifest.numRecords();
+    EXPECT_EQ(manifest.tables().size(), files.size());
+
+    int num_unfinished = 0;
+    for (const auto& info : manifest.tables()) {
+      EXPECT(files.count(info.filename) == 1);
+      EXPECT_EQ(info.metric_key, "mymanifestmetric");
+
+      if (info.finalized) {
+        EXPECT(info.body_size > 0);
+        tables.emplace_back(TableRef::openTable(
+            info.filename,
+            info.metric_key,
+            info.body_size,
+            info.generation,
+            info.parents,
+            info.rollup_resolution,
+            static_cast<TableRef::RowFormat>(info.row_format)));
+      } else {
+        fnord::sstable::SSTableRepair repair(info.filename);
+        EXPECT(repair.checkAndRepair(true));
+        tables.emplace_back(TableRef::openTable(info.filename));
+        ++num_unfinished;
+      }
+    }
+
+    EXPECT_EQ(num_unfinished, 1);
+  }
+
+  Metric metric("mymanifestmetric", &file_repo, std::move(tables));
+
+  int n = 0;
+  metric.scanSamples(
+      util::DateTime::epoch(),
+      util::DateTime::now(),
+      [&n] (Sample* sample) -> bool {
+        EXPECT_EQ(sample->value(), n);
+        EXPECT_EQ(sample->labels()[0].second, "myhost");
+        n++;
+        return true;
+      });
+
+  EXPECT_EQ(n, 20010);
+
+  /* a torn record at the end of the log is dropped */
+  {
+    auto file = io::File::openFile(
+        io::FileUtil::joinPaths(kTestRepoPath, Manifest::kFilename),
+        io::File::O_READ | io::File::O_WRITE);
+
+    file.seekTo(file.size());
+    file.write("\x10\x00\x00\x00\xff", 5);
+  }
+
+  {
+    Manifest manifest(kTestRepoPath);
+    EXPECT_EQ(manifest.numRecords(), num_records);
+    EXPECT_EQ(manifest.tables().size(), files.size());
+  }
+
+  /* the log is checkpointed once it has more records than needed */
+  {
+    Manifest manifest(kTestRepoPath, 8);
+    Metric metric("mycheckpointmetric", &file_repo, &manifest);
+    metric.setLiveTableMaxSize(2 << 11); /* 4KB */
+    metric.setLiveTableIdleTimeMicros(0);
+
+    for (int i = 0; i < 5000; ++i) {
+      metric.insertSample(i, smpl_labels);
+    }
+
+    metric.compact();
+    SizeTieredCompactionPolicy policy;
+    metric.compact(&policy);
+
+    EXPECT(manifest.numRecords() < num_records);
+    EXPECT(manifest.numRecords() <= manifest.tables().size() * 2 + 1);
+  }
+
+  Manifest manifest(kTestRepoPath);
+  std::set<std::string> metric_keys;
+  for (const auto& info : manifest.tables()) {
+    metric_keys.insert(info.metric_key);
+  }
+
+  EXPECT_EQ(metric_keys.size(), 2);
+});
+
+typedef std::map<std::string, uint64_t> GenerationMap;
+
+static std::vector<std::unique_ptr<TableRef>> reopenWithWriteAheadLog(
+    FileRepository* file_repo,
+    WriteAheadLog* wal) {
+  std::vector<std::unique_ptr<TableRef>> tables;
+  file_repo->listFiles([&tables, wal] (const std::string& filename) -> bool {
+    if (!WriteAheadLog::isSegment(filename)) {
+      fnord::sstable::SSTableRepair repair(filename);
+      EXPECT(repair.checkAndRepair(true));
+      tables.emplace_back(TableRef::openTable(filename));
+
+      if (!tables.back()->isWritable()) {
+        wal->addFinalizedTable(
+            tables.back()->metricKey(),
+            tables.back()->generation());
+      }
+    }
+
+    return true;
+  });
+
+  return tables;
+}
+
+TEST_CASE(DiskBackendTest, TestWriteAheadLog, [] () {
+  io::FileUtil::mkdir_p(kTestRepoPath);
+  FileRepository file_repo(kTestRepoPath);
+  file_repo.deleteAllFiles();
+
+  LabelListType smpl_labels;
+  smpl_labels.emplace_back("host", "myhost");
+
+  auto scan_values = [] (Metric* metric) -> std::set<int> {
+    std::set<int> values;
+    metric->scanSamples(
+        util::DateTime::epoch(),
+        std::numeric_limits<util::DateTime>::max(),
+        [&values] (Sample* sample) -> bool {
+          EXPECT_EQ(sample->labels()[0].second, "myhost");
+          EXPECT(values.insert(sample->value()).second);
+          return true;
+        });
+
+    return values;
+  };
+
+  {
+    WriteAheadLog wal(kTestRepoPath, 2 << 11); /* 4KB segments */
+    wal.recover(
+        GenerationMap(),
+        [] (const std::string& metric_key, std::vector<NewSample>&& samples) {
+          EXPECT(false);
+        });
+
+    Metric metric("mywalmetric", &file_repo);
+    metric.setWriteAheadLog(&wal);
+    metric.setSyncPolicy(sstable::SSTableWriter::SyncPolicy::none());
+    metric.setLiveTableMaxSize(2 << 11); /* 4KB */
+    metric.setLiveTableIdleTimeMicros(0);
+
+    /* concurrent inserts share the syncs of the log */
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+      threads.emplace_back([&metric, &smpl_labels, t] () {
+        for (int i = 0; i < 500; ++i) {
+          metric.insertSample(t * 500 + i, smpl_labels);
+        }
+      });
+    }
+
+    for (auto& thread : threads) {
+      thread.join();
+    }
+
+    EXPECT_EQ(scan_values(&metric).size(), 2000);
+    EXPECT(wal.segments().size() > 1);
+
+    /* the segments of finalized tables are released */
+    metric.compact();
+    EXPECT_EQ(metric.minWriteAheadLogSegment(), UINT64_MAX);
+    wal.releaseSegments(wal.currentSegment());
+    EXPECT_EQ(wal.segments().size(), 1);
+
+    /* leave an unfinished live table */
+    for (int i = 2000; i < 2020; ++i) {
+      metric.insertSample(i, smpl_labels);
+    }
+
+    EXPECT(metric.minWriteAheadLogSegment() <= wal.currentSegment());
+  }
+
+  /* the unfinished table is dropped and its samples are recovered */
+  {
+    WriteAheadLog wal(kTestRepoPath, 2 << 11);
+    auto tables = reopenWithWriteAheadLog(&file_repo, &wal);
+
+    int num_unfinished = 0;
+    for (const auto& table : tables) {
+      if (wal.needsRecovery(table->metricKey(), table->generation())) {
+        EXPECT(table->isWritable());
+        ++num_unfinished;
+      }
+    }
+
+    EXPECT_EQ(num_unfinished, 1);
+
+    Metric metric("mywalmetric", &file_repo, std::move(tables));
+    GenerationMap max_generations;
+    max_generations["mywalmetric"] = metric.maxGeneration();
+    metric.setWriteAheadLog(&wal);
+    metric.dropTables([&wal] (const TableRef& table) -> bool {
+      return wal.needsRecovery(table.metricKey(), table.generation());
+    });
+
+    int num_recovered = 0;
+    wal.recover(
+        max_generations,
+        [&metric, &num_recovered] (
+            const std::string& metric_key,
+            std::vector<NewSample>&& samples) {
+          EXPECT_EQ(metric_key, "mywalmetric");
+          num_recovered += samples.size();
+          metric.insertSamples(samples);
+        });
+
+    EXPECT_EQ(num_recovered, 20);
+    EXPECT_EQ(scan_values(&metric).size(), 2020);
+    EXPECT_EQ(wal.segments().size(), 1);
+  }
+
+  /* interrupt the recovery after it wrote to a table */
+  {
+    WriteAheadLog wal(kTestRepoPath, 2 << 11);
+    auto tables = reopenWithWriteAheadLog(&file_repo, &wal);
+    Metric metric("mywalmetric", &file_repo, std::move(tables));
+    GenerationMap max_generations;
+    max_generations["mywalmetric"] = metric.maxGeneration();
+    metric.setWriteAheadLog(&wal);
+    metric.dropTables([&wal] (const TableRef& table) -> bool {
+      return wal.needsRecovery(table.metricKey(), table.generation());
+    });
+
+    auto interrupted = false;
+    try {
+      wal.recover(
+          max_generations,
+          [&metric] (
+              const std::string& metric_key,
+              std::vector<NewSample>&& samples) {
+            metric.insertSamples(samples);
+            RAISE(kRuntimeError, "interrupted");
+          });
+    } catch (const fnordmetric::util::RuntimeException& e) {
+      interrupted = true;
+    }
+
+    EXPECT(interrupted);
+    EXPECT_EQ(wal.segments().size(), 2);
+  }
+
+  /* the samples are recovered exactly once */
+  {
+    WriteAheadLog wal(kTestRepoPath, 2 << 11);
+    auto tables = reopenWithWriteAheadLog(&file_repo, &wal);
+    Metric metric("mywalmetric", &file_repo, std::move(tables));
+    GenerationMap max_generations;
+    max_generations["mywalmetric"] = metric.maxGeneration();
+    metric.setWriteAheadLog(&wal);
+    metric.dropTables([&wal] (const TableRef& table) -> bool {
+      return wal.needsRecovery(table.metricKey(), table.generation());
+    });
+
+    wal.recover(
+        max_generations,
+        [&metric] (
+            const std::string& metric_key,
+            std::vector<NewSample>&& samples) {
+          metric.insertSamples(samples);
+        });
+
+    EXPECT_EQ(scan_values(&metric).size(), 2020);
+    EXPECT_EQ(wal.segments().size(), 1);
+  }
+});
+
+TEST_CASE(DiskBackendTest, TestMemTable, [] () {
+  io::FileUtil::mkdir_p(kTestRepoPath);
+  FileRepository file_repo(kTestRepoPath);
+  file_repo.deleteAllFiles();
+
+  /* the rows are split into chunks and the label sets are deduplicated */
+  TokenIndex token_index;
+  MemTable memtable;
+  for (int i = 0; i < 1000; ++i) {
+    SampleWriter writer(&token_index);
+    writer.writeValue<double>(i);
+    writer.writeLabel("host", "host" + std::to_string(i % 3));
+    memtable.addRow(
+        1000 + i * 2,
+        static_cast<char*>(writer.data()),
+        writer.size());
+  }
+
+  EXPECT_EQ(memtable.numRows(), 1000);
+  EXPECT(memtable.memoryUsage() > 0);
+  EXPECT(memtable.memoryUsage() < 1000 * 64);
+
+  int n = 251;
+  auto cursor = memtable.cursorFrom(1501);
+  while (cursor->valid()) {
+    void* data;
+    size_t size;
+    cursor->getKey(&data, &size);
+    EXPECT_EQ(*static_cast<uint64_t*>(data), 1000 + n * 2);
+    EXPECT_EQ(cursor->position(), n);
+
+    cursor->getData(&data, &size);
+    SampleReader<double> sample(data, size, &token_index);
+    EXPECT_EQ(sample.value(), n);
+    EXPECT_EQ(sample.labels()[0].second, "host" + std::to_string(n % 3));
+    ++n;
+
+    if (!cursor->next()) {
+      break;
+    }
+  }
+
+  EXPECT_EQ(n, 1000);
+  EXPECT(!memtable.cursorFrom(3000)->valid());
+
+  /* the pool's threads outlive the test, so the pool is never freed */
+  auto thread_pool = new fnord::thread::ThreadPool(
+      std::unique_ptr<fnord::util::ExceptionHandler>(
+          new fnord::util::CatchAndAbortExceptionHandler("crashed")));
+
+  auto count_files = [&file_repo] () -> int {
+    int num_files = 0;
+    file_repo.listFiles([&num_files] (const std::string& filename) -> bool {
+      ++num_files;
+      return true;
+    });
+
+    return num_files;
+  };
+
+  LabelListType smpl_labels;
+  smpl_labels.emplace_back("host", "myhost");
+
+  {
+    Metric metric("mymemtablemetric", &file_repo);
+    metric.setMemTables(true, thread_pool);
+    metric.setLiveTableMaxSize(2 << 11); /* 4KB */
+    metric.setLiveTableIdleTimeMicros(0);
+
+    /* the samples are readable while they are buffered and flushed */
+    int last_count = 0;
+    for (int i = 0; i < 20000; ++i) {
+      NewSample sample;
+      sample.time = 1000000 + i;
+      sample.value = i;
+      sample.labels = smpl_labels;
+      metric.insertSamples(&sample, 1);
+
+      if (i % 1000 == 999) {
+        int count = 0;
+        metric.scanSamples(
+            util::DateTime::epoch(),
+            std::numeric_limits<util::DateTime>::max(),
+            [&count] (Sample* sample) -> bool {
+              EXPECT_EQ(sample->value(), count);
+              ++count;
+              return true;
+            });
+
+        EXPECT_EQ(count, i + 1);
+        EXPECT(count > last_count);
+        last_count = count;
+      }
+    }
+
+    /* all full memtables are flushed in the background */
+    EXPECT(metric.numTables() > 16);
+    metric.waitForFlushes();
+    EXPECT_EQ(count_files(), metric.numTables() - 1);
+
+    metric.compact();
+    EXPECT_EQ(count_files(), metric.numTables());
+  }
+
+  std::vector<std::unique_ptr<TableRef>> tables;
+  file_repo.listFiles([&tables] (const std::string& filename) -> bool {
+    tables.emplace_back(TableRef::openTable(filename));
+    EXPECT(!tables.back()->isWritable());
+    return true;
+  });
+
+  Metric metric("mymemtablemetric", &file_repo, std::move(tables));
+
+  int n2 = 0;
+  metric.scanSamples(
+      util::DateTime::epoch(),
+      std::numeric_limits<util::DateTime>::max(),
+      [&n2] (Sample* sample) -> bool {
+        EXPECT_EQ(sample->value(), n2);
+        EXPECT_EQ(sample->labels()[0].second, "myhost");
+        ++n2;
+        return true;
+      });
+
+  EXPECT_EQ(n2, 20000);
+});
+
+TEST_CASE(DiskBackendTest, TestConcurrentFlushAndCompaction, [] () {
+  io::FileUtil::mkdir_p(kTestRepoPath);
+  FileRepository file_repo(kTestRepoPath);
+  file_repo.deleteAllFiles();
+
+  LabelListType smpl_labels;
+  smpl_labels.emplace_back("host", "myhost");
+
+  {
+    /* memtables are only flushed by the flush thread */
+    Metric metric("myflushcompactmetric", &file_repo);
+    metric.setMemTables(true);
+    metric.setLiveTableMaxSize(2 << 10); /* 2KB */
+
+    /* every table must be finalized exactly once */
+    std::atomic<bool> done(false);
+    std::thread flush_thread([&metric, &done] () {
+      while (!done) {
+        metric.flushTables();
+      }
+    });
+
+    std::thread compaction_thread([&metric, &done] () {
+      SizeTieredCompactionPolicy policy;
+      while (!done) {
+        metric.compact(&policy);
+      }
+    });
+
+    for (int i = 0; i < 20000; ++i) {
+      NewSample sample;
+      sample.time = 1000000 + i;
+      sample.value = i;
+      sample.labels = smpl_labels;
+      metric.insertSamples(&sample, 1);
+    }
+
+    done = true;
+    flush_thread.join();
+    compaction_thread.join();
+    metric.setLiveTableIdleTimeMicros(0);
+    metric.compact();
+
+    int count = 0;
+    metric.scanSamples(
+        util::DateTime::epoch(),
+        std::numeric_limits<util::DateTime>::max(),
+        [&count] (Sample* sample) -> bool {
+          EXPECT_EQ(sample->value(), count);
+          ++count;
+          return true;
+        });
+
+    EXPECT_EQ(count, 20000);
+  }
+
+  /* the live table started by the last merge might be empty and unfinished */
+  std::vector<std::unique_ptr<TableRef>> tables;
+  file_repo.listFiles([&tables] (const std::string& filename) -> bool {
+    fnord::sstable::SSTableRepair repair(filename);
+    EXPECT(repair.checkAndRepair(true));
+    tables.emplace_back(TableRef::openTable(filename));
+    return true;
+  });
+
+  Metric metric("myflushcompactmetric", &file_repo, std::move(tables));
+
+  int count = 0;
+  metric.scanSamples(
+      util::DateTime::epoch(),
+      std::numeric_limits<util::DateTime>::max(),
+      [&count] (Sample* sample) -> bool {
+        EXPECT_EQ(sample->value(), count);
+        ++count;
+        return true;
+      });
+
+  EXPECT_EQ(count, 20000);
+});
+
+TEST_CASE(DiskBackendTest, TestFlushEmptyTables, [] () {
+  io::FileUtil::mkdir_p(kTestRepoPath);
+  FileRepository file_repo(kTestRepoPath);
+  file_repo.deleteAllFiles();
+
+  auto count_files = [&file_repo] () -> int {
+    int num_files = 0;
+    file_repo.listFiles([&num_files] (const std::string& filename) -> bool {
+      ++num_files;
+      return true;
+    });
+
+    return num_files;
+  };
+
+  LabelListType smpl_labels;
+  smpl_labels.emplace_back("host", "myhost");
+
+  {
+    Metric metric("myemptytablemetric", &file_repo);
+    metric.setLiveTableMaxSize(2 << 10); /* 2KB */
+
+    for (int i = 0; i < 2000; ++i) {
+      NewSample sample;
+      sample.time = 1000000 + i;
+      sample.value = i;
+      sample.labels = smpl_labels;
+      metric.insertSamples(&sample, 1);
+    }
+
+    /* every expiry starts a new, empty live table after the busy one */
+    metric.compact(nullptr, 3600 * 1000000llu);
+    metric.compact(nullptr, 3600 * 1000000llu);
+    EXPECT_EQ(metric.numTables(), 2);
+    EXPECT_EQ(count_files(), 2);
+
+    /* only the newest table is kept to preserve its parent list */
+    metric.flushTables(true);
+    EXPECT_EQ(metric.numTables(), 0);
+    EXPECT_EQ(count_files(), 1);
+
+    /* until the next live table is written */
+    NewSample sample;
+    sample.value = 23;
+    sample.labels = smpl_labels;
+    metric.insertSamples(&sample, 1);
+    EXPECT_EQ(count_files(), 1);
+
+    metric.flushTables(true);
+  }
+
+  std::vector<std::unique_ptr<TableRef>> tables;
+  file_repo.listFiles([&tables] (const std::string& filename) -> bool {
+    fnord::sstable::SSTableRepair repair(filename);
+    EXPECT(repair.checkAndRepair(true));
+    tables.emplace_back(TableRef::openTable(filename));
+    return true;
+  });
+
+  EXPECT_EQ(tables.size(), 1);
+  Metric metric("myemptytablemetric", &file_repo, std::move(tables));
+
+  int count = 0;
+  metric.scanSamples(
+      util::DateTime::epoch(),
+      std::numeric_limits<util::DateTime>::max(),
+      [&count] (Sample* sample) -> bool {
+        EXPECT_EQ(sample->value(), 23);
+        ++count;
+        return true;
+      });
+
+  EXPECT_EQ(count, 1);
+});
+
+TEST_CASE(DiskBackendTest, TestLiveTableBudget, [] () {
+  io::FileUtil::mkdir_p(kTestRepoPath);
+  FileRepository file_repo(kTestRepoPath);
+  file_repo.deleteAllFiles();
+
+  /* the pool's threads outlive the test, so the pool is never freed */
+  auto thread_pool = new fnord::thread::ThreadPool(
+      std::unique_ptr<fnord::util::ExceptionHandler>(
+          new fnord::util::CatchAndAbortExceptionHandler("crashed")));
+
+  LabelListType smpl_labels;
+  smpl_labels.emplace_back("host", "myhost");
+
+  /* the metrics must outlive the budget's evictions */
+  std::vector<std::unique_ptr<Metric>> metrics;
+  for (int i = 0; i < 16; ++i) {
+    metrics.emplace_back(new Metric(
+        "mybudgetmetric" + std::to_string(i),
+        &file_repo));
+  }
+
+  LiveTableBudget budget(
+      [&metrics] () -> std::vector<Metric*> {
+        std::vector<Metric*> list;
+        for (const auto& metric : metrics) {
+          list.emplace_back(metric.get());
+        }
+
+        return list;
+      },
+      thread_pool,
+      2 << 29, /* 1GB */
+      4);
+
+  for (const auto& metric : metrics) {
+    metric->setLiveTableBudget(&budget);
+  }
+
+  /* every live table holds a file; the idlest metrics are finalized first */
+  for (int i = 0; i < 16; ++i) {
+    NewSample sample;
+    sample.time = 1000000 + i;
+    sample.value = i;
+    sample.labels = smpl_labels;
+    metrics[i]->insertSamples(&sample, 1);
+
+    if (i == 3) {
+      EXPECT_EQ(budget.usedFiles(), 4);
+      EXPECT(!budget.isExceeded());
+    }
+  }
+
+  budget.waitForCapacity();
+  EXPECT(!budget.isExceeded());
+  EXPECT(budget.usedFiles() > 0);
+
+  size_t bytes;
+  size_t files;
+  metrics[0]->liveTableUsage(&bytes, &files);
+  EXPECT_EQ(files, 0);
+  EXPECT_EQ(bytes, 0);
+  metrics[15]->liveTableUsage(&bytes, &files);
+  EXPECT_EQ(files, 1);
+
+  /* the largest metrics are finalized first and ingest is throttled */
+  budget.setLimits(2 << 15, 64); /* 64KB */
+  budget.waitForCapacity();
+  EXPECT(!budget.isExceeded());
+
+  for (int i = 0; i < 20000; ++i) {
+    NewSample sample;
+    sample.time = 2000000 + i;
+    sample.value = i;
+    sample.labels = smpl_labels;
+    metrics[1]->insertSamples(&sample, 1);
+  }
+
+  budget.waitForCapacity();
+  EXPECT(!budget.isExceeded());
+  EXPECT(budget.usedBytes() <= 2 << 15);
+  EXPECT(metrics[1]->numTables() > 2);
+
+  int count = 0;
+  metrics[1]->scanSamples(
+      util::DateTime(2000000),
+      std::numeric_limits<util::DateTime>::max(),
+      [&count] (Sample* sample) -> bool {
+        EXPECT_EQ(sample->value(), count);
+        ++count;
+        return true;
+      });
+
+  EXPECT_EQ(count, 20000);
+
+  for (const auto& metric : metrics) {
+    metric->setLiveTableBudget(nullptr);
+  }
+
+  EXPECT_EQ(budget.usedBytes(), 0);
+  EXPECT_EQ(budget.usedFiles(), 0);
+});
+
+TEST_CASE(DiskBackendTest, TestLiveTableBudgetDuringCompaction, [] () {
+  io::FileUtil::mkdir_p(kTestRepoPath);
+  FileRepository file_repo(kTestRepoPath);
+  file_repo.deleteAllFiles();
+
+  /* the pool's threads outlive the test, so the pool is never freed */
+  auto thread_pool = new fnord::thread::ThreadPool(
+      std::unique_ptr<fnord::util::ExceptionHandler>(
+          new fnord::util::CatchAndAbortExceptionHandler("crashed")));
+
+  LabelListType smpl_labels;
+  smpl_labels.emplace_back("host", "myhost");
+
+  {
+    Metric metric("mybudgetcompactmetric", &file_repo);
+    metric.setMemTables(true);
+    metric.setLiveTableMaxSize(2 << 10); /* 2KB */
+
+    LiveTableBudget budget(
+        [&metric] () -> std::vector<Metric*> {
+          return std::vector<Metric*>{ &metric };
+        },
+        thread_pool,
+        2 << 12, /* 8KB */
+        64);
+
+    metric.setLiveTableBudget(&budget);
+
+    /* the evictions finalize the tables that are being compacted */
+    std::atomic<bool> done(false);
+    std::thread compaction_thread([&metric, &done] () {
+      SizeTieredCompactionPolicy policy;
+      while (!done) {
+        metric.compact(&policy);
+      }
+    });
+
+    for (int i = 0; i < 20000; ++i) {
+      NewSample sample;
+      sample.time = 1000000 + i;
+      sample.value = i;
+      sample.labels = smpl_labels;
+      metric.insertSamples(&sample, 1);
+    }
+
+    done = true;
+    compaction_thread.join();
+    budget.waitForCapacity();
+    metric.setLiveTableBudget(nullptr);
+    metric.setLiveTableIdleTimeMicros(0);
+    metric.compact();
+
+    int count = 0;
+    metric.scanSamples(
+        util::DateTime::epoch(),
+        std::numeric_limits<util::DateTime>::max(),
+        [&count] (Sample* sample) -> bool {
+          EXPECT_EQ(sample->value(), count);
+          ++count;
+          return true;
+        });
+
+    EXPECT_EQ(count, 20000);
+  }
+
+  std::vector<std::unique_ptr<TableRef>> tables;
+  file_repo.listFiles([&tables] (const std::string& filename) -> bool {
+    fnord::sstable::SSTableRepair repair(filename);
+    EXPECT(repair.checkAndRepair(true));
+    tables.emplace_back(TableRef::openTable(filename));
+    return true;
+  });
+
+  Metric metric("mybudgetcompactmetric", &file_repo, std::move(tables));
+
+  int count = 0;
+  metric.scanSamples(
+      util::DateTime::epoch(),
+      std::numeric_limits<util::DateTime>::max(),
+      [&count] (Sample* sample) -> bool {
+        EXPECT_EQ(sample->value(), count);
+        ++count;
+        return true;
+      });
+
+  EXPECT_EQ(count, 20000);
+});
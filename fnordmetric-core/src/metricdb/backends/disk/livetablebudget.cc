@@ -0,0 +1,236 @@
+/**
+ * This file is part of the "FnordMetric" project
+ *   Copyright (c) 2014 Paul Asmuth, Google Inc.
+ *
+ * FnordMetric is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License v3.0. You should have received a
+ * copy of the GNU General Public License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#include <fnordmetric/environment.h>
+#include <fnordmetric/metricdb/backends/disk/livetablebudget.h>
+#include <fnordmetric/metricdb/backends/disk/metric.h>
+#include <fnordmetric/thread/task.h>
+#include <fnordmetric/util/runtimeexception.h>
+#include <fnordmetric/util/wallclock.h>
+#include <algorithm>
+#include <chrono>
+
+using fnord::util::WallClock;
+
+namespace fnordmetric {
+namespace metricdb {
+namespace disk_backend {
+
+LiveTableBudget::LiveTableBudget(
+    std::function<std::vector<Metric*> ()> list_metrics,
+    fnord::thread::TaskScheduler* scheduler,
+    size_t max_bytes /* = kMaxBytesDefault */,
+    size_t max_files /* = kMaxFilesDefault */) :
+    list_metrics_(list_metrics),
+    scheduler_(scheduler),
+    max_bytes_(max_bytes),
+    max_files_(max_files),
+    used_bytes_(0),
+    used_files_(0),
+    eviction_running_(false),
+    next_eviction_(0),
+    shutdown_(false) {}
+
+LiveTableBudget::~LiveTableBudget() {
+  std::unique_lock<std::mutex> lk(mutex_);
+  shutdown_ = true;
+
+  while (eviction_running_) {
+    eviction_done_.wait(lk);
+  }
+}
+
+void LiveTableBudget::setLimits(size_t max_bytes, size_t max_files) {
+  max_bytes_ = max_bytes;
+  max_files_ = max_files;
+
+  if (isExceeded()) {
+    std::lock_guard<std::mutex> lock_holder(mutex_);
+    scheduleEviction();
+  }
+}
+
+size_t LiveTableBudget::maxBytes() const {
+  return max_bytes_;
+}
+
+size_t LiveTableBudget::maxFiles() const {
+  return max_files_;
+}
+
+void LiveTableBudget::charge(int64_t bytes, int64_t files) {
+  used_bytes_ += bytes;
+  used_files_ += files;
+
+  if ((bytes > 0 || files > 0) && isExceeded()) {
+    std::lock_guard<std::mutex> lock_holder(mutex_);
+    scheduleEviction();
+  }
+}
+
+void LiveTableBudget::waitForCapacity() {
+  if (!isExceeded()) {
+    return;
+  }
+
+  auto deadline = WallClock::unixMicros() + kMaxWaitMicros;
+  std::unique_lock<std::mutex> lk(mutex_);
+
+  while (isExceeded() && !shutdown_) {
+    if (!eviction_running_) {
+      scheduleEviction();
+
+      // the last eviction was futile, don't stall the insert
+      if (!eviction_running_) {
+        return;
+      }
+    }
+
+    auto now = WallClock::unixMicros();
+    if (now >= deadline) {
+      return;
+    }
+
+    eviction_done_.wait_for(lk, std::chrono::microseconds(deadline - now));
+  }
+}
+
+bool LiveTableBudget::isExceeded() const {
+  return
+      used_bytes_ > static_cast<int64_t>(max_bytes_) ||
+      used_files_ > static_cast<int64_t>(max_files_);
+}
+
+bool LiveTableBudget::isAboveTarget() const {
+  return
+      used_bytes_ > static_cast<int64_t>(
+          max_bytes_ / 100 * kEvictionTargetPercent) ||
+      used_files_ > static_cast<int64_t>(
+          max_files_ * kEvictionTargetPercent / 100);
+}
+
+size_t LiveTableBudget::usedBytes() const {
+  return std::max(used_bytes_.load(), static_cast<int64_t>(0));
+}
+
+size_t LiveTableBudget::usedFiles() const {
+  return std::max(used_files_.load(), static_cast<int64_t>(0));
+}
+
+// Must hold mutex_ to call this!
+void LiveTableBudget::scheduleEviction() {
+  if (eviction_running_ || shutdown_) {
+    return;
+  }
+
+  if (WallClock::unixMicros() < next_eviction_) {
+    return;
+  }
+
+  eviction_running_ = true;
+
+  scheduler_->run(fnord::thread::Task::create([this] () {
+    size_t num_tables = 0;
+
+    try {
+      num_tables = evict();
+    } catch (util::RuntimeException e) {
+      env()->logger()->printf(
+          "ERROR",
+          "uncaught exception while evicting live tables");
+
+      e.debugPrint();
+    }
+
+    std::lock_guard<std::mutex> lock_holder(mutex_);
+    eviction_running_ = false;
+
+    // e.g. all writable tables are being recovered from the write ahead log
+    if (num_tables == 0) {
+      next_eviction_ = WallClock::unixMicros() + kMaxWaitMicros;
+    }
+
+    eviction_done_.notify_all();
+  }));
+}
+
+size_t LiveTableBudget::evict() {
+  struct Candidate {
+    Metric* metric;
+    size_t bytes;
+    uint64_t last_insert;
+  };
+
+  std::vector<Candidate> candidates;
+  for (const auto metric : list_metrics_()) {
+    size_t bytes;
+    size_t files;
+    metric->liveTableUsage(&bytes, &files);
+
+    if (bytes > 0 || files > 0) {
+      Candidate candidate = {
+        .metric = metric,
+        .bytes = bytes,
+        .last_insert = static_cast<uint64_t>(metric->lastInsertTime())};
+
+      candidates.emplace_back(candidate);
+    }
+  }
+
+  // finalizing a metric frees all of its files, so free the files of the
+  // metrics that are least likely to be written to again first. otherwise
+  // free the most memory per finalized metric
+  if (used_files_ > static_cast<int64_t>(max_files_)) {
+    std::sort(
+        candidates.begin(),
+        candidates.end(),
+        [] (const Candidate& a, const Candidate& b) {
+          return a.last_insert < b.last_insert;
+        });
+  } else {
+    std::sort(
+        candidates.begin(),
+        candidates.end(),
+        [] (const Candidate& a, const Candidate& b) {
+          return a.bytes > b.bytes;
+        });
+  }
+
+  size_t num_tables = 0;
+  for (const auto& candidate : candidates) {
+    if (!isAboveTarget()) {
+      break;
+    }
+
+    {
+      std::lock_guard<std::mutex> lock_holder(mutex_);
+      if (shutdown_) {
+        break;
+      }
+    }
+
+    if (env()->verbose()) {
+      env()->logger()->printf(
+          "DEBUG",
+          "Live table budget exceeded, finalizing metric: '%s'",
+          candidate.metric->key().c_str());
+    }
+
+    num_tables += candidate.metric->flushTables(true);
+
+    std::lock_guard<std::mutex> lock_holder(mutex_);
+    eviction_done_.notify_all();
+  }
+
+  return num_tables;
+}
+
+}
+}
+}
@@ -0,0 +1,120 @@
+/**
+ * This file is part of the "FnordMetric" project
+ *   Copyright (c) 2014 Paul Asmuth, Google Inc.
+ *
+ * FnordMetric is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License v3.0. You should have received a
+ * copy of the GNU General Public License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#ifndef _FNORDMETRIC_METRICDB_DISK_BACKEND_LIVETABLEBUDGET_H_
+#define _FNORDMETRIC_METRICDB_DISK_BACKEND_LIVETABLEBUDGET_H_
+#include <fnordmetric/thread/taskscheduler.h>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+namespace fnordmetric {
+namespace metricdb {
+namespace disk_backend {
+class Metric;
+
+/**
+ * A limit on the memory and the file handles held by the writable tables
+ * (live tables, late tables and memtables) of all metrics of a repository.
+ * Every metric charges the usage of its writable tables to the budget after
+ * each modification (see Metric::setLiveTableBudget()).
+ *
+ * Once the budget is exceeded, an eviction task on the scheduler finalizes
+ * the writable tables of the idlest metrics (if there are too many open
+ * files) or of the largest metrics (if there is too much memory in use) until
+ * the usage is below kEvictionTargetPercent of the limits. Inserts block while
+ * the budget is exceeded and an eviction is running, so ingest slows down to
+ * the rate at which tables are finalized instead of growing the usage
+ * further.
+ *
+ * Read only tables are not charged; their files are opened on demand by the
+ * TableReaderCache.
+ */
+class LiveTableBudget {
+public:
+  static constexpr const size_t kMaxBytesDefault = 2 << 29; /* 1GB */
+  static constexpr const size_t kMaxFilesDefault = 2 << 8; /* 512 */
+  static constexpr const size_t kEvictionTargetPercent = 90;
+  static constexpr const uint64_t kMaxWaitMicros = 1000000; /* 1 second */
+
+  /**
+   * The evictions run on the provided scheduler and pick their victims from
+   * the metrics returned by list_metrics
+   */
+  LiveTableBudget(
+      std::function<std::vector<Metric*> ()> list_metrics,
+      fnord::thread::TaskScheduler* scheduler,
+      size_t max_bytes = kMaxBytesDefault,
+      size_t max_files = kMaxFilesDefault);
+
+  /**
+   * Blocks until the running eviction is done
+   */
+  ~LiveTableBudget();
+
+  LiveTableBudget(const LiveTableBudget& other) = delete;
+  LiveTableBudget& operator=(const LiveTableBudget& other) = delete;
+
+  void setLimits(size_t max_bytes, size_t max_files);
+  size_t maxBytes() const;
+  size_t maxFiles() const;
+
+  /**
+   * Add the change of the memory and the open files held by the writable
+   * tables of a metric. Schedules an eviction if the budget is exceeded
+   */
+  void charge(int64_t bytes, int64_t files);
+
+  /**
+   * Block the calling thread while the budget is exceeded and an eviction is
+   * running, but for at most kMaxWaitMicros. Returns immediately if the last
+   * eviction didn't finalize any tables, so that inserts don't stall when
+   * there is nothing left to evict
+   */
+  void waitForCapacity();
+
+  bool isExceeded() const;
+  size_t usedBytes() const;
+  size_t usedFiles() const;
+
+protected:
+
+  /**
+   * Must hold mutex_ to call this
+   */
+  void scheduleEviction();
+
+  /**
+   * Finalize the writable tables of the idlest or largest metrics until the
+   * usage is below the target. Returns the number of finalized tables
+   */
+  size_t evict();
+
+  bool isAboveTarget() const;
+
+  std::function<std::vector<Metric*> ()> list_metrics_;
+  fnord::thread::TaskScheduler* scheduler_;
+  std::atomic<size_t> max_bytes_;
+  std::atomic<size_t> max_files_;
+  std::atomic<int64_t> used_bytes_;
+  std::atomic<int64_t> used_files_;
+  std::mutex mutex_;
+  std::condition_variable eviction_done_;
+  bool eviction_running_;
+  /* no eviction is scheduled before this time after a futile eviction */
+  uint64_t next_eviction_;
+  bool shutdown_;
+};
+
+}
+}
+}
+#endif
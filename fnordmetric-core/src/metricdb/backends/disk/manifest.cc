@@ -0,0 +1,349 @@
+/**
+ * This file is part of the "FnordMetric" project
+ *   Copyright (c) 2014 Paul Asmuth, Google Inc.
+ *
+ * FnordMetric is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License v3.0. You should have received a
+ * copy of the GNU General Public License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#include <fnordmetric/environment.h>
+#include <fnordmetric/io/fileutil.h>
+#include <fnordmetric/metricdb/backends/disk/manifest.h>
+#include <fnordmetric/metricdb/backends/disk/tableref.h>
+#include <fnordmetric/util/binarymessagereader.h>
+#include <fnordmetric/util/fnv.h>
+#include <fnordmetric/util/runtimeexception.h>
+#include <string.h>
+
+namespace fnordmetric {
+namespace metricdb {
+namespace disk_backend {
+
+const char Manifest::kFilename[] = "MANIFEST";
+
+bool Manifest::exists(const std::string& data_dir) {
+  return fnord::io::FileUtil::exists(fnord::io::FileUtil::joinPaths(data_dir, kFilename));
+}
+
+Manifest::Manifest(
+    const std::string& data_dir,
+    size_t checkpoint_min_records /* = kCheckpointMinRecords */) :
+    data_dir_(data_dir),
+    filename_(fnord::io::FileUtil::joinPaths(data_dir, kFilename)),
+    checkpoint_min_records_(checkpoint_min_records),
+    num_records_(0) {
+  file_.reset(new fnord::io::File(fnord::io::File::openFile(
+      filename_,
+      fnord::io::File::O_READ | fnord::io::File::O_WRITE | fnord::io::File::O_CREATEOROPEN)));
+
+  replay();
+}
+
+void Manifest::createTable(const TableRef& table) {
+  fnord::util::BinaryMessageWriter payload;
+  auto info = tableInfo(table);
+  writeCreateTableRecord(&payload, info);
+
+  std::lock_guard<std::mutex> lock_holder(mutex_);
+  tables_[info.filename] = info;
+  appendRecord(payload);
+}
+
+void Manifest::finalizeTable(const TableRef& table) {
+  fnord::util::BinaryMessageWriter payload;
+  auto info = tableInfo(table);
+  writeFilename(&payload, kFinalizeTable, info.filename);
+  payload.appendUInt64(info.body_size);
+
+  std::lock_guard<std::mutex> lock_holder(mutex_);
+  auto iter = tables_.find(info.filename);
+  if (iter == tables_.end()) {
+    tables_[info.filename] = info;
+  } else {
+    iter->second.finalized = true;
+    iter->second.body_size = info.body_size;
+  }
+
+  appendRecord(payload);
+}
+
+void Manifest::deleteTable(const std::string& table_filename) {
+  fnord::util::BinaryMessageWriter payload;
+  auto filename = absoluteFilename(logicalFilename(table_filename));
+  writeFilename(&payload, kDeleteTable, filename);
+
+  std::lock_guard<std::mutex> lock_holder(mutex_);
+  tables_.erase(filename);
+  appendRecord(payload);
+}
+
+void Manifest::reset(const std::vector<TableRef const*>& tables) {
+  std::lock_guard<std::mutex> lock_holder(mutex_);
+  tables_.clear();
+
+  for (const auto table : tables) {
+    auto info = tableInfo(*table);
+    tables_[info.filename] = info;
+  }
+
+  writeCheckpoint();
+}
+
+std::vector<Manifest::TableInfo> Manifest::tables() const {
+  std::vector<TableInfo> tables;
+
+  std::lock_guard<std::mutex> lock_holder(mutex_);
+  for (const auto& iter : tables_) {
+    tables.emplace_back(iter.second);
+  }
+
+  return tables;
+}
+
+size_t Manifest::numRecords() const {
+  std::lock_guard<std::mutex> lock_holder(mutex_);
+  return num_records_;
+}
+
+Manifest::TableInfo Manifest::tableInfo(const TableRef& table) const {
+  TableInfo info;
+  info.filename = absoluteFilename(logicalFilename(table.filename()));
+  info.metric_key = table.metricKey();
+  info.generation = table.generation();
+  info.parents = table.parents();
+  info.rollup_resolution = table.rollupResolution();
+  info.row_format = table.rowFormat();
+  info.finalized = !table.isWritable();
+  info.body_size = table.bodySize();
+  return info;
+}
+
+std::string Manifest::logicalFilename(const std::string& filename) const {
+  auto pos = filename.rfind('/');
+  if (pos == std::string::npos) {
+    return filename;
+  } else {
+    return filename.substr(pos + 1);
+  }
+}
+
+std::string Manifest::absoluteFilename(const std::string& filename) const {
+  return fnord::io::FileUtil::joinPaths(data_dir_, filename);
+}
+
+void Manifest::replay() {
+  auto size = file_->size();
+  std::string buf(size, 0);
+
+  for (size_t pos = 0; pos < size; ) {
+    auto res = file_->read(&buf[pos], size - pos);
+    if (res == 0) {
+      RAISE(kIOError, "unexpected EOF while reading %s", filename_.c_str());
+    }
+
+    pos += res;
+  }
+
+  size_t pos = 0;
+  while (pos + sizeof(uint32_t) * 2 <= size) {
+    uint32_t checksum;
+    uint32_t record_size;
+    memcpy(&checksum, &buf[pos], sizeof(uint32_t));
+    memcpy(&record_size, &buf[pos + sizeof(uint32_t)], sizeof(uint32_t));
+
+    auto payload_pos = pos + sizeof(uint32_t) * 2;
+    if (payload_pos + record_size > size) {
+      break;
+    }
+
+    fnord::util::FNV<uint32_t> fnv;
+    auto expected_checksum = fnv.hash(
+        &buf[pos + sizeof(uint32_t)],
+        sizeof(uint32_t) + record_size);
+
+    if (checksum != expected_checksum ||
+        !applyRecord(&buf[payload_pos], record_size)) {
+      break;
+    }
+
+    pos = payload_pos + record_size;
+    ++num_records_;
+  }
+
+  if (pos < size) {
+    env()->logger()->printf(
+        "WARNING",
+        "truncating %i trailing bytes of invalid records from %s",
+        (int) (size - pos),
+        filename_.c_str());
+
+    file_->truncate(pos);
+  }
+
+  file_->seekTo(pos);
+
+  if (env()->verbose()) {
+    env()->logger()->printf(
+        "DEBUG",
+        "Replayed %i manifest record(s), %i table(s)",
+        (int) num_records_,
+        (int) tables_.size());
+  }
+}
+
+bool Manifest::applyRecord(void const* data, size_t size) {
+  try {
+    fnord::util::BinaryMessageReader reader(data, size);
+    auto type = *reader.readUInt32();
+    auto filename_len = *reader.readUInt32();
+    auto filename = absoluteFilename(
+        std::string(reader.readString(filename_len), filename_len));
+
+    switch (type) {
+
+      case kCreateTable: {
+        TableInfo info;
+        info.filename = filename;
+        auto metric_key_len = *reader.readUInt32();
+        info.metric_key = std::string(
+            reader.readString(metric_key_len),
+            metric_key_len);
+        info.generation = *reader.readUInt64();
+        auto num_parents = *reader.readUInt32();
+        for (uint32_t i = 0; i < num_parents; ++i) {
+          info.parents.emplace_back(*reader.readUInt64());
+        }
+        info.rollup_resolution = *reader.readUInt64();
+        info.row_format = *reader.readUInt32();
+        info.finalized = false;
+        info.body_size = 0;
+        tables_[filename] = info;
+        return true;
+      }
+
+      case kFinalizeTable: {
+        auto body_size = *reader.readUInt64();
+        auto iter = tables_.find(filename);
+        if (iter != tables_.end()) {
+          iter->second.finalized = true;
+          iter->second.body_size = body_size;
+        }
+        return true;
+      }
+
+      case kDeleteTable:
+        tables_.erase(filename);
+        return true;
+
+      default:
+        return false;
+
+    }
+  } catch (const util::RuntimeException& e) {
+    return false;
+  }
+}
+
+void Manifest::appendRecord(const fnord::util::BinaryMessageWriter& payload) {
+  writeRecord(file_.get(), payload);
+  file_->sync();
+  ++num_records_;
+
+  if (num_records_ >= checkpoint_min_records_ &&
+      num_records_ > tables_.size() * 2) {
+    writeCheckpoint();
+  }
+}
+
+void Manifest::writeRecord(
+    fnord::io::File* file,
+    const fnord::util::BinaryMessageWriter& payload) const {
+  fnord::util::BinaryMessageWriter record(payload.size() + sizeof(uint32_t) * 2);
+  record.appendUInt32(0);
+  record.appendUInt32(payload.size());
+  record.append(payload.data(), payload.size());
+
+  fnord::util::FNV<uint32_t> fnv;
+  record.updateUInt32(0, fnv.hash(
+      static_cast<char*>(record.data()) + sizeof(uint32_t),
+      record.size() - sizeof(uint32_t)));
+
+  file->write(record.data(), record.size());
+}
+
+/**
+ * Write all tables to a new file and atomically replace the log with it
+ */
+void Manifest::writeCheckpoint() {
+  auto checkpoint_filename = filename_ + ".tmp";
+  auto checkpoint = fnord::io::File::openFile(
+      checkpoint_filename,
+      fnord::io::File::O_READ | fnord::io::File::O_WRITE | fnord::io::File::O_CREATEOROPEN |
+      fnord::io::File::O_TRUNCATE);
+
+  size_t num_records = 0;
+  for (const auto& iter : tables_) {
+    const auto& table = iter.second;
+
+    fnord::util::BinaryMessageWriter create_payload;
+    writeCreateTableRecord(&create_payload, table);
+    writeRecord(&checkpoint, create_payload);
+    ++num_records;
+
+    if (table.finalized) {
+      fnord::util::BinaryMessageWriter finalize_payload;
+      writeFilename(&finalize_payload, kFinalizeTable, table.filename);
+      finalize_payload.appendUInt64(table.body_size);
+      writeRecord(&checkpoint, finalize_payload);
+      ++num_records;
+    }
+  }
+
+  checkpoint.sync();
+  fnord::io::FileUtil::mv(checkpoint_filename, filename_);
+
+  /* make the rename durable */
+  fnord::io::File::openFile(data_dir_, fnord::io::File::O_READ).sync();
+
+  if (env()->verbose()) {
+    env()->logger()->printf(
+        "DEBUG",
+        "Wrote manifest checkpoint with %i record(s), %i table(s)",
+        (int) num_records,
+        (int) tables_.size());
+  }
+
+  checkpoint.seekTo(checkpoint.size());
+  file_.reset(new fnord::io::File(std::move(checkpoint)));
+  num_records_ = num_records;
+}
+
+void Manifest::writeCreateTableRecord(
+    fnord::util::BinaryMessageWriter* payload,
+    const TableInfo& table) const {
+  writeFilename(payload, kCreateTable, table.filename);
+  payload->appendUInt32(table.metric_key.size());
+  payload->appendString(table.metric_key);
+  payload->appendUInt64(table.generation);
+  payload->appendUInt32(table.parents.size());
+  for (const auto parent : table.parents) {
+    payload->appendUInt64(parent);
+  }
+  payload->appendUInt64(table.rollup_resolution);
+  payload->appendUInt32(table.row_format);
+}
+
+void Manifest::writeFilename(
+    fnord::util::BinaryMessageWriter* payload,
+    uint32_t type,
+    const std::string& filename) const {
+  auto logical_filename = logicalFilename(filename);
+  payload->appendUInt32(type);
+  payload->appendUInt32(logical_filename.size());
+  payload->appendString(logical_filename);
+}
+
+}
+}
+}
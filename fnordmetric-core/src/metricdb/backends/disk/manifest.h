@@ -0,0 +1,186 @@
+/**
+ * This file is part of the "FnordMetric" project
+ *   Copyright (c) 2014 Paul Asmuth, Google Inc.
+ *
+ * FnordMetric is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License v3.0. You should have received a
+ * copy of the GNU General Public License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#ifndef _FNORDMETRIC_METRICDB_DISK_BACKEND_MANIFEST_H_
+#define _FNORDMETRIC_METRICDB_DISK_BACKEND_MANIFEST_H_
+#include <fnordmetric/io/file.h>
+#include <fnordmetric/util/binarymessagewriter.h>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace fnordmetric {
+namespace metricdb {
+namespace disk_backend {
+class TableRef;
+
+/**
+ * An append-only log of the tables in a data directory. Each table is recorded
+ * when it is created, when it is finalized and when it is deleted, so that the
+ * tables of all metrics can be reopened by replaying this one file instead of
+ * opening every sstable in the directory. Only tables that were never
+ * finalized have to be repaired and opened on startup.
+ *
+ * Records are appended and synced one at a time. A torn record at the end of
+ * the log (i.e. from a crash during an append) is truncated on replay. Once
+ * the log holds more than twice as many records as there are tables, it is
+ * replaced with a checkpoint that contains one record per table.
+ *
+ * Record format:
+ *
+ *   <record> :=
+ *       <uint32_t> checksum    // fnv1a-32 of the size and the payload
+ *       <uint32_t> size
+ *       <uint32_t> type
+ *       <uint32_t> filename_len
+ *       <char[filename_len]> filename
+ *       <create_table_record> | <finalize_table_record> | <delete_table_record>
+ *
+ *   <create_table_record> :=
+ *       <uint32_t> metric_key_len
+ *       <char[metric_key_len]> metric_key
+ *       <uint64_t> generation
+ *       <uint32_t> num_parents
+ *       <uint64_t[num_parents]> parents
+ *       <uint64_t> rollup_resolution
+ *       <uint32_t> row_format
+ *
+ *   <finalize_table_record> :=
+ *       <uint64_t> body_size
+ *
+ *   <delete_table_record> :=
+ *       (empty)
+ *
+ * The filenames are relative to the data directory.
+ */
+class Manifest {
+public:
+  static const char kFilename[];
+  static constexpr const size_t kCheckpointMinRecords = 4096;
+
+  enum RecordType {
+    kCreateTable = 1,
+    kFinalizeTable = 2,
+    kDeleteTable = 3
+  };
+
+  struct TableInfo {
+    std::string filename; /* absolute path */
+    std::string metric_key;
+    uint64_t generation;
+    std::vector<uint64_t> parents;
+    uint64_t rollup_resolution;
+    uint32_t row_format;
+    bool finalized;
+    size_t body_size;
+  };
+
+  /**
+   * Returns true if the data directory contains a manifest
+   */
+  static bool exists(const std::string& data_dir);
+
+  /**
+   * Open and replay the manifest in the data directory or create an empty
+   * manifest if there is none. A checkpoint is written once the log holds at
+   * least checkpoint_min_records records
+   */
+  Manifest(
+      const std::string& data_dir,
+      size_t checkpoint_min_records = kCheckpointMinRecords);
+
+  Manifest(const Manifest& other) = delete;
+  Manifest& operator=(const Manifest& other) = delete;
+
+  /**
+   * Record a new table. Must be called before any samples are written to the
+   * table, so that the table is not lost if the process crashes
+   */
+  void createTable(const TableRef& table);
+
+  /**
+   * Record that a table was finalized
+   */
+  void finalizeTable(const TableRef& table);
+
+  /**
+   * Record that a table was deleted. Must be called before the table's file is
+   * deleted
+   */
+  void deleteTable(const std::string& filename);
+
+  /**
+   * Replace the manifest with a checkpoint that records only the provided
+   * tables, e.g. after the tables of a data directory without a manifest were
+   * opened by scanning the directory
+   */
+  void reset(const std::vector<TableRef const*>& tables);
+
+  /**
+   * Return all tables that were created and not deleted
+   */
+  std::vector<TableInfo> tables() const;
+
+  /**
+   * Return the number of records in the log
+   */
+  size_t numRecords() const;
+
+protected:
+  TableInfo tableInfo(const TableRef& table) const;
+  std::string logicalFilename(const std::string& filename) const;
+  std::string absoluteFilename(const std::string& filename) const;
+
+  void replay();
+
+  /**
+   * Apply a record to the in-memory table state. Returns false if the record
+   * is invalid
+   */
+  bool applyRecord(void const* data, size_t size);
+
+  /**
+   * Append a record and sync the log. Must be called with mutex_ held
+   */
+  void appendRecord(const fnord::util::BinaryMessageWriter& payload);
+
+  void writeRecord(
+      fnord::io::File* file,
+      const fnord::util::BinaryMessageWriter& payload) const;
+
+  /**
+   * Must be called with mutex_ held
+   */
+  void writeCheckpoint();
+
+  void writeCreateTableRecord(
+      fnord::util::BinaryMessageWriter* payload,
+      const TableInfo& table) const;
+
+  void writeFilename(
+      fnord::util::BinaryMessageWriter* payload,
+      uint32_t type,
+      const std::string& filename) const;
+
+  std::string data_dir_;
+  std::string filename_;
+  size_t checkpoint_min_records_;
+  std::unique_ptr<fnord::io::File> file_;
+  size_t num_records_;
+  /* keyed by absolute filename */
+  std::map<std::string, TableInfo> tables_;
+  mutable std::mutex mutex_;
+};
+
+}
+}
+}
+#endif
@@ -0,0 +1,239 @@
+/**
+ * This file is part of the "FnordMetric" project
+ *   Copyright (c) 2014 Paul Asmuth, Google Inc.
+ *
+ * FnordMetric is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License v3.0. You should have received a
+ * copy of the GNU General Public License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#include <fnordmetric/metricdb/backends/disk/memtable.h>
+#include <fnordmetric/util/runtimeexception.h>
+#include <algorithm>
+#include <string.h>
+
+namespace fnordmetric {
+namespace metricdb {
+namespace disk_backend {
+
+const size_t MemTable::kMaxRowsPerChunk;
+
+MemTable::RowChunk::RowChunk(size_t first_row_, size_t capacity_) :
+    first_row(first_row_),
+    capacity(capacity_),
+    times(new uint64_t[capacity_]),
+    values(new uint64_t[capacity_]),
+    label_set_ids(new uint32_t[capacity_]) {}
+
+MemTable::LabelSetChunk::LabelSetChunk(size_t first_id_, size_t capacity_) :
+    first_id(first_id_),
+    capacity(capacity_),
+    label_sets(new std::string[capacity_]) {}
+
+MemTable::MemTable() :
+    num_rows_(0),
+    num_label_sets_(0),
+    memory_usage_(0) {}
+
+void MemTable::addRow(uint64_t time, char const* data, size_t size) {
+  if (size < sizeof(uint64_t)) {
+    RAISE(kIllegalArgumentError, "invalid sample");
+  }
+
+  std::lock_guard<std::mutex> lock_holder(mutex_);
+
+  /* chunks double in size so that small tables stay small */
+  if (row_chunks_.size() == 0 ||
+      num_rows_ == row_chunks_.back()->first_row +
+          row_chunks_.back()->capacity) {
+    auto capacity = row_chunks_.size() == 0 ?
+        kMinRowsPerChunk :
+        std::min(row_chunks_.back()->capacity * 2, kMaxRowsPerChunk);
+
+    row_chunks_.emplace_back(new RowChunk(num_rows_, capacity));
+    memory_usage_ += capacity *
+        (sizeof(uint64_t) + sizeof(uint64_t) + sizeof(uint32_t));
+  }
+
+  /* cursors only read the rows that were appended before they were created,
+     so the slot can be written while they are reading */
+  auto& chunk = row_chunks_.back();
+  auto slot = num_rows_ - chunk->first_row;
+  chunk->times[slot] = time;
+  memcpy(&chunk->values[slot], data, sizeof(uint64_t));
+  chunk->label_set_ids[slot] = labelSetID(
+      data + sizeof(uint64_t),
+      size - sizeof(uint64_t));
+
+  ++num_rows_;
+}
+
+// Must hold mutex_ to call this!
+uint32_t MemTable::labelSetID(char const* data, size_t size) {
+  std::string labels(data, size);
+
+  auto iter = label_set_ids_.find(labels);
+  if (iter != label_set_ids_.end()) {
+    return iter->second;
+  }
+
+  if (label_set_chunks_.size() == 0 ||
+      num_label_sets_ == label_set_chunks_.back()->first_id +
+          label_set_chunks_.back()->capacity) {
+    auto capacity = label_set_chunks_.size() == 0 ?
+        kMinRowsPerChunk :
+        std::min(label_set_chunks_.back()->capacity * 2, kMaxRowsPerChunk);
+
+    label_set_chunks_.emplace_back(new LabelSetChunk(num_label_sets_, capacity));
+    memory_usage_ += capacity * sizeof(std::string);
+  }
+
+  auto& chunk = label_set_chunks_.back();
+  chunk->label_sets[num_label_sets_ - chunk->first_id] = labels;
+
+  /* the label set is stored in the chunk and as the key of the id map */
+  memory_usage_ += labels.size() * 2 + sizeof(uint32_t);
+  label_set_ids_.emplace(labels, num_label_sets_);
+  return num_label_sets_++;
+}
+
+std::unique_ptr<sstable::Cursor> MemTable::cursorFrom(
+    uint64_t time_begin) const {
+  Chunks chunks;
+
+  {
+    std::lock_guard<std::mutex> lock_holder(mutex_);
+    chunks.rows = row_chunks_;
+    chunks.label_sets = label_set_chunks_;
+    chunks.num_rows = num_rows_;
+  }
+
+  /* rows are appended in time order; find the first chunk that ends with a
+     row >= time_begin and the first such row in the chunk */
+  size_t pos = chunks.num_rows;
+  for (const auto& chunk : chunks.rows) {
+    auto num_rows = std::min(chunk->capacity, chunks.num_rows - chunk->first_row);
+    auto times_end = chunk->times.get() + num_rows;
+
+    if (num_rows > 0 && *(times_end - 1) >= time_begin) {
+      auto row = std::lower_bound(chunk->times.get(), times_end, time_begin);
+      pos = chunk->first_row + (row - chunk->times.get());
+      break;
+    }
+  }
+
+  return std::unique_ptr<sstable::Cursor>(
+      new MemTableCursor(std::move(chunks), pos));
+}
+
+size_t MemTable::numRows() const {
+  std::lock_guard<std::mutex> lock_holder(mutex_);
+  return num_rows_;
+}
+
+size_t MemTable::memoryUsage() const {
+  std::lock_guard<std::mutex> lock_holder(mutex_);
+  return memory_usage_;
+}
+
+MemTableCursor::MemTableCursor(
+    MemTable::Chunks&& chunks,
+    size_t pos) :
+    chunks_(std::move(chunks)),
+    pos_(0),
+    chunk_(0),
+    time_(0),
+    sample_read_(false) {
+  seekTo(pos);
+}
+
+void MemTableCursor::seekTo(size_t body_offset) {
+  if (body_offset > chunks_.num_rows) {
+    RAISE(kIndexError, "seekTo() out of bounds position");
+  }
+
+  pos_ = body_offset;
+  sample_read_ = false;
+
+  chunk_ = 0;
+  while (chunk_ + 1 < chunks_.rows.size() &&
+      chunks_.rows[chunk_ + 1]->first_row <= pos_) {
+    ++chunk_;
+  }
+}
+
+bool MemTableCursor::next() {
+  if (pos_ + 1 >= chunks_.num_rows) {
+    return false;
+  }
+
+  ++pos_;
+  sample_read_ = false;
+
+  const auto& chunk = chunks_.rows[chunk_];
+  if (pos_ >= chunk->first_row + chunk->capacity) {
+    ++chunk_;
+  }
+
+  return true;
+}
+
+bool MemTableCursor::valid() {
+  return pos_ < chunks_.num_rows;
+}
+
+void MemTableCursor::getKey(void** data, size_t* size) {
+  if (!valid()) {
+    RAISE(kIndexError, "getKey() on invalid cursor");
+  }
+
+  const auto& chunk = chunks_.rows[chunk_];
+  time_ = chunk->times[pos_ - chunk->first_row];
+  *data = &time_;
+  *size = sizeof(uint64_t);
+}
+
+void MemTableCursor::getData(void** data, size_t* size) {
+  if (!valid()) {
+    RAISE(kIndexError, "getData() on invalid cursor");
+  }
+
+  if (!sample_read_) {
+    const auto& chunk = chunks_.rows[chunk_];
+    auto slot = pos_ - chunk->first_row;
+    const auto& labels = labelSet(chunk->label_set_ids[slot]);
+
+    sample_.resize(sizeof(uint64_t) + labels.size());
+    memcpy(&sample_[0], &chunk->values[slot], sizeof(uint64_t));
+    memcpy(&sample_[sizeof(uint64_t)], labels.data(), labels.size());
+    sample_read_ = true;
+  }
+
+  *data = &sample_[0];
+  *size = sample_.size();
+}
+
+size_t MemTableCursor::position() const {
+  return pos_;
+}
+
+const std::string& MemTableCursor::labelSet(uint32_t id) const {
+  auto chunk = std::upper_bound(
+      chunks_.label_sets.begin(),
+      chunks_.label_sets.end(),
+      id,
+      [] (uint32_t id, const std::shared_ptr<MemTable::LabelSetChunk>& chunk) {
+        return id < chunk->first_id;
+      });
+
+  if (chunk == chunks_.label_sets.begin()) {
+    RAISE(kIndexError, "invalid label set id");
+  }
+
+  --chunk;
+  return (*chunk)->label_sets[id - (*chunk)->first_id];
+}
+
+}
+}
+}
@@ -0,0 +1,134 @@
+/**
+ * This file is part of the "FnordMetric" project
+ *   Copyright (c) 2014 Paul Asmuth, Google Inc.
+ *
+ * FnordMetric is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License v3.0. You should have received a
+ * copy of the GNU General Public License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#ifndef _FNORDMETRIC_METRICDB_MEMTABLE_H
+#define _FNORDMETRIC_METRICDB_MEMTABLE_H
+#include <fnordmetric/sstable/cursor.h>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace fnord;
+namespace fnordmetric {
+namespace metricdb {
+namespace disk_backend {
+
+/**
+ * An append-only, in-memory buffer of raw samples in time order. The samples
+ * are stored column-wise (time, value and label set id) in chunks that are
+ * never moved or resized once allocated, and each distinct serialized label
+ * list is only stored once.
+ *
+ * Rows are appended by a single writer at a time. Cursors can be created and
+ * read concurrently with the writer and see all rows that were appended
+ * before they were created.
+ */
+class MemTable {
+public:
+  static const size_t kMinRowsPerChunk = 64;
+  static const size_t kMaxRowsPerChunk = 8192;
+
+  MemTable();
+  MemTable(const MemTable& other) = delete;
+  MemTable& operator=(const MemTable& other) = delete;
+
+  /**
+   * Append a serialized raw sample (see <sample> in binaryformat.h). The time
+   * must not be older than the time of the last appended row
+   */
+  void addRow(uint64_t time, char const* data, size_t size);
+
+  /**
+   * Return a cursor positioned at the first row with a time >= time_begin.
+   * The "body offsets" of the cursor are row numbers
+   */
+  std::unique_ptr<sstable::Cursor> cursorFrom(uint64_t time_begin) const;
+
+  size_t numRows() const;
+
+  /**
+   * The number of bytes allocated for the rows and label sets
+   */
+  size_t memoryUsage() const;
+
+protected:
+  friend class MemTableCursor;
+
+  struct RowChunk {
+    RowChunk(size_t first_row, size_t capacity);
+    size_t first_row;
+    size_t capacity;
+    std::unique_ptr<uint64_t[]> times;
+    std::unique_ptr<uint64_t[]> values;
+    std::unique_ptr<uint32_t[]> label_set_ids;
+  };
+
+  struct LabelSetChunk {
+    LabelSetChunk(size_t first_id, size_t capacity);
+    size_t first_id;
+    size_t capacity;
+    std::unique_ptr<std::string[]> label_sets;
+  };
+
+  /**
+   * The chunks of a MemTable as of the creation of a cursor
+   */
+  struct Chunks {
+    std::vector<std::shared_ptr<RowChunk>> rows;
+    std::vector<std::shared_ptr<LabelSetChunk>> label_sets;
+    size_t num_rows;
+  };
+
+  uint32_t labelSetID(char const* data, size_t size);
+
+  mutable std::mutex mutex_;
+  std::vector<std::shared_ptr<RowChunk>> row_chunks_;
+  std::vector<std::shared_ptr<LabelSetChunk>> label_set_chunks_;
+  std::unordered_map<std::string, uint32_t> label_set_ids_;
+  size_t num_rows_;
+  size_t num_label_sets_;
+  size_t memory_usage_;
+};
+
+/**
+ * A cursor over the rows of a MemTable. The rows are the same as the rows of
+ * an uncompressed table: the key is the sample time and the data is the
+ * serialized sample
+ */
+class MemTableCursor : public sstable::Cursor {
+public:
+  MemTableCursor(MemTable::Chunks&& chunks, size_t pos);
+
+  void seekTo(size_t body_offset) override;
+  bool next() override;
+  bool valid() override;
+
+  void getKey(void** data, size_t* size) override;
+  void getData(void** data, size_t* size) override;
+
+  size_t position() const override;
+
+protected:
+  const std::string& labelSet(uint32_t id) const;
+
+  MemTable::Chunks chunks_;
+  size_t pos_;
+  size_t chunk_;
+  uint64_t time_;
+  std::string sample_;
+  bool sample_read_;
+};
+
+}
+}
+}
+
+#endif
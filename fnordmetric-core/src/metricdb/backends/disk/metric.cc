@@ -12,9 +12,12 @@
 #include <fnordmetric/metricdb/backends/disk/metric.h>
 #include <fnordmetric/metricdb/backends/disk/tableref.h>
 #include <fnordmetric/metricdb/backends/disk/samplewriter.h>
+#include <fnordmetric/thread/task.h>
 #include <fnordmetric/util/runtimeexception.h>
 #include <fnordmetric/util/freeondestroy.h>
 #include <fnordmetric/util/wallclock.h>
+#include <algorithm>
+#include <limits>
 #include <string.h>
 
 using namespace fnord;
@@ -24,30 +27,108 @@ namespace fnordmetric {
 namespace metricdb {
 namespace disk_backend {
 
+/**
+ * The labels of samples that are scanned without projected labels
+ */
+static const std::vector<std::pair<std::string, std::string>> kNoLabels;
+
+/**
+ * Read the sample at the current position of the cursor as a rollup value. Raw
+ * samples are read as a rollup of one sample
+ */
+static AbstractSampleReader* readRollupSample(
+    MetricCursor* cursor,
+    RollupValue* value) {
+  if (cursor->table()->rollupResolution() > 0) {
+    auto sample = cursor->sample<RollupValue>();
+    *value = sample->value();
+    return sample;
+  } else {
+    auto sample = cursor->sample<double>();
+    *value = RollupValue::fromValue(sample->value());
+    return sample;
+  }
+}
+
 Metric::Metric(
     const std::string& key,
-    io::FileRepository* file_repo) :
+    io::FileRepository* file_repo,
+    Manifest* manifest /* = nullptr */) :
     IMetric(key),
     file_repo_(file_repo),
+    manifest_(manifest),
+    wal_(nullptr),
     head_(nullptr),
+    late_table_created_(0),
     max_generation_(0),
     live_table_max_size_(kLiveTableMaxSize),
     live_table_idle_time_micros_(kLiveTableIdleTimeMicros),
-    last_insert_(fnord::util::WallClock::unixMicros()) {} // FIXPAUL
+    last_insert_(fnord::util::WallClock::unixMicros()), // FIXPAUL
+    sync_policy_(sstable::SSTableWriter::SyncPolicy::groupCommit(
+        kSyncMaxBytes,
+        kSyncMaxDelayMicros)),
+    scan_scheduler_(nullptr),
+    scan_max_parallel_tables_(kScanMaxParallelTablesDefault),
+    series_partitioning_(false),
+    mem_tables_(false),
+    flush_scheduler_(nullptr),
+    flush_queued_(false),
+    num_flush_tasks_(0),
+    budget_(nullptr),
+    budget_bytes_(0),
+    budget_files_(0) {}
 
 Metric::Metric(
     const std::string& key,
     io::FileRepository* file_repo,
-    std::vector<std::unique_ptr<TableRef>>&& tables) :
+    std::vector<std::unique_ptr<TableRef>>&& tables,
+    Manifest* manifest /* = nullptr */) :
     IMetric(key),
     file_repo_(file_repo),
+    manifest_(manifest),
+    wal_(nullptr),
+    late_table_created_(0),
     live_table_max_size_(kLiveTableMaxSize),
     live_table_idle_time_micros_(kLiveTableIdleTimeMicros),
-    last_insert_(fnord::util::WallClock::unixMicros()) { // FIXPAUL
+    last_insert_(fnord::util::WallClock::unixMicros()), // FIXPAUL
+    sync_policy_(sstable::SSTableWriter::SyncPolicy::groupCommit(
+        kSyncMaxBytes,
+        kSyncMaxDelayMicros)),
+    scan_scheduler_(nullptr),
+    scan_max_parallel_tables_(kScanMaxParallelTablesDefault),
+    series_partitioning_(false),
+    mem_tables_(false),
+    flush_scheduler_(nullptr),
+    flush_queued_(false),
+    num_flush_tasks_(0),
+    budget_(nullptr),
+    budget_bytes_(0),
+    budget_files_(0) {
   TableRef* head_table = nullptr;
   std::vector<uint64_t> generations;
+  uint64_t max_generation = 0;
 
   for (auto& table : tables) {
+    max_generation = std::max(max_generation, table->generation());
+
+    // the output of an interrupted compaction lists the new parents of the
+    // tables it was meant to replace, but doesn't contain all their samples
+    if (table->isIncompleteCompaction()) {
+      env()->logger()->printf(
+          "INFO",
+          "Dropping incomplete compaction sstable '%s' (%s)",
+          table->filename().c_str(),
+          key.c_str());
+
+      if (manifest_ != nullptr) {
+        manifest_->deleteTable(table->filename());
+      }
+
+      table->markObsolete();
+      table.reset();
+      continue;
+    }
+
     if (head_table == nullptr ||
         table->generation() > head_table->generation()) {
       head_table = table.get();
@@ -74,15 +155,16 @@ Metric::Metric(
       }
 
       if (table->generation() == gen) {
-        table->import(&token_index_, &label_index_);
-        snapshot->appendTable(std::move(table));
-        table.reset(nullptr);
+        table->setSyncPolicy(sync_policy_);
+        std::shared_ptr<TableRef> table_ref(table.release());
+        import_tables_.emplace_back(table_ref);
+        snapshot->appendTable(table_ref);
       }
     }
   }
 
-  head_ = snapshot;
-  max_generation_ = head_table->generation();
+  std::atomic_store(&head_, snapshot);
+  max_generation_ = max_generation;
 
   for (auto& table : tables) {
     if (table.get() != nullptr) {
@@ -91,58 +173,280 @@ Metric::Metric(
   }
 }
 
+Metric::~Metric() {
+  waitForFlushes();
+}
+
 std::shared_ptr<MetricSnapshot> Metric::getSnapshot() const {
-  std::lock_guard<std::mutex> lock_holder(head_mutex_);
-  return head_;
+  return std::atomic_load(&head_);
+}
+
+void Metric::importTables() const {
+  std::call_once(import_once_, [this] () {
+    if (env()->verbose() && import_tables_.size() > 0) {
+      env()->logger()->printf(
+          "DEBUG",
+          "Importing %i table(s) of metric: '%s'",
+          (int) import_tables_.size(),
+          key_.c_str());
+    }
+
+    for (const auto& table : import_tables_) {
+      table->import(&token_index_, &label_index_);
+    }
+
+    import_tables_.clear();
+  });
+}
+
+// Must hold append_mutex_ to call this!
+void Metric::setSnapshot(std::shared_ptr<MetricSnapshot> snapshot) {
+  std::atomic_store(&head_, snapshot);
 }
 
 // Must hold append_mutex_ to call this!
 std::shared_ptr<MetricSnapshot> Metric::getOrCreateSnapshot() {
-  {
-    std::lock_guard<std::mutex> lock_holder(head_mutex_);
+  auto head = getSnapshot();
 
-    if (head_.get() != nullptr &&
-        head_->isWritable() &&
-        head_->tables().back()->isWritable() &&
-        head_->tables().back()->bodySize() < live_table_max_size_) {
-      return head_;
-    }
+  if (head.get() != nullptr &&
+      head->isWritable() &&
+      head->tables().back()->isWritable() &&
+      head->tables().back()->bodySize() < live_table_max_size_) {
+    return head;
   }
 
-  std::lock_guard<std::mutex> lock_holder(head_mutex_);
   auto new_snapshot = createSnapshot(true);
-  head_ = new_snapshot;
-  return head_;
+  setSnapshot(new_snapshot);
+
+  // the previous live table is full (or the metric was compacted)
+  if (mem_tables_ && head.get() != nullptr) {
+    scheduleFlush();
+  }
+
+  return new_snapshot;
 }
 
-void Metric::insertSampleImpl(
-    double value,
-    const std::vector<std::pair<std::string, std::string>>& labels) {
+void Metric::insertSamplesImpl(
+    NewSample const* samples,
+    size_t num_samples) {
+  importTables();
+
+  // the samples that are recovered from the write ahead log must not wait for
+  // evictions, which skip the tables that are being recovered
+  if (budget_ != nullptr && (wal_ == nullptr || !wal_->isRecovering())) {
+    budget_->waitForCapacity();
+  }
+
   SampleWriter writer(&token_index_);
-  writer.writeValue(value);
-  for (const auto& label : labels) {
-    writer.writeLabel(label.first, label.second);
-    label_index_.addLabel(label.first);
+  std::vector<TableRef::SampleRef> refs;
+  std::vector<size_t> offsets;
+  refs.reserve(num_samples);
+
+  for (size_t i = 0; i < num_samples; ++i) {
+    const auto& sample = samples[i];
+    auto offset = writer.size();
+
+    writer.writeValue(sample.value);
+    for (const auto& label : sample.labels) {
+      writer.writeLabel(label.first, label.second);
+      label_index_.addLabel(label.first);
+    }
+
+    TableRef::SampleRef ref = {
+      .time = sample.time,
+      .offset = offset,
+      .size = writer.size() - offset};
+
+    refs.emplace_back(ref);
+    if (wal_ != nullptr) {
+      offsets.emplace_back(offset);
+    }
+  }
+
+  uint64_t wal_seq = 0;
+  bool flush_late_table = false;
+  {
+    std::lock_guard<std::mutex> lock_holder(append_mutex_);
+    auto snapshot = getOrCreateSnapshot();
+    auto& table = snapshot->tables().back();
+
+    // the insert time must be taken while holding the append lock so that
+    // implicitly timestamped rows are appended in time order
+    uint64_t now = fnord::util::WallClock::unixMicros();
+    for (auto& ref : refs) {
+      if (ref.time == 0) {
+        ref.time = now;
+      }
+    }
+
+    std::stable_sort(
+        refs.begin(),
+        refs.end(),
+        [] (const TableRef::SampleRef& a, const TableRef::SampleRef& b) {
+          return a.time < b.time;
+        });
+
+    // samples that are older than the newest sample in the live table can't be
+    // appended to it without breaking the sort order; they go to the late table
+    auto watermark = table->maxTime();
+    auto late_end = std::lower_bound(
+        refs.begin(),
+        refs.end(),
+        watermark,
+        [] (const TableRef::SampleRef& ref, uint64_t time) {
+          return ref.time < time;
+        });
+
+    if (late_end != refs.begin()) {
+      std::vector<TableRef::SampleRef> late_refs(refs.begin(), late_end);
+      auto late_table = getOrCreateLateTable();
+      late_table->addSamples(&writer, late_refs);
+      refs.erase(refs.begin(), late_end);
+
+      if (wal_ != nullptr) {
+        wal_seq = logSamples(*late_table, late_refs, offsets, samples);
+      }
+
+      // the next late sample starts a new late table
+      if (lateTableNeedsFlush(now)) {
+        late_table_.reset();
+        flush_late_table = true;
+      }
+    }
+
+    if (refs.size() > 0) {
+      table->addSamples(&writer, refs);
+
+      if (wal_ != nullptr) {
+        wal_seq = logSamples(*table, refs, offsets, samples);
+      }
+    }
+
+    last_insert_ = now;
+    updateLiveTableBudget();
   }
 
+  // concurrent inserts into all metrics share a single sync of the log
+  if (wal_seq > 0) {
+    wal_->sync(wal_seq);
+  }
+
+  if (flush_late_table) {
+    flushTables();
+  }
+}
+
+// Must hold append_mutex_ to call this!
+uint64_t Metric::logSamples(
+    const TableRef& table,
+    const std::vector<TableRef::SampleRef>& refs,
+    const std::vector<size_t>& offsets,
+    NewSample const* samples) {
+  WriteAheadLog::SampleList log_samples;
+  log_samples.reserve(refs.size());
+
+  // the refs are sorted by time; find each ref's sample by its offset
+  for (const auto& ref : refs) {
+    auto index = std::lower_bound(offsets.begin(), offsets.end(), ref.offset) -
+        offsets.begin();
+
+    log_samples.emplace_back(ref.time, &samples[index]);
+  }
+
+  uint64_t segment;
+  auto seq = wal_->appendSamples(
+      key_,
+      table.generation(),
+      log_samples,
+      &segment);
+
+  wal_segments_.emplace(table.generation(), segment);
+  return seq;
+}
+
+uint64_t Metric::logFinalizeTable(const TableRef& table) {
   std::lock_guard<std::mutex> lock_holder(append_mutex_);
-  auto snapshot = getOrCreateSnapshot();
-  auto& table = snapshot->tables().back();
+  wal_segments_.erase(table.generation());
+  return wal_->appendFinalizeTable(key_, table.generation());
+}
+
+// Must hold append_mutex_ to call this!
+std::shared_ptr<TableRef> Metric::getOrCreateLateTable() {
+  if (late_table_.get() != nullptr) {
+    return late_table_;
+  }
+
+  std::vector<uint64_t> parents;
+  auto head = getSnapshot();
+  auto snapshot = head->clone();
+  snapshot->setWritable(head->isWritable());
+
+  for (const auto& tbl : snapshot->tables()) {
+    parents.emplace_back(tbl->generation());
+  }
+
+  auto fileref = file_repo_->createFile();
+  late_table_.reset(new LateTableRef(
+      fileref.absolute_path,
+      key_,
+      ++max_generation_,
+      parents));
+
+  late_table_created_ = WallClock::unixMicros();
+
+  if (manifest_ != nullptr) {
+    manifest_->createTable(*late_table_);
+  }
+
+  // insert the late table before the live table, which must stay at the back
+  snapshot->insertTable(snapshot->tables().size() - 1, late_table_);
+
+  setSnapshot(snapshot);
+  return late_table_;
+}
+
+// Must hold append_mutex_ to call this!
+bool Metric::lateTableNeedsFlush(uint64_t now) const {
+  if (late_table_.get() == nullptr) {
+    return false;
+  }
+
+  if (late_table_->bodySize() >= live_table_max_size_) {
+    return true;
+  }
+
+  // the late table is only written to disk when it is finalized, so without
+  // a write ahead log it is flushed whenever the live table would be synced
+  if (wal_ != nullptr) {
+    return false;
+  }
+
+  switch (sync_policy_.mode) {
+    case sstable::SSTableWriter::SyncPolicy::SYNC_EVERY_ROW:
+      return true;
+    case sstable::SSTableWriter::SyncPolicy::SYNC_NONE:
+      return false;
+    case sstable::SSTableWriter::SyncPolicy::SYNC_GROUP:
+      return
+          late_table_->bodySize() >= sync_policy_.max_bytes ||
+          now >= late_table_created_ + sync_policy_.max_delay_micros;
+  }
 
-  uint64_t now = fnord::util::WallClock::unixMicros();
-  table->addSample(&writer, now);
-  last_insert_ = now;
+  return false;
 }
 
 // FIXPAUL misnomer...it creates a new snapshot + appends a new, clean table
-std::shared_ptr<MetricSnapshot> Metric::createSnapshot(bool writable) {
+std::shared_ptr<MetricSnapshot> Metric::createSnapshot(
+    bool writable,
+    bool on_disk /* = false */) {
   std::shared_ptr<MetricSnapshot> snapshot;
   std::vector<uint64_t> parents;
 
-  if (head_.get() == nullptr) {
+  auto head = getSnapshot();
+  if (head.get() == nullptr) {
     snapshot.reset(new MetricSnapshot());
   } else {
-    snapshot = head_->clone();
+    snapshot = head->clone();
     for (const auto& tbl : snapshot->tables()) {
       parents.emplace_back(tbl->generation());
     }
@@ -153,16 +457,35 @@ std::shared_ptr<MetricSnapshot> Metric::createSnapshot(bool writable) {
   if (writable) {
     // open new file
     auto fileref = file_repo_->createFile();
-    auto file = io::File::openFile(
-        fileref.absolute_path,
-        io::File::O_READ | io::File::O_WRITE | io::File::O_CREATE);
+    std::unique_ptr<TableRef> table;
+    if (mem_tables_ && !on_disk) {
+      // memtables are only written to disk when they are finalized
+      table.reset(new MemTableRef(
+          fileref.absolute_path,
+          key_,
+          ++max_generation_,
+          parents));
+    } else {
+      auto file = io::File::openFile(
+          fileref.absolute_path,
+          io::File::O_READ | io::File::O_WRITE | io::File::O_CREATE);
+
+      table = TableRef::createTable(
+          fileref.absolute_path,
+          key_,
+          std::move(file),
+          ++max_generation_,
+          parents);
+
+      releaseEmptyTables(table->generation());
+    }
 
-    snapshot->appendTable(TableRef::createTable(
-        fileref.absolute_path,
-        key_,
-        std::move(file),
-        ++max_generation_,
-        parents));
+    if (manifest_ != nullptr) {
+      manifest_->createTable(*table);
+    }
+
+    table->setSyncPolicy(sync_policy_);
+    snapshot->appendTable(std::move(table));
   }
 
   return snapshot;
@@ -172,27 +495,78 @@ void Metric::scanSamples(
     const fnord::util::DateTime& time_begin,
     const fnord::util::DateTime& time_end,
     std::function<bool (Sample* sample)> callback) {
+  scanSamples(time_begin, time_end, LabelFilter(), callback);
+}
+
+void Metric::scanSamples(
+    const fnord::util::DateTime& time_begin,
+    const fnord::util::DateTime& time_end,
+    const LabelFilter& filter,
+    std::function<bool (Sample* sample)> callback) {
+  scanSamples(time_begin, time_end, filter, SampleProjection(), callback);
+}
+
+void Metric::scanSamples(
+    const fnord::util::DateTime& time_begin,
+    const fnord::util::DateTime& time_end,
+    const LabelFilter& filter,
+    const SampleProjection& projection,
+    std::function<bool (Sample* sample)> callback) {
+  importTables();
+
   auto snapshot = getSnapshot();
   if (snapshot.get() == nullptr) {
     return;
   }
 
-  MetricCursor cursor(snapshot, &token_index_);
+  MetricCursor cursor(
+      snapshot,
+      &token_index_,
+      static_cast<uint64_t>(time_begin),
+      static_cast<uint64_t>(time_end));
+
+  if (scan_scheduler_ != nullptr) {
+    cursor.setParallelScan(scan_scheduler_, scan_max_parallel_tables_);
+  }
+
+  if (!filter.empty()) {
+    cursor.setLabelFilter(&filter);
+  }
+
+  /* samples are not read at all if only their time is projected */
+  auto read_sample =
+      projection.hasValue() || projection.hasLabels() || !filter.empty();
+
   while (cursor.valid()) {
-    auto sample = cursor.sample<double>();
     auto time = cursor.time();
 
     if (time >= static_cast<uint64_t>(time_end)) {
       break;
     }
 
-    if (time >= static_cast<uint64_t>(time_begin)) {
-      Sample cb_sample(
-          time,
-          sample->value(),
-          sample->labels());
+    if (time >= static_cast<uint64_t>(time_begin) && !read_sample) {
+      Sample cb_sample(time, 0, kNoLabels);
+      if (!callback(&cb_sample)) {
+        return;
+      }
+    } else if (time >= static_cast<uint64_t>(time_begin)) {
+      // rolled up windows are returned as one sample with the window's mean
+      RollupValue value;
+      auto sample = readRollupSample(&cursor, &value);
 
-      callback(&cb_sample);
+      if (filter.empty() || filter.matches(sample->labelRefs())) {
+        if (projection.hasLabels()) {
+          Sample cb_sample(time, value.mean(), sample);
+          if (!callback(&cb_sample)) {
+            return;
+          }
+        } else {
+          Sample cb_sample(time, value.mean(), kNoLabels);
+          if (!callback(&cb_sample)) {
+            return;
+          }
+        }
+      }
     }
 
     if (!cursor.next()) {
@@ -201,12 +575,156 @@ void Metric::scanSamples(
   }
 }
 
-void Metric::compact(CompactionPolicy* compaction /* = nullptr */) {
-  if (!compaction_mutex_.try_lock()) {
+void Metric::scanSamplesReverse(
+    const fnord::util::DateTime& time_begin,
+    const fnord::util::DateTime& time_end,
+    std::function<bool (Sample* sample)> callback) {
+  importTables();
+
+  auto snapshot = getSnapshot();
+  if (snapshot.get() == nullptr) {
+    return;
+  }
+
+  /* don't read windows that are older than the oldest sample */
+  auto begin = static_cast<uint64_t>(time_begin);
+  auto min_time = std::numeric_limits<uint64_t>::max();
+  for (const auto& table : snapshot->tables()) {
+    min_time = std::min(min_time, table->minTime());
+  }
+
+  begin = std::max(begin, min_time);
+
+  auto end = static_cast<uint64_t>(time_end);
+  auto window = kReverseScanInitialWindowMicros;
+  std::vector<NewSample> samples;
+
+  while (end > begin) {
+    auto window_begin = end - begin > window ? end - window : begin;
+
+    samples.clear();
+    scanSamples(
+        window_begin,
+        end,
+        [&samples] (Sample* sample) -> bool {
+          NewSample copy;
+          copy.time = static_cast<uint64_t>(sample->time());
+          copy.value = sample->value();
+          copy.labels = sample->labels();
+          samples.emplace_back(std::move(copy));
+          return true;
+        });
+
+    for (auto iter = samples.rbegin(); iter != samples.rend(); ++iter) {
+      Sample sample(iter->time, iter->value, iter->labels);
+      if (!callback(&sample)) {
+        return;
+      }
+    }
+
+    end = window_begin;
+    if (window < std::numeric_limits<uint64_t>::max() / 2) {
+      window *= 2;
+    }
+  }
+}
+
+void Metric::scanRollups(
+    const fnord::util::DateTime& time_begin,
+    const fnord::util::DateTime& time_end,
+    uint64_t resolution,
+    std::function<bool (RollupSample* sample)> callback) {
+  scanRollups(time_begin, time_end, LabelFilter(), resolution, callback);
+}
+
+void Metric::scanRollups(
+    const fnord::util::DateTime& time_begin,
+    const fnord::util::DateTime& time_end,
+    const LabelFilter& filter,
+    uint64_t resolution,
+    std::function<bool (RollupSample* sample)> callback) {
+  importTables();
+
+  auto snapshot = getSnapshot();
+  if (snapshot.get() == nullptr) {
     return;
   }
 
-  std::lock_guard<std::mutex>(compaction_mutex_, std::adopt_lock);
+  RollupAggregator aggregator(resolution, callback);
+  MetricCursor cursor(
+      snapshot,
+      &token_index_,
+      static_cast<uint64_t>(time_begin),
+      static_cast<uint64_t>(time_end));
+
+  if (scan_scheduler_ != nullptr) {
+    cursor.setParallelScan(scan_scheduler_, scan_max_parallel_tables_);
+  }
+
+  if (!filter.empty()) {
+    cursor.setLabelFilter(&filter);
+  }
+
+  while (cursor.valid()) {
+    auto time = cursor.time();
+
+    if (time >= static_cast<uint64_t>(time_end)) {
+      break;
+    }
+
+    if (time >= static_cast<uint64_t>(time_begin)) {
+      RollupValue value;
+      auto sample = readRollupSample(&cursor, &value);
+
+      if ((filter.empty() || filter.matches(sample->labelRefs())) &&
+          !aggregator.addSample(time, value, sample->labels())) {
+        return;
+      }
+    }
+
+    if (!cursor.next()) {
+      break;
+    }
+  }
+
+  aggregator.flush();
+}
+
+std::vector<uint64_t> Metric::rollupResolutions() const {
+  std::vector<uint64_t> resolutions;
+
+  auto snapshot = getSnapshot();
+  if (snapshot.get() == nullptr) {
+    return resolutions;
+  }
+
+  for (const auto& table : snapshot->tables()) {
+    auto resolution = table->rollupResolution();
+
+    if (resolution > 0 &&
+        std::find(resolutions.begin(), resolutions.end(), resolution) ==
+            resolutions.end()) {
+      resolutions.emplace_back(resolution);
+    }
+  }
+
+  std::sort(resolutions.begin(), resolutions.end());
+  return resolutions;
+}
+
+void Metric::compact(
+    CompactionPolicy* compaction /* = nullptr */,
+    uint64_t retention_micros /* = 0 */) {
+  importTables();
+
+  // concurrent compactions and flushes must not finalize the same tables
+  std::unique_lock<std::mutex> compaction_lock(
+      compaction_mutex_,
+      std::try_to_lock);
+
+  if (!compaction_lock.owns_lock()) {
+    return;
+  }
 
   if (env()->verbose()) {
     env()->logger()->printf(
@@ -219,11 +737,20 @@ void Metric::compact(CompactionPolicy* compaction /* = nullptr */) {
   std::shared_ptr<MetricSnapshot> snapshot;
   {
     std::lock_guard<std::mutex> append_lock_holder(append_mutex_);
-    std::lock_guard<std::mutex> head_lock_holder(head_mutex_);
+    if (getSnapshot().get() == nullptr) {
+      return;
+    }
+
     snapshot = createSnapshot(false);
+    late_table_.reset();
   }
 
   auto old_tables = snapshot->tables();
+  uint64_t newest_generation = 0;
+  for (const auto& table : old_tables) {
+    newest_generation = std::max(newest_generation, table->generation());
+  }
+
   auto idle_time_micros = WallClock::unixMicros() - last_insert_;
 
   if (idle_time_micros < live_table_idle_time_micros_) {
@@ -231,6 +758,9 @@ void Metric::compact(CompactionPolicy* compaction /* = nullptr */) {
   }
 
   std::vector<std::shared_ptr<TableRef>> new_tables;
+  std::vector<std::shared_ptr<TableRef>> empty_tables;
+  uint64_t finalized_generation = 0;
+  uint64_t wal_seq = 0;
 
   // finalize unfinished sstables
   for (auto& table : old_tables) {
@@ -244,6 +774,7 @@ void Metric::compact(CompactionPolicy* compaction /* = nullptr */) {
               table->metricKey().c_str());
         }
 
+        empty_tables.emplace_back(table);
         continue;
       } else {
         if (env()->verbose()) {
@@ -255,6 +786,18 @@ void Metric::compact(CompactionPolicy* compaction /* = nullptr */) {
         }
 
         table->finalize(&token_index_, &label_index_);
+        if (manifest_ != nullptr) {
+          manifest_->finalizeTable(*table);
+        }
+
+        if (wal_ != nullptr) {
+          wal_seq = logFinalizeTable(*table);
+        }
+
+        finalized_generation = std::max(
+            finalized_generation,
+            table->generation());
+
         new_tables.emplace_back(new ReadonlyTableRef(*table));
       }
     } else {
@@ -262,30 +805,305 @@ void Metric::compact(CompactionPolicy* compaction /* = nullptr */) {
     }
   }
 
+  auto finalized_tables = new_tables;
+
+  // drop expired tables
+  if (retention_micros > 0) {
+    auto now = WallClock::unixMicros();
+    std::vector<std::shared_ptr<TableRef>> unexpired_tables;
+
+    // tables without a time index report a max time of UINT64_MAX and are
+    // never expired
+    for (const auto& table : new_tables) {
+      if (retention_micros < now && table->maxTime() < now - retention_micros) {
+        if (env()->verbose()) {
+          env()->logger()->printf(
+              "DEBUG",
+              "SSTable '%s' (%s) is expired, dropping...",
+              table->filename().c_str(),
+              table->metricKey().c_str());
+        }
+      } else {
+        unexpired_tables.emplace_back(table);
+      }
+    }
+
+    new_tables = unexpired_tables;
+  }
+
   // run the compaction
   if (compaction != nullptr) {
-    compaction->compact(&new_tables);
+    compaction->compact(this, &new_tables);
+  }
+
+  std::vector<std::shared_ptr<TableRef>> removed_tables;
+  for (const auto& table : finalized_tables) {
+    if (std::find(new_tables.begin(), new_tables.end(), table) ==
+        new_tables.end()) {
+      removed_tables.emplace_back(table);
+    }
   }
 
   // create a new snapshot and commit modifications
   {
     std::lock_guard<std::mutex> append_lock_holder(append_mutex_);
-    std::lock_guard<std::mutex> head_lock_holder(head_mutex_);
-    auto new_snapshot = new MetricSnapshot();
-    new_snapshot->setWritable(head_->isWritable());
+    auto head = getSnapshot();
+    std::shared_ptr<MetricSnapshot> new_snapshot(new MetricSnapshot());
+    new_snapshot->setWritable(head->isWritable());
 
     for (const auto& table : new_tables) {
       new_snapshot->appendTable(table);
     }
 
-    for (int i = old_tables.size(); i < head_->tables().size(); ++i) {
-      new_snapshot->appendTable(head_->tables()[i]);
+    for (int i = old_tables.size(); i < head->tables().size(); ++i) {
+      new_snapshot->appendTable(head->tables()[i]);
     }
 
-    head_.reset(new_snapshot);
+    setSnapshot(new_snapshot);
+    dropEmptyTables(empty_tables, newest_generation);
+    releaseEmptyTables(finalized_generation);
+
+    // on startup, the set of live tables is read from the parent list of the
+    // newest table. start a new live table so that the removed tables are not
+    // in the newest table's parent list anymore before they are deleted. the
+    // table is written to disk right away (even if memtables are enabled) as
+    // the tables that were started during the compaction still list the
+    // removed tables as their parents
+    if (removed_tables.size() > 0) {
+      setSnapshot(createSnapshot(true, true));
+    }
+
+    updateLiveTableBudget();
+  }
+
+  // the log must not recover the samples of deleted tables
+  if (wal_seq > 0 && removed_tables.size() > 0) {
+    wal_->sync(wal_seq);
+  }
+
+  for (const auto& table : removed_tables) {
+    if (manifest_ != nullptr) {
+      manifest_->deleteTable(table->filename());
+    }
+
+    table->markObsolete();
   }
 }
 
+std::shared_ptr<TableRef> Metric::mergeTables(
+    const std::vector<std::shared_ptr<TableRef>>& tables) {
+  std::shared_ptr<MetricSnapshot> input(new MetricSnapshot());
+  for (const auto& table : tables) {
+    input->appendTable(table);
+  }
+
+  // rows are copied verbatim, so all tables must store the same kind of rows
+  uint64_t rollup_resolution = 0;
+  if (tables.size() > 0) {
+    rollup_resolution = tables[0]->rollupResolution();
+  }
+
+  for (const auto& table : tables) {
+    if (table->rollupResolution() != rollup_resolution) {
+      RAISE(
+          kIllegalArgumentError,
+          "can't merge tables with different rollup resolutions");
+    }
+  }
+
+  auto table = createCompactionTable(tables, rollup_resolution);
+  table->setSyncPolicy(sstable::SSTableWriter::SyncPolicy::none());
+
+  // tables with series blocks group the samples by their serialized labels,
+  // so the labels are re-encoded in sorted order instead of copied verbatim
+  auto reencode = table->rowFormat() == TableRef::kSeriesBlocks;
+
+  std::unique_ptr<SampleWriter> writer(new SampleWriter(&token_index_));
+  std::vector<TableRef::SampleRef> refs;
+
+  MetricCursor cursor(input, &token_index_);
+  while (cursor.valid()) {
+    TableRef::SampleRef ref;
+    ref.time = cursor.time();
+    ref.offset = writer->size();
+
+    if (reencode) {
+      RollupValue value;
+      auto sample = readRollupSample(&cursor, &value);
+      auto labels = sample->labels();
+      std::sort(labels.begin(), labels.end());
+
+      if (rollup_resolution > 0) {
+        writer->writeValue(value);
+      } else {
+        writer->writeValue(value.sum);
+      }
+
+      for (const auto& label : labels) {
+        writer->writeLabel(label.first, label.second);
+      }
+    } else {
+      void* data;
+      size_t data_size;
+      cursor.getData(&data, &data_size);
+      writer->append(data, data_size);
+    }
+
+    ref.size = writer->size() - ref.offset;
+    refs.emplace_back(ref);
+
+    if (writer->size() >= kMergeBatchSize) {
+      table->addSamples(writer.get(), refs);
+      writer.reset(new SampleWriter(&token_index_));
+      refs.clear();
+    }
+
+    if (!cursor.next()) {
+      break;
+    }
+  }
+
+  if (refs.size() > 0) {
+    table->addSamples(writer.get(), refs);
+  }
+
+  table->finalize(&token_index_, &label_index_);
+  if (manifest_ != nullptr) {
+    manifest_->finalizeTable(*table);
+  }
+
+  return std::shared_ptr<TableRef>(new ReadonlyTableRef(*table));
+}
+
+std::shared_ptr<TableRef> Metric::rollupTables(
+    const std::vector<std::shared_ptr<TableRef>>& tables,
+    uint64_t resolution) {
+  std::shared_ptr<MetricSnapshot> input(new MetricSnapshot());
+  for (const auto& table : tables) {
+    if (table->rollupResolution() > resolution) {
+      RAISE(
+          kIllegalArgumentError,
+          "can't roll up a table into a finer resolution");
+    }
+
+    input->appendTable(table);
+  }
+
+  auto table = createCompactionTable(tables, resolution);
+  table->setSyncPolicy(sstable::SSTableWriter::SyncPolicy::none());
+
+  std::unique_ptr<SampleWriter> writer(new SampleWriter(&token_index_));
+  std::vector<TableRef::SampleRef> refs;
+
+  RollupAggregator aggregator(
+      resolution,
+      [this, &table, &writer, &refs] (RollupSample* sample) -> bool {
+        TableRef::SampleRef ref;
+        ref.time = sample->time;
+        ref.offset = writer->size();
+
+        // sorted so that all samples of a series have the same labels, see
+        // mergeTables()
+        auto labels = sample->labels;
+        std::sort(labels.begin(), labels.end());
+
+        writer->writeValue(sample->value);
+        for (const auto& label : labels) {
+          writer->writeLabel(label.first, label.second);
+        }
+
+        ref.size = writer->size() - ref.offset;
+        refs.emplace_back(ref);
+
+        if (writer->size() >= kMergeBatchSize) {
+          table->addSamples(writer.get(), refs);
+          writer.reset(new SampleWriter(&token_index_));
+          refs.clear();
+        }
+
+        return true;
+      });
+
+  MetricCursor cursor(input, &token_index_);
+  while (cursor.valid()) {
+    RollupValue value;
+    auto sample = readRollupSample(&cursor, &value);
+    aggregator.addSample(cursor.time(), value, sample->labels());
+
+    if (!cursor.next()) {
+      break;
+    }
+  }
+
+  aggregator.flush();
+
+  if (refs.size() > 0) {
+    table->addSamples(writer.get(), refs);
+  }
+
+  table->finalize(&token_index_, &label_index_);
+  if (manifest_ != nullptr) {
+    manifest_->finalizeTable(*table);
+  }
+
+  return std::shared_ptr<TableRef>(new ReadonlyTableRef(*table));
+}
+
+/**
+ * Create a new table for the output of a compaction. The parents of the new
+ * table are all current tables except the ones it replaces so that the
+ * replaced tables are ignored if the new table is the newest table on startup.
+ * The table is marked as compaction output in its header, so if the process
+ * dies before the table is finalized, the incomplete table is discarded on
+ * startup and the replaced tables are kept. Compaction tables are written in
+ * one go, so they store compressed blocks, grouped by series if series
+ * partitioning is enabled
+ */
+std::unique_ptr<TableRef> Metric::createCompactionTable(
+    const std::vector<std::shared_ptr<TableRef>>& replaced_tables,
+    uint64_t rollup_resolution /* = 0 */) {
+  std::lock_guard<std::mutex> lock_holder(append_mutex_);
+  auto snapshot = getSnapshot();
+
+  std::vector<uint64_t> parents;
+  for (const auto& tbl : snapshot->tables()) {
+    auto replaced = false;
+    for (const auto& replaced_tbl : replaced_tables) {
+      if (replaced_tbl->generation() == tbl->generation()) {
+        replaced = true;
+        break;
+      }
+    }
+
+    if (!replaced) {
+      parents.emplace_back(tbl->generation());
+    }
+  }
+
+  auto fileref = file_repo_->createFile();
+  auto file = io::File::openFile(
+      fileref.absolute_path,
+      io::File::O_READ | io::File::O_WRITE | io::File::O_CREATE);
+
+  auto table = TableRef::createTable(
+      fileref.absolute_path,
+      key_,
+      std::move(file),
+      ++max_generation_,
+      parents,
+      rollup_resolution,
+      series_partitioning_ ?
+          TableRef::kSeriesBlocks :
+          TableRef::kCompressedBlocks,
+      true);
+
+  if (manifest_ != nullptr) {
+    manifest_->createTable(*table);
+  }
+
+  return table;
+}
+
 void Metric::setLiveTableMaxSize(size_t max_size) {
   live_table_max_size_ = max_size;
 }
@@ -294,13 +1112,386 @@ void Metric::setLiveTableIdleTimeMicros(uint64_t idle_time_micros) {
   live_table_idle_time_micros_ = idle_time_micros;
 }
 
+void Metric::setSyncPolicy(const sstable::SSTableWriter::SyncPolicy& policy) {
+  std::lock_guard<std::mutex> lock_holder(append_mutex_);
+  sync_policy_ = policy;
+
+  auto snapshot = getSnapshot();
+  if (snapshot.get() != nullptr) {
+    for (const auto& table : snapshot->tables()) {
+      table->setSyncPolicy(policy);
+    }
+  }
+}
+
+void Metric::syncTables() {
+  bool flush_late_table = false;
+
+  {
+    std::lock_guard<std::mutex> lock_holder(append_mutex_);
+
+    // the other writable tables might be finalized concurrently (see
+    // compact())
+    auto snapshot = getSnapshot();
+    if (snapshot.get() != nullptr && snapshot->isWritable()) {
+      snapshot->tables().back()->maybeSync();
+    }
+
+    if (lateTableNeedsFlush(WallClock::unixMicros())) {
+      late_table_.reset();
+      flush_late_table = true;
+    }
+  }
+
+  if (flush_late_table) {
+    flushTables();
+  }
+}
+
+void Metric::setWriteAheadLog(WriteAheadLog* wal) {
+  wal_ = wal;
+}
+
+void Metric::setMemTables(
+    bool enabled,
+    fnord::thread::TaskScheduler* flush_scheduler /* = nullptr */) {
+  std::lock_guard<std::mutex> lock_holder(append_mutex_);
+  mem_tables_ = enabled;
+  flush_scheduler_ = flush_scheduler;
+}
+
+// Must hold append_mutex_ to call this!
+void Metric::scheduleFlush() {
+  if (flush_scheduler_ == nullptr) {
+    return;
+  }
+
+  // tables that are written during the recovery of the write ahead log must
+  // stay unfinished until the recovery is complete (see WriteAheadLog)
+  if (wal_ != nullptr && wal_->isRecovering()) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock_holder(flush_mutex_);
+  if (flush_queued_) {
+    return;
+  }
+
+  flush_queued_ = true;
+  ++num_flush_tasks_;
+
+  flush_scheduler_->run(fnord::thread::Task::create([this] () {
+    {
+      std::lock_guard<std::mutex> lock_holder(flush_mutex_);
+      flush_queued_ = false;
+    }
+
+    try {
+      flushTables();
+    } catch (util::RuntimeException e) {
+      env()->logger()->printf(
+          "ERROR",
+          "uncaught exception while flushing metric '%s'",
+          key_.c_str());
+
+      e.debugPrint();
+    }
+
+    std::lock_guard<std::mutex> lock_holder(flush_mutex_);
+    --num_flush_tasks_;
+    flush_done_.notify_all();
+  }));
+}
+
+size_t Metric::flushTables(bool flush_live_tables /* = false */) {
+  // see scheduleFlush()
+  if (wal_ != nullptr && wal_->isRecovering()) {
+    return 0;
+  }
+
+  importTables();
+  std::lock_guard<std::mutex> compaction_lock_holder(compaction_mutex_);
+
+  std::vector<std::shared_ptr<TableRef>> tables;
+  std::vector<std::shared_ptr<TableRef>> empty_tables;
+  uint64_t newest_generation = 0;
+  {
+    std::lock_guard<std::mutex> append_lock_holder(append_mutex_);
+    auto head = getSnapshot();
+    if (head.get() == nullptr) {
+      return 0;
+    }
+
+    // the next insert starts a new live table (and late table)
+    if (flush_live_tables) {
+      head = createSnapshot(false);
+      setSnapshot(head);
+      late_table_.reset();
+    }
+
+    // the live table and the late table are still appended to
+    const auto& head_tables = head->tables();
+    for (size_t i = 0; i < head_tables.size(); ++i) {
+      const auto& table = head_tables[i];
+      newest_generation = std::max(newest_generation, table->generation());
+
+      if ((head->isWritable() && i + 1 == head_tables.size()) ||
+          table == late_table_ ||
+          !table->isWritable()) {
+        continue;
+      }
+
+      if (table->bodySize() > 0) {
+        tables.emplace_back(table);
+      } else if (flush_live_tables) {
+        empty_tables.emplace_back(table);
+      }
+    }
+  }
+
+  if (tables.size() == 0 && empty_tables.size() == 0) {
+    return 0;
+  }
+
+  std::vector<std::shared_ptr<TableRef>> readonly_tables;
+  uint64_t finalized_generation = 0;
+  for (const auto& table : tables) {
+    if (env()->verbose()) {
+      env()->logger()->printf(
+          "DEBUG",
+          "Flushing sstable '%s' (%s)",
+          table->filename().c_str(),
+          table->metricKey().c_str());
+    }
+
+    table->finalize(&token_index_, &label_index_);
+    if (manifest_ != nullptr) {
+      manifest_->finalizeTable(*table);
+    }
+
+    if (wal_ != nullptr) {
+      logFinalizeTable(*table);
+    }
+
+    finalized_generation = std::max(finalized_generation, table->generation());
+    readonly_tables.emplace_back(new ReadonlyTableRef(*table));
+  }
+
+  std::lock_guard<std::mutex> append_lock_holder(append_mutex_);
+  auto head = getSnapshot();
+  std::shared_ptr<MetricSnapshot> snapshot(new MetricSnapshot());
+  snapshot->setWritable(head->isWritable());
+
+  // empty tables are dropped and deleted below
+  for (const auto& table : head->tables()) {
+    auto iter = std::find(tables.begin(), tables.end(), table);
+    if (iter != tables.end()) {
+      snapshot->appendTable(readonly_tables[iter - tables.begin()]);
+    } else if (std::find(empty_tables.begin(), empty_tables.end(), table) ==
+        empty_tables.end()) {
+      snapshot->appendTable(table);
+    }
+  }
+
+  setSnapshot(snapshot);
+  dropEmptyTables(empty_tables, newest_generation);
+  releaseEmptyTables(finalized_generation);
+  updateLiveTableBudget();
+
+  return tables.size();
+}
+
+// Must hold append_mutex_ to call this!
+void Metric::dropEmptyTables(
+    const std::vector<std::shared_ptr<TableRef>>& tables,
+    uint64_t newest_generation) {
+  for (const auto& table : tables) {
+    if (table->generation() == newest_generation) {
+      empty_tables_.emplace_back(table);
+      continue;
+    }
+
+    if (manifest_ != nullptr) {
+      manifest_->deleteTable(table->filename());
+    }
+
+    table->markObsolete();
+  }
+}
+
+// Must hold append_mutex_ to call this!
+void Metric::releaseEmptyTables(uint64_t generation) {
+  auto iter = empty_tables_.begin();
+  while (iter != empty_tables_.end()) {
+    if ((*iter)->generation() >= generation) {
+      ++iter;
+      continue;
+    }
+
+    if (manifest_ != nullptr) {
+      manifest_->deleteTable((*iter)->filename());
+    }
+
+    (*iter)->markObsolete();
+    iter = empty_tables_.erase(iter);
+  }
+}
+
+void Metric::waitForFlushes() {
+  std::unique_lock<std::mutex> lk(flush_mutex_);
+  while (num_flush_tasks_ > 0) {
+    flush_done_.wait(lk);
+  }
+}
+
+void Metric::setLiveTableBudget(LiveTableBudget* budget) {
+  std::lock_guard<std::mutex> lock_holder(append_mutex_);
+
+  if (budget_ != nullptr) {
+    budget_->charge(
+        -static_cast<int64_t>(budget_bytes_),
+        -static_cast<int64_t>(budget_files_));
+  }
+
+  budget_ = budget;
+  budget_bytes_ = 0;
+  budget_files_ = 0;
+  updateLiveTableBudget();
+}
+
+void Metric::liveTableUsage(size_t* bytes, size_t* files) const {
+  *bytes = 0;
+  *files = 0;
+
+  auto snapshot = getSnapshot();
+  if (snapshot.get() == nullptr) {
+    return;
+  }
+
+  for (const auto& table : snapshot->tables()) {
+    if (table->isWritable()) {
+      *bytes += table->memoryUsage();
+      *files += table->openFiles();
+    }
+  }
+}
+
+// Must hold append_mutex_ to call this!
+void Metric::updateLiveTableBudget() {
+  if (budget_ == nullptr) {
+    return;
+  }
+
+  size_t bytes;
+  size_t files;
+  liveTableUsage(&bytes, &files);
+
+  budget_->charge(
+      static_cast<int64_t>(bytes) - static_cast<int64_t>(budget_bytes_),
+      static_cast<int64_t>(files) - static_cast<int64_t>(budget_files_));
+
+  budget_bytes_ = bytes;
+  budget_files_ = files;
+}
+
+uint64_t Metric::minWriteAheadLogSegment() const {
+  std::lock_guard<std::mutex> lock_holder(append_mutex_);
+
+  uint64_t min_segment = std::numeric_limits<uint64_t>::max();
+  for (const auto& iter : wal_segments_) {
+    min_segment = std::min(min_segment, iter.second);
+  }
+
+  return min_segment;
+}
+
+uint64_t Metric::maxGeneration() const {
+  std::lock_guard<std::mutex> lock_holder(append_mutex_);
+  return max_generation_;
+}
+
+void Metric::dropTables(
+    std::function<bool (const TableRef& table)> predicate) {
+  std::vector<std::shared_ptr<TableRef>> dropped_tables;
+
+  {
+    std::lock_guard<std::mutex> lock_holder(append_mutex_);
+    auto head = getSnapshot();
+    if (head.get() == nullptr) {
+      return;
+    }
+
+    std::shared_ptr<MetricSnapshot> snapshot(new MetricSnapshot());
+
+    for (const auto& table : head->tables()) {
+      if (table->isWritable() && predicate(*table)) {
+        dropped_tables.emplace_back(table);
+      } else {
+        snapshot->appendTable(table);
+      }
+    }
+
+    if (dropped_tables.size() == 0) {
+      return;
+    }
+
+    std::vector<std::shared_ptr<TableRef>> import_tables;
+    for (const auto& table : import_tables_) {
+      if (std::find(dropped_tables.begin(), dropped_tables.end(), table) ==
+          dropped_tables.end()) {
+        import_tables.emplace_back(table);
+      }
+    }
+
+    import_tables_ = import_tables;
+    setSnapshot(snapshot);
+
+    // the dropped tables must not be in the newest table's parent list (see
+    // compact())
+    setSnapshot(createSnapshot(true, true));
+    updateLiveTableBudget();
+  }
+
+  for (const auto& table : dropped_tables) {
+    env()->logger()->printf(
+        "INFO",
+        "Dropping unfinished sstable '%s' (%s)",
+        table->filename().c_str(),
+        table->metricKey().c_str());
+
+    if (manifest_ != nullptr) {
+      manifest_->deleteTable(table->filename());
+    }
+
+    table->markObsolete();
+  }
+}
+
+void Metric::setParallelScan(
+    fnord::thread::TaskScheduler* scheduler,
+    size_t max_tables /* = kScanMaxParallelTablesDefault */) {
+  scan_scheduler_ = scheduler;
+  scan_max_parallel_tables_ = max_tables;
+}
+
+void Metric::setSeriesPartitioning(bool enabled) {
+  series_partitioning_ = enabled;
+}
+
 size_t Metric::numTables() const {
   auto snapshot = getSnapshot();
+  if (snapshot.get() == nullptr) {
+    return 0;
+  }
+
   return snapshot->tables().size();
 }
 
 size_t Metric::totalBytes() const {
   auto snapshot = getSnapshot();
+  if (snapshot.get() == nullptr) {
+    return 0;
+  }
 
   size_t bytes = 0;
   for (const auto& tbl : snapshot->tables()) {
@@ -315,10 +1506,12 @@ DateTime Metric::lastInsertTime() const {
 }
 
 std::set<std::string> Metric::labels() const {
+  importTables();
   return label_index_.labels();
 }
 
 bool Metric::hasLabel(const std::string& label) const {
+  importTables();
   return label_index_.hasLabel(label);
 }
 
@@ -12,13 +12,19 @@
 #include <fnordmetric/io/filerepository.h>
 #include <fnordmetric/metricdb/backends/disk/compactionpolicy.h>
 #include <fnordmetric/metricdb/backends/disk/labelindex.h>
+#include <fnordmetric/metricdb/backends/disk/livetablebudget.h>
+#include <fnordmetric/metricdb/backends/disk/manifest.h>
 #include <fnordmetric/metricdb/backends/disk/metriccursor.h>
 #include <fnordmetric/metricdb/backends/disk/metricsnapshot.h>
 #include <fnordmetric/metricdb/backends/disk/samplereader.h>
 #include <fnordmetric/metricdb/backends/disk/tokenindex.h>
+#include <fnordmetric/metricdb/backends/disk/writeaheadlog.h>
 #include <fnordmetric/metricdb/metric.h>
 #include <fnordmetric/metricdb/sample.h>
 #include <fnordmetric/util/datetime.h>
+#include <condition_variable>
+#include <map>
+#include <mutex>
 #include <string>
 #include <vector>
 
@@ -32,23 +38,216 @@ public:
   static constexpr const size_t kLiveTableMaxSize = 2 << 19; /* 1MB */
   static constexpr const uint64_t kLiveTableIdleTimeMicros = 
       5 * 60 * 1000000; /* 5 minutes */
+  static constexpr const size_t kSyncMaxBytes = 2 << 15; /* 64KB */
+  static constexpr const uint64_t kSyncMaxDelayMicros =
+      1000000; /* 1 second */
+  static constexpr const size_t kMergeBatchSize = 2 << 15; /* 64KB */
+  static constexpr const size_t kScanMaxParallelTablesDefault = 4;
+  static constexpr const uint64_t kReverseScanInitialWindowMicros =
+      60 * 1000000; /* 1 minute */
 
-  Metric(const std::string& key, io::FileRepository* file_repo);
+  /**
+   * If a manifest is passed, the creation, finalization and deletion of the
+   * metric's tables is recorded in the manifest
+   */
+  Metric(
+      const std::string& key,
+      io::FileRepository* file_repo,
+      Manifest* manifest = nullptr);
 
+  /**
+   * Reopen a metric from its existing tables. The token and label indexes of
+   * the tables are not imported until the metric is first accessed, so that
+   * reopening a metric doesn't read any rows
+   */
   Metric(
       const std::string& key,
       io::FileRepository* file_repo,
-      std::vector<std::unique_ptr<TableRef>>&& tables);
+      std::vector<std::unique_ptr<TableRef>>&& tables,
+      Manifest* manifest = nullptr);
+
+  /**
+   * Blocks until all scheduled flushes are done (see waitForFlushes())
+   */
+  ~Metric();
+
+  void scanSamples(
+      const fnord::util::DateTime& time_begin,
+      const fnord::util::DateTime& time_end,
+      std::function<bool (Sample* sample)> callback) override;
+
+  /**
+   * Only reads the matching series of tables with a series index (see
+   * setSeriesPartitioning()) and filters the samples of all other tables
+   */
+  void scanSamples(
+      const fnord::util::DateTime& time_begin,
+      const fnord::util::DateTime& time_end,
+      const LabelFilter& filter,
+      std::function<bool (Sample* sample)> callback) override;
 
+  /**
+   * Does not decode the labels of a sample unless labels are projected or
+   * needed for the filter and does not read the value of a sample unless the
+   * value is projected
+   */
   void scanSamples(
       const fnord::util::DateTime& time_begin,
       const fnord::util::DateTime& time_end,
+      const LabelFilter& filter,
+      const SampleProjection& projection,
       std::function<bool (Sample* sample)> callback) override;
 
-  void compact(CompactionPolicy* compaction = nullptr);
+  /**
+   * Reads windows of the time range from the newest to the oldest with
+   * forward scans and returns the samples of each window in reverse. The
+   * first window is kReverseScanInitialWindowMicros long and each following
+   * window is twice as long as the previous one, so only roughly the last N
+   * samples are read to return N samples
+   */
+  void scanSamplesReverse(
+      const fnord::util::DateTime& time_begin,
+      const fnord::util::DateTime& time_end,
+      std::function<bool (Sample* sample)> callback) override;
+
+  void scanRollups(
+      const fnord::util::DateTime& time_begin,
+      const fnord::util::DateTime& time_end,
+      uint64_t resolution,
+      std::function<bool (RollupSample* sample)> callback) override;
+
+  void scanRollups(
+      const fnord::util::DateTime& time_begin,
+      const fnord::util::DateTime& time_end,
+      const LabelFilter& filter,
+      uint64_t resolution,
+      std::function<bool (RollupSample* sample)> callback) override;
+
+  std::vector<uint64_t> rollupResolutions() const override;
+
+  /**
+   * Finalize the live tables and compact the read only tables with the
+   * compaction policy. If retention_micros is non-zero, read only tables
+   * whose newest sample is older than retention_micros are dropped before the
+   * compaction policy is applied
+   */
+  void compact(
+      CompactionPolicy* compaction = nullptr,
+      uint64_t retention_micros = 0);
+
+  /**
+   * Merge the (read only) tables into a new, finalized table that replaces
+   * them. Should only be called by a CompactionPolicy from within compact()
+   */
+  std::shared_ptr<TableRef> mergeTables(
+      const std::vector<std::shared_ptr<TableRef>>& tables);
+
+  /**
+   * Aggregate the (read only) tables into a new, finalized rollup table with
+   * windows of resolution microseconds that replaces them. Should only be
+   * called by a CompactionPolicy from within compact()
+   */
+  std::shared_ptr<TableRef> rollupTables(
+      const std::vector<std::shared_ptr<TableRef>>& tables,
+      uint64_t resolution);
 
   void setLiveTableMaxSize(size_t max_size);
   void setLiveTableIdleTimeMicros(uint64_t idle_time_micros);
+
+  /**
+   * Set the sync policy for the live (writable) tables of this metric. The
+   * default is to group commit every kSyncMaxBytes or kSyncMaxDelayMicros
+   */
+  void setSyncPolicy(const sstable::SSTableWriter::SyncPolicy& policy);
+
+  /**
+   * Sync the live table if its sync policy requires it (e.g. because the
+   * sync delay has passed since its last sync) and flush the late table if it
+   * is due (see lateTableNeedsFlush()). Called periodically by the SyncTask
+   */
+  void syncTables();
+
+  /**
+   * Append all inserted samples to the write ahead log and wait for the log
+   * to be synced before an insert returns. The live tables are then usually
+   * not synced themselves (see setSyncPolicy()). Must be called before the
+   * first insert
+   */
+  void setWriteAheadLog(WriteAheadLog* wal);
+
+  /**
+   * Buffer the live tables of this metric in memory (see MemTableRef) instead
+   * of writing them to mmapped sstables. Once a live table is full, it is
+   * written to a finalized sstable by a task on flush_scheduler, or by the
+   * next compaction if flush_scheduler is nullptr. The buffered samples are
+   * lost on a crash unless a write ahead log is set. Must be called before the
+   * first insert
+   */
+  void setMemTables(
+      bool enabled,
+      fnord::thread::TaskScheduler* flush_scheduler = nullptr);
+
+  /**
+   * Finalize the full live tables that are buffered in memory and replace
+   * them with read only tables. Called by the flush tasks. If
+   * flush_live_tables is true, the current live table and late table are
+   * finalized as well and the next insert starts a new live table. Returns the
+   * number of finalized tables
+   */
+  size_t flushTables(bool flush_live_tables = false);
+
+  /**
+   * Blocks until all scheduled flushes (see setMemTables()) are done
+   */
+  void waitForFlushes();
+
+  /**
+   * Charge the memory and the file handles held by the writable tables of
+   * this metric to the budget. Inserts block while the budget is exceeded (see
+   * LiveTableBudget). Pass nullptr to release the charged usage
+   */
+  void setLiveTableBudget(LiveTableBudget* budget);
+
+  /**
+   * Return the memory and the number of file handles held by the writable
+   * tables of this metric
+   */
+  void liveTableUsage(size_t* bytes, size_t* files) const;
+
+  /**
+   * Return the id of the oldest write ahead log segment that contains samples
+   * of a table of this metric that is not finalized yet, or UINT64_MAX
+   */
+  uint64_t minWriteAheadLogSegment() const;
+
+  /**
+   * Return the generation of the newest table of this metric. All tables that
+   * are created later have a higher generation
+   */
+  uint64_t maxGeneration() const;
+
+  /**
+   * Drop the unfinished tables the metric was reopened with for which
+   * predicate returns true, e.g. because their samples are recovered from the
+   * write ahead log. Must be called before the metric is first accessed
+   */
+  void dropTables(std::function<bool (const TableRef& table)> predicate);
+
+  /**
+   * Decode up to max_tables read only tables concurrently on the provided
+   * scheduler when scanning this metric. Pass a nullptr scheduler to scan all
+   * tables on the calling thread (the default)
+   */
+  void setParallelScan(
+      fnord::thread::TaskScheduler* scheduler,
+      size_t max_tables = kScanMaxParallelTablesDefault);
+
+  /**
+   * If enabled, the tables written by compactions group their samples by
+   * series (i.e. by label set) and store a series index, so that scans that
+   * filter on labels only read the matching series. Disabled by default
+   */
+  void setSeriesPartitioning(bool enabled);
   size_t numTables() const;
 
   size_t totalBytes() const override;
@@ -57,26 +256,133 @@ public:
   bool hasLabel(const std::string& label) const override;
 
 protected:
-  void insertSampleImpl(
-      double value,
-      const std::vector<std::pair<std::string, std::string>>& labels) override;
+  void insertSamplesImpl(
+      NewSample const* samples,
+      size_t num_samples) override;
 
+  /**
+   * The head snapshot is published atomically: readers never block, and
+   * writers (which must hold append_mutex_) replace it with a new snapshot
+   * instead of modifying it
+   */
   std::shared_ptr<MetricSnapshot> getSnapshot() const;
+
+  /**
+   * Import the token and label indexes of the tables the metric was reopened
+   * with. Must be called before the indexes or the tables are accessed. Only
+   * the first call does any work; concurrent callers block until the import
+   * is done
+   */
+  void importTables() const;
+
+  void setSnapshot(std::shared_ptr<MetricSnapshot> snapshot);
   std::shared_ptr<MetricSnapshot> getOrCreateSnapshot();
-  std::shared_ptr<MetricSnapshot> createSnapshot(bool writable);
+
+  /**
+   * Clone the head snapshot and append a new live table if writable is true.
+   * The live table is a memtable if memtables are enabled, unless on_disk is
+   * true
+   */
+  std::shared_ptr<MetricSnapshot> createSnapshot(
+      bool writable,
+      bool on_disk = false);
+
+  std::shared_ptr<TableRef> getOrCreateLateTable();
+
+  /**
+   * Returns true if the late table must be written to disk now, either because
+   * it is full or because the write ahead log is disabled and the sync policy
+   * would have synced its rows if they were in the live table. Must hold
+   * append_mutex_ to call this
+   */
+  bool lateTableNeedsFlush(uint64_t now) const;
+
+  /**
+   * Append the samples of refs to the write ahead log. Must hold append_mutex_
+   * to call this. Returns the sequence number of the record
+   */
+  uint64_t logSamples(
+      const TableRef& table,
+      const std::vector<TableRef::SampleRef>& refs,
+      const std::vector<size_t>& offsets,
+      NewSample const* samples);
+
+  /**
+   * Append to the write ahead log that the table was finalized. Returns the
+   * sequence number of the record
+   */
+  uint64_t logFinalizeTable(const TableRef& table);
+
+  /**
+   * Schedule a flushTables() task unless one is already waiting to run. Must
+   * hold append_mutex_ to call this
+   */
+  void scheduleFlush();
+
+  /**
+   * Charge the change of the writable tables' usage since the last call to
+   * the budget. Must hold append_mutex_ to call this
+   */
+  void updateLiveTableBudget();
+
+  /**
+   * Delete the empty tables that were dropped from the snapshot. On startup,
+   * the set of live tables is read from the parent list of the newest table,
+   * so if the newest table is empty, its file is kept until a newer table is
+   * written to disk (see releaseEmptyTables()). Must hold append_mutex_ to
+   * call this
+   */
+  void dropEmptyTables(
+      const std::vector<std::shared_ptr<TableRef>>& tables,
+      uint64_t newest_generation);
+
+  /**
+   * Delete the kept empty tables that are older than a table with the provided
+   * generation that was just written to disk. Must hold append_mutex_ to call
+   * this
+   */
+  void releaseEmptyTables(uint64_t generation);
+
+  std::unique_ptr<TableRef> createCompactionTable(
+      const std::vector<std::shared_ptr<TableRef>>& replaced_tables,
+      uint64_t rollup_resolution = 0);
 
   io::FileRepository const* file_repo_;
+  Manifest* manifest_;
+  WriteAheadLog* wal_;
+  /* the first log segment of each unfinalized table, by generation */
+  std::map<uint64_t, uint64_t> wal_segments_;
   std::shared_ptr<MetricSnapshot> head_;
-  mutable std::mutex head_mutex_;
-  std::mutex append_mutex_;
+  std::shared_ptr<TableRef> late_table_;
+  uint64_t late_table_created_;
+  /* empty tables whose files are kept, see dropEmptyTables() */
+  std::vector<std::shared_ptr<TableRef>> empty_tables_;
+  mutable std::mutex append_mutex_;
   std::mutex compaction_mutex_;
   uint64_t max_generation_;
-  TokenIndex token_index_;
-  LabelIndex label_index_;
+  /* imported lazily, see importTables() */
+  mutable TokenIndex token_index_;
+  mutable LabelIndex label_index_;
+  mutable std::once_flag import_once_;
+  mutable std::vector<std::shared_ptr<TableRef>> import_tables_;
 
   size_t live_table_max_size_; // FIXPAUL make atomic
   uint64_t live_table_idle_time_micros_; // FIXPAUL make atomic
   uint64_t last_insert_; // FIXPAUL make atomic
+  sstable::SSTableWriter::SyncPolicy sync_policy_;
+  fnord::thread::TaskScheduler* scan_scheduler_;
+  size_t scan_max_parallel_tables_;
+  std::atomic<bool> series_partitioning_;
+  bool mem_tables_;
+  fnord::thread::TaskScheduler* flush_scheduler_;
+  std::mutex flush_mutex_;
+  std::condition_variable flush_done_;
+  bool flush_queued_;
+  size_t num_flush_tasks_;
+  LiveTableBudget* budget_;
+  /* the usage that is currently charged to budget_ */
+  size_t budget_bytes_;
+  size_t budget_files_;
 };
 
 }
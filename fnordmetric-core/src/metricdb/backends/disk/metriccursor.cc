@@ -8,9 +8,12 @@
  * <http://www.gnu.org/licenses/>.
  */
 #include <fnordmetric/metricdb/backends/disk/metriccursor.h>
+#include <fnordmetric/metricdb/backends/disk/prefetchcursor.h>
 #include <fnordmetric/util/stringutil.h>
 #include <stdlib.h>
+#include <algorithm>
 #include <cstring>
+#include <functional>
 #include <string>
 #include <vector>
 #include <memory>
@@ -21,65 +24,226 @@ namespace disk_backend {
 
 MetricCursor::MetricCursor(
     std::shared_ptr<MetricSnapshot> snapshot,
-    TokenIndex* token_index) :
+    TokenIndex* token_index,
+    uint64_t time_begin /* = 0 */,
+    uint64_t time_end /* = std::numeric_limits<uint64_t>::max() */) :
     snapshot_(snapshot),
+    initialized_(false),
+    time_begin_(time_begin),
+    time_end_(time_end),
     token_index_(token_index),
-    table_index_(0) {}
+    filter_(nullptr),
+    scheduler_(nullptr),
+    max_prefetch_tables_(0) {}
+
+void MetricCursor::setParallelScan(
+    fnord::thread::TaskScheduler* scheduler,
+    size_t max_tables) {
+  if (initialized_) {
+    RAISE(kIllegalStateError, "cursor is already initialized");
+  }
+
+  scheduler_ = scheduler;
+  max_prefetch_tables_ = max_tables;
+}
+
+void MetricCursor::setLabelFilter(const LabelFilter* filter) {
+  if (initialized_) {
+    RAISE(kIllegalStateError, "cursor is already initialized");
+  }
+
+  filter_ = filter;
+}
 
 bool MetricCursor::next() {
-  if (tableCursor()->next()) {
-    return true;
+  if (!valid()) {
+    return false;
   }
 
+  std::pop_heap(
+      table_cursors_.begin(),
+      table_cursors_.end(),
+      &MetricCursor::compareTableCursors);
 
-  while (table_index_ < (snapshot_->tables().size() - 1)) {
-    table_cur_ = snapshot_->tables()[++table_index_]->cursor();
+  auto& table_cursor = table_cursors_.back();
+  if (table_cursor->cursor->next()) {
+    table_cursor->time = readTime(table_cursor->cursor.get());
 
-    if (table_cur_->valid()) {
-      return true;
-    }
+    std::push_heap(
+        table_cursors_.begin(),
+        table_cursors_.end(),
+        &MetricCursor::compareTableCursors);
+  } else {
+    table_cursors_.pop_back();
   }
 
-  return false;
+  openTables();
+  return table_cursors_.size() > 0;
 }
 
 bool MetricCursor::valid() {
-  if (tableCursor()->valid()) {
-    return true;
+  if (!initialized_) {
+    init();
   }
 
-  while (table_index_ < (snapshot_->tables().size() - 1)) {
-    table_cur_ = snapshot_->tables()[++table_index_]->cursor();
+  return table_cursors_.size() > 0;
+}
+
+void MetricCursor::init() {
+  const auto& tables = snapshot_->tables();
 
-    if (table_cur_->valid()) {
-      return true;
+  for (size_t i = 0; i < tables.size(); ++i) {
+    const auto& time_index = tables[i]->timeIndex();
+
+    /* skip tables that can't contain any rows in the requested time range */
+    if (time_index.overlaps(time_begin_, time_end_)) {
+      pending_tables_.emplace_back(time_index.minTime(), i);
     }
   }
 
-  return false;
+  std::sort(
+      pending_tables_.begin(),
+      pending_tables_.end(),
+      std::greater<std::pair<uint64_t, size_t>>());
+
+  initialized_ = true;
+  openTables();
+}
+
+/**
+ * Open all pending tables that might contain a row that sorts before the
+ * current row. For tables with disjoint time ranges this opens one table at a
+ * time
+ */
+void MetricCursor::openTables() {
+  const auto& tables = snapshot_->tables();
+
+  while (pending_tables_.size() > 0) {
+    auto min_time = pending_tables_.back().first;
+    auto table_index = pending_tables_.back().second;
+
+    if (table_cursors_.size() > 0 && min_time > table_cursors_[0]->time) {
+      break;
+    }
+
+    pending_tables_.pop_back();
+
+    std::unique_ptr<fnord::sstable::Cursor> cursor;
+    auto prefetch_cursor = prefetch_cursors_.find(table_index);
+    if (prefetch_cursor == prefetch_cursors_.end()) {
+      cursor = tables[table_index]->cursorFrom(time_begin_, filter_);
+    } else {
+      cursor = std::move(prefetch_cursor->second);
+      prefetch_cursors_.erase(prefetch_cursor);
+    }
+
+    if (!cursor->valid()) {
+      continue;
+    }
+
+    auto table_cursor = new TableCursor();
+    table_cursor->time = readTime(cursor.get());
+    table_cursor->table_index = table_index;
+    table_cursor->cursor = std::move(cursor);
+    table_cursors_.emplace_back(table_cursor);
+
+    std::push_heap(
+        table_cursors_.begin(),
+        table_cursors_.end(),
+        &MetricCursor::compareTableCursors);
+  }
+
+  prefetchTables();
+}
+
+/**
+ * Start reading the next max_prefetch_tables_ pending tables in the
+ * background so that they are (partially) decoded once the merge reaches them
+ */
+void MetricCursor::prefetchTables() {
+  if (scheduler_ == nullptr) {
+    return;
+  }
+
+  const auto& tables = snapshot_->tables();
+  auto time_begin = time_begin_;
+  auto filter = filter_;
+
+  for (size_t i = 0;
+      i < max_prefetch_tables_ && i < pending_tables_.size();
+      ++i) {
+    auto table_index = pending_tables_[pending_tables_.size() - 1 - i].second;
+    const auto& table = tables[table_index];
+
+    // live tables are still appended to and are read on demand
+    if (table->isWritable() ||
+        prefetch_cursors_.count(table_index) > 0) {
+      continue;
+    }
+
+    std::shared_ptr<TableRef> table_ref = table;
+    prefetch_cursors_.emplace(
+        table_index,
+        std::unique_ptr<fnord::sstable::Cursor>(new PrefetchCursor(
+            [table_ref, time_begin, filter] () {
+              return table_ref->cursorFrom(time_begin, filter);
+            },
+            scheduler_)));
+  }
 }
 
 uint64_t MetricCursor::time() {
+  if (!valid()) {
+    RAISE(kIllegalStateError, "invalid cursor");
+  }
+
+  return table_cursors_[0]->time;
+}
+
+void MetricCursor::getData(void** data, size_t* size) {
+  tableCursor()->getData(data, size);
+}
+
+TableRef* MetricCursor::table() {
+  if (!valid()) {
+    RAISE(kIllegalStateError, "invalid cursor");
+  }
+
+  return snapshot_->tables()[table_cursors_[0]->table_index].get();
+}
+
+fnord::sstable::Cursor* MetricCursor::tableCursor() {
+  if (!valid()) {
+    RAISE(kIllegalStateError, "invalid cursor");
+  }
+
+  return table_cursors_[0]->cursor.get();
+}
+
+bool MetricCursor::compareTableCursors(
+    const std::unique_ptr<TableCursor>& a,
+    const std::unique_ptr<TableCursor>& b) {
+  if (a->time == b->time) {
+    return a->table_index > b->table_index;
+  }
+
+  return a->time > b->time;
+}
+
+uint64_t MetricCursor::readTime(fnord::sstable::Cursor* cursor) {
   uint64_t time = 0;
 
   void* key;
   size_t key_len;
-  tableCursor()->getKey(&key, &key_len);
+  cursor->getKey(&key, &key_len);
 
   if (key_len == sizeof(time)) {
     memcpy(&time, key, sizeof(time));
   } else {
     RAISE(kIllegalStateError, "invalid key");
   }
-  return time;
-}
-
-fnord::sstable::Cursor* MetricCursor::tableCursor() {
-  if (table_cur_.get() == nullptr) {
-    table_cur_ = snapshot_->tables()[table_index_]->cursor();
-  }
 
-  return table_cur_.get();
+  return time;
 }
 
 }
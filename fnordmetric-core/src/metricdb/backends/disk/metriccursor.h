@@ -11,9 +11,12 @@
 #define _FNORD_METRICDB_DISK_BACKEND_METRICCURSOR_H
 #include <fnordmetric/metricdb/backends/disk/metricsnapshot.h>
 #include <fnordmetric/metricdb/backends/disk/samplereader.h>
+#include <fnordmetric/thread/taskscheduler.h>
 #include <fnordmetric/util/binarymessagereader.h>
 #include <stdlib.h>
+#include <limits>
 #include <string>
+#include <unordered_map>
 #include <vector>
 #include <memory>
 
@@ -21,15 +24,38 @@ namespace fnordmetric {
 namespace metricdb {
 namespace disk_backend {
 
+/**
+ * Iterates over all samples of a metric snapshot in time order. Tables with
+ * overlapping time ranges (e.g. late tables) are merged on the fly; only the
+ * tables that overlap the current position are opened at any time
+ */
 class MetricCursor {
 public:
   MetricCursor(
       std::shared_ptr<MetricSnapshot> snapshot,
-      TokenIndex* token_index);
+      TokenIndex* token_index,
+      uint64_t time_begin = 0,
+      uint64_t time_end = std::numeric_limits<uint64_t>::max());
 
   MetricCursor(const MetricCursor& copy) = delete;
   MetricCursor& operator=(const MetricCursor& copy) = delete;
 
+  /**
+   * Read up to max_tables read only tables ahead of the current position
+   * concurrently on the provided scheduler. The rows are still returned in
+   * time order. Must be called before the cursor is used
+   */
+  void setParallelScan(
+      fnord::thread::TaskScheduler* scheduler,
+      size_t max_tables);
+
+  /**
+   * Skip the series that don't match the filter in tables with a series
+   * index. Samples of other tables are still returned unfiltered. The filter
+   * must outlive the cursor. Must be called before the cursor is used
+   */
+  void setLabelFilter(const LabelFilter* filter);
+
   bool next();
   bool valid();
 
@@ -38,13 +64,50 @@ public:
   template <typename T>
   SampleReader<T>* sample();
 
+  /**
+   * Return the serialized sample at the current position
+   */
+  void getData(void** data, size_t* size);
+
+  /**
+   * Return the table that contains the sample at the current position
+   */
+  TableRef* table();
+
 protected:
-  std::shared_ptr<MetricSnapshot> snapshot_;
-  int table_index_;
+  struct TableCursor {
+    std::unique_ptr<fnord::sstable::Cursor> cursor;
+    uint64_t time;
+    size_t table_index;
+  };
+
+  static bool compareTableCursors(
+      const std::unique_ptr<TableCursor>& a,
+      const std::unique_ptr<TableCursor>& b);
+
+  static uint64_t readTime(fnord::sstable::Cursor* cursor);
+
+  void init();
+  void openTables();
+  void prefetchTables();
   fnord::sstable::Cursor* tableCursor();
-  std::unique_ptr<fnord::sstable::Cursor> table_cur_;
+
+  std::shared_ptr<MetricSnapshot> snapshot_;
+  bool initialized_;
+  uint64_t time_begin_;
+  uint64_t time_end_;
+  /* tables that have not been opened yet, sorted by descending min time */
+  std::vector<std::pair<uint64_t, size_t>> pending_tables_;
+  /* a min-heap of the open table cursors, ordered by (time, table index) */
+  std::vector<std::unique_ptr<TableCursor>> table_cursors_;
   std::unique_ptr<fnord::util::BinaryMessageReader> sample_;
   TokenIndex* token_index_;
+  const LabelFilter* filter_;
+  fnord::thread::TaskScheduler* scheduler_;
+  size_t max_prefetch_tables_;
+  /* cursors of pending tables that are already read in the background */
+  std::unordered_map<size_t, std::unique_ptr<fnord::sstable::Cursor>>
+      prefetch_cursors_;
 };
 
 // impl
@@ -8,9 +8,15 @@
  * <http://www.gnu.org/licenses/>.
  */
 #include <fnordmetric/environment.h>
+#include <fnordmetric/io/fileutil.h>
 #include <fnordmetric/metricdb/backends/disk/metricrepository.h>
 #include <fnordmetric/sstable/sstablerepair.h>
 #include <fnordmetric/thread/task.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <string.h>
 
 namespace fnordmetric {
 namespace metricdb {
@@ -18,43 +24,317 @@ namespace disk_backend {
 
 MetricRepository::MetricRepository(
     const std::string data_dir,
-    fnord::thread::TaskScheduler* scheduler) :
+    fnord::thread::TaskScheduler* scheduler,
+    bool write_ahead_log /* = false */) :
     file_repo_(new fnord::io::FileRepository(data_dir)),
-    compaction_task_(this) {
-  std::unordered_map<
-      std::string,
-      std::vector<std::unique_ptr<TableRef>>> tables;
+    scheduler_(scheduler),
+    live_table_budget_(new LiveTableBudget(
+        [this] () -> std::vector<Metric*> {
+          std::vector<Metric*> metrics;
+          for (const auto metric : listMetrics()) {
+            metrics.emplace_back(static_cast<Metric*>(metric));
+          }
 
-  file_repo_->listFiles([this, &tables] (const std::string& filename) -> bool {
-    fnord::sstable::SSTableRepair repair(filename);
+          return metrics;
+        },
+        scheduler)),
+    compaction_policy_(new SizeTieredCompactionPolicy()),
+    retention_micros_(0),
+    series_partitioning_(false),
+    compaction_task_(this),
+    sync_task_(this) {
+  TableMap tables;
 
-    if (repair.checkAndRepair(true)) {
-      auto table_ref = TableRef::openTable(filename);
-      tables[table_ref->metricKey()].emplace_back(std::move(table_ref));
-    } else {
-      env()->logger()->printf(
-          "ERROR",
-          "can't repair sstable %s. skipping...",
-          filename.c_str());
+  if (Manifest::exists(data_dir)) {
+    manifest_.reset(new Manifest(data_dir));
+    openTables(manifest_->tables(), &tables);
+  } else {
+    std::vector<std::string> filenames;
+    file_repo_->listFiles([&filenames] (const std::string& filename) -> bool {
+      auto basename = filename.substr(filename.rfind('/') + 1);
+      if (basename.compare(0, strlen(Manifest::kFilename), Manifest::kFilename)
+          != 0 && !WriteAheadLog::isSegment(basename)) {
+        filenames.emplace_back(filename);
+      }
+
+      return true;
+    });
+
+    openTables(filenames, &tables);
+
+    /* data directories without a manifest are scanned once */
+    std::vector<TableRef const*> table_refs;
+    for (const auto& iter : tables) {
+      for (const auto& table : iter.second) {
+        table_refs.emplace_back(table.get());
+      }
     }
 
-    return true;
-  });
+    manifest_.reset(new Manifest(data_dir));
+    manifest_->reset(table_refs);
+  }
+
+  if (WriteAheadLog::exists(data_dir) && !write_ahead_log) {
+    env()->logger()->printf(
+        "WARNING",
+        "%s contains a write ahead log, keeping the write ahead log enabled",
+        data_dir.c_str());
+
+    write_ahead_log = true;
+  }
+
+  if (write_ahead_log) {
+    wal_.reset(new WriteAheadLog(data_dir));
+
+    for (const auto& iter : tables) {
+      for (const auto& table : iter.second) {
+        if (!table->isWritable()) {
+          wal_->addFinalizedTable(table->metricKey(), table->generation());
+        }
+      }
+    }
+  }
 
   for (auto& iter : tables) {
     auto metric = new Metric(
         iter.first,
         file_repo_.get(),
-        std::move(iter.second));
+        std::move(iter.second),
+        manifest_.get());
 
-    metrics_.emplace(iter.first, std::unique_ptr<Metric>(metric));
+    metric->setParallelScan(scheduler_);
+    metric->setLiveTableBudget(live_table_budget_.get());
+    addMetric(iter.first, metric);
+
+    if (wal_.get() != nullptr) {
+      metric->setWriteAheadLog(wal_.get());
+      metric->setSyncPolicy(sstable::SSTableWriter::SyncPolicy::none());
+      metric->setMemTables(true, scheduler_);
+    }
+  }
+
+  if (wal_.get() != nullptr) {
+    recoverWriteAheadLog();
   }
 
   scheduler->run(fnord::thread::Task::create(compaction_task_.runnable()));
+
+  // the live tables are not synced at all if the write ahead log is enabled
+  if (wal_.get() == nullptr) {
+    scheduler->run(fnord::thread::Task::create(sync_task_.runnable()));
+  }
+}
+
+MetricRepository::~MetricRepository() {
+  // the metrics are deleted after the budget, the log and the manifest
+  for (const auto metric : listMetrics()) {
+    static_cast<Metric*>(metric)->setLiveTableBudget(nullptr);
+    static_cast<Metric*>(metric)->waitForFlushes();
+  }
+
+  live_table_budget_.reset();
+}
+
+void MetricRepository::openTables(
+    const std::vector<std::string>& filenames,
+    TableMap* tables) {
+  std::mutex mutex;
+  std::condition_variable done;
+  std::atomic<size_t> next_file(0);
+  size_t num_running = filenames.size();
+  if (num_running > kOpenMaxParallelFiles) {
+    num_running = kOpenMaxParallelFiles;
+  }
+
+  /* a fixed number of tasks pull the files since the scheduler might start a
+     new thread for every task */
+  for (size_t i = num_running; i > 0; --i) {
+    scheduler_->run(fnord::thread::Task::create(
+        [&filenames, tables, &mutex, &done, &next_file, &num_running] () {
+      for (auto n = next_file++; n < filenames.size(); n = next_file++) {
+        auto table_ref = repairAndOpenTable(filenames[n]);
+
+        if (table_ref.get() != nullptr) {
+          std::lock_guard<std::mutex> lock_holder(mutex);
+          (*tables)[table_ref->metricKey()].emplace_back(std::move(table_ref));
+        }
+      }
+
+      std::lock_guard<std::mutex> lock_holder(mutex);
+      if (--num_running == 0) {
+        done.notify_all();
+      }
+    }));
+  }
+
+  std::unique_lock<std::mutex> lk(mutex);
+  while (num_running > 0) {
+    done.wait(lk);
+  }
+}
+
+void MetricRepository::openTables(
+    const std::vector<Manifest::TableInfo>& table_infos,
+    TableMap* tables) {
+  std::vector<std::string> unfinished_tables;
+
+  for (const auto& info : table_infos) {
+    if (info.finalized) {
+      (*tables)[info.metric_key].emplace_back(TableRef::openTable(
+          info.filename,
+          info.metric_key,
+          info.body_size,
+          info.generation,
+          info.parents,
+          info.rollup_resolution,
+          static_cast<TableRef::RowFormat>(info.row_format)));
+    } else if (fnord::io::FileUtil::exists(info.filename)) {
+      unfinished_tables.emplace_back(info.filename);
+    } else {
+      /* late tables are only written to disk when they are finalized */
+      if (env()->verbose()) {
+        env()->logger()->printf(
+            "DEBUG",
+            "SSTable '%s' (%s) was never written, skipping...",
+            info.filename.c_str(),
+            info.metric_key.c_str());
+      }
+
+      manifest_->deleteTable(info.filename);
+    }
+  }
+
+  openTables(unfinished_tables, tables);
+}
+
+void MetricRepository::recoverWriteAheadLog() {
+  std::map<std::string, uint64_t> max_generations;
+  for (const auto metric : listMetrics()) {
+    max_generations[metric->key()] =
+        static_cast<Metric*>(metric)->maxGeneration();
+  }
+
+  for (const auto metric : listMetrics()) {
+    static_cast<Metric*>(metric)->dropTables([this] (const TableRef& table)
+        -> bool {
+      return wal_->needsRecovery(table.metricKey(), table.generation());
+    });
+  }
+
+  wal_->recover(max_generations, [this] (
+      const std::string& metric_key,
+      std::vector<NewSample>&& samples) {
+    findOrCreateMetric(metric_key)->insertSamples(samples);
+  });
+}
+
+std::unique_ptr<TableRef> MetricRepository::repairAndOpenTable(
+    const std::string& filename) {
+  try {
+    fnord::sstable::SSTableRepair repair(filename);
+
+    if (repair.checkAndRepair(true)) {
+      return TableRef::openTable(filename);
+    }
+
+    env()->logger()->printf(
+        "ERROR",
+        "can't repair sstable %s. skipping...",
+        filename.c_str());
+  } catch (const std::exception& e) {
+    env()->logger()->printf(
+        "ERROR",
+        "can't open sstable %s: %s. skipping...",
+        filename.c_str(),
+        e.what());
+  }
+
+  return std::unique_ptr<TableRef>(nullptr);
+}
+
+void MetricRepository::setCompactionPolicy(
+    std::shared_ptr<CompactionPolicy> policy) {
+  std::lock_guard<std::mutex> lock_holder(compaction_policy_mutex_);
+  compaction_policy_ = policy;
+}
+
+std::shared_ptr<CompactionPolicy> MetricRepository::compactionPolicy() const {
+  std::lock_guard<std::mutex> lock_holder(compaction_policy_mutex_);
+  return compaction_policy_;
+}
+
+void MetricRepository::setRetention(uint64_t retention_micros) {
+  std::lock_guard<std::mutex> lock_holder(retention_mutex_);
+  retention_micros_ = retention_micros;
+}
+
+void MetricRepository::setRetention(
+    const std::string& metric_key,
+    uint64_t retention_micros) {
+  std::lock_guard<std::mutex> lock_holder(retention_mutex_);
+  metric_retention_micros_[metric_key] = retention_micros;
+}
+
+uint64_t MetricRepository::retention(const std::string& metric_key) const {
+  std::lock_guard<std::mutex> lock_holder(retention_mutex_);
+
+  auto iter = metric_retention_micros_.find(metric_key);
+  if (iter == metric_retention_micros_.end()) {
+    return retention_micros_;
+  } else {
+    return iter->second;
+  }
+}
+
+void MetricRepository::setSeriesPartitioning(bool enabled) {
+  series_partitioning_ = enabled;
+
+  for (auto metric : listMetrics()) {
+    static_cast<Metric*>(metric)->setSeriesPartitioning(enabled);
+  }
+}
+
+void MetricRepository::releaseWriteAheadLogSegments() {
+  if (wal_.get() == nullptr) {
+    return;
+  }
+
+  // samples that are appended after this are in the current segment or later
+  auto min_segment = wal_->currentSegment();
+  for (const auto metric : listMetrics()) {
+    min_segment = std::min(
+        min_segment,
+        static_cast<Metric*>(metric)->minWriteAheadLogSegment());
+  }
+
+  wal_->releaseSegments(min_segment);
+}
+
+WriteAheadLog* MetricRepository::writeAheadLog() const {
+  return wal_.get();
+}
+
+void MetricRepository::setLiveTableBudget(size_t max_bytes, size_t max_files) {
+  live_table_budget_->setLimits(max_bytes, max_files);
+}
+
+LiveTableBudget* MetricRepository::liveTableBudget() const {
+  return live_table_budget_.get();
 }
 
 Metric* MetricRepository::createMetric(const std::string& key) {
-  return new Metric(key, file_repo_.get());
+  auto metric = new Metric(key, file_repo_.get(), manifest_.get());
+  metric->setParallelScan(scheduler_);
+  metric->setSeriesPartitioning(series_partitioning_);
+  metric->setLiveTableBudget(live_table_budget_.get());
+
+  if (wal_.get() != nullptr) {
+    metric->setWriteAheadLog(wal_.get());
+    metric->setSyncPolicy(sstable::SSTableWriter::SyncPolicy::none());
+    metric->setMemTables(true, scheduler_);
+  }
+
+  return metric;
 }
 
 }
@@ -10,7 +10,12 @@
 #ifndef _FNORDMETRIC_METRICDB_DISK_BACKEND_METRICREPOSITORY_H_
 #define _FNORDMETRIC_METRICDB_DISK_BACKEND_METRICREPOSITORY_H_
 #include <fnordmetric/metricdb/backends/disk/compactiontask.h>
+#include <fnordmetric/metricdb/backends/disk/livetablebudget.h>
+#include <fnordmetric/metricdb/backends/disk/manifest.h>
 #include <fnordmetric/metricdb/backends/disk/metric.h>
+#include <fnordmetric/metricdb/backends/disk/sizetieredcompactionpolicy.h>
+#include <fnordmetric/metricdb/backends/disk/synctask.h>
+#include <fnordmetric/metricdb/backends/disk/writeaheadlog.h>
 #include <fnordmetric/metricdb/metricrepository.h>
 #include <fnordmetric/io/filerepository.h>
 #include <fnordmetric/thread/taskscheduler.h>
@@ -21,14 +26,133 @@ namespace disk_backend {
 
 class MetricRepository : public fnordmetric::metricdb::IMetricRepository {
 public:
+  static constexpr const size_t kOpenMaxParallelFiles = 8;
+
+  /**
+   * Reopens the tables recorded in the manifest of data_dir (see Manifest).
+   * Finalized tables are opened without reading their files, unfinished
+   * tables are repaired and opened on up to kOpenMaxParallelFiles threads of
+   * the scheduler. Data directories without a manifest are scanned and a
+   * manifest is written. The indexes of the reopened metrics are imported
+   * lazily when each metric is first accessed (see Metric::importTables())
+   *
+   * If write_ahead_log is true, all inserted samples are appended to a
+   * WriteAheadLog and the live tables are buffered in memory (see
+   * Metric::setMemTables()) and flushed on the scheduler. On startup, the
+   * unfinished tables are dropped and their samples are recovered from the
+   * log. The log stays enabled if the data directory contains log segments
+   *
+   * The writable tables of all metrics share a LiveTableBudget with the
+   * default limits (see setLiveTableBudget())
+   */
   MetricRepository(
       const std::string data_dir,
-      fnord::thread::TaskScheduler* scheduler);
+      fnord::thread::TaskScheduler* scheduler,
+      bool write_ahead_log = false);
+
+  /**
+   * Blocks until all scheduled flushes and evictions are done
+   */
+  ~MetricRepository();
+
+  /**
+   * Set the compaction policy that the compaction task applies to all metrics
+   * in this repository. The default is a SizeTieredCompactionPolicy. Pass
+   * nullptr to only finalize tables
+   */
+  void setCompactionPolicy(std::shared_ptr<CompactionPolicy> policy);
+  std::shared_ptr<CompactionPolicy> compactionPolicy() const;
+
+  /**
+   * Set the default retention for all metrics in this repository. The
+   * compaction task drops tables whose newest sample is older than the
+   * retention. A retention of zero (the default) keeps all samples forever
+   */
+  void setRetention(uint64_t retention_micros);
+
+  /**
+   * Set the retention for a single metric. Overrides the default retention.
+   * A retention of zero keeps all samples of the metric forever
+   */
+  void setRetention(const std::string& metric_key, uint64_t retention_micros);
+
+  /**
+   * Return the retention of the metric with the provided key in microseconds
+   * or zero if the samples of the metric should be kept forever
+   */
+  uint64_t retention(const std::string& metric_key) const;
+
+  /**
+   * Enable or disable series partitioning (see
+   * Metric::setSeriesPartitioning()) for all metrics in this repository
+   */
+  void setSeriesPartitioning(bool enabled);
+
+  /**
+   * Limit the memory and the file handles held by the writable tables of all
+   * metrics in this repository. Inserts block while the limits are exceeded
+   * and the writable tables of the idlest or largest metrics are finalized
+   * early (see LiveTableBudget)
+   */
+  void setLiveTableBudget(size_t max_bytes, size_t max_files);
+  LiveTableBudget* liveTableBudget() const;
+
+  /**
+   * Delete the write ahead log segments that only contain samples of
+   * finalized tables. Called by the compaction task after each run
+   */
+  void releaseWriteAheadLogSegments();
+
+  /**
+   * Returns nullptr if the write ahead log is disabled
+   */
+  WriteAheadLog* writeAheadLog() const;
 
 protected:
+  typedef std::unordered_map<
+      std::string,
+      std::vector<std::unique_ptr<TableRef>>> TableMap;
+
   Metric* createMetric(const std::string& key) override;
+
+  /**
+   * Repair and open the files on the scheduler and group the tables by metric
+   * key. Blocks until all files are opened
+   */
+  void openTables(const std::vector<std::string>& filenames, TableMap* tables);
+
+  /**
+   * Open the tables recorded in the manifest and group them by metric key
+   */
+  void openTables(
+      const std::vector<Manifest::TableInfo>& table_infos,
+      TableMap* tables);
+
+  /**
+   * Drop the unfinished tables whose samples are in the write ahead log and
+   * re-insert the samples
+   */
+  void recoverWriteAheadLog();
+
+  /**
+   * Returns nullptr if the file can't be repaired or opened
+   */
+  static std::unique_ptr<TableRef> repairAndOpenTable(
+      const std::string& filename);
+
   std::shared_ptr<fnord::io::FileRepository> file_repo_;
+  std::unique_ptr<Manifest> manifest_;
+  std::unique_ptr<WriteAheadLog> wal_;
+  fnord::thread::TaskScheduler* scheduler_;
+  std::unique_ptr<LiveTableBudget> live_table_budget_;
+  std::shared_ptr<CompactionPolicy> compaction_policy_;
+  mutable std::mutex compaction_policy_mutex_;
+  uint64_t retention_micros_;
+  std::unordered_map<std::string, uint64_t> metric_retention_micros_;
+  mutable std::mutex retention_mutex_;
+  std::atomic<bool> series_partitioning_;
   CompactionTask compaction_task_;
+  SyncTask sync_task_;
 };
 
 }
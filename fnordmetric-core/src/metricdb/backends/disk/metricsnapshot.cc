@@ -25,6 +25,12 @@ void MetricSnapshot::appendTable(std::shared_ptr<TableRef> table) {
   tables_.emplace_back(table);
 }
 
+void MetricSnapshot::insertTable(
+    size_t index,
+    std::shared_ptr<TableRef> table) {
+  tables_.insert(tables_.begin() + index, table);
+}
+
 const std::vector<std::shared_ptr<TableRef>>& MetricSnapshot::tables() const {
   return tables_;
 }
@@ -26,6 +26,7 @@ public:
   MetricSnapshot& operator=(const MetricSnapshot& other) = delete;
 
   void appendTable(std::shared_ptr<TableRef> table);
+  void insertTable(size_t index, std::shared_ptr<TableRef> table);
   const std::vector<std::shared_ptr<TableRef>>& tables() const;
   std::shared_ptr<MetricSnapshot> clone() const;
 
@@ -0,0 +1,84 @@
+/**
+ * This file is part of the "FnordMetric" project
+ *   Copyright (c) 2014 Paul Asmuth, Google Inc.
+ *
+ * FnordMetric is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License v3.0. You should have received a
+ * copy of the GNU General Public License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#include <fnordmetric/metricdb/backends/disk/postingscursor.h>
+#include <fnordmetric/util/runtimeexception.h>
+#include <algorithm>
+
+namespace fnordmetric {
+namespace metricdb {
+namespace disk_backend {
+
+PostingsCursor::PostingsCursor(
+    std::unique_ptr<sstable::Cursor> cursor,
+    std::vector<uint64_t>&& body_offsets) :
+    cursor_(std::move(cursor)),
+    body_offsets_(std::move(body_offsets)),
+    pos_(0),
+    positioned_(false) {}
+
+void PostingsCursor::seekTo(size_t body_offset) {
+  pos_ = std::lower_bound(
+      body_offsets_.begin(),
+      body_offsets_.end(),
+      body_offset) - body_offsets_.begin();
+
+  positioned_ = false;
+}
+
+bool PostingsCursor::next() {
+  if (!valid()) {
+    return false;
+  }
+
+  ++pos_;
+  positioned_ = false;
+  return valid();
+}
+
+bool PostingsCursor::valid() {
+  if (pos_ >= body_offsets_.size()) {
+    return false;
+  }
+
+  if (!positioned_) {
+    cursor_->seekTo(body_offsets_[pos_]);
+    positioned_ = true;
+  }
+
+  return cursor_->valid();
+}
+
+void PostingsCursor::getKey(void** data, size_t* size) {
+  if (!valid()) {
+    RAISE(kIllegalStateError, "invalid cursor");
+  }
+
+  cursor_->getKey(data, size);
+}
+
+void PostingsCursor::getData(void** data, size_t* size) {
+  if (!valid()) {
+    RAISE(kIllegalStateError, "invalid cursor");
+  }
+
+  cursor_->getData(data, size);
+}
+
+size_t PostingsCursor::position() const {
+  if (pos_ >= body_offsets_.size()) {
+    return cursor_->position();
+  }
+
+  return body_offsets_[pos_];
+}
+
+}
+}
+}
@@ -0,0 +1,52 @@
+/**
+ * This file is part of the "FnordMetric" project
+ *   Copyright (c) 2014 Paul Asmuth, Google Inc.
+ *
+ * FnordMetric is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License v3.0. You should have received a
+ * copy of the GNU General Public License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#ifndef _FNORDMETRIC_METRICDB_POSTINGSCURSOR_H
+#define _FNORDMETRIC_METRICDB_POSTINGSCURSOR_H
+#include <fnordmetric/sstable/cursor.h>
+#include <memory>
+#include <vector>
+
+using namespace fnord;
+namespace fnordmetric {
+namespace metricdb {
+namespace disk_backend {
+
+/**
+ * Iterates over the sstable rows at a sorted list of body offsets (e.g. a
+ * list from the PostingsIndex) and skips all other rows. seekTo() positions
+ * the cursor at the first listed row at or after the body offset
+ */
+class PostingsCursor : public sstable::Cursor {
+public:
+  PostingsCursor(
+      std::unique_ptr<sstable::Cursor> cursor,
+      std::vector<uint64_t>&& body_offsets);
+
+  void seekTo(size_t body_offset) override;
+  bool next() override;
+  bool valid() override;
+
+  void getKey(void** data, size_t* size) override;
+  void getData(void** data, size_t* size) override;
+
+  size_t position() const override;
+
+protected:
+  std::unique_ptr<sstable::Cursor> cursor_;
+  std::vector<uint64_t> body_offsets_;
+  size_t pos_;
+  bool positioned_;
+};
+
+}
+}
+}
+
+#endif
@@ -0,0 +1,107 @@
+/**
+ * This file is part of the "FnordMetric" project
+ *   Copyright (c) 2014 Paul Asmuth, Google Inc.
+ *
+ * FnordMetric is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License v3.0. You should have received a
+ * copy of the GNU General Public License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#include <fnordmetric/metricdb/backends/disk/postingsindex.h>
+#include <algorithm>
+#include <iterator>
+
+namespace fnordmetric {
+namespace metricdb {
+namespace disk_backend {
+
+void PostingsIndex::addPosting(
+    const std::string& key,
+    const std::string& value,
+    uint64_t body_offset) {
+  auto& list = lists_[std::make_pair(key, value)];
+
+  if (list.size() == 0 || list.back() < body_offset) {
+    list.emplace_back(body_offset);
+  }
+}
+
+const std::vector<uint64_t>* PostingsIndex::postings(
+    const std::string& key,
+    const std::string& value) const {
+  auto iter = lists_.find(std::make_pair(key, value));
+  if (iter == lists_.end()) {
+    return nullptr;
+  }
+
+  return &iter->second;
+}
+
+std::vector<uint64_t> PostingsIndex::findRows(
+    const LabelFilter& filter) const {
+  std::vector<uint64_t> rows;
+  auto first = true;
+
+  for (const auto& condition : filter.conditions()) {
+    std::vector<uint64_t> condition_rows;
+
+    for (const auto& value : condition.second) {
+      auto list = postings(condition.first, value);
+      if (list != nullptr) {
+        condition_rows = unionPostings(condition_rows, *list);
+      }
+    }
+
+    if (first) {
+      rows = condition_rows;
+      first = false;
+    } else {
+      rows = intersectPostings(rows, condition_rows);
+    }
+
+    if (rows.size() == 0) {
+      break;
+    }
+  }
+
+  return rows;
+}
+
+const std::map<std::pair<std::string, std::string>, std::vector<uint64_t>>&
+    PostingsIndex::lists() const {
+  return lists_;
+}
+
+std::vector<uint64_t> PostingsIndex::intersectPostings(
+    const std::vector<uint64_t>& a,
+    const std::vector<uint64_t>& b) {
+  std::vector<uint64_t> result;
+
+  std::set_intersection(
+      a.begin(),
+      a.end(),
+      b.begin(),
+      b.end(),
+      std::back_inserter(result));
+
+  return result;
+}
+
+std::vector<uint64_t> PostingsIndex::unionPostings(
+    const std::vector<uint64_t>& a,
+    const std::vector<uint64_t>& b) {
+  std::vector<uint64_t> result;
+
+  std::set_union(
+      a.begin(),
+      a.end(),
+      b.begin(),
+      b.end(),
+      std::back_inserter(result));
+
+  return result;
+}
+
+}
+}
+}
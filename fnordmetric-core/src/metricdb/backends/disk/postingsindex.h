@@ -0,0 +1,80 @@
+/**
+ * This file is part of the "FnordMetric" project
+ *   Copyright (c) 2014 Paul Asmuth, Google Inc.
+ *
+ * FnordMetric is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License v3.0. You should have received a
+ * copy of the GNU General Public License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#ifndef _FNORDMETRIC_METRICDB_POSTINGSINDEX_H
+#define _FNORDMETRIC_METRICDB_POSTINGSINDEX_H
+#include <fnordmetric/metricdb/labelfilter.h>
+#include <map>
+#include <set>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace fnordmetric {
+namespace metricdb {
+namespace disk_backend {
+
+/**
+ * An inverted index from (label key, label value) to the sorted body offsets
+ * of the rows (or compressed blocks) of a table that contain a sample with
+ * that label. Unlike the LabelIndex, which only records which label keys
+ * exist, the postings index answers "which rows have host=web42" so that a
+ * scan filtered on labels can skip the rows that can't match.
+ *
+ * The index is built once when the table is finalized (or imported) and is
+ * immutable afterwards
+ */
+class PostingsIndex {
+public:
+  static const uint32_t kIndexType = 0xa0f6;
+
+  /**
+   * Add a row to the postings list of a label. The offsets of each list must
+   * be added in ascending order; adding the last offset again is a no-op
+   */
+  void addPosting(
+      const std::string& key,
+      const std::string& value,
+      uint64_t body_offset);
+
+  /**
+   * Return the postings list of a label or nullptr if no row has the label
+   */
+  const std::vector<uint64_t>* postings(
+      const std::string& key,
+      const std::string& value) const;
+
+  /**
+   * Return the rows that might contain a sample that matches the filter, i.e.
+   * the intersection over all conditions of the union of the postings lists
+   * of the allowed values. The filter must not be empty
+   */
+  std::vector<uint64_t> findRows(const LabelFilter& filter) const;
+
+  const std::map<std::pair<std::string, std::string>, std::vector<uint64_t>>&
+      lists() const;
+
+  static std::vector<uint64_t> intersectPostings(
+      const std::vector<uint64_t>& a,
+      const std::vector<uint64_t>& b);
+
+  static std::vector<uint64_t> unionPostings(
+      const std::vector<uint64_t>& a,
+      const std::vector<uint64_t>& b);
+
+protected:
+  std::map<std::pair<std::string, std::string>, std::vector<uint64_t>> lists_;
+};
+
+}
+}
+}
+
+#endif
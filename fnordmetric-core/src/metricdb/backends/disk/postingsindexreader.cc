@@ -0,0 +1,42 @@
+/**
+ * This file is part of the "FnordMetric" project
+ *   Copyright (c) 2014 Paul Asmuth, Google Inc.
+ *
+ * FnordMetric is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License v3.0. You should have received a
+ * copy of the GNU General Public License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#include <fnordmetric/metricdb/backends/disk/postingsindexreader.h>
+
+namespace fnordmetric {
+namespace metricdb {
+namespace disk_backend {
+
+PostingsIndexReader::PostingsIndexReader(
+    void* data,
+    size_t size) :
+    fnord::util::BinaryMessageReader(data, size) {}
+
+void PostingsIndexReader::readIndex(PostingsIndex* postings_index) {
+  auto num_lists = *readUInt32();
+
+  for (uint32_t i = 0; i < num_lists; ++i) {
+    auto key = readLengthPrefixedString();
+    auto value = readLengthPrefixedString();
+
+    auto num_postings = *readUInt32();
+    for (uint32_t j = 0; j < num_postings; ++j) {
+      postings_index->addPosting(key, value, *readUInt64());
+    }
+  }
+}
+
+std::string PostingsIndexReader::readLengthPrefixedString() {
+  auto str_size = *readUInt32();
+  return std::string(readString(str_size), str_size);
+}
+
+}
+}
+}
@@ -0,0 +1,35 @@
+/**
+ * This file is part of the "FnordMetric" project
+ *   Copyright (c) 2014 Paul Asmuth, Google Inc.
+ *
+ * FnordMetric is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License v3.0. You should have received a
+ * copy of the GNU General Public License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#include <fnordmetric/metricdb/backends/disk/postingsindexwriter.h>
+
+namespace fnordmetric {
+namespace metricdb {
+namespace disk_backend {
+
+PostingsIndexWriter::PostingsIndexWriter(const PostingsIndex* index) {
+  const auto& lists = index->lists();
+  appendUInt32(lists.size());
+
+  for (const auto& list : lists) {
+    appendUInt32(list.first.first.size());
+    appendString(list.first.first);
+    appendUInt32(list.first.second.size());
+    appendString(list.first.second);
+
+    appendUInt32(list.second.size());
+    for (const auto& body_offset : list.second) {
+      appendUInt64(body_offset);
+    }
+  }
+}
+
+}
+}
+}
@@ -0,0 +1,196 @@
+/**
+ * This file is part of the "FnordMetric" project
+ *   Copyright (c) 2014 Paul Asmuth, Google Inc.
+ *
+ * FnordMetric is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License v3.0. You should have received a
+ * copy of the GNU General Public License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#include <fnordmetric/metricdb/backends/disk/prefetchcursor.h>
+#include <fnordmetric/thread/task.h>
+#include <fnordmetric/util/runtimeexception.h>
+
+namespace fnordmetric {
+namespace metricdb {
+namespace disk_backend {
+
+PrefetchCursor::PrefetchCursor(
+    std::function<std::unique_ptr<sstable::Cursor> ()> open_fn,
+    fnord::thread::TaskScheduler* scheduler) :
+    done_(false),
+    cancelled_(false),
+    initialized_(false),
+    row_(0) {
+  try {
+    scheduler->run(fnord::thread::Task::create([this, open_fn] () {
+      prefetch(open_fn);
+    }));
+  } catch (...) {
+    done_ = true;
+    throw;
+  }
+}
+
+PrefetchCursor::~PrefetchCursor() {
+  std::unique_lock<std::mutex> lk(mutex_);
+  cancelled_ = true;
+  cv_.notify_all();
+
+  while (!done_) {
+    cv_.wait(lk);
+  }
+}
+
+void PrefetchCursor::seekTo(size_t body_offset) {
+  RAISE(kNotImplementedError, "PrefetchCursor does not support seekTo()");
+}
+
+bool PrefetchCursor::next() {
+  if (!valid()) {
+    return false;
+  }
+
+  if (++row_ < batch_->rows.size()) {
+    return true;
+  }
+
+  return popBatch();
+}
+
+bool PrefetchCursor::valid() {
+  if (!initialized_) {
+    initialized_ = true;
+    popBatch();
+  }
+
+  return batch_.get() != nullptr;
+}
+
+void PrefetchCursor::getKey(void** data, size_t* size) {
+  const auto& row = currentRow();
+  *data = &batch_->buffer[row.key_offset];
+  *size = row.key_size;
+}
+
+void PrefetchCursor::getData(void** data, size_t* size) {
+  const auto& row = currentRow();
+  *data = &batch_->buffer[row.data_offset];
+  *size = row.data_size;
+}
+
+size_t PrefetchCursor::position() const {
+  return currentRow().position;
+}
+
+const PrefetchCursor::Row& PrefetchCursor::currentRow() const {
+  if (batch_.get() == nullptr) {
+    RAISE(kIllegalStateError, "invalid cursor");
+  }
+
+  return batch_->rows[row_];
+}
+
+/**
+ * Runs on the scheduler. Copies the rows of the wrapped cursor into batches
+ * until the wrapped cursor is exhausted or this cursor is destroyed
+ */
+void PrefetchCursor::prefetch(
+    std::function<std::unique_ptr<sstable::Cursor> ()> open_fn) {
+  try {
+    auto cursor = open_fn();
+    std::unique_ptr<Batch> batch;
+
+    for (bool valid = cursor->valid(); valid; valid = cursor->next()) {
+      if (batch.get() == nullptr) {
+        batch.reset(new Batch());
+        batch->buffer.reserve(kBatchSize);
+      }
+
+      void* key;
+      size_t key_size;
+      void* data;
+      size_t data_size;
+      cursor->getKey(&key, &key_size);
+      cursor->getData(&data, &data_size);
+
+      Row row;
+      row.position = cursor->position();
+      row.key_offset = batch->buffer.size();
+      row.key_size = key_size;
+      batch->buffer.append(static_cast<char*>(key), key_size);
+      row.data_offset = batch->buffer.size();
+      row.data_size = data_size;
+      batch->buffer.append(static_cast<char*>(data), data_size);
+      batch->rows.emplace_back(row);
+
+      if (batch->buffer.size() >= kBatchSize) {
+        if (!pushBatch(std::move(batch))) {
+          break;
+        }
+      }
+    }
+
+    if (batch.get() != nullptr) {
+      pushBatch(std::move(batch));
+    }
+  } catch (...) {
+    std::lock_guard<std::mutex> lock_holder(mutex_);
+    error_ = std::current_exception();
+  }
+
+  std::lock_guard<std::mutex> lock_holder(mutex_);
+  done_ = true;
+  cv_.notify_all();
+}
+
+/**
+ * Blocks until there is room for the batch. Returns false if this cursor was
+ * destroyed in the meantime
+ */
+bool PrefetchCursor::pushBatch(std::unique_ptr<Batch> batch) {
+  std::unique_lock<std::mutex> lk(mutex_);
+
+  while (batches_.size() >= kMaxBatches && !cancelled_) {
+    cv_.wait(lk);
+  }
+
+  if (cancelled_) {
+    return false;
+  }
+
+  batches_.emplace_back(std::move(batch));
+  cv_.notify_all();
+  return true;
+}
+
+/**
+ * Blocks until the next batch is available. Returns false once all batches
+ * were read
+ */
+bool PrefetchCursor::popBatch() {
+  std::unique_lock<std::mutex> lk(mutex_);
+  batch_.reset();
+  row_ = 0;
+
+  while (batches_.empty() && !done_) {
+    cv_.wait(lk);
+  }
+
+  if (batches_.empty()) {
+    if (error_) {
+      std::rethrow_exception(error_);
+    }
+
+    return false;
+  }
+
+  batch_ = std::move(batches_.front());
+  batches_.pop_front();
+  cv_.notify_all();
+  return true;
+}
+
+}
+}
+}
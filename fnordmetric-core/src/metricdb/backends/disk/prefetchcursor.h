@@ -0,0 +1,97 @@
+/**
+ * This file is part of the "FnordMetric" project
+ *   Copyright (c) 2014 Paul Asmuth, Google Inc.
+ *
+ * FnordMetric is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License v3.0. You should have received a
+ * copy of the GNU General Public License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#ifndef _FNORDMETRIC_METRICDB_PREFETCHCURSOR_H_
+#define _FNORDMETRIC_METRICDB_PREFETCHCURSOR_H_
+#include <fnordmetric/sstable/cursor.h>
+#include <fnordmetric/thread/taskscheduler.h>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace fnord;
+namespace fnordmetric {
+namespace metricdb {
+namespace disk_backend {
+
+/**
+ * A cursor that reads the rows of another cursor on a background task. The
+ * rows are copied into batches of kBatchSize bytes and at most kMaxBatches
+ * batches are buffered ahead of the reader, so the memory used per cursor is
+ * bounded.
+ *
+ * The wrapped cursor is opened by the background task with open_fn and must
+ * stay valid until this cursor is destroyed. The destructor stops the
+ * background task and waits for it to finish. Exceptions thrown while reading
+ * are rethrown from valid() or next()
+ */
+class PrefetchCursor : public sstable::Cursor {
+public:
+  static const size_t kBatchSize = 2 << 15; /* 64KB */
+  static const size_t kMaxBatches = 4;
+
+  PrefetchCursor(
+      std::function<std::unique_ptr<sstable::Cursor> ()> open_fn,
+      fnord::thread::TaskScheduler* scheduler);
+
+  ~PrefetchCursor();
+
+  /**
+   * Not supported, prefetch cursors can only be read forward
+   */
+  void seekTo(size_t body_offset) override;
+
+  bool next() override;
+  bool valid() override;
+
+  void getKey(void** data, size_t* size) override;
+  void getData(void** data, size_t* size) override;
+
+  size_t position() const override;
+
+protected:
+  struct Row {
+    size_t key_offset;
+    size_t key_size;
+    size_t data_offset;
+    size_t data_size;
+    size_t position;
+  };
+
+  struct Batch {
+    std::string buffer;
+    std::vector<Row> rows;
+  };
+
+  void prefetch(std::function<std::unique_ptr<sstable::Cursor> ()> open_fn);
+  bool pushBatch(std::unique_ptr<Batch> batch);
+  bool popBatch();
+  const Row& currentRow() const;
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<std::unique_ptr<Batch>> batches_;
+  bool done_;
+  bool cancelled_;
+  std::exception_ptr error_;
+
+  bool initialized_;
+  std::unique_ptr<Batch> batch_;
+  size_t row_;
+};
+
+}
+}
+}
+#endif
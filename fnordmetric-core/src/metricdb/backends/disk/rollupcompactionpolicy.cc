@@ -0,0 +1,172 @@
+/**
+ * This file is part of the "FnordMetric" project
+ *   Copyright (c) 2014 Paul Asmuth, Google Inc.
+ *
+ * FnordMetric is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License v3.0. You should have received a
+ * copy of the GNU General Public License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#include <fnordmetric/environment.h>
+#include <fnordmetric/metricdb/backends/disk/metric.h>
+#include <fnordmetric/metricdb/backends/disk/rollupcompactionpolicy.h>
+#include <fnordmetric/util/runtimeexception.h>
+#include <fnordmetric/util/wallclock.h>
+
+using fnord::util::WallClock;
+
+namespace fnordmetric {
+namespace metricdb {
+namespace disk_backend {
+
+RollupCompactionPolicy::RollupCompactionPolicy(
+    const std::vector<Tier>& tiers) :
+    tiers_(tiers) {
+  for (size_t i = 0; i < tiers_.size(); ++i) {
+    if (tiers_[i].resolution == 0) {
+      RAISE(kIllegalArgumentError, "rollup resolution must be > 0");
+    }
+
+    if (i == 0) {
+      continue;
+    }
+
+    if (tiers_[i].min_age <= tiers_[i - 1].min_age) {
+      RAISE(kIllegalArgumentError, "rollup tiers must be sorted by age");
+    }
+
+    if (tiers_[i].resolution <= tiers_[i - 1].resolution ||
+        tiers_[i].resolution % tiers_[i - 1].resolution != 0) {
+      RAISE(
+          kIllegalArgumentError,
+          "rollup resolutions must be multiples of the previous resolution");
+    }
+  }
+}
+
+std::vector<RollupCompactionPolicy::Tier> RollupCompactionPolicy::parseTiers(
+    const std::string& str) {
+  std::vector<Tier> tiers;
+
+  size_t begin = 0;
+  while (begin < str.size()) {
+    auto end = str.find(',', begin);
+    if (end == std::string::npos) {
+      end = str.size();
+    }
+
+    auto tier_str = str.substr(begin, end - begin);
+    auto sep = tier_str.find(':');
+    if (sep == std::string::npos) {
+      RAISE(
+          kIllegalArgumentError,
+          "invalid rollup tier: '%s', expected <min_age>:<resolution>",
+          tier_str.c_str());
+    }
+
+    Tier tier;
+    tier.min_age = parseDuration(tier_str.substr(0, sep));
+    tier.resolution = parseDuration(tier_str.substr(sep + 1));
+    tiers.emplace_back(tier);
+
+    begin = end + 1;
+  }
+
+  return tiers;
+}
+
+uint64_t RollupCompactionPolicy::parseDuration(const std::string& str) {
+  uint64_t value = 0;
+  size_t pos = 0;
+
+  for (; pos < str.size() && str[pos] >= '0' && str[pos] <= '9'; ++pos) {
+    value = value * 10 + (str[pos] - '0');
+  }
+
+  if (pos == 0 || pos + 1 != str.size()) {
+    RAISE(kIllegalArgumentError, "invalid duration: '%s'", str.c_str());
+  }
+
+  switch (str[pos]) {
+    case 's':
+      return value * 1000000;
+    case 'm':
+      return value * 60 * 1000000;
+    case 'h':
+      return value * 3600 * 1000000;
+    case 'd':
+      return value * 86400 * 1000000;
+    default:
+      RAISE(kIllegalArgumentError, "invalid duration: '%s'", str.c_str());
+  }
+}
+
+uint64_t RollupCompactionPolicy::targetResolution(
+    uint64_t max_time,
+    uint64_t now) const {
+  uint64_t resolution = 0;
+
+  // tables without a time index report a max time of UINT64_MAX and are
+  // never rolled up
+  for (const auto& tier : tiers_) {
+    if (tier.min_age <= now && max_time <= now - tier.min_age) {
+      resolution = tier.resolution;
+    }
+  }
+
+  return resolution;
+}
+
+void RollupCompactionPolicy::compact(
+    Metric* metric,
+    std::vector<std::shared_ptr<TableRef>>* tables) {
+  std::vector<std::shared_ptr<TableRef>> new_tables;
+  auto now = WallClock::unixMicros();
+
+  for (size_t begin = 0; begin < tables->size(); ) {
+    const auto& first = (*tables)[begin];
+    auto resolution = targetResolution(first->maxTime(), now);
+
+    if (first->isWritable() || resolution <= first->rollupResolution()) {
+      new_tables.emplace_back(first);
+      ++begin;
+      continue;
+    }
+
+    /* find the run of adjacent tables that are rolled up into resolution */
+    size_t end = begin + 1;
+    while (end < tables->size()) {
+      const auto& table = (*tables)[end];
+
+      if (table->isWritable() ||
+          table->rollupResolution() >= resolution ||
+          targetResolution(table->maxTime(), now) != resolution) {
+        break;
+      }
+
+      ++end;
+    }
+
+    std::vector<std::shared_ptr<TableRef>> run(
+        tables->begin() + begin,
+        tables->begin() + end);
+
+    if (env()->verbose()) {
+      env()->logger()->printf(
+          "DEBUG",
+          "Rolling up %i sstables into %llus windows for metric: '%s'",
+          (int) run.size(),
+          (long long unsigned) (resolution / 1000000),
+          first->metricKey().c_str());
+    }
+
+    new_tables.emplace_back(metric->rollupTables(run, resolution));
+    begin = end;
+  }
+
+  *tables = new_tables;
+}
+
+}
+}
+}
@@ -0,0 +1,72 @@
+/**
+ * This file is part of the "FnordMetric" project
+ *   Copyright (c) 2014 Paul Asmuth, Google Inc.
+ *
+ * FnordMetric is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License v3.0. You should have received a
+ * copy of the GNU General Public License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#ifndef _FNORDMETRIC_METRICDB_ROLLUPCOMPACTIONPOLICY_H_
+#define _FNORDMETRIC_METRICDB_ROLLUPCOMPACTIONPOLICY_H_
+#include <fnordmetric/metricdb/backends/disk/compactionpolicy.h>
+#include <string>
+#include <vector>
+
+namespace fnordmetric {
+namespace metricdb {
+namespace disk_backend {
+
+/**
+ * Replaces tables whose samples are older than a tier's min age with rollup
+ * tables that store the count, sum, min and max of the samples per label set
+ * and window of the tier's resolution. Runs of adjacent tables that are rolled
+ * up into the same resolution are written to one rollup table.
+ *
+ * E.g. the tiers "7d:1m,90d:1h" keep raw samples for 7 days, 1 minute rollups
+ * for 90 days and 1 hour rollups forever.
+ */
+class RollupCompactionPolicy : public CompactionPolicy {
+public:
+  struct Tier {
+    uint64_t min_age; /* microseconds */
+    uint64_t resolution; /* microseconds */
+  };
+
+  /**
+   * The tiers must be sorted by min age and each resolution must be a multiple
+   * of the previous tier's resolution
+   */
+  RollupCompactionPolicy(const std::vector<Tier>& tiers);
+
+  /**
+   * Parse a comma separated list of <min_age>:<resolution> tiers where each
+   * duration is a number followed by one of the units s, m, h or d, e.g.
+   * "7d:1m,90d:1h"
+   */
+  static std::vector<Tier> parseTiers(const std::string& str);
+
+  /**
+   * Parse a duration like "90s", "5m", "1h" or "7d" into microseconds
+   */
+  static uint64_t parseDuration(const std::string& str);
+
+  void compact(
+      Metric* metric,
+      std::vector<std::shared_ptr<TableRef>>* tables) override;
+
+protected:
+
+  /**
+   * Returns the resolution into which samples with a time of max_time should
+   * be rolled up or 0 if they should be kept
+   */
+  uint64_t targetResolution(uint64_t max_time, uint64_t now) const;
+
+  std::vector<Tier> tiers_;
+};
+
+}
+}
+}
+#endif
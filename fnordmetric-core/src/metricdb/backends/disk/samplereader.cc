@@ -9,6 +9,7 @@
  */
 #include <fnordmetric/metricdb/backends/disk/tokenindex.h>
 #include <fnordmetric/metricdb/backends/disk/samplereader.h>
+#include <fnordmetric/metricdb/rollup.h>
 #include <fnordmetric/util/ieee754.h>
 
 namespace fnordmetric {
@@ -20,25 +21,39 @@ AbstractSampleReader::AbstractSampleReader(
     size_t size,
     TokenIndex* token_index) :
     fnord::util::BinaryMessageReader(data, size),
+    label_offset_(0),
     token_index_(token_index),
+    label_refs_read_(false),
     labels_read_(false) {}
 
 const std::vector<std::pair<std::string, std::string>>&
     AbstractSampleReader::labels() {
   if (!labels_read_) {
-    seekTo(label_offset_);
     labels_read_ = true;
 
-    while (pos_ < size_) {
-      auto key = readToken();
-      auto value = readToken();
-      labels_.emplace_back(key, value);
+    for (const auto& label : labelRefs()) {
+      labels_.emplace_back(label.first.toString(), label.second.toString());
     }
   }
 
   return labels_;
 }
 
+const LabelRefList& AbstractSampleReader::labelRefs() {
+  if (!label_refs_read_) {
+    seekTo(label_offset_);
+    label_refs_read_ = true;
+
+    while (pos_ < size_) {
+      auto key = readTokenRef();
+      auto value = readTokenRef();
+      label_refs_.emplace_back(key, value);
+    }
+  }
+
+  return label_refs_;
+}
+
 std::vector<std::pair<uint32_t, std::string>>
     AbstractSampleReader::tokenDefinitions() {
   seekTo(label_offset_);
@@ -67,7 +82,7 @@ std::vector<std::pair<uint32_t, std::string>>
   return token_definitions;
 }
 
-std::string AbstractSampleReader::readToken() {
+LabelRef AbstractSampleReader::readTokenRef() {
   auto token_ref = *readUInt32();
   uint32_t string_len;
   uint32_t token_def = 0;
@@ -76,19 +91,27 @@ std::string AbstractSampleReader::readToken() {
     token_def = *readUInt32();
     string_len = *readUInt32();
   } else if (token_ref >= TokenIndex::kMinTokenID) {
-    return token_index_->resolveToken(token_ref);
+    return LabelRef(token_index_->resolveTokenRef(token_ref));
   } else {
     string_len = token_ref;
   }
 
-  auto token = std::string(readString(string_len), string_len);
-  return token;
+  return LabelRef(readString(string_len), string_len);
 }
 
 template <> double SampleReader<double>::readValue() {
   return fnord::util::IEEE754::fromBytes(*readUInt64());
 }
 
+template <> RollupValue SampleReader<RollupValue>::readValue() {
+  RollupValue value;
+  value.count = *readUInt64();
+  value.sum = fnord::util::IEEE754::fromBytes(*readUInt64());
+  value.min = fnord::util::IEEE754::fromBytes(*readUInt64());
+  value.max = fnord::util::IEEE754::fromBytes(*readUInt64());
+  return value;
+}
+
 }
 }
 }
@@ -9,6 +9,7 @@
  */
 #ifndef _FNORDMETRIC_METRICDB_SAMPLEREADER_H
 #define _FNORDMETRIC_METRICDB_SAMPLEREADER_H
+#include <fnordmetric/metricdb/sample.h>
 #include <fnordmetric/util/binarymessagereader.h>
 #include <stdlib.h>
 #include <stdint.h>
@@ -20,20 +21,36 @@ namespace disk_backend{
 
 class TokenIndex;
 
-class AbstractSampleReader : public fnord::util::BinaryMessageReader {
+/**
+ * Reads the labels of a serialized sample. On its own, it reads a serialized
+ * list of labels without a value. The labels are only decoded when they are
+ * first accessed
+ */
+class AbstractSampleReader :
+    public fnord::util::BinaryMessageReader,
+    public SampleLabelSource {
 public:
   AbstractSampleReader(
       void* data,
       size_t size,
       TokenIndex* token_index);
 
-  const std::vector<std::pair<std::string, std::string>>& labels();
+  const std::vector<std::pair<std::string, std::string>>& labels() override;
+
+  /**
+   * Return the labels as references into the token index and the serialized
+   * sample, without copying them into strings
+   */
+  const LabelRefList& labelRefs() override;
+
   std::vector<std::pair<uint32_t, std::string>> tokenDefinitions();
 
 protected:
-  std::string readToken();
+  LabelRef readTokenRef();
   size_t label_offset_;
   TokenIndex* token_index_;
+  LabelRefList label_refs_;
+  bool label_refs_read_;
   std::vector<std::pair<std::string, std::string>> labels_;
   bool labels_read_;
 };
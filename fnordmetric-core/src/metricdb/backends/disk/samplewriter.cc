@@ -10,6 +10,7 @@
 #include <fnordmetric/metricdb/backends/disk/binaryformat.h>
 #include <fnordmetric/metricdb/backends/disk/samplewriter.h>
 #include <fnordmetric/metricdb/backends/disk/tokenindex.h>
+#include <fnordmetric/metricdb/rollup.h>
 #include <fnordmetric/util/ieee754.h>
 #include <fnordmetric/util/runtimeexception.h>
 #include <stdlib.h>
@@ -30,6 +31,13 @@ template <> void SampleWriter::writeValue<double>(double value) {
   appendUInt64(fnord::util::IEEE754::toBytes(value));
 }
 
+template <> void SampleWriter::writeValue<RollupValue>(RollupValue value) {
+  appendUInt64(value.count);
+  appendUInt64(fnord::util::IEEE754::toBytes(value.sum));
+  appendUInt64(fnord::util::IEEE754::toBytes(value.min));
+  appendUInt64(fnord::util::IEEE754::toBytes(value.max));
+}
+
 void SampleWriter::writeLabel(
     const std::string& key,
     const std::string& value) {
@@ -49,7 +57,7 @@ void SampleWriter::writeToken(const std::string& token, bool force_indexing) {
     appendUInt32(token_id);
   } else if (force_indexing) {
     // write new definition
-    token_id = token_index_->addToken(token);
+    token_id = token_index_->findOrAddToken(token);
     appendUInt32(0xffffffff);
     appendUInt32(token_id);
     appendUInt32(token.size());
@@ -0,0 +1,69 @@
+/**
+ * This file is part of the "FnordMetric" project
+ *   Copyright (c) 2014 Paul Asmuth, Google Inc.
+ *
+ * FnordMetric is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License v3.0. You should have received a
+ * copy of the GNU General Public License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#include <fnordmetric/metricdb/backends/disk/seriesindex.h>
+#include <fnordmetric/util/fnv.h>
+#include <algorithm>
+
+namespace fnordmetric {
+namespace metricdb {
+namespace disk_backend {
+
+uint64_t SeriesIndex::seriesID(
+    const std::vector<std::pair<std::string, std::string>>& labels) {
+  std::string key;
+  for (const auto& label : labels) {
+    key.append(label.first);
+    key.push_back('\0');
+    key.append(label.second);
+    key.push_back('\0');
+  }
+
+  fnord::util::FNV<uint64_t> fnv;
+  return fnv.hash(key);
+}
+
+void SeriesIndex::addSeries(const Series& series) {
+  auto iter = std::upper_bound(
+      series_.begin(),
+      series_.end(),
+      series,
+      [] (const Series& a, const Series& b) {
+        return a.series_id < b.series_id;
+      });
+
+  series_.insert(iter, series);
+}
+
+const std::vector<SeriesIndex::Series>& SeriesIndex::series() const {
+  return series_;
+}
+
+std::vector<const SeriesIndex::Series*> SeriesIndex::findSeries(
+    const LabelFilter& filter,
+    uint64_t time_begin,
+    uint64_t time_end) const {
+  std::vector<const Series*> series;
+
+  for (const auto& s : series_) {
+    if (s.max_time < time_begin || s.min_time >= time_end) {
+      continue;
+    }
+
+    if (filter.matches(s.labels)) {
+      series.emplace_back(&s);
+    }
+  }
+
+  return series;
+}
+
+}
+}
+}
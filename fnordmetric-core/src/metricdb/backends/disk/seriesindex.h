@@ -0,0 +1,75 @@
+/**
+ * This file is part of the "FnordMetric" project
+ *   Copyright (c) 2014 Paul Asmuth, Google Inc.
+ *
+ * FnordMetric is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License v3.0. You should have received a
+ * copy of the GNU General Public License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#ifndef _FNORDMETRIC_METRICDB_SERIESINDEX_H
+#define _FNORDMETRIC_METRICDB_SERIESINDEX_H
+#include <fnordmetric/metricdb/labelfilter.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace fnordmetric {
+namespace metricdb {
+namespace disk_backend {
+
+/**
+ * The series directory of a table whose rows are grouped by series. A series
+ * is the set of samples with the same label set; its id is the hash of the
+ * sorted label set. The samples of each series are stored as a contiguous
+ * range of <compressed_block> rows in time order, so a scan that is filtered
+ * on labels only has to read the ranges of the matching series.
+ *
+ * The index is built once when the table is finalized (or imported) and is
+ * immutable afterwards
+ */
+class SeriesIndex {
+public:
+  static const uint32_t kIndexType = 0xa0f5;
+
+  struct Series {
+    uint64_t series_id;
+    uint64_t min_time;
+    uint64_t max_time;
+    size_t body_begin; /* body offset of the series' first block */
+    size_t body_end; /* body offset after the series' last block */
+    std::vector<std::pair<std::string, std::string>> labels; /* sorted */
+  };
+
+  /**
+   * Return the series id of a label set. The labels must be sorted
+   */
+  static uint64_t seriesID(
+      const std::vector<std::pair<std::string, std::string>>& labels);
+
+  void addSeries(const Series& series);
+
+  /**
+   * The series of the table sorted by series id
+   */
+  const std::vector<Series>& series() const;
+
+  /**
+   * Return the series that match the filter and might contain samples in
+   * [time_begin, time_end)
+   */
+  std::vector<const Series*> findSeries(
+      const LabelFilter& filter,
+      uint64_t time_begin,
+      uint64_t time_end) const;
+
+protected:
+  std::vector<Series> series_;
+};
+
+}
+}
+}
+
+#endif
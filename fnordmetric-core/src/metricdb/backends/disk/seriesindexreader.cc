@@ -0,0 +1,48 @@
+/**
+ * This file is part of the "FnordMetric" project
+ *   Copyright (c) 2014 Paul Asmuth, Google Inc.
+ *
+ * FnordMetric is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License v3.0. You should have received a
+ * copy of the GNU General Public License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#include <fnordmetric/metricdb/backends/disk/seriesindexreader.h>
+
+namespace fnordmetric {
+namespace metricdb {
+namespace disk_backend {
+
+SeriesIndexReader::SeriesIndexReader(
+    void* data,
+    size_t size) :
+    fnord::util::BinaryMessageReader(data, size) {}
+
+void SeriesIndexReader::readIndex(SeriesIndex* series_index) {
+  while (pos_ < size_) {
+    SeriesIndex::Series series;
+    series.series_id = *readUInt64();
+    series.min_time = *readUInt64();
+    series.max_time = *readUInt64();
+    series.body_begin = *readUInt64();
+    series.body_end = *readUInt64();
+
+    auto num_labels = *readUInt32();
+    for (uint32_t i = 0; i < num_labels; ++i) {
+      auto key = readLengthPrefixedString();
+      auto value = readLengthPrefixedString();
+      series.labels.emplace_back(key, value);
+    }
+
+    series_index->addSeries(series);
+  }
+}
+
+std::string SeriesIndexReader::readLengthPrefixedString() {
+  auto str_size = *readUInt32();
+  return std::string(readString(str_size), str_size);
+}
+
+}
+}
+}
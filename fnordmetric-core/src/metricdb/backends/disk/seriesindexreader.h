@@ -0,0 +1,39 @@
+/**
+ * This file is part of the "FnordMetric" project
+ *   Copyright (c) 2014 Paul Asmuth, Google Inc.
+ *
+ * FnordMetric is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License v3.0. You should have received a
+ * copy of the GNU General Public License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#ifndef _FNORDMETRIC_METRICDB_SERIESINDEXREADER_H
+#define _FNORDMETRIC_METRICDB_SERIESINDEXREADER_H
+#include <fnordmetric/metricdb/backends/disk/seriesindex.h>
+#include <fnordmetric/util/binarymessagereader.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace fnordmetric {
+namespace metricdb {
+namespace disk_backend {
+
+class SeriesIndexReader : public fnord::util::BinaryMessageReader {
+public:
+  SeriesIndexReader(
+      void* data,
+      size_t size);
+
+  void readIndex(SeriesIndex* series_index);
+
+protected:
+  std::string readLengthPrefixedString();
+};
+
+}
+}
+}
+
+#endif
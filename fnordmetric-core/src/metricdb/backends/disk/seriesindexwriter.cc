@@ -0,0 +1,36 @@
+/**
+ * This file is part of the "FnordMetric" project
+ *   Copyright (c) 2014 Paul Asmuth, Google Inc.
+ *
+ * FnordMetric is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License v3.0. You should have received a
+ * copy of the GNU General Public License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#include <fnordmetric/metricdb/backends/disk/seriesindexwriter.h>
+
+namespace fnordmetric {
+namespace metricdb {
+namespace disk_backend {
+
+SeriesIndexWriter::SeriesIndexWriter(const SeriesIndex* index) {
+  for (const auto& series : index->series()) {
+    appendUInt64(series.series_id);
+    appendUInt64(series.min_time);
+    appendUInt64(series.max_time);
+    appendUInt64(series.body_begin);
+    appendUInt64(series.body_end);
+
+    appendUInt32(series.labels.size());
+    for (const auto& label : series.labels) {
+      appendUInt32(label.first.size());
+      appendString(label.first);
+      appendUInt32(label.second.size());
+      appendString(label.second);
+    }
+  }
+}
+
+}
+}
+}
@@ -0,0 +1,124 @@
+/**
+ * This file is part of the "FnordMetric" project
+ *   Copyright (c) 2014 Paul Asmuth, Google Inc.
+ *
+ * FnordMetric is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License v3.0. You should have received a
+ * copy of the GNU General Public License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#include <fnordmetric/metricdb/backends/disk/seriesmergecursor.h>
+#include <fnordmetric/util/runtimeexception.h>
+#include <algorithm>
+#include <string.h>
+
+namespace fnordmetric {
+namespace metricdb {
+namespace disk_backend {
+
+SeriesMergeCursor::SeriesMergeCursor(
+    std::vector<std::unique_ptr<sstable::Cursor>> cursors) {
+  for (size_t i = 0; i < cursors.size(); ++i) {
+    if (!cursors[i]->valid()) {
+      continue;
+    }
+
+    auto series_cursor = new SeriesCursor();
+    series_cursor->time = readTime(cursors[i].get());
+    series_cursor->index = i;
+    series_cursor->cursor = std::move(cursors[i]);
+    cursors_.emplace_back(series_cursor);
+  }
+
+  std::make_heap(
+      cursors_.begin(),
+      cursors_.end(),
+      &SeriesMergeCursor::compareSeriesCursors);
+}
+
+void SeriesMergeCursor::seekTo(size_t body_offset) {
+  RAISE(kNotImplementedError, "can't seek a series merge cursor");
+}
+
+bool SeriesMergeCursor::next() {
+  if (!valid()) {
+    return false;
+  }
+
+  std::pop_heap(
+      cursors_.begin(),
+      cursors_.end(),
+      &SeriesMergeCursor::compareSeriesCursors);
+
+  auto& series_cursor = cursors_.back();
+  if (series_cursor->cursor->next()) {
+    series_cursor->time = readTime(series_cursor->cursor.get());
+
+    std::push_heap(
+        cursors_.begin(),
+        cursors_.end(),
+        &SeriesMergeCursor::compareSeriesCursors);
+  } else {
+    cursors_.pop_back();
+  }
+
+  return valid();
+}
+
+bool SeriesMergeCursor::valid() {
+  return cursors_.size() > 0;
+}
+
+void SeriesMergeCursor::getKey(void** data, size_t* size) {
+  if (!valid()) {
+    RAISE(kIllegalStateError, "invalid cursor");
+  }
+
+  cursors_[0]->cursor->getKey(data, size);
+}
+
+void SeriesMergeCursor::getData(void** data, size_t* size) {
+  if (!valid()) {
+    RAISE(kIllegalStateError, "invalid cursor");
+  }
+
+  cursors_[0]->cursor->getData(data, size);
+}
+
+size_t SeriesMergeCursor::position() const {
+  if (cursors_.size() == 0) {
+    return 0;
+  }
+
+  return cursors_[0]->cursor->position();
+}
+
+bool SeriesMergeCursor::compareSeriesCursors(
+    const std::unique_ptr<SeriesCursor>& a,
+    const std::unique_ptr<SeriesCursor>& b) {
+  if (a->time == b->time) {
+    return a->index > b->index;
+  }
+
+  return a->time > b->time;
+}
+
+uint64_t SeriesMergeCursor::readTime(sstable::Cursor* cursor) {
+  uint64_t time = 0;
+
+  void* key;
+  size_t key_len;
+  cursor->getKey(&key, &key_len);
+
+  if (key_len == sizeof(time)) {
+    memcpy(&time, key, sizeof(time));
+  } else {
+    RAISE(kIllegalStateError, "invalid key");
+  }
+
+  return time;
+}
+
+}
+}
+}
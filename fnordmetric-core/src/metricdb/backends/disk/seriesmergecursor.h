@@ -0,0 +1,63 @@
+/**
+ * This file is part of the "FnordMetric" project
+ *   Copyright (c) 2014 Paul Asmuth, Google Inc.
+ *
+ * FnordMetric is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License v3.0. You should have received a
+ * copy of the GNU General Public License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#ifndef _FNORDMETRIC_METRICDB_SERIESMERGECURSOR_H
+#define _FNORDMETRIC_METRICDB_SERIESMERGECURSOR_H
+#include <fnordmetric/sstable/cursor.h>
+#include <memory>
+#include <vector>
+
+using namespace fnord;
+namespace fnordmetric {
+namespace metricdb {
+namespace disk_backend {
+
+/**
+ * Merges the per-series cursors of a table whose rows are grouped by series
+ * into one cursor over all samples in time order. Samples with the same time
+ * are returned in the order of the series cursors.
+ *
+ * position() returns the position of the series cursor of the current sample;
+ * seekTo() is not supported
+ */
+class SeriesMergeCursor : public sstable::Cursor {
+public:
+  SeriesMergeCursor(std::vector<std::unique_ptr<sstable::Cursor>> cursors);
+
+  void seekTo(size_t body_offset) override;
+  bool next() override;
+  bool valid() override;
+
+  void getKey(void** data, size_t* size) override;
+  void getData(void** data, size_t* size) override;
+
+  size_t position() const override;
+
+protected:
+  struct SeriesCursor {
+    std::unique_ptr<sstable::Cursor> cursor;
+    uint64_t time;
+    size_t index;
+  };
+
+  static bool compareSeriesCursors(
+      const std::unique_ptr<SeriesCursor>& a,
+      const std::unique_ptr<SeriesCursor>& b);
+
+  static uint64_t readTime(sstable::Cursor* cursor);
+
+  /* a min-heap of the series cursors, ordered by (time, index) */
+  std::vector<std::unique_ptr<SeriesCursor>> cursors_;
+};
+
+}
+}
+}
+
+#endif
@@ -0,0 +1,84 @@
+/**
+ * This file is part of the "FnordMetric" project
+ *   Copyright (c) 2014 Paul Asmuth, Google Inc.
+ *
+ * FnordMetric is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License v3.0. You should have received a
+ * copy of the GNU General Public License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#include <fnordmetric/environment.h>
+#include <fnordmetric/metricdb/backends/disk/metric.h>
+#include <fnordmetric/metricdb/backends/disk/sizetieredcompactionpolicy.h>
+
+namespace fnordmetric {
+namespace metricdb {
+namespace disk_backend {
+
+SizeTieredCompactionPolicy::SizeTieredCompactionPolicy(
+    size_t min_threshold /* = kMinThresholdDefault */,
+    size_t max_threshold /* = kMaxThresholdDefault */,
+    size_t max_table_size /* = kMaxTableSizeDefault */) :
+    min_threshold_(min_threshold),
+    max_threshold_(max_threshold),
+    max_table_size_(max_table_size) {}
+
+void SizeTieredCompactionPolicy::compact(
+    Metric* metric,
+    std::vector<std::shared_ptr<TableRef>>* tables) {
+  std::vector<std::shared_ptr<TableRef>> new_tables;
+
+  for (size_t begin = 0; begin < tables->size(); ) {
+    const auto& first = (*tables)[begin];
+    size_t end = begin + 1;
+    size_t run_size = first->bodySize();
+
+    /* find the longest run of adjacent, similar sized tables */
+    while (!first->isWritable() &&
+        end < tables->size() &&
+        end - begin < max_threshold_) {
+      const auto& table = (*tables)[end];
+      auto avg_size = static_cast<double>(run_size) / (end - begin);
+      auto size = table->bodySize();
+
+      if (table->isWritable() ||
+          table->rollupResolution() != first->rollupResolution() ||
+          size < avg_size * kBucketLow ||
+          size > avg_size * kBucketHigh ||
+          run_size + size > max_table_size_) {
+        break;
+      }
+
+      run_size += size;
+      ++end;
+    }
+
+    if (end - begin < min_threshold_) {
+      new_tables.emplace_back(first);
+      ++begin;
+      continue;
+    }
+
+    std::vector<std::shared_ptr<TableRef>> run(
+        tables->begin() + begin,
+        tables->begin() + end);
+
+    if (env()->verbose()) {
+      env()->logger()->printf(
+          "DEBUG",
+          "Merging %i sstables (%llu bytes) for metric: '%s'",
+          (int) run.size(),
+          (long long unsigned) run_size,
+          first->metricKey().c_str());
+    }
+
+    new_tables.emplace_back(metric->mergeTables(run));
+    begin = end;
+  }
+
+  *tables = new_tables;
+}
+
+}
+}
+}
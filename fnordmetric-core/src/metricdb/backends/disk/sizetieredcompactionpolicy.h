@@ -0,0 +1,52 @@
+/**
+ * This file is part of the "FnordMetric" project
+ *   Copyright (c) 2014 Paul Asmuth, Google Inc.
+ *
+ * FnordMetric is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License v3.0. You should have received a
+ * copy of the GNU General Public License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#ifndef _FNORDMETRIC_METRICDB_SIZETIEREDCOMPACTIONPOLICY_H_
+#define _FNORDMETRIC_METRICDB_SIZETIEREDCOMPACTIONPOLICY_H_
+#include <fnordmetric/metricdb/backends/disk/compactionpolicy.h>
+
+namespace fnordmetric {
+namespace metricdb {
+namespace disk_backend {
+
+/**
+ * Merges runs of adjacent tables with a similar size into one bigger table.
+ * A table is "similar" to a run if its size is within kBucketLow..kBucketHigh
+ * times the average table size of the run and it has the same rollup
+ * resolution as the other tables of the run. A run is merged once it contains
+ * at least min_threshold tables; at most max_threshold tables are merged at
+ * once and merged tables never grow beyond max_table_size
+ */
+class SizeTieredCompactionPolicy : public CompactionPolicy {
+public:
+  static const size_t kMinThresholdDefault = 4;
+  static const size_t kMaxThresholdDefault = 32;
+  static const size_t kMaxTableSizeDefault = 2 << 27; /* 256MB */
+  static constexpr const double kBucketLow = 0.5;
+  static constexpr const double kBucketHigh = 1.5;
+
+  SizeTieredCompactionPolicy(
+      size_t min_threshold = kMinThresholdDefault,
+      size_t max_threshold = kMaxThresholdDefault,
+      size_t max_table_size = kMaxTableSizeDefault);
+
+  void compact(
+      Metric* metric,
+      std::vector<std::shared_ptr<TableRef>>* tables) override;
+
+protected:
+  size_t min_threshold_;
+  size_t max_threshold_;
+  size_t max_table_size_;
+};
+
+}
+}
+}
+#endif
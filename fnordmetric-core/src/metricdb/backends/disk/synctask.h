@@ -0,0 +1,40 @@
+/**
+ * This file is part of the "FnordMetric" project
+ *   Copyright (c) 2014 Paul Asmuth, Google Inc.
+ *
+ * FnordMetric is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License v3.0. You should have received a
+ * copy of the GNU General Public License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#ifndef _FNORDMETRIC_METRICDB_SYNCTASK_H_
+#define _FNORDMETRIC_METRICDB_SYNCTASK_H_
+#include <functional>
+#include <stdint.h>
+
+namespace fnordmetric {
+namespace metricdb {
+namespace disk_backend {
+class MetricRepository;
+
+/**
+ * Periodically syncs the live tables of all metrics whose sync delay has
+ * passed (see Metric::syncTables()), so that the delay bound of a group commit
+ * sync policy also holds after the last insert into a metric
+ */
+class SyncTask {
+public:
+  static const uint64_t kRunEveryMicrosDefault = 500000; /* 500ms */
+
+  SyncTask(MetricRepository* metric_repo);
+  std::function<void()> runnable() const;
+protected:
+  void run() const;
+  MetricRepository* metric_repo_;
+  uint64_t run_every_micros_;
+};
+
+}
+}
+}
+#endif
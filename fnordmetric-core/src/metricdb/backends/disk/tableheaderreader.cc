@@ -16,7 +16,10 @@ namespace disk_backend {
 TableHeaderReader::TableHeaderReader(
     void* data,
     size_t size) :
-    fnord::util::BinaryMessageReader(data, size) {
+    fnord::util::BinaryMessageReader(data, size),
+    rollup_resolution_(0),
+    row_format_(0),
+    compaction_output_(false) {
   size_t metric_key_size = *readUInt32();
   metric_key_ = std::string(readString(metric_key_size), metric_key_size);
   generation_ = *readUInt64();
@@ -24,6 +27,23 @@ TableHeaderReader::TableHeaderReader(
   for (int i = 0; i < num_parents; ++i) {
     parents_.emplace_back(*readUInt64());
   }
+
+  /* tables written before rollups were introduced have no rollup resolution */
+  if (pos_ < size_) {
+    rollup_resolution_ = *readUInt64();
+  }
+
+  /* tables written before compressed blocks were introduced store one row
+     per sample */
+  if (pos_ < size_) {
+    row_format_ = *readUInt32();
+  }
+
+  /* tables written before this flag was introduced are treated like tables
+     that were not written by a compaction */
+  if (pos_ < size_) {
+    compaction_output_ = *readUInt32() != 0;
+  }
 }
 
 const std::string& TableHeaderReader::metricKey() const {
@@ -38,6 +58,18 @@ const std::vector<uint64_t>& TableHeaderReader::parents() const {
   return parents_;
 }
 
+uint64_t TableHeaderReader::rollupResolution() const {
+  return rollup_resolution_;
+}
+
+uint32_t TableHeaderReader::rowFormat() const {
+  return row_format_;
+}
+
+bool TableHeaderReader::compactionOutput() const {
+  return compaction_output_;
+}
+
 }
 }
 }
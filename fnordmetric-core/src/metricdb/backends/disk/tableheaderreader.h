@@ -30,10 +30,28 @@ public:
   const uint64_t generation() const;
   const std::vector<uint64_t>& parents() const;
 
+  /**
+   * Returns the rollup resolution of the table or 0 for tables with raw samples
+   */
+  uint64_t rollupResolution() const;
+
+  /**
+   * Returns the row format of the table (see TableRef::RowFormat)
+   */
+  uint32_t rowFormat() const;
+
+  /**
+   * Returns true if the table was written by a compaction
+   */
+  bool compactionOutput() const;
+
 protected:
   std::string metric_key_;
   uint64_t generation_;
   std::vector<uint64_t> parents_;
+  uint64_t rollup_resolution_;
+  uint32_t row_format_;
+  bool compaction_output_;
 };
 
 }
@@ -16,7 +16,10 @@ namespace disk_backend {
 TableHeaderWriter::TableHeaderWriter(
     const std::string& metric_key,
     uint64_t generation,
-    const std::vector<uint64_t>& parents) {
+    const std::vector<uint64_t>& parents,
+    uint64_t rollup_resolution /* = 0 */,
+    uint32_t row_format /* = 0 */,
+    bool compaction_output /* = false */) {
   appendUInt32(metric_key.size());
   appendString(metric_key);
   appendUInt64(generation);
@@ -24,6 +27,9 @@ TableHeaderWriter::TableHeaderWriter(
   for (const auto parent : parents) {
     appendUInt64(parent);
   }
+  appendUInt64(rollup_resolution);
+  appendUInt32(row_format);
+  appendUInt32(compaction_output ? 1 : 0);
 }
 
 }
@@ -24,7 +24,10 @@ public:
   TableHeaderWriter(
       const std::string& metric_key,
       uint64_t generation,
-      const std::vector<uint64_t>& parents);
+      const std::vector<uint64_t>& parents,
+      uint64_t rollup_resolution = 0,
+      uint32_t row_format = 0,
+      bool compaction_output = false);
 };
 
 }
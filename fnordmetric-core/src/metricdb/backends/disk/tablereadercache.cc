@@ -0,0 +1,101 @@
+/**
+ * This file is part of the "FnordMetric" project
+ *   Copyright (c) 2014 Paul Asmuth, Google Inc.
+ *
+ * FnordMetric is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License v3.0. You should have received a
+ * copy of the GNU General Public License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#include <fnordmetric/environment.h>
+#include <fnordmetric/metricdb/backends/disk/tablereadercache.h>
+
+namespace fnordmetric {
+namespace metricdb {
+namespace disk_backend {
+
+TableReaderCache* TableReaderCache::get() {
+  static TableReaderCache cache;
+  return &cache;
+}
+
+TableReaderCache::TableReaderCache(
+    size_t max_size /* = kDefaultMaxSize */) :
+    max_size_(max_size) {}
+
+std::shared_ptr<sstable::SSTableReader> TableReaderCache::getReader(
+    const std::string& filename) {
+  {
+    std::lock_guard<std::mutex> lock_holder(mutex_);
+
+    auto iter = map_.find(filename);
+    if (iter != map_.end()) {
+      lru_.splice(lru_.begin(), lru_, iter->second);
+      return iter->second->second;
+    }
+  }
+
+  if (env()->verbose()) {
+    env()->logger()->printf(
+        "DEBUG",
+        "Opening read-only sstable: '%s'",
+        filename.c_str());
+  }
+
+  // open the table without holding the lock so that a slow open doesn't block
+  // lookups of other tables
+  auto file = io::File::openFile(filename, io::File::O_READ);
+  std::shared_ptr<sstable::SSTableReader> reader(
+      new sstable::SSTableReader(std::move(file)));
+
+  std::lock_guard<std::mutex> lock_holder(mutex_);
+  if (max_size_ == 0) {
+    return reader;
+  }
+
+  // another thread may have opened the same table in the meantime
+  auto iter = map_.find(filename);
+  if (iter != map_.end()) {
+    lru_.splice(lru_.begin(), lru_, iter->second);
+    return iter->second->second;
+  }
+
+  lru_.emplace_front(filename, reader);
+  map_.emplace(filename, lru_.begin());
+  evictLRU();
+
+  return reader;
+}
+
+void TableReaderCache::evict(const std::string& filename) {
+  std::lock_guard<std::mutex> lock_holder(mutex_);
+
+  auto iter = map_.find(filename);
+  if (iter != map_.end()) {
+    lru_.erase(iter->second);
+    map_.erase(iter);
+  }
+}
+
+void TableReaderCache::setMaxSize(size_t max_size) {
+  std::lock_guard<std::mutex> lock_holder(mutex_);
+  max_size_ = max_size;
+  evictLRU();
+}
+
+size_t TableReaderCache::size() const {
+  std::lock_guard<std::mutex> lock_holder(mutex_);
+  return lru_.size();
+}
+
+// Must hold mutex_ to call this!
+void TableReaderCache::evictLRU() {
+  while (lru_.size() > max_size_) {
+    map_.erase(lru_.back().first);
+    lru_.pop_back();
+  }
+}
+
+}
+}
+}
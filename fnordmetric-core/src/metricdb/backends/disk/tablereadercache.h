@@ -0,0 +1,84 @@
+/**
+ * This file is part of the "FnordMetric" project
+ *   Copyright (c) 2014 Paul Asmuth, Google Inc.
+ *
+ * FnordMetric is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License v3.0. You should have received a
+ * copy of the GNU General Public License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#ifndef _FNORDMETRIC_METRICDB_TABLEREADERCACHE_H_
+#define _FNORDMETRIC_METRICDB_TABLEREADERCACHE_H_
+#include <fnordmetric/sstable/sstablereader.h>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+using namespace fnord;
+namespace fnordmetric {
+namespace metricdb {
+namespace disk_backend {
+
+/**
+ * A bounded LRU cache of open (mmapped) readers for read only sstables. The
+ * file descriptor of a table is closed once it is mapped, so the cache bounds
+ * the number of mappings rather than the number of open files.
+ *
+ * Evicting a reader only drops the cache's reference; cursors that were
+ * created from the reader keep the mapping alive until they are destroyed.
+ *
+ * THIS CLASS IS THREADSAFE
+ */
+class TableReaderCache {
+public:
+  static const size_t kDefaultMaxSize = 1024;
+
+  /**
+   * The process wide cache that is used by all ReadonlyTableRefs
+   */
+  static TableReaderCache* get();
+
+  TableReaderCache(size_t max_size = kDefaultMaxSize);
+  TableReaderCache(const TableReaderCache& other) = delete;
+  TableReaderCache& operator=(const TableReaderCache& other) = delete;
+
+  /**
+   * Return the cached reader for the sstable with the provided filename or
+   * open (and cache) a new reader if the sstable is not cached
+   */
+  std::shared_ptr<sstable::SSTableReader> getReader(
+      const std::string& filename);
+
+  /**
+   * Drop the reader for the provided filename from the cache. Must be called
+   * before the file is deleted or replaced
+   */
+  void evict(const std::string& filename);
+
+  /**
+   * Set the maximum number of cached readers. A max size of zero disables
+   * the cache
+   */
+  void setMaxSize(size_t max_size);
+
+  size_t size() const;
+
+protected:
+  typedef std::list<
+      std::pair<std::string, std::shared_ptr<sstable::SSTableReader>>>
+      LRUListType;
+
+  void evictLRU();
+
+  size_t max_size_;
+  LRUListType lru_;
+  std::unordered_map<std::string, LRUListType::iterator> map_;
+  mutable std::mutex mutex_;
+};
+
+}
+}
+}
+#endif
@@ -8,17 +8,34 @@
  * <http://www.gnu.org/licenses/>.
  */
 #include <fnordmetric/environment.h>
+#include <fnordmetric/metricdb/backends/disk/compressedblockcursor.h>
 #include <fnordmetric/metricdb/backends/disk/labelindex.h>
 #include <fnordmetric/metricdb/backends/disk/labelindexreader.h>
 #include <fnordmetric/metricdb/backends/disk/labelindexwriter.h>
+#include <fnordmetric/metricdb/backends/disk/postingscursor.h>
+#include <fnordmetric/metricdb/backends/disk/postingsindexreader.h>
+#include <fnordmetric/metricdb/backends/disk/postingsindexwriter.h>
 #include <fnordmetric/metricdb/backends/disk/samplereader.h>
+#include <fnordmetric/metricdb/backends/disk/seriesindexreader.h>
+#include <fnordmetric/metricdb/backends/disk/seriesindexwriter.h>
+#include <fnordmetric/metricdb/backends/disk/seriesmergecursor.h>
+#include <fnordmetric/metricdb/backends/disk/tablereadercache.h>
 #include <fnordmetric/metricdb/backends/disk/tableref.h>
 #include <fnordmetric/metricdb/backends/disk/tableheaderreader.h>
 #include <fnordmetric/metricdb/backends/disk/tableheaderwriter.h>
+#include <fnordmetric/metricdb/backends/disk/timeindexreader.h>
+#include <fnordmetric/metricdb/backends/disk/timeindexwriter.h>
 #include <fnordmetric/metricdb/backends/disk/tokenindex.h>
 #include <fnordmetric/metricdb/backends/disk/tokenindexwriter.h>
 #include <fnordmetric/metricdb/backends/disk/tokenindexreader.h>
+#include <fnordmetric/metricdb/rollup.h>
+#include <fnordmetric/io/fileutil.h>
+#include <fnordmetric/sstable/binaryformat.h>
 #include <fnordmetric/sstable/sstablereader.h>
+#include <algorithm>
+#include <iterator>
+#include <limits>
+#include <string.h>
 
 using namespace fnord;
 namespace fnordmetric {
@@ -54,21 +71,50 @@ std::unique_ptr<TableRef> TableRef::openTableUnsafe(
         filename.c_str());
   }
 
+  RowFormat row_format;
+  switch (header.rowFormat()) {
+    case kSampleRows:
+      row_format = kSampleRows;
+      break;
+    case kCompressedBlocks:
+      row_format = kCompressedBlocks;
+      break;
+    case kSeriesBlocks:
+      row_format = kSeriesBlocks;
+      break;
+    default:
+      RAISE(
+          kIllegalStateError,
+          "unknown row format: %i",
+          (int) header.rowFormat());
+  }
+
+  std::unique_ptr<TableRef> table_ref;
   if (reader.bodySize() == 0) {
-    return TableRef::reopenTable(
+    table_ref = TableRef::reopenTable(
         filename,
         header.metricKey(),
         std::move(file),
         header.generation(),
-        header.parents());
+        header.parents(),
+        header.rollupResolution(),
+        row_format);
   } else {
-    return TableRef::openTable(
+    table_ref = TableRef::openTable(
         filename,
         header.metricKey(),
         reader.bodySize(),
         header.generation(),
-        header.parents());
+        header.parents(),
+        header.rollupResolution(),
+        row_format);
   }
+
+  /* the body size is only written to the header when the table is finalized */
+  table_ref->incomplete_compaction_ =
+      header.compactionOutput() && reader.bodySize() == 0;
+
+  return table_ref;
 }
 
 std::unique_ptr<TableRef> TableRef::createTable(
@@ -76,7 +122,10 @@ std::unique_ptr<TableRef> TableRef::createTable(
     const std::string& metric_key,
     fnord::io::File&& file,
     uint64_t generation,
-    const std::vector<uint64_t>& parents) {
+    const std::vector<uint64_t>& parents,
+    uint64_t rollup_resolution /* = 0 */,
+    RowFormat row_format /* = kSampleRows */,
+    bool compaction_output /* = false */) {
   if (env()->verbose()) {
     env()->logger()->printf(
         "DEBUG",
@@ -86,7 +135,13 @@ std::unique_ptr<TableRef> TableRef::createTable(
   }
 
   // build header
-  TableHeaderWriter header(metric_key, generation, parents);
+  TableHeaderWriter header(
+      metric_key,
+      generation,
+      parents,
+      rollup_resolution,
+      row_format,
+      compaction_output);
 
   // create new sstable
   sstable::IndexProvider indexes;
@@ -103,6 +158,8 @@ std::unique_ptr<TableRef> TableRef::createTable(
       generation,
       parents);
 
+  table_ref->rollup_resolution_ = rollup_resolution;
+  table_ref->row_format_ = row_format;
   return std::unique_ptr<TableRef>(table_ref);
 }
 
@@ -111,7 +168,9 @@ std::unique_ptr<TableRef> TableRef::reopenTable(
     const std::string& metric_key,
     fnord::io::File&& file,
     uint64_t generation,
-    const std::vector<uint64_t>& parents) {
+    const std::vector<uint64_t>& parents,
+    uint64_t rollup_resolution /* = 0 */,
+    RowFormat row_format /* = kSampleRows */) {
   sstable::IndexProvider indexes;
 
   auto table = sstable::SSTableWriter::reopen(
@@ -125,6 +184,8 @@ std::unique_ptr<TableRef> TableRef::reopenTable(
       generation,
       parents);
 
+  table_ref->rollup_resolution_ = rollup_resolution;
+  table_ref->row_format_ = row_format;
   return std::unique_ptr<TableRef>(table_ref);
 }
 
@@ -133,7 +194,9 @@ std::unique_ptr<TableRef> TableRef::openTable(
     const std::string& metric_key,
     size_t body_size,
     uint64_t generation,
-    const std::vector<uint64_t>& parents) {
+    const std::vector<uint64_t>& parents,
+    uint64_t rollup_resolution /* = 0 */,
+    RowFormat row_format /* = kSampleRows */) {
   auto table_ref = new ReadonlyTableRef(
       filename,
       metric_key,
@@ -141,6 +204,8 @@ std::unique_ptr<TableRef> TableRef::openTable(
       generation,
       parents);
 
+  table_ref->rollup_resolution_ = rollup_resolution;
+  table_ref->row_format_ = row_format;
   return std::unique_ptr<TableRef>(table_ref);
 }
 
@@ -152,7 +217,43 @@ TableRef::TableRef(
     filename_(filename),
     metric_key_(metric_key),
     generation_(generation),
-    parents_(parents) {}
+    parents_(parents),
+    rollup_resolution_(0),
+    row_format_(kSampleRows),
+    has_postings_index_(false),
+    incomplete_compaction_(false),
+    obsolete_(false) {}
+
+TableRef::~TableRef() {
+  if (!obsolete_) {
+    return;
+  }
+
+  if (env()->verbose()) {
+    env()->logger()->printf(
+        "DEBUG",
+        "Deleting obsolete sstable: '%s' (%s)",
+        filename_.c_str(),
+        metric_key_.c_str());
+  }
+
+  TableReaderCache::get()->evict(filename_);
+  io::FileUtil::rm(filename_);
+}
+
+void TableRef::markObsolete() {
+  obsolete_ = true;
+}
+
+void TableRef::maybeSync() {}
+
+size_t TableRef::memoryUsage() const {
+  return 0;
+}
+
+size_t TableRef::openFiles() const {
+  return 0;
+}
 
 const std::string& TableRef::filename() const {
   return filename_;
@@ -170,6 +271,98 @@ const std::vector<uint64_t> TableRef::parents() const {
   return parents_;
 }
 
+uint64_t TableRef::rollupResolution() const {
+  return rollup_resolution_;
+}
+
+TableRef::RowFormat TableRef::rowFormat() const {
+  return row_format_;
+}
+
+size_t TableRef::valueWords() const {
+  /* see <sample> and <rollup_sample> in binaryformat.h */
+  return rollup_resolution_ > 0 ? 4 : 1;
+}
+
+uint64_t TableRef::minTime() const {
+  return time_index_.minTime();
+}
+
+uint64_t TableRef::maxTime() const {
+  return time_index_.maxTime();
+}
+
+const TimeIndex& TableRef::timeIndex() const {
+  return time_index_;
+}
+
+const SeriesIndex& TableRef::seriesIndex() const {
+  return series_index_;
+}
+
+const PostingsIndex* TableRef::postingsIndex() const {
+  return has_postings_index_ ? &postings_index_ : nullptr;
+}
+
+bool TableRef::isIncompleteCompaction() const {
+  return incomplete_compaction_;
+}
+
+std::unique_ptr<sstable::Cursor> TableRef::cursor() {
+  return cursorFrom(0);
+}
+
+std::unique_ptr<sstable::Cursor> TableRef::cursorFrom(
+    uint64_t time_begin,
+    const LabelFilter* filter /* = nullptr */) {
+  if (row_format_ == kSeriesBlocks) {
+    return seriesCursor(time_begin, filter);
+  }
+
+  auto cur = rowCursor();
+
+  // only visit the rows (or blocks) that contain a matching sample
+  if (filter != nullptr && !filter->empty() && has_postings_index_) {
+    cur.reset(new PostingsCursor(
+        std::move(cur),
+        postings_index_.findRows(*filter)));
+  }
+
+  if (row_format_ == kCompressedBlocks) {
+    cur.reset(new CompressedBlockCursor(std::move(cur)));
+  }
+
+  auto body_offset = time_index_.lowerBound(time_begin);
+  if (body_offset > 0) {
+    cur->seekTo(body_offset);
+  }
+
+  return cur;
+}
+
+std::unique_ptr<sstable::Cursor> TableRef::seriesCursor(
+    uint64_t time_begin,
+    const LabelFilter* filter) {
+  LabelFilter match_all;
+  auto series = series_index_.findSeries(
+      filter == nullptr ? match_all : *filter,
+      time_begin,
+      std::numeric_limits<uint64_t>::max());
+
+  std::vector<std::unique_ptr<sstable::Cursor>> cursors;
+  for (const auto& s : series) {
+    auto cur = rowCursor();
+    cur->seekTo(s->body_begin);
+
+    cursors.emplace_back(new CompressedBlockCursor(
+        std::move(cur),
+        s->body_end));
+  }
+
+  return std::unique_ptr<sstable::Cursor>(
+      new SeriesMergeCursor(std::move(cursors)));
+}
+
 LiveTableRef::LiveTableRef(
     const std::string& filename,
     const std::string& metric_key,
@@ -184,14 +377,261 @@ LiveTableRef::LiveTableRef(
 LiveTableRef::~LiveTableRef() {
 }
 
-void LiveTableRef::addSample(SampleWriter const* sample, uint64_t time) {
-  table_->appendRow(&time, sizeof(time), sample->data(), sample->size()); // FIXPAUL
+void LiveTableRef::addSamples(
+    SampleWriter const* samples,
+    const std::vector<SampleRef>& refs) {
+  auto data = static_cast<char const*>(samples->data());
+
+  if (row_format_ == kSeriesBlocks) {
+    for (const auto& ref : refs) {
+      addSeriesSample(ref.time, data + ref.offset, ref.size);
+    }
+
+    return;
+  }
+
+  if (row_format_ == kCompressedBlocks) {
+    if (block_writer_.get() == nullptr) {
+      block_writer_.reset(new CompressedBlockWriter(valueWords()));
+    }
+
+    for (const auto& ref : refs) {
+      block_label_sets_.emplace(sampleLabels(data + ref.offset, ref.size));
+      block_writer_->addRow(ref.time, data + ref.offset, ref.size);
+
+      if (block_writer_->numRows() >= CompressedBlockWriter::kMaxRowsPerBlock) {
+        flushBlock();
+      }
+    }
+
+    return;
+  }
+
+  std::vector<sstable::SSTableWriter::RowRef> rows;
+  rows.reserve(refs.size());
+
+  for (const auto& ref : refs) {
+    sstable::SSTableWriter::RowRef row = {
+      .key = &ref.time,
+      .key_size = sizeof(uint64_t),
+      .data = data + ref.offset,
+      .data_size = ref.size};
+
+    rows.emplace_back(row);
+  }
+
+  auto body_offset = table_->bodySize();
+  table_->appendRows(rows.data(), rows.size());
+
+  for (size_t i = 0; i < rows.size(); ++i) {
+    time_index_.addRow(refs[i].time, body_offset);
+    addLabelPosting(
+        sampleLabels(data + refs[i].offset, refs[i].size),
+        body_offset);
+
+    body_offset += sizeof(sstable::BinaryFormat::RowHeader) +
+        rows[i].key_size + rows[i].data_size;
+  }
+}
+
+void LiveTableRef::flushBlock() {
+  if (block_writer_.get() == nullptr || block_writer_->numRows() == 0) {
+    return;
+  }
+
+  auto min_time = block_writer_->minTime();
+  auto max_time = block_writer_->maxTime();
+
+  fnord::util::BinaryMessageWriter block;
+  block_writer_->writeBlock(&block);
+
+  sstable::SSTableWriter::RowRef row = {
+    .key = &min_time,
+    .key_size = sizeof(uint64_t),
+    .data = block.data(),
+    .data_size = block.size()};
+
+  auto body_offset = table_->bodySize();
+  table_->appendRows(&row, 1);
+
+  /* every block is a seek point */
+  time_index_.addSeekPoint(min_time, body_offset);
+  time_index_.extendRange(min_time, max_time);
+
+  for (const auto& labels : block_label_sets_) {
+    addLabelPosting(labels, body_offset);
+  }
+
+  block_label_sets_.clear();
+}
+
+std::string LiveTableRef::sampleLabels(char const* data, size_t size) const {
+  auto value_size = valueWords() * sizeof(uint64_t);
+  if (size < value_size) {
+    RAISE(kIllegalArgumentError, "invalid sample");
+  }
+
+  return std::string(data + value_size, size - value_size);
+}
+
+void LiveTableRef::addLabelPosting(
+    const std::string& labels,
+    uint64_t body_offset) {
+  auto& postings = label_postings_[labels];
+
+  if (postings.size() == 0 || postings.back() < body_offset) {
+    postings.emplace_back(body_offset);
+  }
 }
 
-std::unique_ptr<sstable::Cursor> LiveTableRef::cursor() {
+void LiveTableRef::buildPostingsIndex(TokenIndex* token_index) {
+  // the postings list of a label is the union of the postings of all label
+  // lists that contain the label
+  std::map<std::pair<std::string, std::string>, std::vector<uint64_t>> lists;
+  for (const auto& iter : label_postings_) {
+    AbstractSampleReader labels(
+        const_cast<char*>(iter.first.data()),
+        iter.first.size(),
+        token_index);
+
+    for (const auto& label : labels.labels()) {
+      auto& list = lists[label];
+      list.insert(list.end(), iter.second.begin(), iter.second.end());
+    }
+  }
+
+  for (auto& list : lists) {
+    std::sort(list.second.begin(), list.second.end());
+
+    for (const auto& body_offset : list.second) {
+      postings_index_.addPosting(
+          list.first.first,
+          list.first.second,
+          body_offset);
+    }
+  }
+
+  label_postings_.clear();
+  has_postings_index_ = true;
+}
+
+void LiveTableRef::addSeriesSample(
+    uint64_t time,
+    char const* data,
+    size_t size) {
+  auto value_size = valueWords() * sizeof(uint64_t);
+  if (size < value_size) {
+    RAISE(kIllegalArgumentError, "invalid sample");
+  }
+
+  std::string labels(data + value_size, size - value_size);
+
+  auto& buffer = series_buffers_[labels];
+  if (buffer.get() == nullptr) {
+    buffer.reset(new SeriesBuffer());
+    buffer->first_sample = std::string(data, size);
+    buffer->min_time = time;
+    buffer->block_writer.reset(new CompressedBlockWriter(valueWords()));
+  }
+
+  buffer->max_time = time;
+  buffer->block_writer->addRow(time, data, size);
+
+  if (buffer->block_writer->numRows() >=
+      CompressedBlockWriter::kMaxRowsPerBlock) {
+    flushSeriesBlock(buffer.get());
+  }
+}
+
+void LiveTableRef::flushSeriesBlock(SeriesBuffer* buffer) {
+  if (buffer->block_writer->numRows() == 0) {
+    return;
+  }
+
+  auto min_time = buffer->block_writer->minTime();
+  fnord::util::BinaryMessageWriter block;
+  buffer->block_writer->writeBlock(&block);
+
+  buffer->blocks.emplace_back(
+      min_time,
+      std::string(static_cast<char const*>(block.data()), block.size()));
+}
+
+void LiveTableRef::writeSeries(TokenIndex* token_index) {
+  std::vector<std::pair<SeriesIndex::Series, SeriesBuffer*>> series;
+
+  for (auto& iter : series_buffers_) {
+    auto buffer = iter.second.get();
+    flushSeriesBlock(buffer);
+
+    std::unique_ptr<AbstractSampleReader> sample;
+    auto data = &buffer->first_sample[0];
+    auto data_size = buffer->first_sample.size();
+    if (rollup_resolution_ > 0) {
+      sample.reset(new SampleReader<RollupValue>(data, data_size, token_index));
+    } else {
+      sample.reset(new SampleReader<double>(data, data_size, token_index));
+    }
+
+    SeriesIndex::Series s;
+    s.labels = sample->labels();
+    std::sort(s.labels.begin(), s.labels.end());
+    s.series_id = SeriesIndex::seriesID(s.labels);
+    s.min_time = buffer->min_time;
+    s.max_time = buffer->max_time;
+    series.emplace_back(s, buffer);
+  }
+
+  std::sort(
+      series.begin(),
+      series.end(),
+      [] (
+          const std::pair<SeriesIndex::Series, SeriesBuffer*>& a,
+          const std::pair<SeriesIndex::Series, SeriesBuffer*>& b) {
+        if (a.first.series_id == b.first.series_id) {
+          return a.first.labels < b.first.labels;
+        }
+
+        return a.first.series_id < b.first.series_id;
+      });
+
+  for (auto& iter : series) {
+    auto& s = iter.first;
+    s.body_begin = table_->bodySize();
+
+    for (const auto& block : iter.second->blocks) {
+      sstable::SSTableWriter::RowRef row = {
+        .key = &block.first,
+        .key_size = sizeof(uint64_t),
+        .data = block.second.data(),
+        .data_size = block.second.size()};
+
+      table_->appendRows(&row, 1);
+    }
+
+    s.body_end = table_->bodySize();
+    time_index_.extendRange(s.min_time, s.max_time);
+    series_index_.addSeries(s);
+  }
+
+  series_buffers_.clear();
+}
+
+std::unique_ptr<sstable::Cursor> LiveTableRef::rowCursor() {
   return table_->getCursor();
 }
 
+void LiveTableRef::setSyncPolicy(
+    const sstable::SSTableWriter::SyncPolicy& policy) {
+  table_->setSyncPolicy(policy);
+}
+
+void LiveTableRef::maybeSync() {
+  if (is_writable_) {
+    table_->maybeSync();
+  }
+}
+
 bool LiveTableRef::isWritable() const {
   return is_writable_;
 }
@@ -200,6 +640,14 @@ size_t LiveTableRef::bodySize() const {
   return table_->bodySize();
 }
 
+size_t LiveTableRef::memoryUsage() const {
+  return is_writable_ ? table_->bodySize() : 0;
+}
+
+size_t LiveTableRef::openFiles() const {
+  return is_writable_ ? 1 : 0;
+}
+
 void LiveTableRef::import(TokenIndex* token_index, LabelIndex* label_index) {
   auto cur = cursor();
 
@@ -208,16 +656,34 @@ void LiveTableRef::import(TokenIndex* token_index, LabelIndex* label_index) {
     size_t data_size;
     cur->getData(&data, &data_size);
 
-    SampleReader<double> sample(data, data_size, token_index);
+    std::unique_ptr<AbstractSampleReader> sample;
+    if (rollup_resolution_ > 0) {
+      sample.reset(new SampleReader<RollupValue>(data, data_size, token_index));
+    } else {
+      sample.reset(new SampleReader<double>(data, data_size, token_index));
+    }
 
-    for (const auto& def : sample.tokenDefinitions()) {
+    for (const auto& def : sample->tokenDefinitions()) {
       token_index->addToken(def.second, def.first);
     }
 
-    for (const auto& label : sample.labels()) {
+    for (const auto& label : sample->labels()) {
       label_index->addLabel(label.first);
     }
 
+    addLabelPosting(
+        sampleLabels(static_cast<char const*>(data), data_size),
+        cur->position());
+
+    uint64_t time;
+    void* key;
+    size_t key_size;
+    cur->getKey(&key, &key_size);
+    if (key_size == sizeof(time)) {
+      memcpy(&time, key, sizeof(time));
+      time_index_.addRow(time, cur->position());
+    }
+
     if (!cur->next()) {
       break;
     }
@@ -227,6 +693,12 @@ void LiveTableRef::import(TokenIndex* token_index, LabelIndex* label_index) {
 void LiveTableRef::finalize(
     TokenIndex* token_index,
     LabelIndex* label_index) {
+  flushBlock();
+
+  if (row_format_ == kSeriesBlocks) {
+    writeSeries(token_index);
+  }
+
   TokenIndexWriter token_index_writer(token_index);
 
   table_->writeIndex(
@@ -241,6 +713,30 @@ void LiveTableRef::finalize(
       label_index_writer.data(),
       label_index_writer.size());
 
+  TimeIndexWriter time_index_writer(&time_index_);
+
+  table_->writeIndex(
+      TimeIndex::kIndexType,
+      time_index_writer.data(),
+      time_index_writer.size());
+
+  if (row_format_ == kSeriesBlocks) {
+    SeriesIndexWriter series_index_writer(&series_index_);
+
+    table_->writeIndex(
+        SeriesIndex::kIndexType,
+        series_index_writer.data(),
+        series_index_writer.size());
+  } else {
+    buildPostingsIndex(token_index);
+    PostingsIndexWriter postings_index_writer(&postings_index_);
+
+    table_->writeIndex(
+        PostingsIndex::kIndexType,
+        postings_index_writer.data(),
+        postings_index_writer.size());
+  }
+
   table_->finalize();
 }
 
@@ -260,17 +756,37 @@ ReadonlyTableRef::ReadonlyTableRef(
         live_table.filename(),
         live_table.metricKey(),
         live_table.generation(),
-        live_table.parents()) {}
+        live_table.parents()) {
+  rollup_resolution_ = live_table.rollupResolution();
+  row_format_ = live_table.rowFormat();
+
+  for (const auto& point : live_table.timeIndex().seekPoints()) {
+    time_index_.addSeekPoint(point.first, point.second);
+  }
+
+  time_index_.extendRange(live_table.minTime(), live_table.maxTime());
+  series_index_ = live_table.seriesIndex();
+
+  if (live_table.postingsIndex() != nullptr) {
+    postings_index_ = *live_table.postingsIndex();
+    has_postings_index_ = true;
+  }
+}
 
-void ReadonlyTableRef::addSample(SampleWriter const* sample, uint64_t time) {
+void ReadonlyTableRef::addSamples(
+    SampleWriter const* samples,
+    const std::vector<SampleRef>& refs) {
   RAISE(kIllegalStateError, "table is immutable");
 }
 
-std::unique_ptr<sstable::Cursor> ReadonlyTableRef::cursor() {
+std::unique_ptr<sstable::Cursor> ReadonlyTableRef::rowCursor() {
   auto table = openTable();
   return table->getCursor();
 }
 
+void ReadonlyTableRef::setSyncPolicy(
+    const sstable::SSTableWriter::SyncPolicy& policy) {}
+
 void ReadonlyTableRef::import(
     TokenIndex* token_index,
     LabelIndex* label_index) {
@@ -308,6 +824,49 @@ void ReadonlyTableRef::import(
 
     label_index_reader.readIndex(label_index);
   }
+
+  auto time_index_buffer = reader->readFooter(TimeIndex::kIndexType);
+  if (time_index_buffer.size() == 0) {
+    if (env()->verbose()) {
+      env()->logger()->printf(
+          "DEBUG",
+          "SStable has no time index: '%s' (%s)",
+          filename_.c_str(),
+          metric_key_.c_str());
+    }
+
+    /* tables written before the time index was introduced may contain any
+       time range */
+    time_index_.extendRange(0, std::numeric_limits<uint64_t>::max());
+  } else {
+    TimeIndexReader time_index_reader(
+        time_index_buffer.data(),
+        time_index_buffer.size());
+
+    time_index_reader.readIndex(&time_index_);
+  }
+
+  if (row_format_ == kSeriesBlocks) {
+    auto series_index_buffer = reader->readFooter(SeriesIndex::kIndexType);
+
+    SeriesIndexReader series_index_reader(
+        series_index_buffer.data(),
+        series_index_buffer.size());
+
+    series_index_reader.readIndex(&series_index_);
+  }
+
+  /* tables written before the postings index was introduced are scanned
+     without skipping rows */
+  auto postings_index_buffer = reader->readFooter(PostingsIndex::kIndexType);
+  if (postings_index_buffer.size() > 0) {
+    PostingsIndexReader postings_index_reader(
+        postings_index_buffer.data(),
+        postings_index_buffer.size());
+
+    postings_index_reader.readIndex(&postings_index_);
+    has_postings_index_ = true;
+  }
 }
 
 void ReadonlyTableRef::finalize(
@@ -324,17 +883,327 @@ size_t ReadonlyTableRef::bodySize() const {
   return body_size_;
 }
 
-std::unique_ptr<fnord::sstable::SSTableReader> ReadonlyTableRef::openTable() {
-  if (env()->verbose()) {
-    env()->logger()->printf(
-        "DEBUG",
-        "Opening read-only sstable: '%s'",
-        filename_.c_str());
+LateTableRef::LateTableRef(
+    const std::string& filename,
+    const std::string& metric_key,
+    uint64_t generation,
+    const std::vector<uint64_t>& parents) :
+    TableRef(filename, metric_key, generation, parents),
+    rows_(new RowVector()),
+    body_size_(0),
+    is_writable_(true) {}
+
+void LateTableRef::addSamples(
+    SampleWriter const* samples,
+    const std::vector<SampleRef>& refs) {
+  RowVector new_rows;
+  new_rows.reserve(refs.size());
+  for (const auto& ref : refs) {
+    new_rows.emplace_back(
+        ref.time,
+        std::string(
+            static_cast<char const*>(samples->data()) + ref.offset,
+            ref.size));
+  }
+
+  auto by_time = [] (
+      const RowVector::value_type& a,
+      const RowVector::value_type& b) {
+    return a.first < b.first;
+  };
+
+  std::stable_sort(new_rows.begin(), new_rows.end(), by_time);
+
+  std::lock_guard<std::mutex> lock_holder(mutex_);
+
+  if (!is_writable_) {
+    RAISE(kIllegalStateError, "table is immutable");
+  }
+
+  /* rows with the same time keep their insertion order */
+  std::shared_ptr<RowVector> rows(new RowVector());
+  rows->reserve(rows_->size() + new_rows.size());
+  std::merge(
+      rows_->begin(),
+      rows_->end(),
+      std::make_move_iterator(new_rows.begin()),
+      std::make_move_iterator(new_rows.end()),
+      std::back_inserter(*rows),
+      by_time);
+
+  rows_ = std::move(rows);
+
+  for (const auto& ref : refs) {
+    time_index_.extendRange(ref.time, ref.time);
+    body_size_ += sizeof(sstable::BinaryFormat::RowHeader) +
+        sizeof(uint64_t) + ref.size;
+  }
+}
+
+std::unique_ptr<sstable::Cursor> LateTableRef::cursor() {
+  return cursorFrom(0);
+}
+
+std::unique_ptr<sstable::Cursor> LateTableRef::rowCursor() {
+  return cursorFrom(0);
+}
+
+std::unique_ptr<sstable::Cursor> LateTableRef::cursorFrom(
+    uint64_t time_begin,
+    const LabelFilter* filter /* = nullptr */) {
+  std::shared_ptr<const RowVector> rows;
+  {
+    std::lock_guard<std::mutex> lock_holder(mutex_);
+    rows = rows_;
+  }
+
+  auto begin = std::lower_bound(
+      rows->begin(),
+      rows->end(),
+      time_begin,
+      [] (const RowVector::value_type& row, uint64_t time) {
+        return row.first < time;
+      });
+
+  return std::unique_ptr<sstable::Cursor>(
+      new LateTableCursor(rows, begin - rows->begin()));
+}
+
+void LateTableRef::setSyncPolicy(
+    const sstable::SSTableWriter::SyncPolicy& policy) {}
+
+void LateTableRef::import(
+    TokenIndex* token_index,
+    LabelIndex* label_index) {}
+
+void LateTableRef::finalize(
+    TokenIndex* token_index,
+    LabelIndex* label_index) {
+  std::lock_guard<std::mutex> lock_holder(mutex_);
+  is_writable_ = false;
+
+  SampleWriter writer(nullptr);
+  std::vector<SampleRef> refs;
+  refs.reserve(rows_->size());
+
+  for (const auto& row : *rows_) {
+    SampleRef ref = {
+      .time = row.first,
+      .offset = writer.size(),
+      .size = row.second.size()};
+
+    writer.append(row.second.data(), row.second.size());
+    refs.emplace_back(ref);
+  }
+
+  auto file = io::File::openFile(
+      filename_,
+      io::File::O_READ | io::File::O_WRITE | io::File::O_CREATE);
+
+  auto table = TableRef::createTable(
+      filename_,
+      metric_key_,
+      std::move(file),
+      generation_,
+      parents_);
+
+  table->addSamples(&writer, refs);
+  table->finalize(token_index, label_index);
+
+  for (const auto& point : table->timeIndex().seekPoints()) {
+    time_index_.addSeekPoint(point.first, point.second);
   }
 
-  auto file = io::File::openFile(filename_, io::File::O_READ);
-  return std::unique_ptr<fnord::sstable::SSTableReader>(
-      new sstable::SSTableReader(std::move(file)));
+  postings_index_ = *table->postingsIndex();
+  has_postings_index_ = true;
+}
+
+bool LateTableRef::isWritable() const {
+  std::lock_guard<std::mutex> lock_holder(mutex_);
+  return is_writable_;
+}
+
+size_t LateTableRef::bodySize() const {
+  std::lock_guard<std::mutex> lock_holder(mutex_);
+  return body_size_;
+}
+
+size_t LateTableRef::memoryUsage() const {
+  std::lock_guard<std::mutex> lock_holder(mutex_);
+  return is_writable_ ? body_size_ : 0;
+}
+
+MemTableRef::MemTableRef(
+    const std::string& filename,
+    const std::string& metric_key,
+    uint64_t generation,
+    const std::vector<uint64_t>& parents) :
+    TableRef(filename, metric_key, generation, parents),
+    body_size_(0),
+    is_writable_(true) {}
+
+void MemTableRef::addSamples(
+    SampleWriter const* samples,
+    const std::vector<SampleRef>& refs) {
+  std::lock_guard<std::mutex> lock_holder(mutex_);
+
+  if (!is_writable_) {
+    RAISE(kIllegalStateError, "table is immutable");
+  }
+
+  auto data = static_cast<char const*>(samples->data());
+  for (const auto& ref : refs) {
+    memtable_.addRow(ref.time, data + ref.offset, ref.size);
+    time_index_.extendRange(ref.time, ref.time);
+    body_size_ += sizeof(sstable::BinaryFormat::RowHeader) +
+        sizeof(uint64_t) + ref.size;
+  }
+}
+
+std::unique_ptr<sstable::Cursor> MemTableRef::cursor() {
+  return cursorFrom(0);
+}
+
+std::unique_ptr<sstable::Cursor> MemTableRef::rowCursor() {
+  return cursorFrom(0);
+}
+
+std::unique_ptr<sstable::Cursor> MemTableRef::cursorFrom(
+    uint64_t time_begin,
+    const LabelFilter* filter /* = nullptr */) {
+  return memtable_.cursorFrom(time_begin);
+}
+
+void MemTableRef::setSyncPolicy(
+    const sstable::SSTableWriter::SyncPolicy& policy) {}
+
+void MemTableRef::import(
+    TokenIndex* token_index,
+    LabelIndex* label_index) {}
+
+void MemTableRef::finalize(
+    TokenIndex* token_index,
+    LabelIndex* label_index) {
+  {
+    std::lock_guard<std::mutex> lock_holder(mutex_);
+    is_writable_ = false;
+  }
+
+  SampleWriter writer(nullptr);
+  std::vector<SampleRef> refs;
+  refs.reserve(memtable_.numRows());
+
+  auto cur = memtable_.cursorFrom(0);
+  while (cur->valid()) {
+    void* key;
+    size_t key_size;
+    void* data;
+    size_t data_size;
+    cur->getKey(&key, &key_size);
+    cur->getData(&data, &data_size);
+
+    SampleRef ref = {
+      .time = *static_cast<uint64_t*>(key),
+      .offset = writer.size(),
+      .size = data_size};
+
+    writer.append(data, data_size);
+    refs.emplace_back(ref);
+
+    if (!cur->next()) {
+      break;
+    }
+  }
+
+  auto file = io::File::openFile(
+      filename_,
+      io::File::O_READ | io::File::O_WRITE | io::File::O_CREATE);
+
+  auto table = TableRef::createTable(
+      filename_,
+      metric_key_,
+      std::move(file),
+      generation_,
+      parents_);
+
+  table->setSyncPolicy(sstable::SSTableWriter::SyncPolicy::none());
+  table->addSamples(&writer, refs);
+  table->finalize(token_index, label_index);
+
+  for (const auto& point : table->timeIndex().seekPoints()) {
+    time_index_.addSeekPoint(point.first, point.second);
+  }
+
+  postings_index_ = *table->postingsIndex();
+  has_postings_index_ = true;
+}
+
+bool MemTableRef::isWritable() const {
+  std::lock_guard<std::mutex> lock_holder(mutex_);
+  return is_writable_;
+}
+
+size_t MemTableRef::bodySize() const {
+  std::lock_guard<std::mutex> lock_holder(mutex_);
+  return body_size_;
+}
+
+size_t MemTableRef::memoryUsage() const {
+  return memtable_.memoryUsage();
+}
+
+LateTableCursor::LateTableCursor(
+    std::shared_ptr<const LateTableRef::RowVector> rows,
+    size_t begin) :
+    rows_(std::move(rows)),
+    begin_(begin),
+    pos_(begin) {}
+
+void LateTableCursor::seekTo(size_t body_offset) {
+  if (body_offset > rows_->size() - begin_) {
+    RAISE(kIndexError, "seekTo() out of bounds position");
+  }
+
+  pos_ = begin_ + body_offset;
+}
+
+bool LateTableCursor::next() {
+  if (pos_ + 1 >= rows_->size()) {
+    return false;
+  }
+
+  ++pos_;
+  return true;
+}
+
+bool LateTableCursor::valid() {
+  return pos_ < rows_->size();
+}
+
+void LateTableCursor::getKey(void** data, size_t* size) {
+  if (!valid()) {
+    RAISE(kIndexError, "getKey() on invalid cursor");
+  }
+
+  *data = const_cast<uint64_t*>(&(*rows_)[pos_].first);
+  *size = sizeof(uint64_t);
+}
+
+void LateTableCursor::getData(void** data, size_t* size) {
+  if (!valid()) {
+    RAISE(kIndexError, "getData() on invalid cursor");
+  }
+
+  *data = const_cast<char*>((*rows_)[pos_].second.data());
+  *size = (*rows_)[pos_].second.size();
+}
+
+size_t LateTableCursor::position() const {
+  return pos_ - begin_;
+}
+
+std::shared_ptr<fnord::sstable::SSTableReader> ReadonlyTableRef::openTable() {
+  return TableReaderCache::get()->getReader(filename_);
 }
 
 }
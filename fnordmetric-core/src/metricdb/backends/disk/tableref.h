@@ -9,11 +9,21 @@
  */
 #ifndef _FNORDMETRIC_METRICDB_TABLEREF_H_
 #define _FNORDMETRIC_METRICDB_TABLEREF_H_
+#include <fnordmetric/metricdb/backends/disk/compressedblockwriter.h>
+#include <fnordmetric/metricdb/backends/disk/memtable.h>
+#include <fnordmetric/metricdb/backends/disk/postingsindex.h>
 #include <fnordmetric/metricdb/backends/disk/samplewriter.h>
+#include <fnordmetric/metricdb/backends/disk/seriesindex.h>
+#include <fnordmetric/metricdb/backends/disk/timeindex.h>
+#include <fnordmetric/metricdb/labelfilter.h>
 #include <fnordmetric/metricdb/sample.h>
 #include <fnordmetric/sstable/sstablereader.h>
 #include <fnordmetric/sstable/sstablewriter.h>
+#include <atomic>
+#include <mutex>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
 
 using namespace fnord;
 namespace fnordmetric {
@@ -24,9 +34,29 @@ class TableHeaderReader;
 
 class TableRef {
 public:
+
+  /**
+   * A serialized sample with a time of "time" stored at [offset, offset + size)
+   * in a SampleWriter
+   */
+  struct SampleRef {
+    uint64_t time;
+    size_t offset;
+    size_t size;
+  };
+
+  /**
+   * How the samples of a table are stored in the rows of the sstable
+   */
+  enum RowFormat {
+    kSampleRows = 0, /* one <sample> or <rollup_sample> row per sample */
+    kCompressedBlocks = 1, /* one <compressed_block> row per block of samples */
+    kSeriesBlocks = 2 /* <compressed_block> rows grouped by series */
+  };
+
   TableRef(const TableRef& other) = delete;
   TableRef& operator=(const TableRef& other) = delete;
-  virtual ~TableRef() {}
+  virtual ~TableRef();
 
   static std::unique_ptr<TableRef> openTable(const std::string filename);
   static std::unique_ptr<TableRef> openTableUnsafe(const std::string filename);
@@ -36,24 +66,64 @@ public:
       const std::string& metric_key,
       fnord::io::File&& file,
       uint64_t generation,
-      const std::vector<uint64_t>& parents);
+      const std::vector<uint64_t>& parents,
+      uint64_t rollup_resolution = 0,
+      RowFormat row_format = kSampleRows,
+      bool compaction_output = false);
 
   static std::unique_ptr<TableRef> reopenTable(
       const std::string& filename,
       const std::string& metric_key,
       fnord::io::File&& file,
       uint64_t generation,
-      const std::vector<uint64_t>& parents);
+      const std::vector<uint64_t>& parents,
+      uint64_t rollup_resolution = 0,
+      RowFormat row_format = kSampleRows);
 
   static std::unique_ptr<TableRef> openTable(
       const std::string& filename,
       const std::string& metric_key,
       size_t body_size,
       uint64_t generation,
-      const std::vector<uint64_t>& parents);
+      const std::vector<uint64_t>& parents,
+      uint64_t rollup_resolution = 0,
+      RowFormat row_format = kSampleRows);
+
+  /**
+   * Append a batch of samples. Writable on-disk tables require the samples to
+   * be sorted by time and not older than maxTime()
+   */
+  virtual void addSamples(
+      SampleWriter const* samples,
+      const std::vector<SampleRef>& refs) = 0;
 
-  virtual void addSample(SampleWriter const* sample, uint64_t time) = 0;
-  virtual std::unique_ptr<sstable::Cursor> cursor() = 0;
+  /**
+   * Return a cursor over all samples of the table in time order
+   */
+  virtual std::unique_ptr<sstable::Cursor> cursor();
+
+  /**
+   * Set the sync policy for writable tables. No-op for read only tables
+   */
+  virtual void setSyncPolicy(
+      const sstable::SSTableWriter::SyncPolicy& policy) = 0;
+
+  /**
+   * Sync the appended samples of a writable on-disk table if its sync policy
+   * requires it (see SSTableWriter::maybeSync()). No-op for all other tables
+   */
+  virtual void maybeSync();
+
+  /**
+   * Return a cursor positioned at or shortly before the first row with a
+   * time >= time_begin. If a filter is passed, tables with a series index only
+   * return the samples of the series that match the filter and tables with a
+   * postings index skip the rows (or blocks) that don't contain a matching
+   * sample. The returned samples still have to be matched against the filter
+   */
+  virtual std::unique_ptr<sstable::Cursor> cursorFrom(
+      uint64_t time_begin,
+      const LabelFilter* filter = nullptr);
 
   virtual void import(TokenIndex* token_index, LabelIndex* label_index) = 0;
   virtual void finalize(TokenIndex* token_index, LabelIndex* label_index) = 0;
@@ -66,6 +136,55 @@ public:
   uint64_t generation() const;
   const std::vector<uint64_t> parents() const;
 
+  /**
+   * The resolution (in microseconds) of the rollup windows stored in this
+   * table or 0 if the table stores raw samples. The rows of rollup tables are
+   * RollupValues keyed by the start of their window
+   */
+  uint64_t rollupResolution() const;
+
+  /**
+   * The format of the table's rows. Cursors always return one row per sample
+   * regardless of the row format
+   */
+  RowFormat rowFormat() const;
+
+  uint64_t minTime() const;
+  uint64_t maxTime() const;
+  const TimeIndex& timeIndex() const;
+
+  /**
+   * The series directory of tables with the kSeriesBlocks row format. Empty
+   * for all other tables
+   */
+  const SeriesIndex& seriesIndex() const;
+
+  /**
+   * The postings index of finalized tables or nullptr if the table has none
+   */
+  const PostingsIndex* postingsIndex() const;
+
+  /**
+   * True if the table was written by a compaction that was interrupted before
+   * the table was finalized. Such tables are incomplete and must be discarded
+   * instead of repaired (see Metric::createCompactionTable())
+   */
+  bool isIncompleteCompaction() const;
+
+  /**
+   * Mark the table as obsolete. The table's file is deleted once the last
+   * reference to this TableRef is dropped
+   */
+  void markObsolete();
+
+  /**
+   * The number of bytes of memory (or mmapped dirty pages) and the number of
+   * file handles held by a writable table. Zero for read only tables, which
+   * are opened on demand
+   */
+  virtual size_t memoryUsage() const;
+  virtual size_t openFiles() const;
+
 protected:
   TableRef(
       const std::string& filename,
@@ -73,10 +192,36 @@ protected:
       uint64_t generation,
       const std::vector<uint64_t>& parents);
 
+  /**
+   * Return a cursor over the raw sstable rows of this table
+   */
+  virtual std::unique_ptr<sstable::Cursor> rowCursor() = 0;
+
+  /**
+   * Return a cursor that merges the series of a table with series blocks
+   * that match the filter (if any) and might contain samples >= time_begin
+   */
+  std::unique_ptr<sstable::Cursor> seriesCursor(
+      uint64_t time_begin,
+      const LabelFilter* filter);
+
+  /**
+   * The number of 64 bit words in the value of each sample of this table
+   */
+  size_t valueWords() const;
+
   std::string filename_;
   std::string metric_key_;
   uint64_t generation_;
   std::vector<uint64_t> parents_;
+  uint64_t rollup_resolution_;
+  RowFormat row_format_;
+  TimeIndex time_index_;
+  SeriesIndex series_index_;
+  PostingsIndex postings_index_;
+  bool has_postings_index_;
+  bool incomplete_compaction_;
+  std::atomic<bool> obsolete_;
 };
 
 class LiveTableRef : public TableRef {
@@ -88,8 +233,14 @@ public:
       uint64_t generation,
       const std::vector<uint64_t>& parents);
   ~LiveTableRef();
-  void addSample(SampleWriter const* sample, uint64_t time) override;
-  std::unique_ptr<sstable::Cursor> cursor() override;
+  void addSamples(
+      SampleWriter const* samples,
+      const std::vector<SampleRef>& refs) override;
+
+  void setSyncPolicy(
+      const sstable::SSTableWriter::SyncPolicy& policy) override;
+
+  void maybeSync() override;
 
   void import(
       TokenIndex* token_index,
@@ -101,10 +252,76 @@ public:
 
   bool isWritable() const override;
   size_t bodySize() const override;
+  size_t memoryUsage() const override;
+  size_t openFiles() const override;
 
 protected:
+
+  /**
+   * The buffered samples of one series of a table with series blocks
+   */
+  struct SeriesBuffer {
+    std::string first_sample;
+    uint64_t min_time;
+    uint64_t max_time;
+    std::unique_ptr<CompressedBlockWriter> block_writer;
+    /* the encoded blocks of the series keyed by the block's min time */
+    std::vector<std::pair<uint64_t, std::string>> blocks;
+  };
+
+  std::unique_ptr<sstable::Cursor> rowCursor() override;
+
+  /**
+   * Append the buffered samples of a table with compressed blocks as a new
+   * block
+   */
+  void flushBlock();
+
+  /**
+   * Buffer a sample of a table with series blocks. The samples are grouped by
+   * their serialized labels, so all samples of a series should be serialized
+   * with the same label tokens in the same (sorted) order. Otherwise the
+   * series is stored as more than one entry with the same label set
+   */
+  void addSeriesSample(uint64_t time, char const* data, size_t size);
+
+  /**
+   * Encode the buffered samples of a series as a new block
+   */
+  void flushSeriesBlock(SeriesBuffer* buffer);
+
+  /**
+   * Write the buffered series of a table with series blocks ordered by series
+   * id and build the series index
+   */
+  void writeSeries(TokenIndex* token_index);
+
+  /**
+   * Record that the row or block at body_offset contains a sample with the
+   * provided serialized labels
+   */
+  void addLabelPosting(const std::string& labels, uint64_t body_offset);
+
+  /**
+   * Build the postings index from the recorded label postings
+   */
+  void buildPostingsIndex(TokenIndex* token_index);
+
+  /**
+   * Return the serialized labels of a serialized sample
+   */
+  std::string sampleLabels(char const* data, size_t size) const;
+
   bool is_writable_;
   std::unique_ptr<sstable::SSTableWriter> table_;
+  std::unique_ptr<CompressedBlockWriter> block_writer_;
+  /* buffered series of a table with series blocks keyed by their labels */
+  std::unordered_map<std::string, std::unique_ptr<SeriesBuffer>>
+      series_buffers_;
+  /* body offsets of the rows or blocks per distinct serialized label list */
+  std::unordered_map<std::string, std::vector<uint64_t>> label_postings_;
+  /* the distinct serialized label lists of the buffered block */
+  std::unordered_set<std::string> block_label_sets_;
 };
 
 class ReadonlyTableRef : public TableRef {
@@ -119,8 +336,60 @@ public:
   explicit ReadonlyTableRef(
       const TableRef& live_table);
 
-  void addSample(SampleWriter const* sample, uint64_t time) override;
+  void addSamples(
+      SampleWriter const* samples,
+      const std::vector<SampleRef>& refs) override;
+
+  void setSyncPolicy(
+      const sstable::SSTableWriter::SyncPolicy& policy) override;
+
+  void import(
+      TokenIndex* token_index,
+      LabelIndex* label_index) override;
+
+  void finalize(
+      TokenIndex* token_index,
+      LabelIndex* label_index) override;
+
+  bool isWritable() const override;
+  size_t bodySize() const override;
+
+protected:
+  std::unique_ptr<sstable::Cursor> rowCursor() override;
+
+  /**
+   * Return the shared reader for this table from the TableReaderCache
+   */
+  std::shared_ptr<fnord::sstable::SSTableReader> openTable();
+  size_t body_size_;
+};
+
+/**
+ * An in-memory table that buffers samples that arrived out of order (i.e.
+ * older than the newest sample in the live table) sorted by time. The table
+ * is written to disk as a regular, sorted sstable when it is finalized, which
+ * the metric does once the table is full or, if there is no write ahead log,
+ * as often as the live table is synced (see Metric::lateTableNeedsFlush())
+ */
+class LateTableRef : public TableRef {
+public:
+  LateTableRef(
+      const std::string& filename,
+      const std::string& metric_key,
+      uint64_t generation,
+      const std::vector<uint64_t>& parents);
+
+  void addSamples(
+      SampleWriter const* samples,
+      const std::vector<SampleRef>& refs) override;
+
   std::unique_ptr<sstable::Cursor> cursor() override;
+  std::unique_ptr<sstable::Cursor> cursorFrom(
+      uint64_t time_begin,
+      const LabelFilter* filter = nullptr) override;
+
+  void setSyncPolicy(
+      const sstable::SSTableWriter::SyncPolicy& policy) override;
 
   void import(
       TokenIndex* token_index,
@@ -132,10 +401,106 @@ public:
 
   bool isWritable() const override;
   size_t bodySize() const override;
+  size_t memoryUsage() const override;
+
+  typedef std::vector<std::pair<uint64_t, std::string>> RowVector;
 
 protected:
-  std::unique_ptr<fnord::sstable::SSTableReader> openTable();
+  std::unique_ptr<sstable::Cursor> rowCursor() override;
+
+  /**
+   * The rows sorted by time. The vector is never modified once it is
+   * published; addSamples() merges the new rows into a copy and swaps it in,
+   * so cursors can share it without copying the rows on every read
+   */
+  std::shared_ptr<const RowVector> rows_;
+  mutable std::mutex mutex_;
   size_t body_size_;
+  bool is_writable_;
+};
+
+/**
+ * A live table that buffers its samples in a MemTable instead of an mmapped
+ * sstable, so that appending a sample doesn't touch the disk and recent
+ * samples are read from memory. The table is written to disk as a regular
+ * sstable when it is finalized.
+ *
+ * The buffered samples are lost if the process crashes before the table is
+ * finalized, so memtables should only be used with a WriteAheadLog
+ */
+class MemTableRef : public TableRef {
+public:
+  MemTableRef(
+      const std::string& filename,
+      const std::string& metric_key,
+      uint64_t generation,
+      const std::vector<uint64_t>& parents);
+
+  void addSamples(
+      SampleWriter const* samples,
+      const std::vector<SampleRef>& refs) override;
+
+  std::unique_ptr<sstable::Cursor> cursor() override;
+  std::unique_ptr<sstable::Cursor> cursorFrom(
+      uint64_t time_begin,
+      const LabelFilter* filter = nullptr) override;
+
+  void setSyncPolicy(
+      const sstable::SSTableWriter::SyncPolicy& policy) override;
+
+  void import(
+      TokenIndex* token_index,
+      LabelIndex* label_index) override;
+
+  void finalize(
+      TokenIndex* token_index,
+      LabelIndex* label_index) override;
+
+  bool isWritable() const override;
+
+  /**
+   * The size of the table's body once it is written to disk
+   */
+  size_t bodySize() const override;
+
+  /**
+   * The number of bytes of memory allocated for the buffered samples
+   */
+  size_t memoryUsage() const override;
+
+protected:
+  std::unique_ptr<sstable::Cursor> rowCursor() override;
+
+  MemTable memtable_;
+  mutable std::mutex mutex_;
+  size_t body_size_;
+  bool is_writable_;
+};
+
+/**
+ * A cursor over a snapshot of the rows of a LateTableRef, starting at row
+ * number begin. The "body offsets" of this cursor are row numbers relative to
+ * begin
+ */
+class LateTableCursor : public sstable::Cursor {
+public:
+  LateTableCursor(
+      std::shared_ptr<const LateTableRef::RowVector> rows,
+      size_t begin);
+
+  void seekTo(size_t body_offset) override;
+  bool next() override;
+  bool valid() override;
+
+  void getKey(void** data, size_t* size) override;
+  void getData(void** data, size_t* size) override;
+
+  size_t position() const override;
+
+protected:
+  std::shared_ptr<const LateTableRef::RowVector> rows_;
+  size_t begin_;
+  size_t pos_;
 };
 
 }
@@ -0,0 +1,102 @@
+/**
+ * This file is part of the "FnordMetric" project
+ *   Copyright (c) 2014 Paul Asmuth, Google Inc.
+ *
+ * FnordMetric is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License v3.0. You should have received a
+ * copy of the GNU General Public License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#include <fnordmetric/metricdb/backends/disk/timeindex.h>
+#include <algorithm>
+#include <limits>
+
+namespace fnordmetric {
+namespace metricdb {
+namespace disk_backend {
+
+TimeIndex::TimeIndex() :
+    min_time_(std::numeric_limits<uint64_t>::max()),
+    max_time_(0),
+    last_offset_(0) {}
+
+void TimeIndex::addRow(uint64_t time, size_t body_offset) {
+  std::lock_guard<std::mutex> lock_holder(mutex_);
+
+  if (time < min_time_) {
+    min_time_ = time;
+  }
+
+  if (time > max_time_) {
+    max_time_ = time;
+  }
+
+  if (seek_points_.size() == 0 ||
+      body_offset >= last_offset_ + kSeekInterval) {
+    seek_points_.emplace_back(time, body_offset);
+    last_offset_ = body_offset;
+  }
+}
+
+void TimeIndex::addSeekPoint(uint64_t time, size_t body_offset) {
+  std::lock_guard<std::mutex> lock_holder(mutex_);
+  seek_points_.emplace_back(time, body_offset);
+  last_offset_ = body_offset;
+}
+
+void TimeIndex::extendRange(uint64_t min_time, uint64_t max_time) {
+  std::lock_guard<std::mutex> lock_holder(mutex_);
+
+  if (min_time < min_time_) {
+    min_time_ = min_time;
+  }
+
+  if (max_time > max_time_) {
+    max_time_ = max_time;
+  }
+}
+
+size_t TimeIndex::lowerBound(uint64_t time_begin) const {
+  std::lock_guard<std::mutex> lock_holder(mutex_);
+
+  /* find the last seek point with a time strictly less than time_begin. all
+     rows before that seek point must be older than time_begin as well */
+  auto iter = std::lower_bound(
+      seek_points_.begin(),
+      seek_points_.end(),
+      time_begin,
+      [] (const std::pair<uint64_t, size_t>& point, uint64_t time) -> bool {
+        return point.first < time;
+      });
+
+  if (iter == seek_points_.begin()) {
+    return 0;
+  }
+
+  return (--iter)->second;
+}
+
+bool TimeIndex::overlaps(uint64_t time_begin, uint64_t time_end) const {
+  std::lock_guard<std::mutex> lock_holder(mutex_);
+  return max_time_ >= time_begin && min_time_ < time_end;
+}
+
+uint64_t TimeIndex::minTime() const {
+  std::lock_guard<std::mutex> lock_holder(mutex_);
+  return min_time_;
+}
+
+uint64_t TimeIndex::maxTime() const {
+  std::lock_guard<std::mutex> lock_holder(mutex_);
+  return max_time_;
+}
+
+std::vector<std::pair<uint64_t, size_t>> TimeIndex::seekPoints() const {
+  std::lock_guard<std::mutex> lock_holder(mutex_);
+  return seek_points_;
+}
+
+}
+}
+}
+
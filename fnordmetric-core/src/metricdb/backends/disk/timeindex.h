@@ -0,0 +1,70 @@
+/**
+ * This file is part of the "FnordMetric" project
+ *   Copyright (c) 2014 Paul Asmuth, Google Inc.
+ *
+ * FnordMetric is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License v3.0. You should have received a
+ * copy of the GNU General Public License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#ifndef _FNORDMETRIC_METRICDB_TIMEINDEX_H
+#define _FNORDMETRIC_METRICDB_TIMEINDEX_H
+#include <memory>
+#include <mutex>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace fnordmetric {
+namespace metricdb {
+namespace disk_backend {
+
+/**
+ * A sparse time -> body offset index. Stores the min/max sample time of a
+ * table and the body offset of (at least) one row every kSeekInterval bytes so
+ * that a cursor can be positioned close to the first row of a time range
+ * without scanning the whole table.
+ */
+class TimeIndex {
+public:
+  static const uint32_t kIndexType = 0xa0f4;
+  static const size_t kSeekInterval = 4096;
+
+  TimeIndex();
+  TimeIndex(const TimeIndex& other) = delete;
+  TimeIndex& operator=(const TimeIndex& other) = delete;
+
+  void addRow(uint64_t time, size_t body_offset);
+  void addSeekPoint(uint64_t time, size_t body_offset);
+  void extendRange(uint64_t min_time, uint64_t max_time);
+
+  /**
+   * Returns the body offset of a row at or before the first row with a time
+   * >= time_begin. Returns 0 if the table has no seek point before time_begin
+   */
+  size_t lowerBound(uint64_t time_begin) const;
+
+  /**
+   * Returns true if the table might contain rows in [time_begin, time_end)
+   */
+  bool overlaps(uint64_t time_begin, uint64_t time_end) const;
+
+  uint64_t minTime() const;
+  uint64_t maxTime() const;
+  std::vector<std::pair<uint64_t, size_t>> seekPoints() const;
+
+protected:
+  std::vector<std::pair<uint64_t, size_t>> seek_points_;
+  uint64_t min_time_;
+  uint64_t max_time_;
+  size_t last_offset_;
+  mutable std::mutex mutex_;
+};
+
+
+}
+}
+}
+
+#endif
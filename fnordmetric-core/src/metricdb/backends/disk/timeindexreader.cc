@@ -0,0 +1,36 @@
+/**
+ * This file is part of the "FnordMetric" project
+ *   Copyright (c) 2014 Paul Asmuth, Google Inc.
+ *
+ * FnordMetric is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License v3.0. You should have received a
+ * copy of the GNU General Public License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#include <fnordmetric/metricdb/backends/disk/timeindexreader.h>
+
+namespace fnordmetric {
+namespace metricdb {
+namespace disk_backend {
+
+TimeIndexReader::TimeIndexReader(
+    void* data,
+    size_t size) :
+    fnord::util::BinaryMessageReader(data, size) {}
+
+void TimeIndexReader::readIndex(TimeIndex* time_index) {
+  auto min_time = *readUInt64();
+  auto max_time = *readUInt64();
+  time_index->extendRange(min_time, max_time);
+
+  while (pos_ < size_) {
+    auto time = *readUInt64();
+    auto body_offset = *readUInt64();
+    time_index->addSeekPoint(time, body_offset);
+  }
+}
+
+}
+}
+}
+
@@ -0,0 +1,29 @@
+/**
+ * This file is part of the "FnordMetric" project
+ *   Copyright (c) 2014 Paul Asmuth, Google Inc.
+ *
+ * FnordMetric is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License v3.0. You should have received a
+ * copy of the GNU General Public License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#include <fnordmetric/metricdb/backends/disk/timeindexwriter.h>
+
+namespace fnordmetric {
+namespace metricdb {
+namespace disk_backend {
+
+TimeIndexWriter::TimeIndexWriter(TimeIndex* index) {
+  appendUInt64(index->minTime());
+  appendUInt64(index->maxTime());
+
+  for (const auto& point : index->seekPoints()) {
+    appendUInt64(point.first);
+    appendUInt64(point.second);
+  }
+}
+
+}
+}
+}
+
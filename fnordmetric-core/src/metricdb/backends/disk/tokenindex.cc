@@ -14,76 +14,163 @@ namespace fnordmetric {
 namespace metricdb {
 namespace disk_backend {
 
-TokenIndex::TokenIndex() : max_token_id_(kMinTokenID) {}
+TokenIndex::Token::Token(
+    const std::string& key_,
+    uint32_t id_) :
+    key(key_),
+    id(id_) {}
+
+TokenIndex::TokenIndex() : max_token_id_(kMinTokenID) {
+  for (size_t i = 0; i < kNumChunks; ++i) {
+    chunks_[i].store(nullptr, std::memory_order_relaxed);
+  }
+}
 
 uint32_t TokenIndex::findToken(const std::string& key) const {
-  std::lock_guard<std::mutex> lock_holder(mutex_);
-
-  auto iter = token_ids_.find(key);
-  if (iter == token_ids_.end()) {
+  auto token = keys_.find(key);
+  if (token == nullptr) {
     return 0;
   } else {
-    return iter->second;
+    return token->id;
   }
 }
 
 uint32_t TokenIndex::addToken(const std::string& key) {
   std::lock_guard<std::mutex> lock_holder(mutex_);
 
-  auto iter = token_ids_.find(key);
-  if (iter != token_ids_.end()) {
+  if (keys_.find(key) != nullptr) {
     RAISE(kIllegalStateError, "label already exists in index");
   }
 
-  auto new_id = ++max_token_id_;
-  token_ids_.emplace(key, new_id);
+  return insertToken(key, max_token_id_ + 1)->id;
+}
+
+uint32_t TokenIndex::findOrAddToken(const std::string& key) {
+  auto token = keys_.find(key);
+  if (token != nullptr) {
+    return token->id;
+  }
+
+  std::lock_guard<std::mutex> lock_holder(mutex_);
+
+  /* another thread might have added the token before we got the lock */
+  token = keys_.find(key);
+  if (token != nullptr) {
+    return token->id;
+  }
 
-  return new_id;
+  return insertToken(key, max_token_id_ + 1)->id;
 }
 
 void TokenIndex::addToken(const std::string& key, uint32_t id) {
   std::lock_guard<std::mutex> lock_holder(mutex_);
 
-  auto iter = token_ids_.find(key);
-  if (iter == token_ids_.end()) {
-    token_ids_.emplace(key, id);
-  } else if (iter->second != id) {
+  auto token = keys_.find(key);
+  if (token == nullptr) {
+    insertToken(key, id);
+  } else if (token->id != id) {
     RAISE(
         kIllegalStateError,
         "conflicting token definitions for token '%s'\n",
         key.c_str());
   }
-
-  if (id > max_token_id_) {
-    max_token_id_ = id;
-  }
 }
 
 std::string TokenIndex::resolveToken(uint32_t token_id) const {
-  std::lock_guard<std::mutex> lock_holder(mutex_);
+  return resolveTokenRef(token_id);
+}
 
-  // FIXPAUL!
-  for (const auto& pair : token_ids_) {
-    if (pair.second == token_id) {
-      return pair.first;
-    }
+const std::string& TokenIndex::resolveTokenRef(uint32_t token_id) const {
+  auto token = lookupTokenID(token_id);
+  if (token == nullptr) {
+    RAISE(kIndexError, "token not found, %i", (int) token_id);
   }
 
-  RAISE(kIndexError, "token not found, %i", (int) token_id);
+  return token->key;
 }
 
 std::unordered_map<std::string, uint32_t> TokenIndex::tokenIDs() const {
   std::unordered_map<std::string, uint32_t> copy;
 
-  {
-    std::lock_guard<std::mutex> lock_holder(mutex_);
-    copy = token_ids_;
+  std::lock_guard<std::mutex> lock_holder(mutex_);
+  for (const auto& token : tokens_) {
+    copy.emplace(token->key, token->id);
   }
 
   return copy;
 }
 
+const TokenIndex::Token* TokenIndex::lookupTokenID(uint32_t token_id) const {
+  if (token_id <= (uint32_t) kMinTokenID) {
+    return nullptr;
+  }
+
+  uint64_t slot = token_id - (uint32_t) kMinTokenID + (1 << kFirstChunkBits);
+  int bits = 63 - __builtin_clzll(slot);
+
+  auto chunk = chunks_[bits - kFirstChunkBits].load(std::memory_order_acquire);
+  if (chunk == nullptr) {
+    return nullptr;
+  }
+
+  return chunk[slot - (1llu << bits)].load(std::memory_order_acquire);
 }
+
+std::atomic<const TokenIndex::Token*>* TokenIndex::tokenIDSlot(
+    uint32_t token_id) {
+  if (token_id <= (uint32_t) kMinTokenID) {
+    RAISE(kIllegalArgumentError, "invalid token id %i", (int) token_id);
+  }
+
+  uint64_t slot = token_id - (uint32_t) kMinTokenID + (1 << kFirstChunkBits);
+  int bits = 63 - __builtin_clzll(slot);
+  auto& chunk_ref = chunks_[bits - kFirstChunkBits];
+
+  auto chunk = chunk_ref.load(std::memory_order_relaxed);
+  if (chunk == nullptr) {
+    size_t chunk_size = 1llu << bits;
+    chunk = new std::atomic<const Token*>[chunk_size];
+    chunk_storage_.emplace_back(chunk);
+
+    for (size_t i = 0; i < chunk_size; ++i) {
+      chunk[i].store(nullptr, std::memory_order_relaxed);
+    }
+
+    chunk_ref.store(chunk, std::memory_order_release);
+  }
+
+  return &chunk[slot - (1llu << bits)];
 }
+
+const TokenIndex::Token* TokenIndex::insertToken(
+    const std::string& key,
+    uint32_t id) {
+  auto id_slot = tokenIDSlot(id);
+  auto existing = id_slot->load(std::memory_order_relaxed);
+  if (existing != nullptr) {
+    RAISE(
+        kIllegalStateError,
+        "conflicting token definitions for token id %i: '%s' and '%s'\n",
+        (int) id,
+        existing->key.c_str(),
+        key.c_str());
+  }
+
+  tokens_.emplace_back(new Token(key, id));
+  auto token = tokens_.back().get();
+
+  /* the id is published first, so that readers that find the token by its key
+     can always resolve its id, too */
+  id_slot->store(token, std::memory_order_release);
+  keys_.insert(token);
+
+  if (id > max_token_id_) {
+    max_token_id_ = id;
+  }
+
+  return token;
 }
 
+}
+}
+}
@@ -9,6 +9,8 @@
  */
 #ifndef _FNORDMETRIC_METRICDB_TOKENINDEX_H
 #define _FNORDMETRIC_METRICDB_TOKENINDEX_H
+#include <fnordmetric/util/concurrentstringmap.h>
+#include <atomic>
 #include <memory>
 #include <mutex>
 #include <stdlib.h>
@@ -20,27 +22,78 @@ namespace fnordmetric {
 namespace metricdb {
 namespace disk_backend {
 
+/**
+ * Maps label tokens to 32 bit ids and back. Lookups (findToken, resolveToken)
+ * do not take a lock and never wait: the id to token map is an append only
+ * array of chunks and the token to id map is a ConcurrentStringMap. Only the
+ * insertion of new tokens is serialized by a mutex.
+ *
+ * Tokens are never freed before the index is destroyed, so a reader sees a
+ * consistent (but possibly stale) snapshot of the index.
+ */
 class TokenIndex {
 public:
   static const uint32_t kIndexType = 0xa0f0;
   static const int kMinTokenID = 0xf0000000;
 
   TokenIndex();
+  TokenIndex(const TokenIndex& copy) = delete;
+  TokenIndex& operator=(const TokenIndex& copy) = delete;
 
+  /**
+   * Returns the id of the token or 0 if the token is not in the index
+   */
   uint32_t findToken(const std::string& key) const;
+
+  /**
+   * Adds a new token and returns its id. Raises if the token already exists
+   */
   uint32_t addToken(const std::string& key);
+
+  /**
+   * Returns the id of the token, adding the token if it is not in the index
+   */
+  uint32_t findOrAddToken(const std::string& key);
+
   void addToken(const std::string& key, uint32_t id);
   std::string resolveToken(uint32_t token_id) const;
+
+  /**
+   * Returns a reference to the token string that stays valid for the lifetime
+   * of the index
+   */
+  const std::string& resolveTokenRef(uint32_t token_id) const;
+
   std::unordered_map<std::string, uint32_t> tokenIDs() const;
 
 protected:
-  std::unordered_map<std::string, uint32_t> token_ids_;
+  static const size_t kFirstChunkBits = 6;
+  static const size_t kNumChunks = 32 - kFirstChunkBits;
+  struct Token {
+    Token(const std::string& key, uint32_t id);
+    const std::string key;
+    const uint32_t id;
+  };
+
+  const Token* lookupTokenID(uint32_t token_id) const;
+
+  /**
+   * Must be called with the mutex held
+   */
+  const Token* insertToken(const std::string& key, uint32_t id);
+  std::atomic<const Token*>* tokenIDSlot(uint32_t token_id);
+
+  fnord::util::ConcurrentStringMap<Token> keys_;
+  std::atomic<std::atomic<const Token*>*> chunks_[kNumChunks];
+
+  /* owned memory, only accessed with the mutex held */
+  std::vector<std::unique_ptr<Token>> tokens_;
+  std::vector<std::unique_ptr<std::atomic<const Token*>[]>> chunk_storage_;
 
   uint32_t max_token_id_;
   mutable std::mutex mutex_;
 };
 
-
 }
 }
 }
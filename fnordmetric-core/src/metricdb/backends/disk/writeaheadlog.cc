@@ -0,0 +1,563 @@
+/**
+ * This file is part of the "FnordMetric" project
+ *   Copyright (c) 2014 Paul Asmuth, Google Inc.
+ *
+ * FnordMetric is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License v3.0. You should have received a
+ * copy of the GNU General Public License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#include <fnordmetric/environment.h>
+#include <fnordmetric/io/fileutil.h>
+#include <fnordmetric/metricdb/backends/disk/writeaheadlog.h>
+#include <fnordmetric/util/fnv.h>
+#include <fnordmetric/util/ieee754.h>
+#include <fnordmetric/util/runtimeexception.h>
+#include <algorithm>
+#include <stdlib.h>
+#include <string.h>
+
+namespace fnordmetric {
+namespace metricdb {
+namespace disk_backend {
+
+const char WriteAheadLog::kFilenamePrefix[] = "WAL.";
+
+bool WriteAheadLog::isSegment(const std::string& filename) {
+  auto pos = filename.rfind('/');
+  auto basename =
+      pos == std::string::npos ? filename : filename.substr(pos + 1);
+
+  return basename.compare(0, strlen(kFilenamePrefix), kFilenamePrefix) == 0;
+}
+
+bool WriteAheadLog::exists(const std::string& data_dir) {
+  bool exists = false;
+
+  fnord::io::FileUtil::ls(data_dir, [&exists] (const std::string& filename)
+      -> bool {
+    exists = isSegment(filename);
+    return !exists;
+  });
+
+  return exists;
+}
+
+WriteAheadLog::WriteAheadLog(
+    const std::string& data_dir,
+    size_t segment_max_size /* = kSegmentMaxSize */) :
+    data_dir_(data_dir),
+    segment_max_size_(segment_max_size),
+    recovery_interrupted_(false),
+    segment_(0),
+    segment_size_(0),
+    appended_seq_(0),
+    synced_seq_(0),
+    syncing_(false),
+    recovering_(true),
+    failed_(false) {
+  fnord::io::FileUtil::ls(data_dir, [this] (const std::string& filename)
+      -> bool {
+    if (isSegment(filename)) {
+      segments_.emplace_back(
+          strtoull(filename.c_str() + strlen(kFilenamePrefix), NULL, 10));
+    }
+
+    return true;
+  });
+
+  std::sort(segments_.begin(), segments_.end());
+
+  struct SegmentInfo {
+    bool recovered;
+    bool supersedes;
+    bool recovery_started;
+    std::set<TableKey> logged_tables;
+    std::set<TableKey> finalized_tables;
+    std::map<std::string, uint64_t> recovery_generations;
+  };
+
+  std::vector<SegmentInfo> infos(segments_.size());
+  size_t first_segment = 0;
+
+  for (size_t i = 0; i < segments_.size(); ++i) {
+    auto& info = infos[i];
+    info.recovered = false;
+    info.supersedes = false;
+    info.recovery_started = false;
+
+    readSegment(segments_[i], [&info] (
+        uint32_t type,
+        fnord::util::BinaryMessageReader* reader) {
+      switch (type) {
+
+        case kSamples:
+          info.logged_tables.emplace(readTableKey(reader));
+          break;
+
+        case kFinalizeTable:
+          info.finalized_tables.emplace(readTableKey(reader));
+          break;
+
+        case kRecovered:
+          info.recovered = true;
+          info.supersedes = *reader->readUInt32() > 0;
+          break;
+
+        case kRecoveryStart: {
+          auto num_metrics = *reader->readUInt32();
+          for (uint32_t i = 0; i < num_metrics; ++i) {
+            auto table = readTableKey(reader);
+            info.recovery_generations[table.metric_key] = table.generation;
+          }
+
+          info.recovery_started = true;
+          break;
+        }
+
+      }
+    });
+
+    if (info.supersedes) {
+      first_segment = i;
+    }
+  }
+
+  for (size_t i = first_segment; i < segments_.size(); ++i) {
+    auto& info = infos[i];
+
+    if (info.recovered) {
+      recover_segments_.emplace_back(segments_[i]);
+      logged_tables_.insert(
+          info.logged_tables.begin(),
+          info.logged_tables.end());
+      finalized_tables_.insert(
+          info.finalized_tables.begin(),
+          info.finalized_tables.end());
+    } else if (info.recovery_started && !recovery_interrupted_) {
+      /* a recovery was interrupted. the tables it wrote to are dropped and
+         the recovery is repeated */
+      recovery_interrupted_ = true;
+      recovery_generations_ = info.recovery_generations;
+    }
+  }
+
+  openSegment(segments_.size() == 0 ? 1 : segments_.back() + 1);
+}
+
+void WriteAheadLog::addFinalizedTable(
+    const std::string& metric_key,
+    uint64_t generation) {
+  TableKey table = {
+    .metric_key = metric_key,
+    .generation = generation};
+
+  finalized_tables_.emplace(table);
+}
+
+bool WriteAheadLog::needsRecovery(
+    const std::string& metric_key,
+    uint64_t generation) const {
+  TableKey table = {
+    .metric_key = metric_key,
+    .generation = generation};
+
+  if (recovery_interrupted_) {
+    auto iter = recovery_generations_.find(metric_key);
+    if (iter == recovery_generations_.end() || generation > iter->second) {
+      return true;
+    }
+  }
+
+  return logged_tables_.count(table) > 0 && finalized_tables_.count(table) == 0;
+}
+
+void WriteAheadLog::recover(
+    const std::map<std::string, uint64_t>& max_generations,
+    std::function<void (
+        const std::string& metric_key,
+        std::vector<NewSample>&& samples)> callback) {
+  fnord::util::BinaryMessageWriter payload;
+  payload.appendUInt32(kRecoveryStart);
+  payload.appendUInt32(max_generations.size());
+  for (const auto& iter : max_generations) {
+    payload.appendUInt32(iter.first.size());
+    payload.appendString(iter.first);
+    payload.appendUInt64(iter.second);
+  }
+
+  /* must be durable before any table is written to */
+  uint64_t start_seq;
+  {
+    std::lock_guard<std::mutex> lock_holder(mutex_);
+    start_seq = appendRecord(payload);
+  }
+
+  flush(start_seq);
+
+  size_t num_samples = 0;
+
+  for (const auto segment : recover_segments_) {
+    readSegment(segment, [this, callback, &num_samples] (
+        uint32_t type,
+        fnord::util::BinaryMessageReader* reader) {
+      if (type != kSamples) {
+        return;
+      }
+
+      auto table = readTableKey(reader);
+      if (finalized_tables_.count(table) > 0) {
+        return;
+      }
+
+      std::vector<NewSample> samples(*reader->readUInt32());
+      for (auto& sample : samples) {
+        sample.time = *reader->readUInt64();
+        sample.value = fnord::util::IEEE754::fromBytes(*reader->readUInt64());
+
+        auto num_labels = *reader->readUInt32();
+        for (uint32_t i = 0; i < num_labels; ++i) {
+          auto key_len = *reader->readUInt32();
+          std::string key(reader->readString(key_len), key_len);
+          auto value_len = *reader->readUInt32();
+          std::string value(reader->readString(value_len), value_len);
+          sample.labels.emplace_back(key, value);
+        }
+      }
+
+      num_samples += samples.size();
+      callback(table.metric_key, std::move(samples));
+    });
+
+    uint64_t seq;
+    {
+      std::lock_guard<std::mutex> lock_holder(mutex_);
+      seq = appended_seq_;
+    }
+
+    flush(seq);
+  }
+
+  if (num_samples > 0) {
+    env()->logger()->printf(
+        "INFO",
+        "Recovered %i sample(s) from the write ahead log",
+        (int) num_samples);
+  }
+
+  uint64_t seq;
+  {
+    std::lock_guard<std::mutex> lock_holder(mutex_);
+    seq = appendRecoveredMarker(true);
+  }
+
+  flush(seq);
+
+  std::lock_guard<std::mutex> lock_holder(mutex_);
+  recovering_ = false;
+  recover_segments_.clear();
+  logged_tables_.clear();
+  finalized_tables_.clear();
+  recovery_interrupted_ = false;
+  recovery_generations_.clear();
+
+  std::vector<uint64_t> segments;
+  for (const auto segment : segments_) {
+    if (segment < segment_) {
+      fnord::io::FileUtil::rm(segmentFilename(segment));
+    } else {
+      segments.emplace_back(segment);
+    }
+  }
+
+  segments_ = segments;
+}
+
+uint64_t WriteAheadLog::appendSamples(
+    const std::string& metric_key,
+    uint64_t generation,
+    const SampleList& samples,
+    uint64_t* segment) {
+  fnord::util::BinaryMessageWriter payload;
+  writeTableKey(&payload, kSamples, metric_key, generation);
+  payload.appendUInt32(samples.size());
+
+  for (const auto& sample : samples) {
+    payload.appendUInt64(sample.first);
+    payload.appendUInt64(fnord::util::IEEE754::toBytes(sample.second->value));
+    payload.appendUInt32(sample.second->labels.size());
+
+    for (const auto& label : sample.second->labels) {
+      payload.appendUInt32(label.first.size());
+      payload.appendString(label.first);
+      payload.appendUInt32(label.second.size());
+      payload.appendString(label.second);
+    }
+  }
+
+  std::lock_guard<std::mutex> lock_holder(mutex_);
+  *segment = segment_;
+  return appendRecord(payload);
+}
+
+uint64_t WriteAheadLog::appendFinalizeTable(
+    const std::string& metric_key,
+    uint64_t generation) {
+  fnord::util::BinaryMessageWriter payload;
+  writeTableKey(&payload, kFinalizeTable, metric_key, generation);
+
+  std::lock_guard<std::mutex> lock_holder(mutex_);
+  return appendRecord(payload);
+}
+
+void WriteAheadLog::sync(uint64_t seq) {
+  {
+    std::lock_guard<std::mutex> lock_holder(mutex_);
+
+    /* the recovered records are flushed once per segment (see recover()) */
+    if (recovering_) {
+      return;
+    }
+  }
+
+  flush(seq);
+}
+
+void WriteAheadLog::flush(uint64_t seq) {
+  std::unique_lock<std::mutex> lk(mutex_);
+
+  while (synced_seq_ < seq) {
+    if (failed_) {
+      RAISE(kIOError, "write ahead log in %s failed", data_dir_.c_str());
+    }
+
+    if (syncing_) {
+      synced_.wait(lk);
+      continue;
+    }
+
+    /* write and sync the records of all waiting threads at once */
+    syncing_ = true;
+    std::string buffer;
+    buffer.swap(buffer_);
+    auto buffer_seq = appended_seq_;
+    auto file = file_.get();
+    lk.unlock();
+
+    bool success = true;
+    try {
+      file->write(buffer.data(), buffer.size());
+      file->sync();
+    } catch (const std::exception& e) {
+      env()->logger()->printf(
+          "ERROR",
+          "can't write to write ahead log in %s: %s",
+          data_dir_.c_str(),
+          e.what());
+
+      success = false;
+    }
+
+    lk.lock();
+    syncing_ = false;
+    if (success) {
+      synced_seq_ = buffer_seq;
+    } else {
+      failed_ = true;
+    }
+
+    synced_.notify_all();
+
+    /* the recovery must not be split across segments (see recover()) */
+    if (success && !recovering_ && segment_size_ >= segment_max_size_) {
+      auto pending = buffer_;
+      buffer_.clear();
+      openSegment(segment_ + 1);
+      appendRecoveredMarker(false);
+      buffer_.append(pending);
+      segment_size_ = buffer_.size();
+    }
+  }
+}
+
+void WriteAheadLog::releaseSegments(uint64_t min_segment) {
+  std::lock_guard<std::mutex> lock_holder(mutex_);
+
+  std::vector<uint64_t> segments;
+  for (const auto segment : segments_) {
+    if (segment < min_segment && segment < segment_) {
+      if (env()->verbose()) {
+        env()->logger()->printf(
+            "DEBUG",
+            "Deleting write ahead log segment '%s'",
+            segmentFilename(segment).c_str());
+      }
+
+      fnord::io::FileUtil::rm(segmentFilename(segment));
+    } else {
+      segments.emplace_back(segment);
+    }
+  }
+
+  segments_ = segments;
+}
+
+bool WriteAheadLog::isRecovering() const {
+  std::lock_guard<std::mutex> lock_holder(mutex_);
+  return recovering_;
+}
+
+uint64_t WriteAheadLog::currentSegment() const {
+  std::lock_guard<std::mutex> lock_holder(mutex_);
+  return segment_;
+}
+
+std::vector<uint64_t> WriteAheadLog::segments() const {
+  std::lock_guard<std::mutex> lock_holder(mutex_);
+  return segments_;
+}
+
+bool WriteAheadLog::TableKey::operator<(const TableKey& other) const {
+  if (generation != other.generation) {
+    return generation < other.generation;
+  }
+
+  return metric_key < other.metric_key;
+}
+
+std::string WriteAheadLog::segmentFilename(uint64_t segment) const {
+  return fnord::io::FileUtil::joinPaths(
+      data_dir_,
+      kFilenamePrefix + std::to_string(segment));
+}
+
+void WriteAheadLog::readSegment(
+    uint64_t segment,
+    std::function<void (
+        uint32_t type,
+        fnord::util::BinaryMessageReader* reader)> fn) const {
+  auto filename = segmentFilename(segment);
+  auto file = fnord::io::File::openFile(filename, fnord::io::File::O_READ);
+  auto size = file.size();
+  std::string buf(size, 0);
+
+  for (size_t pos = 0; pos < size; ) {
+    auto res = file.read(&buf[pos], size - pos);
+    if (res == 0) {
+      RAISE(kIOError, "unexpected EOF while reading %s", filename.c_str());
+    }
+
+    pos += res;
+  }
+
+  size_t pos = 0;
+  while (pos + sizeof(uint32_t) * 3 <= size) {
+    uint32_t checksum;
+    uint32_t record_size;
+    memcpy(&checksum, &buf[pos], sizeof(uint32_t));
+    memcpy(&record_size, &buf[pos + sizeof(uint32_t)], sizeof(uint32_t));
+
+    auto payload_pos = pos + sizeof(uint32_t) * 2;
+    if (record_size < sizeof(uint32_t) || payload_pos + record_size > size) {
+      break;
+    }
+
+    fnord::util::FNV<uint32_t> fnv;
+    auto expected_checksum = fnv.hash(
+        &buf[pos + sizeof(uint32_t)],
+        sizeof(uint32_t) + record_size);
+
+    if (checksum != expected_checksum) {
+      break;
+    }
+
+    fnord::util::BinaryMessageReader reader(&buf[payload_pos], record_size);
+    auto type = *reader.readUInt32();
+    fn(type, &reader);
+
+    pos = payload_pos + record_size;
+  }
+
+  if (pos < size) {
+    env()->logger()->printf(
+        "WARNING",
+        "ignoring %i trailing bytes of invalid records in %s",
+        (int) (size - pos),
+        filename.c_str());
+  }
+}
+
+uint64_t WriteAheadLog::appendRecord(
+    const fnord::util::BinaryMessageWriter& payload) {
+  fnord::util::BinaryMessageWriter record(
+      payload.size() + sizeof(uint32_t) * 2);
+  record.appendUInt32(0);
+  record.appendUInt32(payload.size());
+  record.append(payload.data(), payload.size());
+
+  fnord::util::FNV<uint32_t> fnv;
+  record.updateUInt32(0, fnv.hash(
+      static_cast<char*>(record.data()) + sizeof(uint32_t),
+      record.size() - sizeof(uint32_t)));
+
+  buffer_.append(static_cast<char*>(record.data()), record.size());
+  segment_size_ += record.size();
+  return ++appended_seq_;
+}
+
+uint64_t WriteAheadLog::appendRecoveredMarker(
+    bool supersedes_previous_segments) {
+  fnord::util::BinaryMessageWriter payload;
+  payload.appendUInt32(kRecovered);
+  payload.appendUInt32(supersedes_previous_segments ? 1 : 0);
+  return appendRecord(payload);
+}
+
+void WriteAheadLog::openSegment(uint64_t segment) {
+  auto filename = segmentFilename(segment);
+
+  file_.reset(new fnord::io::File(fnord::io::File::openFile(
+      filename,
+      fnord::io::File::O_READ | fnord::io::File::O_WRITE |
+      fnord::io::File::O_CREATE)));
+
+  /* make the new file durable */
+  fnord::io::File::openFile(data_dir_, fnord::io::File::O_READ).sync();
+
+  if (env()->verbose()) {
+    env()->logger()->printf(
+        "DEBUG",
+        "Opened write ahead log segment '%s'",
+        filename.c_str());
+  }
+
+  segments_.emplace_back(segment);
+  segment_ = segment;
+  segment_size_ = 0;
+}
+
+WriteAheadLog::TableKey WriteAheadLog::readTableKey(
+    fnord::util::BinaryMessageReader* reader) {
+  TableKey table;
+  auto metric_key_len = *reader->readUInt32();
+  table.metric_key = std::string(
+      reader->readString(metric_key_len),
+      metric_key_len);
+  table.generation = *reader->readUInt64();
+  return table;
+}
+
+void WriteAheadLog::writeTableKey(
+    fnord::util::BinaryMessageWriter* payload,
+    uint32_t type,
+    const std::string& metric_key,
+    uint64_t generation) {
+  payload->appendUInt32(type);
+  payload->appendUInt32(metric_key.size());
+  payload->appendString(metric_key);
+  payload->appendUInt64(generation);
+}
+
+}
+}
+}
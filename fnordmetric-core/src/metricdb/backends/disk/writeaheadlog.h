@@ -0,0 +1,275 @@
+/**
+ * This file is part of the "FnordMetric" project
+ *   Copyright (c) 2014 Paul Asmuth, Google Inc.
+ *
+ * FnordMetric is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License v3.0. You should have received a
+ * copy of the GNU General Public License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#ifndef _FNORDMETRIC_METRICDB_DISK_BACKEND_WRITEAHEADLOG_H_
+#define _FNORDMETRIC_METRICDB_DISK_BACKEND_WRITEAHEADLOG_H_
+#include <fnordmetric/io/file.h>
+#include <fnordmetric/metricdb/metric.h>
+#include <fnordmetric/util/binarymessagereader.h>
+#include <fnordmetric/util/binarymessagewriter.h>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace fnordmetric {
+namespace metricdb {
+namespace disk_backend {
+
+/**
+ * A log of the samples inserted into all metrics of a repository. The samples
+ * of concurrent inserts are appended to one in-memory buffer that is written
+ * and fdatasync()ed by a single thread (group commit), so the live tables
+ * don't have to be synced at all.
+ *
+ * The log is split into numbered segment files ("WAL.<id>" in the data
+ * directory). A segment is deleted once every table that samples in the
+ * segment were written to has been finalized (see releaseSegments()).
+ *
+ * On startup, the samples of tables that were never finalized are recovered
+ * from the log: the unfinished tables are dropped and their samples are
+ * re-inserted (and thereby written to a new segment). A segment is only valid
+ * once it contains a recovered marker. The segment that is opened on startup
+ * gets the marker after the recovery completed and supersedes all older
+ * segments. If the recovery is interrupted, the segment has no marker and the
+ * tables that the recovery wrote to are dropped on the next startup, so the
+ * recovered samples are not duplicated.
+ *
+ * Record format:
+ *
+ *   <record> :=
+ *       <uint32_t> checksum    // fnv1a-32 of the size and the payload
+ *       <uint32_t> size
+ *       <uint32_t> type
+ *       <samples_record> | <finalize_table_record> | <recovered_record> |
+ *       <recovery_start_record>
+ *
+ *   <samples_record> :=
+ *       <uint32_t> metric_key_len
+ *       <char[metric_key_len]> metric_key
+ *       <uint64_t> generation  // the generation of the table
+ *       <uint32_t> num_samples
+ *       <sample>*
+ *
+ *   <sample> :=
+ *       <uint64_t> time
+ *       <uint64_t> value       // ieee754 double
+ *       <uint32_t> num_labels
+ *       (<uint32_t> len <char[len]> key <uint32_t> len <char[len]> value)*
+ *
+ *   <finalize_table_record> :=
+ *       <uint32_t> metric_key_len
+ *       <char[metric_key_len]> metric_key
+ *       <uint64_t> generation
+ *
+ *   <recovered_record> :=
+ *       <uint32_t> supersedes_previous_segments
+ *
+ *   <recovery_start_record> :=
+ *       <uint32_t> num_metrics
+ *       (<uint32_t> len <char[len]> metric_key <uint64_t> max_generation)*
+ */
+class WriteAheadLog {
+public:
+  static const char kFilenamePrefix[];
+  static constexpr const size_t kSegmentMaxSize = 2 << 25; /* 64MB */
+
+  enum RecordType {
+    kSamples = 1,
+    kFinalizeTable = 2,
+    kRecovered = 3,
+    kRecoveryStart = 4
+  };
+
+  /**
+   * A batch of samples with their (resolved) insert times
+   */
+  typedef std::vector<std::pair<uint64_t, NewSample const*>> SampleList;
+
+  /**
+   * Returns true if filename is a segment of a write ahead log
+   */
+  static bool isSegment(const std::string& filename);
+
+  /**
+   * Returns true if the data directory contains any segments
+   */
+  static bool exists(const std::string& data_dir);
+
+  /**
+   * Read the existing segments in the data directory and open a new segment.
+   * recover() must be called before any new records are appended
+   */
+  WriteAheadLog(
+      const std::string& data_dir,
+      size_t segment_max_size = kSegmentMaxSize);
+
+  WriteAheadLog(const WriteAheadLog& other) = delete;
+  WriteAheadLog& operator=(const WriteAheadLog& other) = delete;
+
+  /**
+   * Mark a table as finalized before recover() is called, i.e. its samples
+   * are not recovered even if the log has no finalize record for it
+   */
+  void addFinalizedTable(const std::string& metric_key, uint64_t generation);
+
+  /**
+   * Returns true if the unfinished table must be dropped before recover() is
+   * called because its samples are recovered from the log (or it was written
+   * to by an interrupted recovery)
+   */
+  bool needsRecovery(const std::string& metric_key, uint64_t generation) const;
+
+  /**
+   * Call the callback with the samples of every table that was never
+   * finalized. The callback must re-insert the samples. Afterwards, the new
+   * segment is marked as valid and all older segments are deleted.
+   *
+   * max_generations must contain the highest table generation of every
+   * metric before any table was dropped, i.e. every table that is created
+   * during the recovery has a higher generation
+   */
+  void recover(
+      const std::map<std::string, uint64_t>& max_generations,
+      std::function<void (
+          const std::string& metric_key,
+          std::vector<NewSample>&& samples)> callback);
+
+  /**
+   * Append the samples of a table to the buffer. Returns the sequence number
+   * of the record and stores the id of the segment the record is written to
+   * in segment. The samples are not durable until sync() returns
+   */
+  uint64_t appendSamples(
+      const std::string& metric_key,
+      uint64_t generation,
+      const SampleList& samples,
+      uint64_t* segment);
+
+  /**
+   * Append a record that the table was finalized. Returns the sequence number
+   * of the record
+   */
+  uint64_t appendFinalizeTable(
+      const std::string& metric_key,
+      uint64_t generation);
+
+  /**
+   * Block until all records up to the provided sequence number are durable.
+   * The thread that finds the buffer unsynced writes and syncs the records of
+   * all waiting threads at once. Returns immediately during recover()
+   */
+  void sync(uint64_t seq);
+
+  /**
+   * Delete the segments with an id below min_segment. The records of the
+   * tables that are not finalized yet must be in segments with an id of at
+   * least min_segment, i.e. min_segment must be computed from the first
+   * segments of all unfinalized tables and currentSegment() (read before the
+   * tables)
+   */
+  void releaseSegments(uint64_t min_segment);
+
+  /**
+   * Returns true until recover() is complete
+   */
+  bool isRecovering() const;
+
+  /**
+   * Return the id of the segment that new records are appended to
+   */
+  uint64_t currentSegment() const;
+
+  /**
+   * Return the ids of the existing segments
+   */
+  std::vector<uint64_t> segments() const;
+
+protected:
+  struct TableKey {
+    std::string metric_key;
+    uint64_t generation;
+    bool operator<(const TableKey& other) const;
+  };
+
+  std::string segmentFilename(uint64_t segment) const;
+
+  /**
+   * Call fn with the type and a reader positioned at the body of every valid
+   * record of a segment. Stops at the first torn or corrupt record
+   */
+  void readSegment(
+      uint64_t segment,
+      std::function<void (
+          uint32_t type,
+          fnord::util::BinaryMessageReader* reader)> fn) const;
+
+  /**
+   * Write and sync the buffer until all records up to the provided sequence
+   * number are durable
+   */
+  void flush(uint64_t seq);
+
+  /**
+   * Append a record to the buffer. Must be called with mutex_ held
+   */
+  uint64_t appendRecord(const fnord::util::BinaryMessageWriter& payload);
+
+  /**
+   * Append a recovered marker to the buffer. Must be called with mutex_ held
+   */
+  uint64_t appendRecoveredMarker(bool supersedes_previous_segments);
+
+  /**
+   * Create a new segment file and append all further records to it. Must be
+   * called with mutex_ held and while no sync is running
+   */
+  void openSegment(uint64_t segment);
+
+  static TableKey readTableKey(fnord::util::BinaryMessageReader* reader);
+  static void writeTableKey(
+      fnord::util::BinaryMessageWriter* payload,
+      uint32_t type,
+      const std::string& metric_key,
+      uint64_t generation);
+
+  std::string data_dir_;
+  size_t segment_max_size_;
+
+  /* the segments that have to be recovered */
+  std::vector<uint64_t> recover_segments_;
+  std::set<TableKey> finalized_tables_;
+  std::set<TableKey> logged_tables_;
+  bool recovery_interrupted_;
+  /* the max generations of the first interrupted recovery, if any */
+  std::map<std::string, uint64_t> recovery_generations_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable synced_;
+  std::vector<uint64_t> segments_;
+  std::unique_ptr<fnord::io::File> file_;
+  uint64_t segment_;
+  size_t segment_size_;
+  std::string buffer_;
+  uint64_t appended_seq_;
+  uint64_t synced_seq_;
+  bool syncing_;
+  bool recovering_;
+  bool failed_;
+};
+
+}
+}
+}
+#endif
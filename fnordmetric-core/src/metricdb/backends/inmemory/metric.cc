@@ -9,6 +9,7 @@
  */
 #include <fnordmetric/metricdb/backends/inmemory/metric.h>
 #include <fnordmetric/util/wallclock.h>
+#include <algorithm>
 
 namespace fnordmetric {
 namespace metricdb {
@@ -23,26 +24,46 @@ Metric::Metric(
     total_bytes_(0),
     last_insert_time_(0) {}
 
-void Metric::insertSampleImpl(
-    double value,
-    const std::vector<std::pair<std::string, std::string>>& labels) {
+void Metric::insertSamplesImpl(
+    NewSample const* samples,
+    size_t num_samples) {
 
   {
     std::lock_guard<std::mutex> lock_holder(labels_mutex_);
-    for (const auto& pair : labels) {
-      labels_.emplace(pair.first);
+    for (size_t i = 0; i < num_samples; ++i) {
+      for (const auto& pair : samples[i].labels) {
+        labels_.emplace(pair.first);
+      }
     }
   }
 
   {
     std::lock_guard<std::mutex> lock_holder(values_mutex_);
-    last_insert_time_ = WallClock::unixMicros();
-    MemSample sample = {
-      .time = DateTime(last_insert_time_),
-      .value = value,
-      .labels = labels};
-
-    values_.emplace_back(sample);
+    uint64_t now = WallClock::unixMicros();
+    last_insert_time_ = now;
+
+    for (size_t i = 0; i < num_samples; ++i) {
+      const auto& new_sample = samples[i];
+      MemSample sample = {
+        .time = DateTime(
+            new_sample.time == 0 ? now : new_sample.time),
+        .value = new_sample.value,
+        .labels = new_sample.labels};
+
+      // keep the samples sorted by time, late samples are inserted in place
+      auto pos = values_.end();
+      if (values_.size() > 0 && sample.time < values_.back().time) {
+        pos = std::upper_bound(
+            values_.begin(),
+            values_.end(),
+            sample,
+            [] (const MemSample& a, const MemSample& b) {
+              return a.time < b.time;
+            });
+      }
+
+      values_.insert(pos, sample);
+    }
   }
 }
 
@@ -38,9 +38,9 @@ public:
 
 protected:
 
-  void insertSampleImpl(
-      double value,
-      const std::vector<std::pair<std::string, std::string>>& labels) override;
+  void insertSamplesImpl(
+      NewSample const* samples,
+      size_t num_samples) override;
 
   struct MemSample {
     DateTime time;
@@ -12,7 +12,10 @@
 #include <fnordmetric/query/queryservice.h>
 #include <fnordmetric/metricdb/metricrepository.h>
 #include <fnordmetric/metricdb/metrictablerepository.h>
+#include <fnordmetric/metricdb/statsd.h>
+#include <fnordmetric/util/runtimeexception.h>
 #include <fnordmetric/util/stringutil.h>
+#include <fnordmetric/util/wallclock.h>
 #include <fnordmetric/sql/backends/csv/csvbackend.h>
 #include <fnordmetric/sql/backends/mysql/mysqlbackend.h>
 
@@ -23,6 +26,7 @@ static const char kMetricsUrl[] = "/metrics";
 static const char kMetricsUrlPrefix[] = "/metrics/";
 static const char kQueryUrl[] = "/query";
 static const char kLabelParamPrefix[] = "label[";
+static const char kBatchContentType[] = "text/plain";
 
 HTTPAPI::HTTPAPI(IMetricRepository* metric_repo) : metric_repo_(metric_repo) {}
 
@@ -104,6 +108,15 @@ void HTTPAPI::insertSample(
     http::HTTPResponse* response,
     util::URI* uri) {
   const auto& postbody = request->getBody();
+  const auto& content_type = request->getHeader("Content-Type");
+  if (postbody.size() > 0 && content_type.compare(
+        0,
+        sizeof(kBatchContentType) - 1,
+        kBatchContentType) == 0) {
+    insertSampleBatch(request, response, uri);
+    return;
+  }
+
   util::URI::ParamList params;
 
   if (postbody.size() > 0) {
@@ -150,8 +163,87 @@ void HTTPAPI::insertSample(
     return;
   }
 
+  uint64_t sample_time = 0;
+  std::string time_str;
+  if (util::URI::getParam(params, "time", &time_str) &&
+      !StatsdServer::parseUnixTime(time_str, &sample_time)) {
+    response->addBody("error: invalid time: " + time_str);
+    response->setStatus(http::kStatusBadRequest);
+    return;
+  }
+
+  NewSample sample = {
+    .time = sample_time,
+    .value = sample_value,
+    .labels = labels};
+
   auto metric = metric_repo_->findOrCreateMetric(metric_key);
-  metric->insertSample(sample_value, labels);
+  try {
+    metric->insertSamples(&sample, 1);
+  } catch (const fnordmetric::util::RuntimeException& e) {
+    response->addBody("error: " + e.getMessage());
+    response->setStatus(http::kStatusBadRequest);
+    return;
+  }
+
+  response->setStatus(http::kStatusCreated);
+}
+
+void HTTPAPI::insertSampleBatch(
+    http::HTTPRequest* request,
+    http::HTTPResponse* response,
+    util::URI* uri) {
+  IMetricRepository::SampleBatch batch;
+
+  const auto& postbody = request->getBody();
+  char const* begin = postbody.c_str();
+  char const* end = begin + postbody.size();
+
+  while (begin < end) {
+    std::string key;
+    std::string value_str;
+    std::vector<std::pair<std::string, std::string>> labels;
+
+    try {
+      begin = StatsdServer::parseStatsdSample(
+          begin,
+          end,
+          &key,
+          &value_str,
+          &labels);
+    } catch (const fnordmetric::util::RuntimeException& e) {
+      response->addBody("error: " + e.getMessage());
+      response->setStatus(http::kStatusBadRequest);
+      return;
+    }
+
+    double sample_value;
+    uint64_t sample_time;
+    if (!StatsdServer::parseStatsdValue(
+          value_str,
+          &sample_value,
+          &sample_time)) {
+      response->addBody("error: invalid value: " + value_str);
+      response->setStatus(http::kStatusBadRequest);
+      return;
+    }
+
+    NewSample sample = {
+      .time = sample_time,
+      .value = sample_value,
+      .labels = std::move(labels)};
+
+    batch[key].emplace_back(std::move(sample));
+  }
+
+  try {
+    metric_repo_->insertBatch(batch);
+  } catch (const fnordmetric::util::RuntimeException& e) {
+    response->addBody("error: " + e.getMessage());
+    response->setStatus(http::kStatusBadRequest);
+    return;
+  }
+
   response->setStatus(http::kStatusCreated);
 }
 
@@ -173,6 +265,47 @@ void HTTPAPI::renderMetricSampleScan(
     return;
   }
 
+  auto params = uri->queryParams();
+
+  // samples up to kMaxClockSkewMicros in the future are accepted on insert
+  uint64_t time_begin = 0;
+  uint64_t time_end =
+      fnord::util::WallClock::unixMicros() + IMetric::kMaxClockSkewMicros;
+
+  std::string time_param;
+  if ((util::URI::getParam(params, "from", &time_param) &&
+          !StatsdServer::parseUnixTime(time_param, &time_begin)) ||
+      (util::URI::getParam(params, "until", &time_param) &&
+          !StatsdServer::parseUnixTime(time_param, &time_end))) {
+    response->addBody("error: invalid time: " + time_param);
+    response->setStatus(http::kStatusBadRequest);
+    return;
+  }
+
+  size_t limit = 0;
+  std::string limit_param;
+  if (util::URI::getParam(params, "limit", &limit_param)) {
+    try {
+      limit = std::stoull(limit_param);
+    } catch (std::exception& e) {
+      response->addBody("error: invalid limit: " + limit_param);
+      response->setStatus(http::kStatusBadRequest);
+      return;
+    }
+  }
+
+  bool reverse = false;
+  std::string order_param;
+  if (util::URI::getParam(params, "order", &order_param)) {
+    if (order_param == "desc") {
+      reverse = true;
+    } else if (order_param != "asc") {
+      response->addBody("error: invalid order: " + order_param);
+      response->setStatus(http::kStatusBadRequest);
+      return;
+    }
+  }
+
   response->setStatus(http::kStatusOK);
   response->addHeader("Content-Type", "application/json; charset=utf-8");
   util::JSONOutputStream json(response->getBodyOutputStream());
@@ -186,38 +319,41 @@ void HTTPAPI::renderMetricSampleScan(
   json.addObjectEntry("samples");
   json.beginArray();
 
-  int i = 0;
-  metric->scanSamples(
-      fnord::util::DateTime::epoch(),
-      fnord::util::DateTime::now(),
-      [&json, &i] (Sample* sample) -> bool {
-        if (i++ > 0) { json.addComma(); }
-        json.beginObject();
-
-        json.addObjectEntry("time");
-        json.addLiteral<uint64_t>(static_cast<uint64_t>(sample->time()));
-        json.addComma();
+  size_t i = 0;
+  auto render_sample = [&json, &i, limit] (Sample* sample) -> bool {
+    if (i++ > 0) { json.addComma(); }
+    json.beginObject();
+
+    json.addObjectEntry("time");
+    json.addLiteral<uint64_t>(static_cast<uint64_t>(sample->time()));
+    json.addComma();
+
+    json.addObjectEntry("value");
+    json.addLiteral<double>(sample->value());
+    json.addComma();
 
-        json.addObjectEntry("value");
-        json.addLiteral<double>(sample->value());
+    json.addObjectEntry("labels");
+    json.beginObject();
+    auto labels = sample->labels();
+    for (int n = 0; n < labels.size(); n++) {
+      if (n > 0) {
         json.addComma();
+      }
 
-        json.addObjectEntry("labels");
-        json.beginObject();
-        auto labels = sample->labels();
-        for (int n = 0; n < labels.size(); n++) {
-          if (n > 0) {
-            json.addComma();
-          }
+      json.addObjectEntry(labels[n].first);
+      json.addString(labels[n].second);
+    }
+    json.endObject();
 
-          json.addObjectEntry(labels[n].first);
-          json.addString(labels[n].second);
-        }
-        json.endObject();
+    json.endObject();
+    return limit == 0 || i < limit;
+  };
 
-        json.endObject();
-        return true;
-      });
+  if (reverse) {
+    metric->scanSamplesReverse(time_begin, time_end, render_sample);
+  } else {
+    metric->scanSamples(time_begin, time_end, render_sample);
+  }
 
   json.endArray();
   json.endObject();
@@ -48,6 +48,11 @@ protected:
       http::HTTPResponse* response,
       util::URI* uri);
 
+  void insertSampleBatch(
+      http::HTTPRequest* request,
+      http::HTTPResponse* response,
+      util::URI* uri);
+
   void executeQuery(
       http::HTTPRequest* request,
       http::HTTPResponse* response,
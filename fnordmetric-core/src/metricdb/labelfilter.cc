@@ -0,0 +1,93 @@
+/**
+ * This file is part of the "FnordMetric" project
+ *   Copyright (c) 2014 Paul Asmuth, Google Inc.
+ *
+ * FnordMetric is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License v3.0. You should have received a
+ * copy of the GNU General Public License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#include <fnordmetric/metricdb/labelfilter.h>
+
+namespace fnordmetric {
+namespace metricdb {
+
+void LabelFilter::addCondition(
+    const std::string& key,
+    const std::set<std::string>& values) {
+  auto iter = conditions_.find(key);
+  if (iter == conditions_.end()) {
+    conditions_.emplace(key, values);
+    return;
+  }
+
+  std::set<std::string> intersection;
+  for (const auto& value : values) {
+    if (iter->second.count(value) > 0) {
+      intersection.insert(value);
+    }
+  }
+
+  iter->second = intersection;
+}
+
+bool LabelFilter::matches(
+    const std::vector<std::pair<std::string, std::string>>& labels) const {
+  for (const auto& condition : conditions_) {
+    auto matched = false;
+
+    for (const auto& label : labels) {
+      if (label.first == condition.first &&
+          condition.second.count(label.second) > 0) {
+        matched = true;
+        break;
+      }
+    }
+
+    if (!matched) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool LabelFilter::matches(const LabelRefList& labels) const {
+  for (const auto& condition : conditions_) {
+    auto matched = false;
+
+    /* compare the references in place instead of copying them into strings */
+    for (const auto& label : labels) {
+      if (!(label.first == condition.first)) {
+        continue;
+      }
+
+      for (const auto& value : condition.second) {
+        if (label.second == value) {
+          matched = true;
+          break;
+        }
+      }
+
+      break;
+    }
+
+    if (!matched) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool LabelFilter::empty() const {
+  return conditions_.empty();
+}
+
+const std::map<std::string, std::set<std::string>>&
+    LabelFilter::conditions() const {
+  return conditions_;
+}
+
+}
+}
@@ -0,0 +1,55 @@
+/**
+ * This file is part of the "FnordMetric" project
+ *   Copyright (c) 2014 Paul Asmuth, Google Inc.
+ *
+ * FnordMetric is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License v3.0. You should have received a
+ * copy of the GNU General Public License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#ifndef _FNORDMETRIC_METRICDB_LABELFILTER_H_
+#define _FNORDMETRIC_METRICDB_LABELFILTER_H_
+#include <fnordmetric/metricdb/labelref.h>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace fnordmetric {
+namespace metricdb {
+
+/**
+ * A conjunction of label conditions. Each condition requires a label key to
+ * be present and to have one of a set of values, i.e. "key = value" or
+ * "key IN (value, ...)". An empty filter matches all samples
+ */
+class LabelFilter {
+public:
+
+  /**
+   * Require the label key to have one of the values. Adding a second condition
+   * for the same key only keeps the values that are allowed by both
+   */
+  void addCondition(
+      const std::string& key,
+      const std::set<std::string>& values);
+
+  bool matches(
+      const std::vector<std::pair<std::string, std::string>>& labels) const;
+
+  bool matches(const LabelRefList& labels) const;
+
+  bool empty() const;
+
+  /**
+   * The allowed values per label key
+   */
+  const std::map<std::string, std::set<std::string>>& conditions() const;
+
+protected:
+  std::map<std::string, std::set<std::string>> conditions_;
+};
+
+}
+}
+#endif
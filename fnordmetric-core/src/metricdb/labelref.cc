@@ -0,0 +1,50 @@
+/**
+ * This file is part of the "FnordMetric" project
+ *   Copyright (c) 2014 Paul Asmuth, Google Inc.
+ *
+ * FnordMetric is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License v3.0. You should have received a
+ * copy of the GNU General Public License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#include <fnordmetric/metricdb/labelref.h>
+#include <string.h>
+
+namespace fnordmetric {
+namespace metricdb {
+
+LabelRef::LabelRef() : data_(nullptr), size_(0) {}
+
+LabelRef::LabelRef(
+    char const* data,
+    size_t size) :
+    data_(data),
+    size_(size) {}
+
+LabelRef::LabelRef(
+    const std::string& str) :
+    data_(str.data()),
+    size_(str.size()) {}
+
+char const* LabelRef::data() const {
+  return data_;
+}
+
+size_t LabelRef::size() const {
+  return size_;
+}
+
+std::string LabelRef::toString() const {
+  return std::string(data_, size_);
+}
+
+bool LabelRef::operator==(const LabelRef& other) const {
+  return size_ == other.size_ && memcmp(data_, other.data_, size_) == 0;
+}
+
+bool LabelRef::operator==(const std::string& other) const {
+  return size_ == other.size() && memcmp(data_, other.data(), size_) == 0;
+}
+
+}
+}
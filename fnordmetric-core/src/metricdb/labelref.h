@@ -0,0 +1,50 @@
+/**
+ * This file is part of the "FnordMetric" project
+ *   Copyright (c) 2014 Paul Asmuth, Google Inc.
+ *
+ * FnordMetric is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License v3.0. You should have received a
+ * copy of the GNU General Public License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#ifndef _FNORDMETRIC_METRICDB_LABELREF_H_
+#define _FNORDMETRIC_METRICDB_LABELREF_H_
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+namespace fnordmetric {
+namespace metricdb {
+
+/**
+ * A reference to a label key or value that is owned by someone else, e.g. a
+ * token in a token index or a string in a mmapped table. Label refs returned
+ * from a scan are only valid until the scan callback returns
+ */
+class LabelRef {
+public:
+  LabelRef();
+  LabelRef(char const* data, size_t size);
+  LabelRef(const std::string& str);
+
+  char const* data() const;
+  size_t size() const;
+
+  /**
+   * Copy the referenced bytes into a new string
+   */
+  std::string toString() const;
+
+  bool operator==(const LabelRef& other) const;
+  bool operator==(const std::string& other) const;
+
+protected:
+  char const* data_;
+  size_t size_;
+};
+
+typedef std::vector<std::pair<LabelRef, LabelRef>> LabelRefList;
+
+}
+}
+#endif
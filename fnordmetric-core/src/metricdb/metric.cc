@@ -9,6 +9,7 @@
  */
 #include <fnordmetric/metricdb/metric.h>
 #include <fnordmetric/util/runtimeexception.h>
+#include <fnordmetric/util/wallclock.h>
 
 namespace fnordmetric {
 namespace metricdb {
@@ -19,19 +20,138 @@ IMetric::~IMetric() {}
 void IMetric::insertSample(
     double value,
     const std::vector<std::pair<std::string, std::string>>& labels) {
-  // FIXPAUL slow slow slow!
-  for (int i1 = 0; i1 < labels.size(); ++i1) {
-    for (int i2 = 0; i2 < labels.size(); ++i2) {
-      if (i1 != i2 && labels[i1].first == labels[i2].first) {
-        RAISE(
-            kIllegalArgumentError,
-            "duplicate label: %s",
-            labels[i1].first.c_str());
+  NewSample sample = {
+    .time = 0,
+    .value = value,
+    .labels = labels};
+
+  insertSamples(&sample, 1);
+}
+
+void IMetric::insertSamples(NewSample const* samples, size_t num_samples) {
+  validateSamples(samples, num_samples);
+
+  if (num_samples > 0) {
+    insertSamplesImpl(samples, num_samples);
+  }
+}
+
+void IMetric::validateSamples(NewSample const* samples, size_t num_samples) {
+  // all samples after one from the future would arrive out of order
+  auto max_time = fnord::util::WallClock::unixMicros() + kMaxClockSkewMicros;
+
+  for (size_t n = 0; n < num_samples; ++n) {
+    if (samples[n].time > max_time) {
+      RAISE(
+          kIllegalArgumentError,
+          "sample time is in the future: %llu",
+          (long long unsigned) samples[n].time);
+    }
+
+    const auto& labels = samples[n].labels;
+
+    // FIXPAUL slow slow slow!
+    for (int i1 = 0; i1 < labels.size(); ++i1) {
+      for (int i2 = 0; i2 < labels.size(); ++i2) {
+        if (i1 != i2 && labels[i1].first == labels[i2].first) {
+          RAISE(
+              kIllegalArgumentError,
+              "duplicate label: %s",
+              labels[i1].first.c_str());
+        }
       }
     }
   }
+}
+
+void IMetric::insertSamples(const std::vector<NewSample>& samples) {
+  insertSamples(samples.data(), samples.size());
+}
+
+void IMetric::scanSamples(
+    const fnord::util::DateTime& time_begin,
+    const fnord::util::DateTime& time_end,
+    const LabelFilter& filter,
+    std::function<bool (Sample* sample)> callback) {
+  scanSamples(
+      time_begin,
+      time_end,
+      [&filter, &callback] (Sample* sample) -> bool {
+        if (!filter.empty() && !filter.matches(sample->labelRefs())) {
+          return true;
+        }
+
+        return callback(sample);
+      });
+}
+
+void IMetric::scanSamples(
+    const fnord::util::DateTime& time_begin,
+    const fnord::util::DateTime& time_end,
+    const LabelFilter& filter,
+    const SampleProjection& projection,
+    std::function<bool (Sample* sample)> callback) {
+  scanSamples(time_begin, time_end, filter, callback);
+}
+
+void IMetric::scanSamplesReverse(
+    const fnord::util::DateTime& time_begin,
+    const fnord::util::DateTime& time_end,
+    std::function<bool (Sample* sample)> callback) {
+  std::vector<NewSample> samples;
+
+  scanSamples(
+      time_begin,
+      time_end,
+      [&samples] (Sample* sample) -> bool {
+        NewSample copy;
+        copy.time = static_cast<uint64_t>(sample->time());
+        copy.value = sample->value();
+        copy.labels = sample->labels();
+        samples.emplace_back(std::move(copy));
+        return true;
+      });
+
+  for (auto iter = samples.rbegin(); iter != samples.rend(); ++iter) {
+    Sample sample(iter->time, iter->value, iter->labels);
+    if (!callback(&sample)) {
+      return;
+    }
+  }
+}
+
+void IMetric::scanRollups(
+    const fnord::util::DateTime& time_begin,
+    const fnord::util::DateTime& time_end,
+    uint64_t resolution,
+    std::function<bool (RollupSample* sample)> callback) {
+  scanRollups(time_begin, time_end, LabelFilter(), resolution, callback);
+}
+
+void IMetric::scanRollups(
+    const fnord::util::DateTime& time_begin,
+    const fnord::util::DateTime& time_end,
+    const LabelFilter& filter,
+    uint64_t resolution,
+    std::function<bool (RollupSample* sample)> callback) {
+  RollupAggregator aggregator(resolution, callback);
+
+  scanSamples(
+      time_begin,
+      time_end,
+      filter,
+      [&aggregator] (Sample* sample) -> bool {
+        return aggregator.addSample(
+            static_cast<uint64_t>(sample->time()),
+            RollupValue::fromValue(sample->value()),
+            sample->labels());
+      });
+
+  aggregator.flush();
+}
 
-  insertSampleImpl(value, labels);
+std::vector<uint64_t> IMetric::rollupResolutions() const {
+  return std::vector<uint64_t>();
 }
 
 const std::string& IMetric::key() const {
@@ -9,7 +9,10 @@
  */
 #ifndef _FNORDMETRIC_METRICDB_METRIC_H_
 #define _FNORDMETRIC_METRICDB_METRIC_H_
+#include <fnordmetric/metricdb/labelfilter.h>
+#include <fnordmetric/metricdb/rollup.h>
 #include <fnordmetric/metricdb/sample.h>
+#include <fnordmetric/metricdb/sampleprojection.h>
 #include <fnordmetric/util/datetime.h>
 #include <functional>
 #include <string>
@@ -19,11 +22,24 @@
 namespace fnordmetric {
 namespace metricdb {
 
+/**
+ * A sample to be inserted into a metric. A time of zero means "now", i.e. the
+ * sample is stamped with the insert time
+ */
+struct NewSample {
+  uint64_t time;
+  double value;
+  std::vector<std::pair<std::string, std::string>> labels;
+};
+
 /**
  * IMPLEMENTATIONS MUST BE THREADSAFE
  */
 class IMetric {
 public:
+  static constexpr const uint64_t kMaxClockSkewMicros =
+      60 * 1000000; /* 1 minute */
+
   IMetric(const std::string& key);
   virtual ~IMetric();
 
@@ -31,11 +47,89 @@ public:
       double value,
       const std::vector<std::pair<std::string, std::string>>& labels);
 
+  /**
+   * Insert a batch of samples. The batch is appended under a single lock and
+   * with a single write. Raises an error (and inserts none of the samples) if
+   * a sample is more than kMaxClockSkewMicros in the future
+   */
+  void insertSamples(NewSample const* samples, size_t num_samples);
+  void insertSamples(const std::vector<NewSample>& samples);
+
+  /**
+   * Raises the error that insertSamples() would raise for the samples, i.e.
+   * if a sample is more than kMaxClockSkewMicros in the future or has a
+   * duplicate label
+   */
+  static void validateSamples(NewSample const* samples, size_t num_samples);
+
   virtual void scanSamples(
       const fnord::util::DateTime& time_begin,
       const fnord::util::DateTime& time_end,
       std::function<bool (Sample* sample)> callback) = 0;
 
+  /**
+   * Scan only the samples whose labels match the filter. Backends that index
+   * their samples by label set may skip non-matching samples without decoding
+   * them. The default implementation filters the samples of scanSamples()
+   */
+  virtual void scanSamples(
+      const fnord::util::DateTime& time_begin,
+      const fnord::util::DateTime& time_end,
+      const LabelFilter& filter,
+      std::function<bool (Sample* sample)> callback);
+
+  /**
+   * Scan only the samples whose labels match the filter and only decode the
+   * projected fields of each sample. The default implementation ignores the
+   * projection and returns the samples of the filtered scanSamples()
+   */
+  virtual void scanSamples(
+      const fnord::util::DateTime& time_begin,
+      const fnord::util::DateTime& time_end,
+      const LabelFilter& filter,
+      const SampleProjection& projection,
+      std::function<bool (Sample* sample)> callback);
+
+  /**
+   * Scan the samples from the newest to the oldest, e.g. to read the last N
+   * samples of a metric. Like all scans, the scan stops as soon as the
+   * callback returns false. The default implementation buffers all samples
+   * returned by scanSamples() and returns them in reverse order
+   */
+  virtual void scanSamplesReverse(
+      const fnord::util::DateTime& time_begin,
+      const fnord::util::DateTime& time_end,
+      std::function<bool (Sample* sample)> callback);
+
+  /**
+   * Scan the count, sum, min and max of all samples per label set in windows
+   * of resolution microseconds. Backends that store rollups may return windows
+   * coarser than the resolution for time ranges that were rolled up into a
+   * coarser resolution. The default implementation aggregates scanSamples()
+   */
+  virtual void scanRollups(
+      const fnord::util::DateTime& time_begin,
+      const fnord::util::DateTime& time_end,
+      uint64_t resolution,
+      std::function<bool (RollupSample* sample)> callback);
+
+  /**
+   * Scan the rollups of only the samples whose labels match the filter. The
+   * default implementation aggregates the filtered scanSamples()
+   */
+  virtual void scanRollups(
+      const fnord::util::DateTime& time_begin,
+      const fnord::util::DateTime& time_end,
+      const LabelFilter& filter,
+      uint64_t resolution,
+      std::function<bool (RollupSample* sample)> callback);
+
+  /**
+   * Return the resolutions (in microseconds) of the stored rollups of this
+   * metric, if any
+   */
+  virtual std::vector<uint64_t> rollupResolutions() const;
+
   const std::string& key() const;
   virtual size_t totalBytes() const = 0;
   virtual DateTime lastInsertTime() const = 0;
@@ -44,9 +138,9 @@ public:
 
 protected:
 
-  virtual void insertSampleImpl(
-      double value,
-      const std::vector<std::pair<std::string, std::string>>& labels) = 0;
+  virtual void insertSamplesImpl(
+      NewSample const* samples,
+      size_t num_samples) = 0;
 
   const std::string key_;
 };
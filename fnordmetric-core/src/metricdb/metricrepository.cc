@@ -9,60 +9,93 @@
  */
 #include <fnordmetric/environment.h>
 #include <fnordmetric/metricdb/metricrepository.h>
+#include <fnordmetric/util/runtimeexception.h>
 
 using namespace fnord;
 namespace fnordmetric {
 namespace metricdb {
 
-IMetric* IMetricRepository::findMetric(const std::string& key) const {
-  IMetric* metric = nullptr;
+IMetricRepository::MetricEntry::MetricEntry(
+    const std::string& key_,
+    IMetric* metric_) :
+    key(key_),
+    metric(metric_) {}
 
-  std::lock_guard<std::mutex> lock_holder(metrics_mutex_);
+IMetricRepository::IMetricRepository() : metrics_(kInitialTableSize) {}
 
-  auto iter = metrics_.find(key);
-  if (iter != metrics_.end()) {
-    metric = iter->second.get();
+IMetric* IMetricRepository::findMetric(const std::string& key) const {
+  auto entry = metrics_.find(key);
+  if (entry == nullptr) {
+    return nullptr;
+  } else {
+    return entry->metric.get();
   }
-
-  return metric;
 }
 
 IMetric* IMetricRepository::findOrCreateMetric(const std::string& key) {
-  IMetric* metric;
+  auto entry = metrics_.find(key);
+  if (entry != nullptr) {
+    return entry->metric.get();
+  }
+
   std::lock_guard<std::mutex> lock_holder(metrics_mutex_);
 
-  auto iter = metrics_.find(key);
-  if (iter == metrics_.end()) {
-    if (env()->verbose()) {
-      env()->logger()->printf(
-          "DEBUG",
-          "Create new metric: '%s'",
-          key.c_str());
-    }
-
-    // FIXPAUL expensive operation; should be done outside of lock..
-    metric = createMetric(key);
-    metrics_.emplace(key, std::unique_ptr<IMetric>(metric));
-  } else {
-    metric = iter->second.get();
+  /* another thread might have created the metric before we got the lock */
+  entry = metrics_.find(key);
+  if (entry != nullptr) {
+    return entry->metric.get();
+  }
+
+  if (env()->verbose()) {
+    env()->logger()->printf(
+        "DEBUG",
+        "Create new metric: '%s'",
+        key.c_str());
   }
 
+  auto metric = createMetric(key);
+  insertMetric(key, metric);
   return metric;
 }
 
+void IMetricRepository::insertBatch(const SampleBatch& batch) {
+  /* validated up front so that no metric is written if any sample is invalid */
+  for (const auto& iter : batch) {
+    IMetric::validateSamples(iter.second.data(), iter.second.size());
+  }
+
+  for (const auto& iter : batch) {
+    auto metric = findOrCreateMetric(iter.first);
+    metric->insertSamples(iter.second);
+  }
+}
+
 std::vector<IMetric*> IMetricRepository::listMetrics()
     const {
   std::vector<IMetric*> metrics;
 
-  {
-    std::lock_guard<std::mutex> lock_holder(metrics_mutex_);
-    for (const auto& iter : metrics_) {
-      metrics.emplace_back(iter.second.get());
-    }
-  }
+  /* metrics that are created during the iteration may or may not be listed */
+  metrics_.forEach([&metrics] (const MetricEntry* entry) {
+    metrics.emplace_back(entry->metric.get());
+  });
 
   return metrics;
 }
 
+void IMetricRepository::addMetric(const std::string& key, IMetric* metric) {
+  std::lock_guard<std::mutex> lock_holder(metrics_mutex_);
+
+  if (metrics_.find(key) != nullptr) {
+    RAISE(kIllegalStateError, "metric already exists: '%s'", key.c_str());
+  }
+
+  insertMetric(key, metric);
+}
+
+void IMetricRepository::insertMetric(const std::string& key, IMetric* metric) {
+  entries_.emplace_back(new MetricEntry(key, metric));
+  metrics_.insert(entries_.back().get());
+}
+
 }
 }
@@ -10,6 +10,7 @@
 #ifndef _FNORDMETRIC_METRICDB_METRICREPOSITORY_H_
 #define _FNORDMETRIC_METRICDB_METRICREPOSITORY_H_
 #include <fnordmetric/metricdb/metric.h>
+#include <fnordmetric/util/concurrentstringmap.h>
 #include <mutex>
 #include <memory>
 #include <string>
@@ -20,15 +21,57 @@ using namespace fnord;
 namespace fnordmetric {
 namespace metricdb {
 
+/**
+ * Lookups (findMetric, findOrCreateMetric for existing metrics) and
+ * listMetrics() do not take a lock: the metrics are stored in a
+ * ConcurrentStringMap. Only the creation of new metrics is serialized by a
+ * mutex. Metrics are never removed, so metric pointers stay valid for the
+ * lifetime of the repository
+ */
 class IMetricRepository {
 public:
+  typedef std::unordered_map<std::string, std::vector<NewSample>> SampleBatch;
+
+  IMetricRepository();
   virtual ~IMetricRepository() {}
   IMetric* findMetric(const std::string& key) const;
   IMetric* findOrCreateMetric(const std::string& key);
   std::vector<IMetric*> listMetrics() const;
+
+  /**
+   * Insert a batch of samples for one or more metrics (keyed by metric key).
+   * Each metric is looked up once and all of its samples are appended at once.
+   * Raises an error (and inserts none of the samples) if any sample is invalid
+   * (see IMetric::insertSamples())
+   */
+  void insertBatch(const SampleBatch& batch);
+
 protected:
+  static const size_t kInitialTableSize = 1024;
+
+  struct MetricEntry {
+    MetricEntry(const std::string& key, IMetric* metric);
+    const std::string key;
+    const std::unique_ptr<IMetric> metric;
+  };
+
   virtual IMetric* createMetric(const std::string& key) = 0;
-  std::unordered_map<std::string, std::unique_ptr<IMetric>> metrics_;
+
+  /**
+   * Add a metric to the repository and take ownership of it. The key must not
+   * exist yet
+   */
+  void addMetric(const std::string& key, IMetric* metric);
+
+  /**
+   * Must be called with metrics_mutex_ held
+   */
+  void insertMetric(const std::string& key, IMetric* metric);
+
+  fnord::util::ConcurrentStringMap<MetricEntry> metrics_;
+
+  /* owned memory, only accessed with metrics_mutex_ held */
+  std::vector<std::unique_ptr<MetricEntry>> entries_;
   mutable std::mutex metrics_mutex_;
 };
 
@@ -8,8 +8,15 @@
  * <http://www.gnu.org/licenses/>.
  */
 #include <fnordmetric/metricdb/metrictableref.h>
+#include <fnordmetric/sql/parser/astnode.h>
+#include <fnordmetric/sql/parser/token.h>
+#include <fnordmetric/sql/runtime/compile.h>
+#include <fnordmetric/sql/runtime/execute.h>
 #include <fnordmetric/sql/runtime/tablescan.h>
 #include <fnordmetric/sql/svalue.h>
+#include <fnordmetric/util/runtimeexception.h>
+#include <limits>
+#include <math.h>
 
 namespace fnordmetric {
 namespace query {
@@ -18,23 +25,266 @@ class TableScan;
 
 namespace metricdb {
 
-MetricTableRef::MetricTableRef(IMetric* metric) : metric_(metric) {}
+AbstractMetricTableRef::AbstractMetricTableRef(
+    IMetric* metric,
+    size_t num_fixed_columns) :
+    metric_(metric),
+    num_fixed_columns_(num_fixed_columns),
+    time_begin_(0),
+    time_end_(std::numeric_limits<uint64_t>::max()) {}
+
+int AbstractMetricTableRef::getLabelColumnIndex(const std::string& name) {
+  for (int i = 0; i < fields_.size(); ++i) {
+    if (fields_[i] == name) {
+      return i + num_fixed_columns_;
+    }
+  }
+
+  if (metric_->hasLabel(name)) {
+    fields_.emplace_back(name);
+    return fields_.size() + num_fixed_columns_ - 1;
+  }
+
+  return -1;
+}
+
+std::string AbstractMetricTableRef::getLabelColumnName(int index) const {
+  if (index < num_fixed_columns_ ||
+      index - num_fixed_columns_ >= fields_.size()) {
+    RAISE(kIndexError, "no such column");
+  }
+
+  return fields_[index - num_fixed_columns_];
+}
+
+bool AbstractMetricTableRef::getScanRange(
+    uint64_t* begin,
+    uint64_t* limit) const {
+  auto now = static_cast<uint64_t>(fnord::util::DateTime::now());
+  *begin = time_begin_;
+  *limit = std::min(time_end_, now);
+  return *begin < *limit;
+}
+
+void AbstractMetricTableRef::setWhereExpression(
+    query::ASTNode* expr,
+    query::Compiler* compiler) {
+  if (expr->getType() == query::ASTNode::T_AND_EXPR) {
+    for (const auto& child : expr->getChildren()) {
+      setWhereExpression(child, compiler);
+    }
+
+    return;
+  }
+
+  std::string key;
+  std::set<std::string> values;
+  if (getLabelCondition(expr, &key, &values)) {
+    filter_.addCondition(key, values);
+    return;
+  }
+
+  addTimeCondition(expr, compiler);
+}
+
+bool AbstractMetricTableRef::getLabelCondition(
+    query::ASTNode* expr,
+    std::string* key,
+    std::set<std::string>* values) const {
+  const auto& children = expr->getChildren();
+  if (children.size() != 2) {
+    return false;
+  }
+
+  switch (expr->getType()) {
+    case query::ASTNode::T_EQ_EXPR: {
+      auto column = children[0];
+      auto literal = children[1];
+      if (column->getType() == query::ASTNode::T_LITERAL) {
+        std::swap(column, literal);
+      }
+
+      if (column->getType() != query::ASTNode::T_RESOLVED_COLUMN ||
+          literal->getType() != query::ASTNode::T_LITERAL) {
+        return false;
+      }
+
+      /* the label columns follow the fixed columns */
+      auto index = column->getID();
+      if (index < num_fixed_columns_ ||
+          index - num_fixed_columns_ >= fields_.size()) {
+        return false;
+      }
+
+      auto token = literal->getToken();
+      if (token == nullptr || !(*token == query::Token::T_STRING)) {
+        return false;
+      }
+
+      *key = fields_[index - num_fixed_columns_];
+      values->insert(token->getString());
+      return true;
+    }
+
+    case query::ASTNode::T_OR_EXPR: {
+      std::string left_key;
+      std::string right_key;
+      if (!getLabelCondition(children[0], &left_key, values) ||
+          !getLabelCondition(children[1], &right_key, values) ||
+          left_key != right_key) {
+        return false;
+      }
+
+      *key = left_key;
+      return true;
+    }
+
+    default:
+      return false;
+  }
+}
+
+void AbstractMetricTableRef::addTimeCondition(
+    query::ASTNode* expr,
+    query::Compiler* compiler) {
+  auto type = expr->getType();
+  switch (type) {
+    case query::ASTNode::T_LT_EXPR:
+    case query::ASTNode::T_LTE_EXPR:
+    case query::ASTNode::T_GT_EXPR:
+    case query::ASTNode::T_GTE_EXPR:
+      break;
+    default:
+      return;
+  }
+
+  const auto& children = expr->getChildren();
+  if (children.size() != 2) {
+    return;
+  }
+
+  /* normalize "<bound> op time" to "time op' <bound>" */
+  auto column = children[0];
+  auto bound = children[1];
+  if (column->getType() != query::ASTNode::T_RESOLVED_COLUMN) {
+    std::swap(column, bound);
+
+    switch (type) {
+      case query::ASTNode::T_LT_EXPR:
+        type = query::ASTNode::T_GT_EXPR;
+        break;
+      case query::ASTNode::T_LTE_EXPR:
+        type = query::ASTNode::T_GTE_EXPR;
+        break;
+      case query::ASTNode::T_GT_EXPR:
+        type = query::ASTNode::T_LT_EXPR;
+        break;
+      case query::ASTNode::T_GTE_EXPR:
+        type = query::ASTNode::T_LTE_EXPR;
+        break;
+      default:
+        return;
+    }
+  }
+
+  /* column 0 is time */
+  if (column->getType() != query::ASTNode::T_RESOLVED_COLUMN ||
+      column->getID() != 0 ||
+      compiler == nullptr ||
+      !isConstExpression(bound)) {
+    return;
+  }
+
+  query::SValue value;
+  try {
+    value = query::executeSimpleConstExpression(compiler, bound);
+  } catch (const fnordmetric::util::RuntimeException& e) {
+    /* not a pure constant expression, leave it to the WHERE expression */
+    return;
+  }
+
+  /* timestamps compare as their microsecond value */
+  double micros;
+  switch (value.testTypeWithNumericConversion()) {
+    case query::SValue::T_INTEGER:
+    case query::SValue::T_TIMESTAMP:
+      micros = value.getInteger();
+      break;
+    case query::SValue::T_FLOAT:
+      micros = value.getFloat();
+      break;
+    default:
+      return;
+  }
+
+  auto clamp = [] (double t) -> uint64_t {
+    if (t <= 0) {
+      return 0;
+    }
+
+    if (t >= std::numeric_limits<uint64_t>::max()) {
+      return std::numeric_limits<uint64_t>::max();
+    }
+
+    return t;
+  };
+
+  /* the scanned range includes time_begin_ and excludes time_end_ */
+  switch (type) {
+    case query::ASTNode::T_GT_EXPR:
+      time_begin_ = std::max(time_begin_, clamp(floor(micros) + 1));
+      break;
+    case query::ASTNode::T_GTE_EXPR:
+      time_begin_ = std::max(time_begin_, clamp(ceil(micros)));
+      break;
+    case query::ASTNode::T_LT_EXPR:
+      time_end_ = std::min(time_end_, clamp(ceil(micros)));
+      break;
+    case query::ASTNode::T_LTE_EXPR:
+      time_end_ = std::min(time_end_, clamp(floor(micros) + 1));
+      break;
+    default:
+      break;
+  }
+}
+
+bool AbstractMetricTableRef::isConstExpression(query::ASTNode* expr) {
+  switch (expr->getType()) {
+    case query::ASTNode::T_RESOLVED_COLUMN:
+    case query::ASTNode::T_COLUMN_NAME:
+    case query::ASTNode::T_TABLE_NAME:
+      return false;
+    default:
+      break;
+  }
+
+  for (const auto& child : expr->getChildren()) {
+    if (child == nullptr || !isConstExpression(child)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+MetricTableRef::MetricTableRef(
+    IMetric* metric) :
+    AbstractMetricTableRef(metric, 2),
+    time_referenced_(false),
+    value_referenced_(false) {}
 
 int MetricTableRef::getColumnIndex(const std::string& name) {
   if (name == "time") {
+    time_referenced_ = true;
     return 0;
   }
 
   if (name == "value") {
+    value_referenced_ = true;
     return 1;
   }
 
-  if (metric_->hasLabel(name)) {
-    fields_.emplace_back(name);
-    return fields_.size() + 1;
-  }
-
-  return -1;
+  return getLabelColumnIndex(name);
 }
 
 std::string MetricTableRef::getColumnName(int index) {
@@ -46,11 +296,7 @@ std::string MetricTableRef::getColumnName(int index) {
     return "value";
   }
 
-  if (index - 2 >= fields_.size()) {
-    RAISE(kIndexError, "no such column");
-  }
-
-  return fields_[index - 2];
+  return getLabelColumnName(index);
 }
 
 std::vector<std::string> MetricTableRef::columns() {
@@ -61,22 +307,133 @@ std::vector<std::string> MetricTableRef::columns() {
 }
 
 void MetricTableRef::executeScan(query::TableScan* scan) {
-  auto begin = fnord::util::DateTime::epoch();
-  auto limit = fnord::util::DateTime::now();
+  uint64_t begin;
+  uint64_t limit;
+  if (!getScanRange(&begin, &limit)) {
+    return;
+  }
+
+  SampleProjection projection;
+  projection.setTime(time_referenced_);
+  projection.setValue(value_referenced_);
+  projection.setLabels(std::set<std::string>(fields_.begin(), fields_.end()));
 
   metric_->scanSamples(
-      begin,
-      limit,
+      fnord::util::DateTime(begin),
+      fnord::util::DateTime(limit),
+      filter_,
+      projection,
       [this, scan] (Sample* sample) -> bool {
         std::vector<query::SValue> row;
         row.emplace_back(sample->time());
-        row.emplace_back(sample->value());
 
-        // FIXPAUL slow!
+        if (value_referenced_) {
+          row.emplace_back(sample->value());
+        } else {
+          row.emplace_back();
+        }
+
+        /* fields_ only contains the referenced labels */
+        for (const auto& field : fields_) {
+          LabelRef value;
+          if (sample->findLabel(field, &value)) {
+            row.emplace_back(value.data(), value.size(), true);
+          } else {
+            row.emplace_back();
+          }
+        }
+
+        return scan->nextRow(row.data(), row.size());
+      });
+}
+
+query::TableRef* MetricTableRef::getRollupTableRef(
+    uint64_t window,
+    uint64_t step) {
+  auto resolutions = metric_->rollupResolutions();
+
+  for (auto iter = resolutions.rbegin(); iter != resolutions.rend(); ++iter) {
+    auto resolution = *iter;
+
+    if ((window * 1000000) % resolution == 0 &&
+        (step * 1000000) % resolution == 0) {
+      return new MetricRollupTableRef(metric_, resolution);
+    }
+  }
+
+  return nullptr;
+}
+
+const std::vector<std::string> MetricRollupTableRef::kRollupColumns = {
+  "time",
+  "value_count",
+  "value_sum",
+  "value_min",
+  "value_max"
+};
+
+MetricRollupTableRef::MetricRollupTableRef(
+    IMetric* metric,
+    uint64_t resolution) :
+    AbstractMetricTableRef(metric, kRollupColumns.size()),
+    resolution_(resolution) {}
+
+int MetricRollupTableRef::getColumnIndex(const std::string& name) {
+  for (int i = 0; i < kRollupColumns.size(); ++i) {
+    if (kRollupColumns[i] == name) {
+      return i;
+    }
+  }
+
+  return getLabelColumnIndex(name);
+}
+
+std::string MetricRollupTableRef::getColumnName(int index) {
+  if (index < kRollupColumns.size()) {
+    return kRollupColumns[index];
+  }
+
+  return getLabelColumnName(index);
+}
+
+std::vector<std::string> MetricRollupTableRef::columns() {
+  auto columns = fields_;
+  columns.insert(columns.end(), kRollupColumns.rbegin(), kRollupColumns.rend());
+  return columns;
+}
+
+void MetricRollupTableRef::executeScan(query::TableScan* scan) {
+  uint64_t begin;
+  uint64_t limit;
+  if (!getScanRange(&begin, &limit)) {
+    return;
+  }
+
+  // the windows at the bounds of the range must be aggregated from all of
+  // their samples, so the range is widened to whole windows
+  begin -= begin % resolution_;
+  if (limit % resolution_ > 0) {
+    limit += resolution_ - limit % resolution_;
+  }
+
+  metric_->scanRollups(
+      fnord::util::DateTime(begin),
+      fnord::util::DateTime(limit),
+      filter_,
+      resolution_,
+      [this, scan] (RollupSample* sample) -> bool {
+        std::vector<query::SValue> row;
+        row.emplace_back(fnord::util::DateTime(sample->time));
+        row.emplace_back(
+            static_cast<fnordmetric::IntegerType>(sample->value.count));
+        row.emplace_back(sample->value.sum);
+        row.emplace_back(sample->value.min);
+        row.emplace_back(sample->value.max);
+
         for (const auto& field : fields_) {
           bool found = false;
 
-          for (const auto& label : sample->labels()) {
+          for (const auto& label : sample->labels) {
             if (label.first == field) {
               found = true;
               row.emplace_back(label.second);
@@ -93,7 +450,6 @@ void MetricTableRef::executeScan(query::TableScan* scan) {
       });
 }
 
-
 }
 }
 
@@ -9,6 +9,7 @@
  */
 #ifndef _FNORDMETRIC_METRICDB_METRICTABLEREF_H
 #define _FNORDMETRIC_METRICDB_METRICTABLEREF_H
+#include <fnordmetric/metricdb/labelfilter.h>
 #include <fnordmetric/metricdb/metric.h>
 #include <fnordmetric/sql/backends/tableref.h>
 #include <stdlib.h>
@@ -22,18 +23,119 @@ class TableScan;
 
 namespace metricdb {
 
-class MetricTableRef : public query::TableRef {
+/**
+ * The columns and the WHERE condition pushdown that are shared by the tables
+ * of a metric's samples and of its rollups. Each table has a fixed number of
+ * leading columns, of which column 0 is the time, followed by one column per
+ * referenced label
+ */
+class AbstractMetricTableRef : public query::TableRef {
+public:
+  AbstractMetricTableRef(IMetric* metric, size_t num_fixed_columns);
+
+  /**
+   * Extracts the label equality (label = 'value') and IN (label = 'a' OR
+   * label = 'b') conditions of the top level conjunction of the expression
+   * into a LabelFilter for the scan and narrows the scanned time range to the
+   * tightest bounds of the time comparisons (<, <=, > and >= against constant
+   * expressions like FROM_TIMESTAMP(...)) of the conjunction
+   */
+  void setWhereExpression(
+      query::ASTNode* expr,
+      query::Compiler* compiler) override;
+
+protected:
+
+  /**
+   * Returns the index of the label's column, which is added if the label is
+   * referenced for the first time, or -1 if the metric has no such label
+   */
+  int getLabelColumnIndex(const std::string& name);
+
+  /**
+   * Returns the name of the label column with the index
+   */
+  std::string getLabelColumnName(int index) const;
+
+  /**
+   * Returns the scanned time range in microseconds, which is capped at the
+   * current time, or false if the range is empty
+   */
+  bool getScanRange(uint64_t* begin, uint64_t* limit) const;
+
+  /**
+   * Return true if the expression is an equality condition or a disjunction
+   * of equality conditions on a single label and a string literal
+   */
+  bool getLabelCondition(
+      query::ASTNode* expr,
+      std::string* key,
+      std::set<std::string>* values) const;
+
+  /**
+   * Narrows the scanned time range if the expression compares the time column
+   * to a constant expression
+   */
+  void addTimeCondition(query::ASTNode* expr, query::Compiler* compiler);
+
+  /**
+   * Return true if the expression does not reference any columns
+   */
+  static bool isConstExpression(query::ASTNode* expr);
+
+  IMetric* metric_;
+  size_t num_fixed_columns_;
+  std::vector<std::string> fields_;
+  LabelFilter filter_;
+  uint64_t time_begin_;
+  uint64_t time_end_;
+};
+
+/**
+ * A table of the samples of a metric with the columns time, value and one
+ * column per label
+ */
+class MetricTableRef : public AbstractMetricTableRef {
 public:
   MetricTableRef(IMetric* metric);
 
+  /**
+   * Records the referenced columns so that the scan only decodes the time,
+   * value and labels that are referenced by the query
+   */
   int getColumnIndex(const std::string& name) override;
   std::string getColumnName(int index) override;
   void executeScan(query::TableScan* scan) override;
   std::vector<std::string> columns() override;
 
+  /**
+   * Returns a MetricRollupTableRef with the coarsest stored rollup resolution
+   * of the metric that evenly divides window and step
+   */
+  query::TableRef* getRollupTableRef(uint64_t window, uint64_t step) override;
+
 protected:
-  IMetric* metric_;
-  std::vector<std::string> fields_;
+  bool time_referenced_;
+  bool value_referenced_;
+};
+
+/**
+ * A table of the rollups of a metric with the columns time, value_count,
+ * value_sum, value_min, value_max and one column per label
+ */
+class MetricRollupTableRef : public AbstractMetricTableRef {
+public:
+  MetricRollupTableRef(IMetric* metric, uint64_t resolution);
+
+  int getColumnIndex(const std::string& name) override;
+  std::string getColumnName(int index) override;
+  void executeScan(query::TableScan* scan) override;
+  std::vector<std::string> columns() override;
+
+protected:
+  static const std::vector<std::string> kRollupColumns;
+
+  uint64_t resolution_;
 };
 
 }
@@ -0,0 +1,123 @@
+/**
+ * This file is part of the "FnordMetric" project
+ *   Copyright (c) 2014 Paul Asmuth, Google Inc.
+ *
+ * FnordMetric is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License v3.0. You should have received a
+ * copy of the GNU General Public License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#include <fnordmetric/metricdb/rollup.h>
+#include <fnordmetric/util/runtimeexception.h>
+#include <algorithm>
+
+namespace fnordmetric {
+namespace metricdb {
+
+RollupValue RollupValue::fromValue(double value) {
+  RollupValue rollup;
+  rollup.count = 1;
+  rollup.sum = value;
+  rollup.min = value;
+  rollup.max = value;
+  return rollup;
+}
+
+void RollupValue::merge(const RollupValue& other) {
+  if (other.count == 0) {
+    return;
+  }
+
+  if (count == 0) {
+    *this = other;
+    return;
+  }
+
+  count += other.count;
+  sum += other.sum;
+  min = std::min(min, other.min);
+  max = std::max(max, other.max);
+}
+
+double RollupValue::mean() const {
+  if (count == 0) {
+    return 0;
+  }
+
+  return sum / count;
+}
+
+RollupAggregator::RollupAggregator(
+    uint64_t resolution,
+    std::function<bool (RollupSample* sample)> callback) :
+    resolution_(resolution),
+    callback_(callback),
+    window_(0),
+    stopped_(false) {
+  if (resolution_ == 0) {
+    RAISE(kIllegalArgumentError, "rollup resolution must be > 0");
+  }
+}
+
+bool RollupAggregator::addSample(
+    uint64_t time,
+    const RollupValue& value,
+    const std::vector<std::pair<std::string, std::string>>& labels) {
+  if (stopped_) {
+    return false;
+  }
+
+  auto window = time - time % resolution_;
+
+  if (window != window_ && !flush()) {
+    return false;
+  }
+
+  window_ = window;
+
+  auto sorted_labels = labels;
+  std::sort(sorted_labels.begin(), sorted_labels.end());
+
+  std::string key;
+  for (const auto& label : sorted_labels) {
+    key.append(label.first);
+    key.push_back('\0');
+    key.append(label.second);
+    key.push_back('\0');
+  }
+
+  auto iter = samples_.find(key);
+  if (iter == samples_.end()) {
+    auto& sample = samples_[key];
+    sample.time = window;
+    sample.value = value;
+    sample.labels = labels;
+  } else {
+    iter->second.value.merge(value);
+  }
+
+  return true;
+}
+
+bool RollupAggregator::flush() {
+  if (stopped_) {
+    return false;
+  }
+
+  for (auto& iter : samples_) {
+    if (!callback_(&iter.second)) {
+      stopped_ = true;
+      break;
+    }
+  }
+
+  samples_.clear();
+  return !stopped_;
+}
+
+uint64_t RollupAggregator::resolution() const {
+  return resolution_;
+}
+
+}
+}
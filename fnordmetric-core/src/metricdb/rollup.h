@@ -0,0 +1,86 @@
+/**
+ * This file is part of the "FnordMetric" project
+ *   Copyright (c) 2014 Paul Asmuth, Google Inc.
+ *
+ * FnordMetric is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License v3.0. You should have received a
+ * copy of the GNU General Public License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#ifndef _FNORDMETRIC_METRICDB_ROLLUP_H_
+#define _FNORDMETRIC_METRICDB_ROLLUP_H_
+#include <stdlib.h>
+#include <stdint.h>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace fnordmetric {
+namespace metricdb {
+
+/**
+ * The count, sum, min and max of all samples with the same label set in one
+ * rollup window
+ */
+struct RollupValue {
+  uint64_t count;
+  double sum;
+  double min;
+  double max;
+
+  static RollupValue fromValue(double value);
+  void merge(const RollupValue& other);
+  double mean() const;
+};
+
+/**
+ * A rollup window. The time is the start of the window
+ */
+struct RollupSample {
+  uint64_t time;
+  RollupValue value;
+  std::vector<std::pair<std::string, std::string>> labels;
+};
+
+/**
+ * Aggregates a time ordered stream of (rollup) samples into windows of
+ * resolution microseconds per label set. A window is emitted once a sample of
+ * a later window is added, so the output is also time ordered. The callback
+ * may return false to stop the aggregation.
+ */
+class RollupAggregator {
+public:
+  RollupAggregator(
+      uint64_t resolution,
+      std::function<bool (RollupSample* sample)> callback);
+
+  RollupAggregator(const RollupAggregator& other) = delete;
+  RollupAggregator& operator=(const RollupAggregator& other) = delete;
+
+  /**
+   * Add a sample. Returns false if the callback asked to stop
+   */
+  bool addSample(
+      uint64_t time,
+      const RollupValue& value,
+      const std::vector<std::pair<std::string, std::string>>& labels);
+
+  /**
+   * Emit the current window. Returns false if the callback asked to stop
+   */
+  bool flush();
+
+  uint64_t resolution() const;
+
+protected:
+  uint64_t resolution_;
+  std::function<bool (RollupSample* sample)> callback_;
+  uint64_t window_;
+  std::map<std::string, RollupSample> samples_;
+  bool stopped_;
+};
+
+}
+}
+#endif
@@ -20,7 +20,19 @@ Sample::Sample(
     const std::vector<std::pair<std::string, std::string>>& labels) :
     time_(time),
     value_(value),
-    labels_(labels) {}
+    labels_(&labels),
+    label_source_(nullptr),
+    label_refs_read_(false) {}
+
+Sample::Sample(
+    const DateTime& time,
+    double value,
+    SampleLabelSource* label_source) :
+    time_(time),
+    value_(value),
+    labels_(nullptr),
+    label_source_(label_source),
+    label_refs_read_(false) {}
 
 const DateTime& Sample::time() {
   return time_;
@@ -31,10 +43,39 @@ double Sample::value() {
 }
 
 const std::vector<std::pair<std::string, std::string>>& Sample::labels() {
-  return labels_;
+  if (labels_ == nullptr) {
+    labels_ = &label_source_->labels();
+  }
+
+  return *labels_;
 }
 
+const LabelRefList& Sample::labelRefs() {
+  if (label_source_ != nullptr) {
+    return label_source_->labelRefs();
+  }
 
+  if (!label_refs_read_) {
+    label_refs_read_ = true;
+
+    for (const auto& label : *labels_) {
+      label_refs_.emplace_back(LabelRef(label.first), LabelRef(label.second));
+    }
+  }
+
+  return label_refs_;
 }
+
+bool Sample::findLabel(const std::string& key, LabelRef* value) {
+  for (const auto& label : labelRefs()) {
+    if (label.first == key) {
+      *value = label.second;
+      return true;
+    }
+  }
+
+  return false;
 }
 
+}
+}
@@ -9,6 +9,7 @@
  */
 #ifndef _FNORDMETRIC_METRICDB_SAMPLE_H_
 #define _FNORDMETRIC_METRICDB_SAMPLE_H_
+#include <fnordmetric/metricdb/labelref.h>
 #include <fnordmetric/util/datetime.h>
 #include <stdlib.h>
 #include <string>
@@ -19,6 +20,24 @@ using fnord::util::DateTime;
 namespace fnordmetric {
 namespace metricdb {
 
+/**
+ * Decodes the labels of a sample on demand
+ */
+class SampleLabelSource {
+public:
+  virtual ~SampleLabelSource() {}
+
+  /**
+   * Return the labels as references into the backend's storage
+   */
+  virtual const LabelRefList& labelRefs() = 0;
+
+  /**
+   * Return the labels as strings
+   */
+  virtual const std::vector<std::pair<std::string, std::string>>& labels() = 0;
+};
+
 class Sample {
 public:
   Sample(
@@ -26,14 +45,38 @@ public:
       double value,
       const std::vector<std::pair<std::string, std::string>>& labels);
 
+  /**
+   * Construct a sample whose labels are only decoded by the label source if
+   * labels(), labelRefs() or findLabel() is called
+   */
+  Sample(
+      const DateTime& time,
+      double value,
+      SampleLabelSource* label_source);
+
   const DateTime& time();
   double value();
   const std::vector<std::pair<std::string, std::string>>& labels();
 
+  /**
+   * Return the labels without copying them into strings. The references are
+   * only valid until the scan callback returns
+   */
+  const LabelRefList& labelRefs();
+
+  /**
+   * Find the value of the label with the key. Returns false if the sample has
+   * no such label
+   */
+  bool findLabel(const std::string& key, LabelRef* value);
+
 protected:
-  const DateTime& time_;
+  const DateTime time_;
   double value_;
-  const std::vector<std::pair<std::string, std::string>>& labels_;
+  const std::vector<std::pair<std::string, std::string>>* labels_;
+  SampleLabelSource* label_source_;
+  LabelRefList label_refs_;
+  bool label_refs_read_;
 };
 
 }
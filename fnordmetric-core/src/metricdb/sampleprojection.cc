@@ -0,0 +1,50 @@
+/**
+ * This file is part of the "FnordMetric" project
+ *   Copyright (c) 2014 Paul Asmuth, Google Inc.
+ *
+ * FnordMetric is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License v3.0. You should have received a
+ * copy of the GNU General Public License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#include <fnordmetric/metricdb/sampleprojection.h>
+
+namespace fnordmetric {
+namespace metricdb {
+
+SampleProjection::SampleProjection() :
+    time_(true),
+    value_(true),
+    all_labels_(true) {}
+
+void SampleProjection::setTime(bool project_time) {
+  time_ = project_time;
+}
+
+void SampleProjection::setValue(bool project_value) {
+  value_ = project_value;
+}
+
+void SampleProjection::setLabels(const std::set<std::string>& keys) {
+  all_labels_ = false;
+  labels_ = keys;
+}
+
+bool SampleProjection::hasTime() const {
+  return time_;
+}
+
+bool SampleProjection::hasValue() const {
+  return value_;
+}
+
+bool SampleProjection::hasLabels() const {
+  return all_labels_ || !labels_.empty();
+}
+
+bool SampleProjection::hasLabel(const std::string& key) const {
+  return all_labels_ || labels_.count(key) > 0;
+}
+
+}
+}
@@ -0,0 +1,55 @@
+/**
+ * This file is part of the "FnordMetric" project
+ *   Copyright (c) 2014 Paul Asmuth, Google Inc.
+ *
+ * FnordMetric is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License v3.0. You should have received a
+ * copy of the GNU General Public License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#ifndef _FNORDMETRIC_METRICDB_SAMPLEPROJECTION_H_
+#define _FNORDMETRIC_METRICDB_SAMPLEPROJECTION_H_
+#include <set>
+#include <string>
+
+namespace fnordmetric {
+namespace metricdb {
+
+/**
+ * Describes which fields of a sample a scan needs: the time, the value and
+ * all or some of the labels. Backends may skip decoding fields that are not
+ * projected; a sample's labels() and labelRefs() are empty if no labels are
+ * projected and the values of fields that are not projected are undefined.
+ * A default constructed projection contains all fields
+ */
+class SampleProjection {
+public:
+  SampleProjection();
+
+  void setTime(bool project_time);
+  void setValue(bool project_value);
+
+  /**
+   * Only project the labels with the keys. An empty set projects no labels
+   */
+  void setLabels(const std::set<std::string>& keys);
+
+  bool hasTime() const;
+  bool hasValue() const;
+
+  /**
+   * Returns true if any label is projected
+   */
+  bool hasLabels() const;
+  bool hasLabel(const std::string& key) const;
+
+protected:
+  bool time_;
+  bool value_;
+  bool all_labels_;
+  std::set<std::string> labels_;
+};
+
+}
+}
+#endif
@@ -39,22 +39,22 @@ enum StatsdParseState {
 };
 
 void StatsdServer::messageReceived(const fnord::util::Buffer& msg) {
-  std::string key;
-  std::string value;
-  std::vector<std::pair<std::string, std::string>> labels;
+  IMetricRepository::SampleBatch batch;
 
   auto msg_str = msg.toString();
   char const* begin = msg_str.c_str();
   char const* end = begin + msg_str.size();
 
   while (begin < end) {
+    std::string key;
+    std::string value;
+    std::vector<std::pair<std::string, std::string>> labels;
     begin = parseStatsdSample(begin, end, &key, &value, &labels);
 
     double float_value;
-    try {
-      float_value = std::stod(value);
-    } catch (std::exception& e) {
-      return;
+    uint64_t time;
+    if (!parseStatsdValue(value, &float_value, &time)) {
+      break;
     }
 
     if (env()->verbose()) {
@@ -66,10 +66,23 @@ void StatsdServer::messageReceived(const fnord::util::Buffer& msg) {
           fnord::util::inspect(labels).c_str());*/
     }
 
-    auto metric = metric_repo_->findOrCreateMetric(key);
-    metric->insertSample(float_value, labels);
-    labels.clear();
+    NewSample sample = {
+      .time = time,
+      .value = float_value,
+      .labels = std::move(labels)};
+
+    // invalid samples are dropped one by one since the repository would
+    // reject the whole batch (see IMetricRepository::insertBatch())
+    try {
+      IMetric::validateSamples(&sample, 1);
+    } catch (const fnordmetric::util::RuntimeException& e) {
+      continue;
+    }
+
+    batch[key].emplace_back(std::move(sample));
   }
+
+  metric_repo_->insertBatch(batch);
 }
 
 char const* StatsdServer::parseStatsdSample(
@@ -160,5 +173,75 @@ char const* StatsdServer::parseStatsdSample(
   return end;
 }
 
+bool StatsdServer::parseStatsdValue(
+    const std::string& value_str,
+    double* value,
+    uint64_t* time) {
+  *time = 0;
+
+  try {
+    *value = std::stod(value_str);
+
+    auto ts_pos = value_str.find("|T");
+    if (ts_pos != std::string::npos) {
+      auto ts_end = value_str.find('|', ts_pos + 2);
+      if (ts_end == std::string::npos) {
+        ts_end = value_str.size();
+      }
+
+      if (!parseUnixTime(
+            value_str.substr(ts_pos + 2, ts_end - ts_pos - 2),
+            time)) {
+        return false;
+      }
+    }
+  } catch (std::exception& e) {
+    return false;
+  }
+
+  return true;
+}
+
+bool StatsdServer::parseUnixTime(const std::string& time_str, uint64_t* time) {
+  uint64_t seconds = 0;
+  uint64_t micros = 0;
+  size_t i = 0;
+
+  /* no signs, exponents or whitespace; at most 12 digits can't overflow */
+  for (; i < time_str.size() && time_str[i] != '.'; ++i) {
+    if (time_str[i] < '0' || time_str[i] > '9' || i >= 12) {
+      return false;
+    }
+
+    seconds = seconds * 10 + (time_str[i] - '0');
+  }
+
+  if (i == 0 || seconds > kMaxUnixTimeSeconds) {
+    return false;
+  }
+
+  if (i < time_str.size()) {
+    auto num_digits = time_str.size() - i - 1;
+    if (num_digits == 0 || num_digits > 6) {
+      return false;
+    }
+
+    for (++i; i < time_str.size(); ++i) {
+      if (time_str[i] < '0' || time_str[i] > '9') {
+        return false;
+      }
+
+      micros = micros * 10 + (time_str[i] - '0');
+    }
+
+    for (; num_digits < 6; ++num_digits) {
+      micros *= 10;
+    }
+  }
+
+  *time = seconds * 1000000 + micros;
+  return *time > 0;
+}
+
 }
 }
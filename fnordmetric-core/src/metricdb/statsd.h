@@ -31,6 +31,26 @@ public:
       std::string* value,
       std::vector<std::pair<std::string, std::string>>* labels);
 
+  static const uint64_t kMaxUnixTimeSeconds = 253402300799; /* 9999-12-31 */
+
+  /**
+   * Parse a statsd value string (e.g. "23.5" or "23.5|c|T1414241420"). A
+   * "|T<unix timestamp>" field sets the sample time (see parseUnixTime()),
+   * otherwise time is set to zero. Returns false if the value is invalid
+   */
+  static bool parseStatsdValue(
+      const std::string& value_str,
+      double* value,
+      uint64_t* time);
+
+  /**
+   * Parse a unix timestamp in seconds with an optional fraction of up to six
+   * digits (e.g. "1414241420" or "1414241420.25") into microseconds. Returns
+   * false unless the string only consists of digits (and one decimal point)
+   * and the time is greater than zero and at most kMaxUnixTimeSeconds
+   */
+  static bool parseUnixTime(const std::string& time_str, uint64_t* time);
+
 protected:
 
   void messageReceived(const fnord::util::Buffer& msg);
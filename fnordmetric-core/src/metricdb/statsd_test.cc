@@ -172,3 +172,54 @@ TEST_CASE(StatsdTest, TestParseFromStatsdFormatWithMultipleSmplLabels, [] () {
   EXPECT_EQ(labels.size(), 1);
   EXPECT_EQ(value, "4.6");
 });
+
+TEST_CASE(StatsdTest, TestParseStatsdValueWithTimestamp, [] () {
+  double value;
+  uint64_t time;
+
+  EXPECT(StatsdServer::parseStatsdValue("34.23", &value, &time));
+  EXPECT_EQ(value, 34.23);
+  EXPECT_EQ(time, 0);
+
+  EXPECT(StatsdServer::parseStatsdValue("1|c|T1414241420", &value, &time));
+  EXPECT_EQ(value, 1);
+  EXPECT_EQ(time, 1414241420000000);
+
+  EXPECT(StatsdServer::parseStatsdValue("5|T1414241420|c", &value, &time));
+  EXPECT_EQ(value, 5);
+  EXPECT_EQ(time, 1414241420000000);
+
+  EXPECT(!StatsdServer::parseStatsdValue("fnord", &value, &time));
+  EXPECT(!StatsdServer::parseStatsdValue("5|Tfnord", &value, &time));
+  EXPECT(!StatsdServer::parseStatsdValue("5|T123x", &value, &time));
+  EXPECT(!StatsdServer::parseStatsdValue("5|T-1", &value, &time));
+  EXPECT(!StatsdServer::parseStatsdValue("5|T", &value, &time));
+  EXPECT(
+      !StatsdServer::parseStatsdValue("5|T18446744073709551", &value, &time));
+});
+
+TEST_CASE(StatsdTest, TestParseUnixTime, [] () {
+  uint64_t time;
+
+  EXPECT(StatsdServer::parseUnixTime("1414241420", &time));
+  EXPECT_EQ(time, 1414241420000000);
+  EXPECT(StatsdServer::parseUnixTime("1414241420.25", &time));
+  EXPECT_EQ(time, 1414241420250000);
+  EXPECT(StatsdServer::parseUnixTime("1414241420.000001", &time));
+  EXPECT_EQ(time, 1414241420000001);
+  EXPECT(StatsdServer::parseUnixTime("253402300799", &time));
+  EXPECT_EQ(time, 253402300799000000);
+
+  EXPECT(!StatsdServer::parseUnixTime("", &time));
+  EXPECT(!StatsdServer::parseUnixTime("0", &time));
+  EXPECT(!StatsdServer::parseUnixTime("-1", &time));
+  EXPECT(!StatsdServer::parseUnixTime("+1414241420", &time));
+  EXPECT(!StatsdServer::parseUnixTime(" 1414241420", &time));
+  EXPECT(!StatsdServer::parseUnixTime("1e9", &time));
+  EXPECT(!StatsdServer::parseUnixTime(".5", &time));
+  EXPECT(!StatsdServer::parseUnixTime("1414241420.", &time));
+  EXPECT(!StatsdServer::parseUnixTime("1414241420.1234567", &time));
+  EXPECT(!StatsdServer::parseUnixTime("1414241420.1.2", &time));
+  EXPECT(!StatsdServer::parseUnixTime("253402300800", &time));
+  EXPECT(!StatsdServer::parseUnixTime("18446744073709551616", &time));
+});
@@ -20,6 +20,7 @@
 #include <fnordmetric/metricdb/httpapi.h>
 #include <fnordmetric/metricdb/metricrepository.h>
 #include <fnordmetric/metricdb/backends/disk/metricrepository.h>
+#include <fnordmetric/metricdb/backends/disk/rollupcompactionpolicy.h>
 #include <fnordmetric/metricdb/backends/inmemory/metricrepository.h>
 #include <fnordmetric/metricdb/statsd.h>
 #include <fnordmetric/net/udpserver.h>
@@ -66,7 +67,83 @@ static IMetricRepository* openBackend(
         "Opening disk backend at %s",
         datadir.c_str());
 
-    return new disk_backend::MetricRepository(datadir, backend_scheduler);
+    auto repo = new disk_backend::MetricRepository(
+        datadir,
+        backend_scheduler,
+        env()->flags()->isSet("write_ahead_log"));
+
+    std::vector<std::shared_ptr<disk_backend::CompactionPolicy>> policies;
+
+    if (env()->flags()->isSet("rollups")) {
+      auto tiers = disk_backend::RollupCompactionPolicy::parseTiers(
+          env()->flags()->getString("rollups"));
+
+      policies.emplace_back(new disk_backend::RollupCompactionPolicy(tiers));
+    }
+
+    auto compaction_policy = env()->flags()->getString("compaction_policy");
+    if (compaction_policy == "sizetiered") {
+      policies.emplace_back(new disk_backend::SizeTieredCompactionPolicy());
+    } else if (compaction_policy != "none") {
+      RAISE(
+          kUsageError,
+          "unknown compaction policy: %s",
+          compaction_policy.c_str());
+    }
+
+    if (env()->flags()->isSet("retention")) {
+      repo->setRetention(
+          disk_backend::RollupCompactionPolicy::parseDuration(
+              env()->flags()->getString("retention")));
+    }
+
+    if (env()->flags()->isSet("metric_retention")) {
+      auto str = env()->flags()->getString("metric_retention");
+
+      size_t begin = 0;
+      while (begin < str.size()) {
+        auto end = str.find(',', begin);
+        if (end == std::string::npos) {
+          end = str.size();
+        }
+
+        auto entry = str.substr(begin, end - begin);
+        auto sep = entry.rfind(':');
+        if (sep == std::string::npos) {
+          RAISE(
+              kUsageError,
+              "invalid metric retention: '%s', expected <metric>:<duration>",
+              entry.c_str());
+        }
+
+        repo->setRetention(
+            entry.substr(0, sep),
+            disk_backend::RollupCompactionPolicy::parseDuration(
+                entry.substr(sep + 1)));
+
+        begin = end + 1;
+      }
+    }
+
+    if (env()->flags()->isSet("series_partitioning")) {
+      repo->setSeriesPartitioning(true);
+    }
+
+    repo->setLiveTableBudget(
+        env()->flags()->getInt("live_table_budget_mb") << 20,
+        env()->flags()->getInt("live_table_budget_files"));
+
+    if (policies.size() == 0) {
+      repo->setCompactionPolicy(nullptr);
+    } else if (policies.size() == 1) {
+      repo->setCompactionPolicy(policies[0]);
+    } else {
+      repo->setCompactionPolicy(
+          std::shared_ptr<disk_backend::CompactionPolicy>(
+              new disk_backend::CompactionPolicyChain(policies)));
+    }
+
+    return repo;
   }
 
   RAISE(
@@ -197,6 +274,76 @@ int main(int argc, const char** argv) {
       "Store the database in this directory (disk backend only)",
       "<path>");
 
+  env()->flags()->defineFlag(
+      "compaction_policy",
+      cli::FlagParser::T_STRING,
+      false,
+      NULL,
+      "sizetiered",
+      "One of 'sizetiered' or 'none'. Default: 'sizetiered' (disk backend only)",
+      "<name>");
+
+  env()->flags()->defineFlag(
+      "rollups",
+      cli::FlagParser::T_STRING,
+      false,
+      NULL,
+      NULL,
+      "Roll up old samples, e.g. '7d:1m,90d:1h' (disk backend only)",
+      "<tiers>");
+
+  env()->flags()->defineFlag(
+      "retention",
+      cli::FlagParser::T_STRING,
+      false,
+      NULL,
+      NULL,
+      "Delete samples older than this, e.g. '90d' (disk backend only)",
+      "<duration>");
+
+  env()->flags()->defineFlag(
+      "metric_retention",
+      cli::FlagParser::T_STRING,
+      false,
+      NULL,
+      NULL,
+      "Per metric retention, e.g. 'cpu.load:7d,mem.free:30d' (disk backend only)",
+      "<metric:duration,...>");
+
+  env()->flags()->defineFlag(
+      "series_partitioning",
+      cli::FlagParser::T_SWITCH,
+      false,
+      NULL,
+      NULL,
+      "Group compacted samples by label set (disk backend only)");
+
+  env()->flags()->defineFlag(
+      "write_ahead_log",
+      cli::FlagParser::T_SWITCH,
+      false,
+      NULL,
+      NULL,
+      "Log inserts to a write ahead log instead of syncing tables (disk backend only)");
+
+  env()->flags()->defineFlag(
+      "live_table_budget_mb",
+      cli::FlagParser::T_INTEGER,
+      false,
+      NULL,
+      "1024",
+      "Memory budget of the tables that are written to (disk backend only)",
+      "<megabytes>");
+
+  env()->flags()->defineFlag(
+      "live_table_budget_files",
+      cli::FlagParser::T_INTEGER,
+      false,
+      NULL,
+      "512",
+      "Open file budget of the tables that are written to (disk backend only)",
+      "<num>");
+
   env()->flags()->defineFlag(
       "disable_external_sources",
       cli::FlagParser::T_SWITCH,
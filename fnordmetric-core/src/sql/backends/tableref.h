@@ -10,11 +10,14 @@
 #ifndef _FNORDMETRIC_QUERY_TABLEREF_H
 #define _FNORDMETRIC_QUERY_TABLEREF_H
 #include <stdlib.h>
+#include <stdint.h>
 #include <string>
 #include <memory>
 
 namespace fnordmetric {
 namespace query {
+class ASTNode;
+class Compiler;
 class TableScan;
 
 class TableRef {
@@ -24,6 +27,24 @@ public:
   virtual int getColumnIndex(const std::string& name) = 0;
   virtual std::string getColumnName(int index) = 0;
   virtual void executeScan(TableScan* scan) = 0;
+
+  /**
+   * Called with the WHERE expression (with resolved columns) of a scan before
+   * executeScan(). Tables may use it to skip rows that can't match the
+   * expression; the expression is still evaluated for every returned row. The
+   * compiler may be used to evaluate constant subexpressions
+   */
+  virtual void setWhereExpression(ASTNode* expr, Compiler* compiler) {}
+
+  /**
+   * Return a table that contains pre-aggregated rollups of this table in
+   * windows that evenly divide window and step (in seconds) or nullptr if
+   * there are no such rollups. Rollup tables have the columns time (window
+   * start), value_count, value_sum, value_min and value_max instead of value
+   */
+  virtual TableRef* getRollupTableRef(uint64_t window, uint64_t step) {
+    return nullptr;
+  }
 protected:
 };
 
@@ -75,14 +75,14 @@ size_t sumExprScratchpadSize() {
 /**
  * MEAN() expression
  */
-union mean_expr_scratchpad {
+struct mean_expr_scratchpad {
   double sum;
   int count;
 };
 
 void meanExpr(void* scratchpad, int argc, SValue* argv, SValue* out) {
   SValue* val = argv;
-  union mean_expr_scratchpad* data = (union mean_expr_scratchpad*) scratchpad;
+  struct mean_expr_scratchpad* data = (struct mean_expr_scratchpad*) scratchpad;
 
   if (argc != 1) {
     RAISE(
@@ -108,7 +108,7 @@ void meanExprFree(void* scratchpad) {
 }
 
 size_t meanExprScratchpadSize() {
-  return sizeof(union mean_expr_scratchpad);
+  return sizeof(struct mean_expr_scratchpad);
 }
 
 /**
@@ -22,10 +22,39 @@
 #include <fnordmetric/sql/runtime/runtime.h>
 #include <fnordmetric/sql/runtime/symboltable.h>
 #include <fnordmetric/sql/runtime/importstatement.h>
+#include <fnordmetric/sql/runtime/execute.h>
 
 namespace fnordmetric {
 namespace query {
 
+/**
+ * Resolves the table name of a GROUP OVER TIMEWINDOW query to its rollup table
+ * and all other table names from the parent repository
+ */
+class RollupTableRepository : public TableRepository {
+public:
+  RollupTableRepository(
+      const std::string& table_name,
+      TableRef* rollup_table,
+      TableRepository* parent) :
+      table_name_(table_name),
+      rollup_table_(rollup_table),
+      parent_(parent) {}
+
+  TableRef* getTableRef(const std::string& table_name) const override {
+    if (table_name == table_name_) {
+      return rollup_table_;
+    } else {
+      return parent_->getTableRef(table_name);
+    }
+  }
+
+protected:
+  const std::string table_name_;
+  TableRef* rollup_table_;
+  TableRepository* parent_;
+};
+
 QueryPlanBuilder::QueryPlanBuilder(
     Compiler* compiler,
     const std::vector<std::unique_ptr<Backend>>& backends) :
@@ -389,6 +418,18 @@ QueryPlanNode* QueryPlanBuilder::buildGroupOverTimewindow(
 
   auto select_list = ast->getChildren()[0]->deepCopy();
 
+  /* read from pre-aggregated rollups of the table if possible */
+  auto rollup_table = findRollupTable(ast, &select_list, repo);
+  std::unique_ptr<TableRepository> rollup_repo;
+  if (rollup_table != nullptr) {
+    rollup_repo.reset(new RollupTableRepository(
+        ast->getChildren()[1]->getChildren()[0]->getToken()->getString(),
+        rollup_table,
+        repo));
+
+    repo = rollup_repo.get();
+  }
+
   /* generate select list for child */
   auto child_sl = new ASTNode(ASTNode::T_SELECT_LIST);
   buildInternalSelectList(select_list, child_sl);
@@ -496,6 +537,201 @@ QueryPlanNode* QueryPlanBuilder::buildGroupOverTimewindow(
       buildQueryPlan(child_ast, repo));
 }
 
+TableRef* QueryPlanBuilder::findRollupTable(
+    ASTNode* ast,
+    ASTNode** select_list,
+    TableRepository* repo) {
+  /* rollups are only used for queries against a single table */
+  if (ast->getChildren().size() < 2) {
+    return nullptr;
+  }
+
+  auto from_list = ast->getChildren()[1];
+  if (from_list->getType() != ASTNode::T_FROM ||
+      from_list->getChildren().size() != 1) {
+    return nullptr;
+  }
+
+  auto table_name = from_list->getChildren()[0];
+  if (table_name->getType() != ASTNode::T_TABLE_NAME ||
+      table_name->getToken() == nullptr ||
+      table_name->getChildren().size() != 0) {
+    return nullptr;
+  }
+
+  /* rollups don't contain the raw values, so no clause may reference them */
+  ASTNode* group_clause = nullptr;
+  for (const auto& child : ast->getChildren()) {
+    switch (child->getType()) {
+      case ASTNode::T_SELECT_LIST:
+      case ASTNode::T_FROM:
+        continue;
+
+      case ASTNode::T_GROUP_OVER_TIMEWINDOW:
+        group_clause = child;
+        continue;
+
+      default:
+        if (hasColumnReference(child, "value")) {
+          return nullptr;
+        }
+    }
+  }
+
+  if (group_clause == nullptr || group_clause->getChildren().size() < 3) {
+    return nullptr;
+  }
+
+  auto time_expr = group_clause->getChildren()[0];
+  if (time_expr->getType() != ASTNode::T_COLUMN_NAME ||
+      time_expr->getToken() == nullptr ||
+      time_expr->getToken()->getString() != "time" ||
+      hasColumnReference(group_clause->getChildren()[1], "value")) {
+    return nullptr;
+  }
+
+  /* rewrite the aggregations in a copy of the select list */
+  auto rollup_select_list = (*select_list)->deepCopy();
+  if (!rewriteRollupExpression(rollup_select_list)) {
+    return nullptr;
+  }
+
+  /* the rollup windows must evenly divide the query's window and step */
+  auto window = executeSimpleConstExpression(
+      compiler_,
+      group_clause->getChildren()[2]->deepCopy()).getInteger();
+
+  auto step = window;
+  if (group_clause->getChildren().size() > 3) {
+    step = executeSimpleConstExpression(
+        compiler_,
+        group_clause->getChildren()[3]->deepCopy()).getInteger();
+  }
+
+  if (window <= 0 || step <= 0) {
+    return nullptr;
+  }
+
+  auto tbl_ref = repo->getTableRef(table_name->getToken()->getString());
+  if (tbl_ref == nullptr) {
+    return nullptr;
+  }
+
+  auto rollup_table = tbl_ref->getRollupTableRef(window, step);
+  if (rollup_table != nullptr) {
+    *select_list = rollup_select_list;
+  }
+
+  return rollup_table;
+}
+
+bool QueryPlanBuilder::rewriteRollupExpression(ASTNode* ast) const {
+  switch (ast->getType()) {
+
+    case ASTNode::T_COLUMN_NAME:
+      return ast->getToken() != nullptr &&
+          ast->getToken()->getString() != "value";
+
+    case ASTNode::T_TABLE_NAME:
+      return false;
+
+    case ASTNode::T_METHOD_CALL: {
+      if (ast->getToken() == nullptr) {
+        RAISE(kRuntimeError, "corrupt AST");
+      }
+
+      auto symbol = compiler_->symbolTable()->lookupSymbol(
+          ast->getToken()->getString());
+
+      if (symbol == nullptr || !symbol->isAggregate()) {
+        break;
+      }
+
+      auto args = ast->getChildren();
+      if (args.size() != 1 ||
+          args[0]->getType() != ASTNode::T_COLUMN_NAME ||
+          args[0]->getToken() == nullptr ||
+          args[0]->getToken()->getString() != "value") {
+        return false;
+      }
+
+      auto method = ast->getToken()->getString();
+
+      if (method == "sum") {
+        args[0]->setToken(new Token(Token::T_IDENTIFIER, "value_sum"));
+        return true;
+      }
+
+      if (method == "count") {
+        ast->setToken(new Token(Token::T_IDENTIFIER, "sum"));
+        args[0]->setToken(new Token(Token::T_IDENTIFIER, "value_count"));
+        return true;
+      }
+
+      if (method == "min") {
+        args[0]->setToken(new Token(Token::T_IDENTIFIER, "value_min"));
+        return true;
+      }
+
+      if (method == "max") {
+        args[0]->setToken(new Token(Token::T_IDENTIFIER, "value_max"));
+        return true;
+      }
+
+      /* mean(value) -> sum(value_sum) / sum(value_count) */
+      if (method == "mean" || method == "avg" || method == "average") {
+        ast->setType(ASTNode::T_DIV_EXPR);
+        ast->setToken(nullptr);
+        ast->removeChildByIndex(0);
+
+        auto sum = ast->appendChild(ASTNode::T_METHOD_CALL);
+        sum->setToken(new Token(Token::T_IDENTIFIER, "sum"));
+        sum->appendChild(ASTNode::T_COLUMN_NAME)->setToken(
+            new Token(Token::T_IDENTIFIER, "value_sum"));
+
+        auto count = ast->appendChild(ASTNode::T_METHOD_CALL);
+        count->setToken(new Token(Token::T_IDENTIFIER, "sum"));
+        count->appendChild(ASTNode::T_COLUMN_NAME)->setToken(
+            new Token(Token::T_IDENTIFIER, "value_count"));
+
+        return true;
+      }
+
+      return false;
+    }
+
+    default:
+      break;
+
+  }
+
+  for (const auto& child : ast->getChildren()) {
+    if (!rewriteRollupExpression(child)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool QueryPlanBuilder::hasColumnReference(
+    ASTNode* ast,
+    const std::string& column) const {
+  if (ast->getType() == ASTNode::T_COLUMN_NAME &&
+      ast->getToken() != nullptr &&
+      ast->getToken()->getString() == column) {
+    return true;
+  }
+
+  for (const auto& child : ast->getChildren()) {
+    if (hasColumnReference(child, column)) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
 bool QueryPlanBuilder::buildInternalSelectList(
     ASTNode* node,
     ASTNode* target_select_list) {
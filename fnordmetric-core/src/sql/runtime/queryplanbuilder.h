@@ -22,6 +22,7 @@
 namespace fnordmetric {
 namespace query {
 class QueryPlanNode;
+class TableRef;
 class TableRepository;
 class Runtime;
 
@@ -126,6 +127,29 @@ protected:
    */
   QueryPlanNode* buildGroupOverTimewindow(ASTNode* ast, TableRepository* repo);
 
+  /**
+   * Returns the rollup table for a SELECT statement with a GROUP OVER
+   * TIMEWINDOW clause if the query can be answered from pre-aggregated rollups
+   * of its table and replaces the select list with one that aggregates the
+   * rollup columns. Otherwise returns nullptr and leaves the select list as is
+   */
+  TableRef* findRollupTable(
+      ASTNode* ast,
+      ASTNode** select_list,
+      TableRepository* repo);
+
+  /**
+   * Recursively rewrite the count, sum, min, max and mean aggregations of the
+   * value column to the equivalent aggregations of the rollup columns. Returns
+   * false if the expression can't be computed from rollups
+   */
+  bool rewriteRollupExpression(ASTNode* ast) const;
+
+  /**
+   * Returns true if the ast contains a reference to the column
+   */
+  bool hasColumnReference(ASTNode* ast, const std::string& column) const;
+
   /**
    * Recursively walk the provided ast and search for column references. For
    * each found column reference, add the column reference to the provided
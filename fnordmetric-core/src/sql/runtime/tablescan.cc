@@ -113,6 +113,8 @@ TableScan* TableScan::build(
       return nullptr;
     }
 
+    tbl_ref->setWhereExpression(e, compiler);
+
     size_t where_scratchpad_len = 0;
     where_expr = compiler->compile(e, &where_scratchpad_len);
     if (where_scratchpad_len != 0) {
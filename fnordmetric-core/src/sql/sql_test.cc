@@ -118,6 +118,80 @@ class TestTimeTableRef : public TableRef {
   }
 };
 
+class TestRollupTableRef : public TableRef {
+public:
+  static int num_scans;
+
+  std::vector<std::string> columns() override {
+    return {"time", "value_count", "value_sum", "value_min", "value_max"};
+  }
+  int getColumnIndex(const std::string& name) override {
+    auto cols = columns();
+    for (int i = 0; i < cols.size(); ++i) {
+      if (cols[i] == name) return i;
+    }
+    return -1;
+  }
+  std::string getColumnName(int index) override {
+    return columns()[index];
+  }
+  void executeScan(TableScan* scan) override {
+    auto start_time = 1415712840000000;
+    num_scans++;
+
+    for (int i = 0; i < 10; ++i) {
+      std::vector<SValue> row;
+      row.emplace_back(fnord::util::DateTime(start_time + 60000000 * i));
+      row.emplace_back(SValue((fnordmetric::IntegerType) 60));
+      row.emplace_back(SValue((fnordmetric::FloatType) (i * 3600 + 1770)));
+      row.emplace_back(SValue((fnordmetric::FloatType) (i * 60)));
+      row.emplace_back(SValue((fnordmetric::FloatType) (i * 60 + 59)));
+      if (!scan->nextRow(row.data(), row.size())) {
+        return;
+      }
+    }
+  }
+};
+
+int TestRollupTableRef::num_scans = 0;
+
+class TestRollupTimeTableRef : public TableRef {
+public:
+  TestRollupTimeTableRef(bool has_rollups) : has_rollups_(has_rollups) {}
+
+  std::vector<std::string> columns() override {
+    return {"time", "value"};
+  }
+  int getColumnIndex(const std::string& name) override {
+    if (name == "time") return 0;
+    if (name == "value") return 1;
+    return -1;
+  }
+  std::string getColumnName(int index) override {
+    return columns()[index];
+  }
+  void executeScan(TableScan* scan) override {
+    auto start_time = 1415712840000000;
+
+    for (int i = 0; i < 600; ++i) {
+      std::vector<SValue> row;
+      row.emplace_back(fnord::util::DateTime(start_time + 1000000 * i));
+      row.emplace_back(SValue((fnordmetric::FloatType) i));
+      if (!scan->nextRow(row.data(), row.size())) {
+        return;
+      }
+    }
+  }
+  TableRef* getRollupTableRef(uint64_t window, uint64_t step) override {
+    if (!has_rollups_ || window % 60 != 0 || step % 60 != 0) {
+      return nullptr;
+    }
+
+    return new TestRollupTableRef();
+  }
+protected:
+  bool has_rollups_;
+};
 
 static Parser parseTestQuery(const char* query) {
   Parser parser;
@@ -145,6 +219,14 @@ static std::unique_ptr<ResultList> executeTestQuery(
       "timeseries",
       std::unique_ptr<TableRef>(new TestTimeTableRef()));
 
+  query_plan.tableRepository()->addTableRef(
+      "rollupseries",
+      std::unique_ptr<TableRef>(new TestRollupTimeTableRef(true)));
+
+  query_plan.tableRepository()->addTableRef(
+      "rawseries",
+      std::unique_ptr<TableRef>(new TestRollupTimeTableRef(false)));
+
   query_plan.tableRepository()->addTableRef(
       "gbp_per_country",
       std::unique_ptr<TableRef>(
@@ -1268,6 +1350,51 @@ TEST_CASE(SQLTest, TestSimpleGroupOverTimeWindow, [] () {
   EXPECT_EQ(result->getRow(28)[1], "28170");
 });
 
+TEST_CASE(SQLTest, TestGroupOverTimeWindowWithRollups, [] () {
+  auto query =
+      "  SELECT time, sum(value), count(value), mean(value) + 1,"
+      "      min(value), max(value)"
+      "      FROM %s"
+      "      GROUP OVER TIMEWINDOW(time, 120, 60);";
+
+  char rollup_query[256];
+  snprintf(rollup_query, sizeof(rollup_query), query, "rollupseries");
+  char raw_query[256];
+  snprintf(raw_query, sizeof(raw_query), query, "rawseries");
+
+  TestRollupTableRef::num_scans = 0;
+  auto rollup_result = executeTestQuery(rollup_query);
+  EXPECT_EQ(TestRollupTableRef::num_scans, 1);
+
+  auto raw_result = executeTestQuery(raw_query);
+  EXPECT_EQ(TestRollupTableRef::num_scans, 1);
+
+  EXPECT_EQ(rollup_result->getNumRows(), 9);
+  EXPECT_EQ(rollup_result->getNumRows(), raw_result->getNumRows());
+  EXPECT_EQ(rollup_result->getNumColumns(), 6);
+  EXPECT_EQ(rollup_result->getRow(0)[1], "7140.000000");
+  EXPECT_EQ(rollup_result->getRow(0)[2], "120");
+
+  for (int i = 0; i < raw_result->getNumRows(); ++i) {
+    for (int j = 0; j < raw_result->getNumColumns(); ++j) {
+      EXPECT_EQ(rollup_result->getRow(i)[j], raw_result->getRow(i)[j]);
+    }
+  }
+
+  /* the raw values are not available from rollups */
+  TestRollupTableRef::num_scans = 0;
+  executeTestQuery(
+      "  SELECT time, sum(value) FROM rollupseries WHERE value > 10"
+      "      GROUP OVER TIMEWINDOW(time, 120, 60);");
+  executeTestQuery(
+      "  SELECT time, sum(value * 2) FROM rollupseries"
+      "      GROUP OVER TIMEWINDOW(time, 120, 60);");
+  executeTestQuery(
+      "  SELECT time, sum(value) FROM rollupseries"
+      "      GROUP OVER TIMEWINDOW(time, 90, 90);");
+  EXPECT_EQ(TestRollupTableRef::num_scans, 0);
+});
+
 TEST_CASE(SQLTest, TestNumericConversion, [] () {
   {
     SValue val("42");
@@ -1334,7 +1461,7 @@ TEST_CASE(SQLTest, TestMeanAggregation, [] () {
       "    testtable2;");
 
   EXPECT_EQ(results->getNumRows(), 1);
-  EXPECT_EQ(results->getRow(0)[0], "6.875000");
+  EXPECT_EQ(results->getRow(0)[0], "5.500000");
 });
 
 TEST_CASE(SQLTest, TestMaxAggregation, [] () {
@@ -49,6 +49,24 @@ SValue::SValue(
     char const* string_value) :
     SValue(std::string(string_value)) {}
 
+SValue::SValue(const char* str_value, size_t len, bool copy) {
+  data_.type = T_STRING;
+  data_.u.t_string.len = len;
+
+  if (!copy) {
+    data_.u.t_string.ptr = const_cast<char*>(str_value);
+    return;
+  }
+
+  data_.u.t_string.ptr = static_cast<char *>(malloc(len));
+
+  if (data_.u.t_string.ptr == nullptr) {
+    RAISE(kRuntimeError, "could not allocate SValue");
+  }
+
+  memcpy(data_.u.t_string.ptr, str_value, len);
+}
+
 SValue::SValue(fnordmetric::IntegerType integer_value) {
   data_.type = T_INTEGER;
   data_.u.t_integer = integer_value;
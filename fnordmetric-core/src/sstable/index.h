@@ -9,6 +9,7 @@
  */
 #ifndef _FNORD_SSTABLE_INDEX_H
 #define _FNORD_SSTABLE_INDEX_H
+#include <fnordmetric/util/binarymessagewriter.h>
 #include <stdlib.h>
 #include <string>
 #include <vector>
@@ -33,7 +34,13 @@ public:
       void const* key,
       size_t key_size,
       void const* data,
-      size_t data_size) const = 0;
+      size_t data_size) = 0;
+
+  /**
+   * Serialize the index. The result is written into the sstable footer with
+   * the index type as the footer type id when the sstable is finalized
+   */
+  virtual void serialize(util::BinaryMessageWriter* writer) const = 0;
 
 protected:
   uint32_t type_;
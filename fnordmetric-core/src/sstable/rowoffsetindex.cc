@@ -8,22 +8,122 @@
  * <http://www.gnu.org/licenses/>.
  */
 #include <fnordmetric/sstable/rowoffsetindex.h>
+#include <fnordmetric/util/binarymessagereader.h>
+#include <fnordmetric/util/runtimeexception.h>
+#include <string.h>
 
 namespace fnord {
 namespace sstable {
 
+int RowOffsetIndex::compareKeys(
+    void const* a,
+    size_t a_size,
+    void const* b,
+    size_t b_size) {
+  auto res = memcmp(a, b, a_size < b_size ? a_size : b_size);
+
+  if (res != 0) {
+    return res;
+  }
+
+  if (a_size < b_size) {
+    return -1;
+  }
+
+  if (a_size > b_size) {
+    return 1;
+  }
+
+  return 0;
+}
+
+size_t RowOffsetIndex::lookup(
+    void const* index_data,
+    size_t index_size,
+    void const* key,
+    size_t key_size,
+    KeyCompareFn compare_fn /* = compareKeys */) {
+  if (index_size == 0) {
+    return 0;
+  }
+
+  util::BinaryMessageReader reader(index_data, index_size);
+  uint32_t num_entries = *reader.readUInt32();
+  auto entry_offsets = static_cast<uint32_t const*>(
+      reader.read(num_entries * sizeof(uint32_t)));
+
+  /* binary search for the first entry with a key >= the search key */
+  uint32_t lo = 0;
+  uint32_t hi = num_entries;
+  while (lo < hi) {
+    uint32_t mid = lo + (hi - lo) / 2;
+
+    reader.seekTo(entry_offsets[mid] + sizeof(uint64_t));
+    auto entry_key_size = *reader.readUInt32();
+    auto entry_key = reader.read(entry_key_size);
+
+    if (compare_fn(entry_key, entry_key_size, key, key_size) < 0) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  if (lo == 0) {
+    return 0;
+  }
+
+  reader.seekTo(entry_offsets[lo - 1]);
+  return *reader.readUInt64();
+}
+
 RowOffsetIndex* RowOffsetIndex::makeIndex() {
   return new RowOffsetIndex();
 }
 
-RowOffsetIndex::RowOffsetIndex() : Index(RowOffsetIndex::kIndexType) {}
+RowOffsetIndex::RowOffsetIndex(
+    size_t interval /* = kDefaultInterval */) :
+    Index(RowOffsetIndex::kIndexType),
+    interval_(interval),
+    num_rows_(0) {
+  if (interval_ == 0) {
+    RAISE(kIllegalArgumentError, "interval must be > 0");
+  }
+}
 
 void RowOffsetIndex::addRow(
     size_t body_offset,
     void const* key,
     size_t key_size,
     void const* data,
-    size_t data_size) const {
+    size_t data_size) {
+  if (num_rows_++ % interval_ == 0) {
+    entries_.emplace_back(
+        std::string(static_cast<char const*>(key), key_size),
+        body_offset);
+  }
+}
+
+void RowOffsetIndex::serialize(util::BinaryMessageWriter* writer) const {
+  if (entries_.size() == 0) {
+    return;
+  }
+
+  writer->appendUInt32(entries_.size());
+
+  uint32_t entry_offset =
+      sizeof(uint32_t) + entries_.size() * sizeof(uint32_t);
+
+  for (const auto& entry : entries_) {
+    writer->appendUInt32(entry_offset);
+    entry_offset += sizeof(uint64_t) + sizeof(uint32_t) + entry.first.size();
+  }
+
+  for (const auto& entry : entries_) {
+    writer->appendUInt64(entry.second);
+    writer->appendUInt32(entry.first.size());
+    writer->appendString(entry.first);
+  }
 }
 
 }
@@ -10,7 +10,9 @@
 #ifndef _FNORD_SSTABLE_ROWOFFSETINDEX_H
 #define _FNORD_SSTABLE_ROWOFFSETINDEX_H
 #include <fnordmetric/sstable/index.h>
+#include <functional>
 #include <stdlib.h>
+#include <stdint.h>
 #include <string>
 #include <vector>
 #include <memory>
@@ -18,21 +20,75 @@
 namespace fnord {
 namespace sstable {
 
+/**
+ * Records the key and body offset of every Nth row. The serialized index is
+ * binary searchable in place (i.e. directly in the mmaped footer):
+ *
+ *   <row_offset_index> :=
+ *       <uint32_t>              // number of entries
+ *       *<uint32_t>             // entry offset (relative to the index start)
+ *       *<entry>
+ *
+ *   <entry> :=
+ *       <uint64_t>              // row body offset
+ *       <uint32_t>              // key size in bytes
+ *       <bytes>                 // key
+ *
+ */
 class RowOffsetIndex : public Index {
 public:
   static const uint32_t kIndexType = 0xa0a0;
+  static const size_t kDefaultInterval = 64;
+
+  /**
+   * Returns < 0 if key a sorts before key b, 0 if both keys are equal and > 0
+   * if key a sorts after key b
+   */
+  typedef std::function<int (
+      void const* a,
+      size_t a_size,
+      void const* b,
+      size_t b_size)> KeyCompareFn;
+
+  /**
+   * The default key order: bytewise lexicographic comparison
+   */
+  static int compareKeys(
+      void const* a,
+      size_t a_size,
+      void const* b,
+      size_t b_size);
+
+  /**
+   * Search a serialized index and return the body offset of the last indexed
+   * row with a key that sorts strictly before the provided key (or 0 if there
+   * is no such row). All rows with a key >= the provided key are located at or
+   * after the returned offset
+   */
+  static size_t lookup(
+      void const* index_data,
+      size_t index_size,
+      void const* key,
+      size_t key_size,
+      KeyCompareFn compare_fn = compareKeys);
 
   static RowOffsetIndex* makeIndex();
 
-  RowOffsetIndex();
+  RowOffsetIndex(size_t interval = kDefaultInterval);
 
   void addRow(
       size_t body_offset,
       void const* key,
       size_t key_size,
       void const* data,
-      size_t data_size) const override;
+      size_t data_size) override;
+
+  void serialize(util::BinaryMessageWriter* writer) const override;
 
+protected:
+  size_t interval_;
+  size_t num_rows_;
+  std::vector<std::pair<std::string, uint64_t>> entries_;
 };
 
 
@@ -12,6 +12,7 @@
 #include <string.h>
 #include <fnordmetric/io/file.h>
 #include <fnordmetric/util/unittest.h>
+#include <fnordmetric/sstable/sstablereader.h>
 #include <fnordmetric/sstable/sstablewriter.h>
 #include <fnordmetric/sstable/rowoffsetindex.h>
 
@@ -106,3 +107,115 @@ TEST_CASE(SSTableTest, TestSSTableWriterWithIndexes, [] () {
 
 
 
+
+TEST_CASE(SSTableTest, TestSSTableReaderWithRowOffsetIndex, [] () {
+  auto file = File::openFile(
+      "/tmp/__fnord__sstabletest3.sstable",
+      File::O_READ | File::O_WRITE | File::O_CREATEOROPEN | File::O_TRUNCATE);
+
+  std::string header = "myfnordyheader!";
+
+  IndexProvider indexes;
+  indexes.addIndex<RowOffsetIndex>();
+
+  auto tbl = SSTableWriter::create(
+      "/tmp/__fnord__sstabletest3.sstable",
+      std::move(indexes),
+      header.data(),
+      header.size());
+
+  char key[32];
+  for (int i = 0; i < 1000; ++i) {
+    snprintf(key, sizeof(key), "key%06i", i * 2);
+    tbl->appendRow(key, std::string("value") + key);
+  }
+
+  tbl->finalize();
+
+  SSTableReader reader(File::openFile(
+      "/tmp/__fnord__sstabletest3.sstable",
+      File::O_READ));
+
+  EXPECT(reader.readFooter(RowOffsetIndex::kIndexType).size() > 0);
+
+  auto cursor = reader.seekToKey("key000500");
+  EXPECT(cursor.get() != nullptr);
+  EXPECT_EQ(cursor->getKeyString(), "key000500");
+  EXPECT_EQ(cursor->getDataString(), "valuekey000500");
+  EXPECT_EQ(cursor->next(), true);
+  EXPECT_EQ(cursor->getKeyString(), "key000502");
+
+  EXPECT(reader.seekToKey("key000501").get() == nullptr);
+
+  cursor = reader.lowerBound("key000501");
+  EXPECT_EQ(cursor->valid(), true);
+  EXPECT_EQ(cursor->getKeyString(), "key000502");
+
+  cursor = reader.lowerBound("a");
+  EXPECT_EQ(cursor->valid(), true);
+  EXPECT_EQ(cursor->getKeyString(), "key000000");
+
+  cursor = reader.lowerBound("key001998");
+  EXPECT_EQ(cursor->valid(), true);
+  EXPECT_EQ(cursor->getKeyString(), "key001998");
+  EXPECT_EQ(cursor->next(), false);
+
+  cursor = reader.lowerBound("key001999");
+  EXPECT_EQ(cursor->valid(), false);
+});
+
+TEST_CASE(SSTableTest, TestSSTableWriterAppendRows, [] () {
+  auto file = File::openFile(
+      "/tmp/__fnord__sstabletest4.sstable",
+      File::O_READ | File::O_WRITE | File::O_CREATEOROPEN | File::O_TRUNCATE);
+
+  std::string header = "myfnordyheader!";
+
+  IndexProvider indexes;
+  indexes.addIndex<RowOffsetIndex>();
+
+  auto tbl = SSTableWriter::create(
+      "/tmp/__fnord__sstabletest4.sstable",
+      std::move(indexes),
+      header.data(),
+      header.size());
+
+  tbl->setSyncPolicy(SSTableWriter::SyncPolicy::groupCommit(4096, 0));
+
+  std::vector<std::string> keys;
+  for (int i = 0; i < 100; ++i) {
+    char key[32];
+    snprintf(key, sizeof(key), "key%03i", i);
+    keys.emplace_back(key);
+  }
+
+  std::vector<SSTableWriter::RowRef> rows;
+  for (const auto& key : keys) {
+    SSTableWriter::RowRef row;
+    row.key = key.data();
+    row.key_size = key.size();
+    row.data = key.data();
+    row.data_size = key.size();
+    rows.emplace_back(row);
+  }
+
+  tbl->appendRows(rows.data(), 50);
+  tbl->appendRows(rows.data() + 50, 50);
+  tbl->finalize();
+
+  SSTableReader reader(File::openFile(
+      "/tmp/__fnord__sstabletest4.sstable",
+      File::O_READ));
+
+  auto cursor = reader.getCursor();
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_EQ(cursor->valid(), true);
+    EXPECT_EQ(cursor->getKeyString(), keys[i]);
+    EXPECT_EQ(cursor->getDataString(), keys[i]);
+    EXPECT_EQ(cursor->next(), i < 99);
+  }
+
+  cursor = reader.seekToKey("key077");
+  EXPECT(cursor.get() != nullptr);
+  EXPECT_EQ(cursor->getDataString(), "key077");
+});
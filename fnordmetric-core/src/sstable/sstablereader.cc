@@ -19,7 +19,9 @@ SSTableReader::SSTableReader(
     io::File&& file) :
     mmap_(new io::MmappedFile(std::move(file))),
     file_size_(mmap_->size()),
-    header_(mmap_->ptr(), file_size_) {
+    header_(mmap_->ptr(), file_size_),
+    row_offset_index_data_(nullptr),
+    row_offset_index_size_(0) {
   if (!header_.verify()) {
     RAISE(kIllegalStateError, "corrupt sstable header");
   }
@@ -110,6 +112,75 @@ std::unique_ptr<SSTableReader::SSTableReaderCursor> SSTableReader::getCursor() {
   return std::unique_ptr<SSTableReaderCursor>(cursor);
 }
 
+std::unique_ptr<SSTableReader::SSTableReaderCursor> SSTableReader::lowerBound(
+    void const* key,
+    size_t key_size,
+    RowOffsetIndex::KeyCompareFn compare_fn /* = RowOffsetIndex::compareKeys */) {
+  /* the footer checksum is only verified once per reader */
+  std::call_once(row_offset_index_once_, [this] () {
+    readFooter(
+        RowOffsetIndex::kIndexType,
+        &row_offset_index_data_,
+        &row_offset_index_size_);
+  });
+
+  auto cursor = getCursor();
+  cursor->seekTo(RowOffsetIndex::lookup(
+      row_offset_index_data_,
+      row_offset_index_size_,
+      key,
+      key_size,
+      compare_fn));
+
+  while (cursor->valid()) {
+    void* row_key;
+    size_t row_key_size;
+    cursor->getKey(&row_key, &row_key_size);
+
+    if (compare_fn(row_key, row_key_size, key, key_size) >= 0) {
+      return cursor;
+    }
+
+    if (!cursor->next()) {
+      break;
+    }
+  }
+
+  cursor->seekTo(header_.bodySize());
+  return cursor;
+}
+
+std::unique_ptr<SSTableReader::SSTableReaderCursor> SSTableReader::lowerBound(
+    const std::string& key) {
+  return lowerBound(key.data(), key.size());
+}
+
+std::unique_ptr<SSTableReader::SSTableReaderCursor> SSTableReader::seekToKey(
+    void const* key,
+    size_t key_size,
+    RowOffsetIndex::KeyCompareFn compare_fn /* = RowOffsetIndex::compareKeys */) {
+  auto cursor = lowerBound(key, key_size, compare_fn);
+
+  if (!cursor->valid()) {
+    return nullptr;
+  }
+
+  void* row_key;
+  size_t row_key_size;
+  cursor->getKey(&row_key, &row_key_size);
+
+  if (compare_fn(row_key, row_key_size, key, key_size) != 0) {
+    return nullptr;
+  }
+
+  return cursor;
+}
+
+std::unique_ptr<SSTableReader::SSTableReaderCursor> SSTableReader::seekToKey(
+    const std::string& key) {
+  return seekToKey(key.data(), key.size());
+}
+
 size_t SSTableReader::bodySize() const {
   return header_.bodySize();
 }
@@ -136,9 +207,13 @@ size_t SSTableReader::SSTableReaderCursor::position() const {
 }
 
 bool SSTableReader::SSTableReaderCursor::next() {
+  if (!valid()) {
+    return false;
+  }
+
   auto header = mmap_->structAt<BinaryFormat::RowHeader>(pos_);
 
-  auto next_pos = pos_ += sizeof(BinaryFormat::RowHeader) +
+  auto next_pos = pos_ + sizeof(BinaryFormat::RowHeader) +
       header->key_size +
       header->data_size;
 
@@ -152,6 +227,10 @@ bool SSTableReader::SSTableReaderCursor::next() {
 }
 
 bool SSTableReader::SSTableReaderCursor::valid() {
+  if (pos_ + sizeof(BinaryFormat::RowHeader) > limit_) {
+    return false;
+  }
+
   auto header = mmap_->structAt<BinaryFormat::RowHeader>(pos_);
 
   auto row_limit = pos_ + sizeof(BinaryFormat::RowHeader) +
@@ -13,6 +13,7 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <mutex>
 #include <fnordmetric/io/file.h>
 #include <fnordmetric/io/mmappedfile.h>
 #include <fnordmetric/sstable/binaryformat.h>
@@ -20,6 +21,7 @@
 #include <fnordmetric/sstable/cursor.h>
 #include <fnordmetric/sstable/index.h>
 #include <fnordmetric/sstable/indexprovider.h>
+#include <fnordmetric/sstable/rowoffsetindex.h>
 #include <fnordmetric/util/buffer.h>
 #include <fnordmetric/util/runtimeexception.h>
 
@@ -58,6 +60,31 @@ public:
    */
   std::unique_ptr<SSTableReaderCursor> getCursor();
 
+  /**
+   * Get an sstable cursor positioned at the first row with a key >= the
+   * provided key. The returned cursor is invalid if there is no such row.
+   *
+   * Requires rows to be sorted by the provided key order. Uses the
+   * RowOffsetIndex footer if present and scans from the first row otherwise
+   */
+  std::unique_ptr<SSTableReaderCursor> lowerBound(
+      void const* key,
+      size_t key_size,
+      RowOffsetIndex::KeyCompareFn compare_fn = RowOffsetIndex::compareKeys);
+
+  std::unique_ptr<SSTableReaderCursor> lowerBound(const std::string& key);
+
+  /**
+   * Get an sstable cursor positioned at the first row with exactly the
+   * provided key. Returns nullptr if the key is not found
+   */
+  std::unique_ptr<SSTableReaderCursor> seekToKey(
+      void const* key,
+      size_t key_size,
+      RowOffsetIndex::KeyCompareFn compare_fn = RowOffsetIndex::compareKeys);
+
+  std::unique_ptr<SSTableReaderCursor> seekToKey(const std::string& key);
+
   void readHeader(const void** data, size_t* size);
   util::Buffer readHeader();
   void readFooter(uint32_t type, void** data, size_t* size);
@@ -70,6 +97,9 @@ private:
   std::shared_ptr<io::MmappedFile> mmap_;
   uint64_t file_size_;
   FileHeaderReader header_;
+  std::once_flag row_offset_index_once_;
+  void* row_offset_index_data_;
+  size_t row_offset_index_size_;
 };
 
 
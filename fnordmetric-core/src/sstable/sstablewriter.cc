@@ -11,13 +11,42 @@
 #include <fnordmetric/sstable/fileheaderwriter.h>
 #include <fnordmetric/sstable/fileheaderreader.h>
 #include <fnordmetric/sstable/sstablewriter.h>
+#include <fnordmetric/util/binarymessagewriter.h>
 #include <fnordmetric/util/fnv.h>
 #include <fnordmetric/util/runtimeexception.h>
+#include <fnordmetric/util/wallclock.h>
 #include <string.h>
 
 namespace fnord {
 namespace sstable {
 
+SSTableWriter::SyncPolicy::SyncPolicy(
+    kSyncMode mode_ /* = SYNC_EVERY_ROW */,
+    size_t max_bytes_ /* = 0 */,
+    uint64_t max_delay_micros_ /* = 0 */) :
+    mode(mode_),
+    max_bytes(max_bytes_),
+    max_delay_micros(max_delay_micros_) {}
+
+SSTableWriter::SyncPolicy SSTableWriter::SyncPolicy::everyRow() {
+  return SyncPolicy(SYNC_EVERY_ROW);
+}
+
+SSTableWriter::SyncPolicy SSTableWriter::SyncPolicy::none() {
+  return SyncPolicy(SYNC_NONE);
+}
+
+SSTableWriter::SyncPolicy SSTableWriter::SyncPolicy::periodic(
+    uint64_t interval_micros) {
+  return SyncPolicy(SYNC_GROUP, 0, interval_micros);
+}
+
+SSTableWriter::SyncPolicy SSTableWriter::SyncPolicy::groupCommit(
+    size_t max_bytes,
+    uint64_t max_delay_micros) {
+  return SyncPolicy(SYNC_GROUP, max_bytes, max_delay_micros);
+}
+
 std::unique_ptr<SSTableWriter> SSTableWriter::create(
     const std::string& filename,
     IndexProvider index_provider,
@@ -61,56 +90,141 @@ SSTableWriter::SSTableWriter(
     mmap_(new io::MmapPageManager(filename, file_size)),
     header_size_(0),
     body_size_(0),
-    finalized_(false) {}
+    finalized_(false),
+    synced_body_size_(0),
+    last_sync_micros_(util::WallClock::unixMicros()) {}
 
 SSTableWriter::~SSTableWriter() {
 }
 
-// FIXPAUL lock
 void SSTableWriter::appendRow(
     void const* key,
     size_t key_size,
     void const* data,
     size_t data_size) {
+  RowRef row;
+  row.key = key;
+  row.key_size = key_size;
+  row.data = data;
+  row.data_size = data_size;
+  appendRows(&row, 1);
+}
+
+void SSTableWriter::appendRow(
+    const std::string& key,
+    const std::string& value) {
+  appendRow(key.data(), key.size(), value.data(), value.size());
+}
+
+// FIXPAUL lock
+void SSTableWriter::appendRows(RowRef const* rows, size_t num_rows) {
   if (finalized_) {
     RAISE(kIllegalStateError, "table is immutable (alread finalized)");
   }
   // FIXPAUL assert that key is monotonically increasing...
 
-  size_t page_size = sizeof(BinaryFormat::RowHeader) + key_size + data_size;
-  auto alloc = mmap_->allocPage(page_size);
+  if (num_rows == 0) {
+    return;
+  }
+
+  size_t alloc_size = 0;
+  for (size_t i = 0; i < num_rows; ++i) {
+    alloc_size += sizeof(BinaryFormat::RowHeader) + rows[i].key_size +
+        rows[i].data_size;
+  }
+
+  auto alloc = mmap_->allocPage(alloc_size);
   auto page = mmap_->getPage(alloc);
 
-  auto header = page->structAt<BinaryFormat::RowHeader>(0);
-  header->key_size = key_size;
-  header->data_size = data_size;
+  size_t page_offset = 0;
+  for (size_t i = 0; i < num_rows; ++i) {
+    const auto& row = rows[i];
+    size_t row_size = sizeof(BinaryFormat::RowHeader) + row.key_size +
+        row.data_size;
+
+    auto header = page->structAt<BinaryFormat::RowHeader>(page_offset);
+    header->key_size = row.key_size;
+    header->data_size = row.data_size;
+
+    auto key_dst = page->structAt<void>(
+        page_offset + sizeof(BinaryFormat::RowHeader));
+    memcpy(key_dst, row.key, row.key_size);
+
+    auto data_dst = page->structAt<void>(
+        page_offset + sizeof(BinaryFormat::RowHeader) + row.key_size);
+    memcpy(data_dst, row.data, row.data_size);
+
+    util::FNV<uint32_t> fnv;
+    header->checksum = fnv.hash(
+        page->structAt<void>(page_offset + sizeof(uint32_t)),
+        row_size - sizeof(uint32_t));
+
+    auto row_body_offset = body_size_ + page_offset;
+    page_offset += row_size;
+
+    for (const auto& idx : indexes_) {
+      idx->addRow(
+          row_body_offset,
+          row.key,
+          row.key_size,
+          row.data,
+          row.data_size);
+    }
+  }
 
-  auto key_dst = page->structAt<void>(sizeof(BinaryFormat::RowHeader));
-  memcpy(key_dst, key, key_size);
+  body_size_ += alloc_size;
+  maybeSync();
+}
 
-  auto data_dst = page->structAt<void>(
-      sizeof(BinaryFormat::RowHeader) + key_size);
-  memcpy(data_dst, data, data_size);
+void SSTableWriter::setSyncPolicy(const SyncPolicy& policy) {
+  sync_policy_ = policy;
+}
 
-  util::FNV<uint32_t> fnv;
-  header->checksum = fnv.hash(
-      page->structAt<void>(sizeof(uint32_t)),
-      page_size - sizeof(uint32_t));
+void SSTableWriter::maybeSync() {
+  switch (sync_policy_.mode) {
 
-  page->sync();
+    case SyncPolicy::SYNC_EVERY_ROW:
+      sync();
+      return;
 
-  auto row_body_offset = body_size_;
-  body_size_ += page_size;
+    case SyncPolicy::SYNC_NONE:
+      return;
+
+    case SyncPolicy::SYNC_GROUP: {
+      auto unsynced_bytes = body_size_ - synced_body_size_;
+      if (sync_policy_.max_bytes > 0 &&
+          unsynced_bytes >= sync_policy_.max_bytes) {
+        sync();
+        return;
+      }
+
+      if (sync_policy_.max_delay_micros > 0) {
+        auto now = util::WallClock::unixMicros();
+        if (now >= last_sync_micros_ + sync_policy_.max_delay_micros) {
+          sync();
+        }
+      }
+
+      return;
+    }
 
-  for (const auto& idx : indexes_) {
-    idx->addRow(row_body_offset, key, key_size, data, data_size);
   }
 }
 
-void SSTableWriter::appendRow(
-    const std::string& key,
-    const std::string& value) {
-  appendRow(key.data(), key.size(), value.data(), value.size());
+// FIXPAUL lock
+void SSTableWriter::sync() {
+  last_sync_micros_ = util::WallClock::unixMicros();
+
+  if (synced_body_size_ == body_size_) {
+    return;
+  }
+
+  auto page = mmap_->getPage(io::PageManager::Page(
+      header_size_ + synced_body_size_,
+      body_size_ - synced_body_size_));
+
+  page->sync();
+  synced_body_size_ = body_size_;
 }
 
 // FIXPAUL lock
@@ -185,10 +299,37 @@ void SSTableWriter::reopen(size_t file_size) {
 
   header_size_ = header.headerSize();
   body_size_ = file_size - header_size_;
+  synced_body_size_ = body_size_;
+
+  /* rebuild the in-memory indexes from the rows written so far */
+  if (indexes_.size() > 0 && body_size_ > 0) {
+    auto cursor = getCursor();
+
+    do {
+      void* key;
+      size_t key_size;
+      void* data;
+      size_t data_size;
+      cursor->getKey(&key, &key_size);
+      cursor->getData(&data, &data_size);
+
+      for (const auto& idx : indexes_) {
+        idx->addRow(cursor->position(), key, key_size, data, data_size);
+      }
+    } while (cursor->next());
+  }
 }
 
 // FIXPAUL lock
 void SSTableWriter::finalize() {
+  sync();
+
+  for (const auto& idx : indexes_) {
+    util::BinaryMessageWriter index_data;
+    idx->serialize(&index_data);
+    writeIndex(idx->type(), index_data.data(), index_data.size());
+  }
+
   finalized_ = true;
 
   auto page = mmap_->getPage(
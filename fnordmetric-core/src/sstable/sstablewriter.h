@@ -53,6 +53,50 @@ public:
     size_t pos_;
   };
 
+  /**
+   * Controls when appended rows are msync()ed to disk. Rows are always written
+   * into the shared mapping immediately (i.e. they are visible to readers and
+   * survive a process crash); the policy only controls how often we explicitly
+   * ask the kernel to write them back.
+   *
+   *   SYNC_EVERY_ROW: sync after every appendRow()/appendRows() call
+   *   SYNC_NONE: never sync explicitly, leave writeback to the kernel
+   *   SYNC_GROUP: sync once at least max_bytes have been appended or
+   *     max_delay_micros have passed since the last sync, whichever comes
+   *     first (a zero value disables the respective trigger)
+   *
+   * The policy is checked after every append. The delay trigger only fires
+   * after the last append if maybeSync() is called periodically
+   */
+  struct SyncPolicy {
+    enum kSyncMode {
+      SYNC_EVERY_ROW,
+      SYNC_NONE,
+      SYNC_GROUP
+    };
+
+    SyncPolicy(
+        kSyncMode mode = SYNC_EVERY_ROW,
+        size_t max_bytes = 0,
+        uint64_t max_delay_micros = 0);
+
+    static SyncPolicy everyRow();
+    static SyncPolicy none();
+    static SyncPolicy periodic(uint64_t interval_micros);
+    static SyncPolicy groupCommit(size_t max_bytes, uint64_t max_delay_micros);
+
+    kSyncMode mode;
+    size_t max_bytes;
+    uint64_t max_delay_micros;
+  };
+
+  struct RowRef {
+    void const* key;
+    size_t key_size;
+    void const* data;
+    size_t data_size;
+  };
+
   /**
    * Create and open a new sstable for writing
    */
@@ -90,6 +134,28 @@ public:
       const std::string& key,
       const std::string& value);
 
+  /**
+   * Append a batch of rows to the sstable. All rows are written into a single
+   * mapped region and synced at most once according to the sync policy
+   */
+  void appendRows(RowRef const* rows, size_t num_rows);
+
+  /**
+   * Set the sync policy for subsequent appends
+   */
+  void setSyncPolicy(const SyncPolicy& policy);
+
+  /**
+   * Sync all rows that were appended since the last sync
+   */
+  void sync();
+
+  /**
+   * Sync the appended rows if the sync policy requires it, e.g. because
+   * max_delay_micros have passed since the last sync
+   */
+  void maybeSync();
+
   /**
    * Finalize the sstable (writes out the indexes to disk)
    */
@@ -125,6 +191,9 @@ private:
   size_t header_size_; // FIXPAUL make atomic
   size_t body_size_; // FIXPAUL make atomic
   bool finalized_;
+  SyncPolicy sync_policy_;
+  size_t synced_body_size_;
+  uint64_t last_sync_micros_;
 };
 
 
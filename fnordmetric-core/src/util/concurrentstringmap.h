@@ -0,0 +1,80 @@
+/**
+ * This file is part of the "FnordMetric" project
+ *   Copyright (c) 2014 Paul Asmuth, Google Inc.
+ *
+ * FnordMetric is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License v3.0. You should have received a
+ * copy of the GNU General Public License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#ifndef _FNORD_UTIL_CONCURRENTSTRINGMAP_H
+#define _FNORD_UTIL_CONCURRENTSTRINGMAP_H
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+namespace fnord {
+namespace util {
+
+/**
+ * An append only map from strings to values of type T that are owned by the
+ * caller. Each value is stored under its "key" member.
+ *
+ * Lookups (find, forEach) do not take a lock and never wait: the values are
+ * stored in an open addressing hash table that is copied into a larger table
+ * when it grows. Inserts must be serialized by the caller. Replaced tables are
+ * never freed before the map is destroyed, so a reader that still holds a
+ * replaced table sees a consistent (but possibly stale) snapshot of the map.
+ */
+template <typename T>
+class ConcurrentStringMap {
+public:
+  /**
+   * The initial size of the hash table must be a power of two
+   */
+  explicit ConcurrentStringMap(size_t initial_size = 256);
+  ConcurrentStringMap(const ConcurrentStringMap& copy) = delete;
+  ConcurrentStringMap& operator=(const ConcurrentStringMap& copy) = delete;
+
+  /**
+   * Returns the value with the key or nullptr if there is none
+   */
+  const T* find(const std::string& key) const;
+
+  /**
+   * Call fn for each value in the map. Values that are inserted during the
+   * iteration may or may not be visited
+   */
+  void forEach(std::function<void (const T* value)> fn) const;
+
+  /**
+   * Insert a value that must stay valid for the lifetime of the map. No value
+   * with the same key may exist yet. Must not be called concurrently
+   */
+  void insert(const T* value);
+
+protected:
+
+  struct Table {
+    Table(size_t size);
+    const size_t mask;
+    std::unique_ptr<std::atomic<const T*>[]> slots;
+  };
+
+  void insertIntoTable(Table* table, const T* value);
+
+  std::atomic<Table*> table_;
+
+  /* only accessed by insert() */
+  std::vector<const T*> values_;
+  std::vector<std::unique_ptr<Table>> tables_;
+};
+
+}
+}
+
+#include "concurrentstringmap_impl.h"
+#endif
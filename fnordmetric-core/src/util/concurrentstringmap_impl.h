@@ -0,0 +1,92 @@
+/**
+ * This file is part of the "FnordMetric" project
+ *   Copyright (c) 2014 Paul Asmuth, Google Inc.
+ *
+ * FnordMetric is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License v3.0. You should have received a
+ * copy of the GNU General Public License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+namespace fnord {
+namespace util {
+
+template <typename T>
+ConcurrentStringMap<T>::Table::Table(
+    size_t size) :
+    mask(size - 1),
+    slots(new std::atomic<const T*>[size]) {
+  for (size_t i = 0; i < size; ++i) {
+    slots[i].store(nullptr, std::memory_order_relaxed);
+  }
+}
+
+template <typename T>
+ConcurrentStringMap<T>::ConcurrentStringMap(
+    size_t initial_size /* = 256 */) {
+  tables_.emplace_back(new Table(initial_size));
+  table_.store(tables_.back().get(), std::memory_order_release);
+}
+
+template <typename T>
+const T* ConcurrentStringMap<T>::find(const std::string& key) const {
+  auto table = table_.load(std::memory_order_acquire);
+
+  /* the table is never more than half full so the probe always terminates */
+  for (auto pos = std::hash<std::string>()(key); ; ++pos) {
+    auto value = table->slots[pos & table->mask].load(
+        std::memory_order_acquire);
+
+    if (value == nullptr || value->key == key) {
+      return value;
+    }
+  }
+}
+
+template <typename T>
+void ConcurrentStringMap<T>::forEach(
+    std::function<void (const T* value)> fn) const {
+  auto table = table_.load(std::memory_order_acquire);
+
+  for (size_t i = 0; i <= table->mask; ++i) {
+    auto value = table->slots[i].load(std::memory_order_acquire);
+    if (value != nullptr) {
+      fn(value);
+    }
+  }
+}
+
+template <typename T>
+void ConcurrentStringMap<T>::insert(const T* value) {
+  values_.emplace_back(value);
+
+  /* grow the table before it gets more than half full. readers that still
+     hold the old table keep working on it since it is never freed */
+  auto table = table_.load(std::memory_order_relaxed);
+  if (values_.size() * 2 > table->mask + 1) {
+    auto new_table = new Table((table->mask + 1) * 2);
+    tables_.emplace_back(new_table);
+
+    for (const auto v : values_) {
+      insertIntoTable(new_table, v);
+    }
+
+    table_.store(new_table, std::memory_order_release);
+  } else {
+    insertIntoTable(table, value);
+  }
+}
+
+template <typename T>
+void ConcurrentStringMap<T>::insertIntoTable(Table* table, const T* value) {
+  for (auto pos = std::hash<std::string>()(value->key); ; ++pos) {
+    auto& slot = table->slots[pos & table->mask];
+
+    if (slot.load(std::memory_order_relaxed) == nullptr) {
+      slot.store(value, std::memory_order_release);
+      return;
+    }
+  }
+}
+
+}
+}